@@ -12,12 +12,27 @@ Application::Application(const CreateInfo& info)
     : m_context(info.bin)
 {
     m_interactive = info.interactive;
+    if (m_interactive && info.headless) [[unlikely]]
+    {
+        LUISA_ERROR("Interactive rendering needs a window and cannot run headless.");
+    }
 
     m_device = m_context.create_device(info.backend);
-    m_stream = m_device.create_stream(StreamTag::GRAPHICS);
+    // nothing is presented without a window, so a compute stream is enough
+    m_stream = m_device.create_stream(info.headless ? StreamTag::COMPUTE : StreamTag::GRAPHICS);
+
+    auto scene_info = info.scene_info;
+    if (info.headless)
+    {
+        scene_info.camera_info.film_info.headless = true;
+        for (auto& camera_info : scene_info.batch_camera_infos)
+        {
+            camera_info.film_info.headless = true;
+        }
+    }
 
-    m_scene    = Scene::create(m_context, info.scene_info);
-    m_renderer = Renderer::create(m_device, m_stream, *m_scene);
+    m_scene    = Scene::create(m_context, scene_info);
+    m_renderer = Renderer::create(m_device, m_stream, *m_scene, m_interactive);
 }
 
 Application::~Application() noexcept = default;
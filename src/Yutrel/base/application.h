@@ -24,6 +24,8 @@ public:
         luisa::string_view backend;
         Scene::CreateInfo scene_info;
         bool interactive{false};
+        // renders without any window and exits, for display-less render nodes
+        bool headless{false};
     };
 
 private:
@@ -0,0 +1,142 @@
+#include "brick_map.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <luisa/luisa-compute.h>
+
+#include "base/renderer.h"
+
+namespace Yutrel
+{
+BrickMap::BrickMap(luisa::span<const float> voxels, uint3 resolution) noexcept
+    : m_resolution(resolution),
+      m_grid((resolution + brick_size - 1u) / brick_size)
+{
+    LUISA_ASSERT(voxels.size() == static_cast<size_t>(resolution.x) * resolution.y * resolution.z,
+                 "Grid of {} voxels does not match the resolution {}x{}x{}.",
+                 voxels.size(), resolution.x, resolution.y, resolution.z);
+    auto voxel = [&](int x, int y, int z) noexcept
+    {
+        if (x < 0 || y < 0 || z < 0 ||
+            x >= static_cast<int>(resolution.x) || y >= static_cast<int>(resolution.y) || z >= static_cast<int>(resolution.z))
+        {
+            return 0.0f;
+        }
+        return voxels[(static_cast<size_t>(z) * resolution.y + y) * resolution.x + x];
+    };
+
+    // gather the padded bricks, a brick is kept when any voxel its lookups can reach is non-zero
+    constexpr auto padded_voxels = padded_brick_size * padded_brick_size * padded_brick_size;
+    luisa::vector<float> bricks;
+    m_indirection.resize(static_cast<size_t>(m_grid.x) * m_grid.y * m_grid.z, 0.0f);
+    luisa::vector<float> brick(padded_voxels);
+    for (auto bz = 0u; bz < m_grid.z; bz++)
+    {
+        for (auto by = 0u; by < m_grid.y; by++)
+        {
+            for (auto bx = 0u; bx < m_grid.x; bx++)
+            {
+                auto occupied = false;
+                for (auto k = 0u; k < padded_brick_size; k++)
+                {
+                    for (auto j = 0u; j < padded_brick_size; j++)
+                    {
+                        for (auto i = 0u; i < padded_brick_size; i++)
+                        {
+                            auto v = voxel(static_cast<int>(bx * brick_size + i) - 1,
+                                           static_cast<int>(by * brick_size + j) - 1,
+                                           static_cast<int>(bz * brick_size + k) - 1);
+                            brick[(k * padded_brick_size + j) * padded_brick_size + i] = v;
+                            occupied |= v != 0.0f;
+                        }
+                    }
+                }
+                if (occupied)
+                {
+                    m_brick_count++;
+                    m_indirection[(static_cast<size_t>(bz) * m_grid.y + by) * m_grid.x + bx] = static_cast<float>(m_brick_count);
+                    bricks.insert(bricks.end(), brick.cbegin(), brick.cend());
+                }
+            }
+        }
+    }
+    LUISA_ASSERT(m_brick_count < (1u << 24u), "Too many bricks ({}) to index exactly through a float texture.", m_brick_count);
+
+    // bricks are laid out in a roughly cubic atlas, which keeps every axis within the texture size limits
+    auto n         = std::max(m_brick_count, 1u);
+    auto side      = static_cast<uint>(std::ceil(std::cbrt(static_cast<double>(n))));
+    m_atlas_bricks = make_uint3(side, side, (n + side * side - 1u) / (side * side));
+    auto texels    = m_atlas_bricks * padded_brick_size;
+    m_atlas.resize(static_cast<size_t>(texels.x) * texels.y * texels.z, 0.0f);
+    for (auto s = 0u; s < m_brick_count; s++)
+    {
+        auto origin = make_uint3(s % side, (s / side) % side, s / (side * side)) * padded_brick_size;
+        for (auto k = 0u; k < padded_brick_size; k++)
+        {
+            for (auto j = 0u; j < padded_brick_size; j++)
+            {
+                auto src = bricks.data() + static_cast<size_t>(s) * padded_voxels + (k * padded_brick_size + j) * padded_brick_size;
+                auto dst = m_atlas.data() + (static_cast<size_t>(origin.z + k) * texels.y + origin.y + j) * texels.x + origin.x;
+                std::copy_n(src, padded_brick_size, dst);
+            }
+        }
+    }
+
+    LUISA_INFO("Brick map: {} of {} bricks occupied, {:.2f} MB against {:.2f} MB dense ({:.1f}%).",
+               m_brick_count,
+               m_indirection.size(),
+               static_cast<double>(size_bytes()) / (1024.0 * 1024.0),
+               static_cast<double>(dense_size_bytes()) / (1024.0 * 1024.0),
+               100.0 * static_cast<double>(size_bytes()) / static_cast<double>(std::max<size_t>(dense_size_bytes(), 1u)));
+}
+
+size_t BrickMap::size_bytes() const noexcept
+{
+    return (m_indirection.size() + m_atlas.size()) * sizeof(float);
+}
+
+size_t BrickMap::dense_size_bytes() const noexcept
+{
+    return static_cast<size_t>(m_resolution.x) * m_resolution.y * m_resolution.z * sizeof(float);
+}
+
+luisa::unique_ptr<BrickMap::Instance> BrickMap::build(Renderer& renderer, CommandBuffer& command_buffer) const noexcept
+{
+    auto indirection = renderer.create<Volume<float>>(PixelStorage::FLOAT1, m_grid);
+    auto atlas       = renderer.create<Volume<float>>(PixelStorage::FLOAT1, m_atlas_bricks * padded_brick_size);
+    command_buffer
+        << indirection->copy_from(m_indirection.data())
+        << atlas->copy_from(m_atlas.data());
+    auto indirection_id = renderer.register_bindless(*indirection, TextureSampler::point_point_zero());
+    auto atlas_id       = renderer.register_bindless(*atlas, TextureSampler::linear_point_zero());
+    return luisa::make_unique<Instance>(renderer, this, indirection_id, atlas_id);
+}
+
+Float BrickMap::Instance::sample(Expr<float3> uvw) const noexcept
+{
+    auto resolution = m_brick_map->resolution();
+    auto grid       = m_brick_map->grid();
+    auto side       = m_brick_map->atlas_bricks().x;
+    auto texels     = make_float3(m_brick_map->atlas_bricks() * padded_brick_size);
+
+    auto value = def(0.0f);
+    $if(all(uvw >= 0.0f & uvw <= 1.0f))
+    {
+        // continuous voxel coordinates, voxel i is centred at i + 0.5
+        auto c     = uvw * make_float3(resolution);
+        auto brick = min(make_uint3(c * (1.0f / static_cast<float>(brick_size))), grid - 1u);
+        auto slot  = m_renderer.tex3d(m_indirection_id).read(brick).x;
+        $if(slot > 0.0f)
+        {
+            auto s      = cast<uint>(slot) - 1u;
+            auto origin = make_uint3(s % side, (s / side) % side, s / (side * side)) * padded_brick_size;
+            // past the apron the brick lines up with the grid
+            auto local = c - make_float3(brick * brick_size);
+            value      = m_renderer.tex3d(m_atlas_id).sample((make_float3(origin) + 1.0f + local) / texels).x;
+        };
+    };
+    return value;
+}
+
+} // namespace Yutrel
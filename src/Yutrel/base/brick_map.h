@@ -0,0 +1,72 @@
+#pragma once
+
+#include <luisa/dsl/syntax.h>
+
+#include "utils/command_buffer.h"
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+class Renderer;
+
+// a sparse scalar volume: the grid is cut into bricks of 8^3 voxels, bricks that hold anything are packed
+// into an atlas texture and an indirection texture maps every brick of the grid to its slot in the atlas.
+// Each brick is stored with a one voxel apron copied from its neighbours, so that hardware trilinear
+// filtering of a lookup inside the brick never reads past it
+class BrickMap
+{
+public:
+    static constexpr auto brick_size        = 8u;
+    static constexpr auto padded_brick_size = brick_size + 2u;
+
+public:
+    class Instance;
+
+private:
+    uint3 m_resolution;
+    uint3 m_grid;
+    uint3 m_atlas_bricks;
+    uint m_brick_count{0u};
+    // atlas slot + 1 of each brick of the grid, 0 for bricks without density
+    luisa::vector<float> m_indirection;
+    luisa::vector<float> m_atlas;
+
+public:
+    // converts a dense grid, x fastest
+    BrickMap(luisa::span<const float> voxels, uint3 resolution) noexcept;
+    ~BrickMap() noexcept = default;
+
+    BrickMap(const BrickMap&)            = delete;
+    BrickMap& operator=(const BrickMap&) = delete;
+
+public:
+    [[nodiscard]] auto resolution() const noexcept { return m_resolution; }
+    [[nodiscard]] auto grid() const noexcept { return m_grid; }
+    [[nodiscard]] auto atlas_bricks() const noexcept { return m_atlas_bricks; }
+    [[nodiscard]] auto brick_count() const noexcept { return m_brick_count; }
+    [[nodiscard]] bool empty() const noexcept { return m_brick_count == 0u; }
+    [[nodiscard]] size_t size_bytes() const noexcept;
+    [[nodiscard]] size_t dense_size_bytes() const noexcept;
+    [[nodiscard]] luisa::unique_ptr<Instance> build(Renderer& renderer, CommandBuffer& command_buffer) const noexcept;
+};
+
+class BrickMap::Instance
+{
+private:
+    const Renderer& m_renderer;
+    const BrickMap* m_brick_map;
+    uint m_indirection_id;
+    uint m_atlas_id;
+
+public:
+    Instance(const Renderer& renderer, const BrickMap* brick_map, uint indirection_id, uint atlas_id) noexcept
+        : m_renderer{renderer}, m_brick_map{brick_map}, m_indirection_id{indirection_id}, m_atlas_id{atlas_id} {}
+
+    [[nodiscard]] auto base() const noexcept { return m_brick_map; }
+    // trilinearly filtered value at uvw in [0, 1]^3 over the whole grid, zero outside
+    [[nodiscard]] Float sample(Expr<float3> uvw) const noexcept;
+};
+
+} // namespace Yutrel
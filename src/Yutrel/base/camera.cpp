@@ -159,6 +159,17 @@ void Camera::Instance::set_transform(CommandBuffer& command_buffer, const float4
         << commit();
 }
 
+void Camera::Instance::set_camera(CommandBuffer& command_buffer, const Camera* camera) noexcept
+{
+    if (camera == m_camera)
+    {
+        return;
+    }
+    m_camera = camera;
+    set_transform(command_buffer, camera->init_transform());
+    upload_device_data(command_buffer);
+}
+
 Camera::Sample Camera::Instance::generate_ray(Expr<uint2> pixel_coord, Expr<float> time, Expr<float2> u_filter, Expr<float2> u_lens) const noexcept
 {
     auto [filter_offset, filter_weight] = m_filter->sample(u_filter);
@@ -179,4 +190,30 @@ Camera::Sample Camera::Instance::generate_ray(Expr<uint2> pixel_coord, Expr<floa
     return {std::move(ray), pixel, filter_weight};
 }
 
+Camera::Projection Camera::Instance::project(Expr<float3> p, Expr<float2> u_lens) const noexcept
+{
+    auto c2w  = m_device_transform->read(0u);
+    auto w2c  = inverse(c2w);
+    auto p_cs = make_float3(w2c * make_float4(p, 1.0f));
+
+    auto projection = project_in_camera_space(p_cs, u_lens);
+    auto resolution = make_float2(m_film->base()->resolution());
+    auto d_cs       = normalize(p_cs - projection.p_lens);
+    auto cos_theta  = -d_cs.z;
+    auto inside     = all(projection.pixel >= 0.0f & projection.pixel < resolution);
+
+    projection.p_lens = make_float3(c2w * make_float4(projection.p_lens, 1.0f));
+    projection.valid  = projection.valid & cos_theta > 1e-6f & inside;
+    projection.pdf    = ite(projection.valid, 1.0f / (image_area() * cos_theta * cos_theta * cos_theta), 0.0f);
+    return projection;
+}
+
+Float Camera::Instance::pdf_direction(Expr<float3> direction) const noexcept
+{
+    auto c2w       = m_device_transform->read(0u);
+    auto forward   = -normalize(make_float3x3(c2w) * make_float3(0.0f, 0.0f, 1.0f));
+    auto cos_theta = dot(direction, forward);
+    return ite(cos_theta > 1e-6f, 1.0f / (image_area() * cos_theta * cos_theta * cos_theta), 0.0f);
+}
+
 } // namespace Yutrel
\ No newline at end of file
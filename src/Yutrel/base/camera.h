@@ -61,6 +61,16 @@ public:
         Float weight;
     };
 
+    // where light arriving at a scene point through the lens lands on the film, for connecting light paths
+    struct Projection
+    {
+        Float3 p_lens;
+        Float2 pixel;
+        // solid angle density generate_ray() picks the direction from the lens towards the point with
+        Float pdf;
+        Bool valid;
+    };
+
     struct ShutterSample
     {
         float time;
@@ -102,10 +112,22 @@ public:
         [[nodiscard]] auto transform() const noexcept { return m_host_transform; }
 
         void set_transform(CommandBuffer& command_buffer, const float4x4& c2w) noexcept;
+        // switches to another camera of the same model and film layout, so batch jobs reuse the compiled shaders
+        void set_camera(CommandBuffer& command_buffer, const Camera* camera) noexcept;
         [[nodiscard]] Sample generate_ray(Expr<uint2> pixel_coord, Expr<float> time, Expr<float2> u_filter, Expr<float2> u_lens) const noexcept;
+        // connects a world-space point to the lens for light tracing, the pixel is not filtered
+        [[nodiscard]] Projection project(Expr<float3> p, Expr<float2> u_lens) const noexcept;
+        // solid angle density generate_ray() picks a world-space direction with, 1 / (A cos³θ) for an image of area A
+        // on the plane at unit distance in front of the lens, it is also the importance a light path carries
+        [[nodiscard]] Float pdf_direction(Expr<float3> direction) const noexcept;
 
     private:
         [[nodiscard]] virtual Var<Ray> generate_ray_in_camera_space(Expr<float2> pixel, Expr<float> time, Expr<float2> u_lens) const noexcept = 0;
+        // fills the camera-space lens point and the continuous pixel coordinate of light from a camera-space point
+        [[nodiscard]] virtual Projection project_in_camera_space(Expr<float3> p, Expr<float2> u_lens) const noexcept = 0;
+        // area of the image on the plane at unit distance in front of the lens
+        [[nodiscard]] virtual Float image_area() const noexcept = 0;
+        virtual void upload_device_data(CommandBuffer& command_buffer) noexcept = 0;
     };
 
 private:
@@ -135,6 +157,7 @@ public:
     [[nodiscard]] auto spp() const noexcept { return m_spp; }
     [[nodiscard]] auto init_transform() const noexcept { return m_init_transform; }
     [[nodiscard]] auto up() const noexcept { return m_up; }
+    [[nodiscard]] auto shutter_span() const noexcept { return m_shutter_span; }
     [[nodiscard]] luisa::vector<ShutterSample> shutter_samples() const noexcept;
     [[nodiscard]] virtual bool requires_lens_sampling() const noexcept { return false; }
 };
@@ -3,6 +3,8 @@
 #include <luisa/luisa-compute.h>
 
 #include "base/renderer.h"
+#include "utils/color_space.h"
+#include "utils/shader_cache.h"
 
 namespace Yutrel
 {
@@ -12,21 +14,56 @@ luisa::unique_ptr<Film> Film::create(const CreateInfo& info) noexcept
 }
 
 Film::Film(const CreateInfo& info) noexcept
-    : m_resolution(info.resolution), m_hdr(info.hdr) {}
+    : m_resolution(info.resolution),
+      m_hdr(info.hdr),
+      m_headless(info.headless),
+      m_tile_size(info.tile_size),
+      m_denoise(info.denoise),
+      m_aovs(info.aovs),
+      m_output(info.output)
+{
+    // the filter footprint would cross into tiles that are no longer on the device
+    if (m_denoise && m_tile_size != 0u)
+    {
+        LUISA_WARNING("The denoiser is not available with a tiled film, writing the noisy image.");
+        m_denoise = false;
+    }
+    // tiles are streamed to disk as plain colour rows
+    if (m_aovs && m_tile_size != 0u)
+    {
+        LUISA_WARNING("AOVs are not available with a tiled film, writing the colour only.");
+        m_aovs = false;
+    }
+}
 
 Film::~Film() noexcept = default;
 
-void Film::Instance::accumulate(Expr<uint2> pixel, Expr<float3> rgb, Expr<float> effective_spp) const noexcept
+Bool Film::Instance::is_valid(Expr<float3> rgb) noexcept
 {
-    LUISA_ASSERT(m_image && m_converted, "Film is not prepared.");
+    return !any(compute::isnan(rgb) || compute::isinf(rgb));
+}
 
-    auto pixel_id = pixel.y * base()->resolution().x + pixel.x;
-    $if(!any(compute::isnan(rgb) || compute::isinf(rgb)))
+Float3 Film::Instance::sanitize(Expr<float3> rgb, Expr<float> effective_spp) const noexcept
+{
+    auto c = def(make_float3(0.0f));
+    $if(is_valid(rgb))
     {
         auto threshold = 256.0f * max(effective_spp, 1.f);
         auto abs_rgb   = abs(rgb);
         auto strength  = max(max(max(abs_rgb.x, abs_rgb.y), abs_rgb.z), 0.f);
-        auto c         = rgb * (threshold / max(strength, threshold));
+        c              = rgb * (threshold / max(strength, threshold));
+    };
+    return c;
+}
+
+void Film::Instance::accumulate(Expr<uint2> pixel, Expr<float3> rgb, Expr<float> effective_spp) const noexcept
+{
+    LUISA_ASSERT(m_image && m_converted, "Film is not prepared.");
+
+    auto pixel_id = pixel_index(pixel);
+    $if(is_valid(rgb))
+    {
+        auto c = sanitize(rgb, effective_spp);
 
         $if(any(c != 0.f))
         {
@@ -41,41 +78,393 @@ void Film::Instance::accumulate(Expr<uint2> pixel, Expr<float3> rgb, Expr<float>
     };
 }
 
-void Film::Instance::prepare(CommandBuffer& command_buffer) noexcept
+void Film::Instance::accumulate(Expr<uint2> pixel, Expr<float3> rgb_sum, Expr<float> spp, Expr<float2> moments) const noexcept
 {
-    m_rendering_finished = false;
+    LUISA_ASSERT(m_moments, "Film moments are not prepared.");
+
+    // splats never touch the sample count, so it can be read without atomics
+    auto pixel_id = pixel_index(pixel);
+    auto n_a      = m_image->read(pixel_id).w;
+    auto old_m    = m_moments->read(pixel_id);
+
+    auto n     = n_a + spp;
+    auto delta = moments.x - old_m.x;
+    auto mean  = old_m.x + delta * spp / max(n, 1.0f);
+    auto m2    = old_m.y + moments.y + delta * delta * n_a * spp / max(n, 1.0f);
+
+    m_image->atomic(pixel_id).x.fetch_add(rgb_sum.x);
+    m_image->atomic(pixel_id).y.fetch_add(rgb_sum.y);
+    m_image->atomic(pixel_id).z.fetch_add(rgb_sum.z);
+    m_image->atomic(pixel_id).w.fetch_add(spp);
+    m_moments->write(pixel_id, make_float2(mean, m2));
+}
 
-    auto&& device = m_renderer.device();
+void Film::Instance::accumulate_exclusive(Expr<uint2> pixel, Expr<float3> rgb_sum, Expr<float> spp) const noexcept
+{
+    LUISA_ASSERT(m_image && m_converted, "Film is not prepared.");
 
-    // render image
-    uint2 render_resolution = base()->resolution();
-    auto pixel_count        = render_resolution.x * render_resolution.y;
+    auto pixel_id = pixel_index(pixel);
+    auto old      = m_image->read(pixel_id);
+    m_image->write(pixel_id, old + make_float4(rgb_sum, spp));
+}
+
+void Film::Instance::accumulate_exclusive(Expr<uint2> pixel, Expr<float3> rgb_sum, Expr<float> spp, Expr<float2> moments) const noexcept
+{
+    LUISA_ASSERT(m_moments, "Film moments are not prepared.");
+
+    auto pixel_id = pixel_index(pixel);
+    auto old      = m_image->read(pixel_id);
+    auto old_m    = m_moments->read(pixel_id);
+
+    // Chan et al. parallel combination of two Welford states
+    auto n_a   = old.w;
+    auto n     = n_a + spp;
+    auto delta = moments.x - old_m.x;
+    auto mean  = old_m.x + delta * spp / max(n, 1.0f);
+    auto m2    = old_m.y + moments.y + delta * delta * n_a * spp / max(n, 1.0f);
+
+    m_image->write(pixel_id, old + make_float4(rgb_sum, spp));
+    m_moments->write(pixel_id, make_float2(mean, m2));
+}
+
+void Film::Instance::accumulate_features(Expr<uint2> pixel, Expr<float3> albedo, Expr<float3> normal, Expr<float> distance,
+                                         Expr<uint> instance_id, Expr<uint> primitive_id) const noexcept
+{
+    LUISA_ASSERT(m_features, "Film features are not prepared.");
+
+    // misses add a zero normal and leave the direction of the sum unchanged
+    auto pixel_id = pixel_index(pixel);
+    m_features->write(pixel_id, m_features->read(pixel_id) + make_float4(albedo, distance));
+    m_feature_normals->write(pixel_id, m_feature_normals->read(pixel_id) + make_float4(normal, 1.0f));
+    $if(instance_id != ~0u & m_ids->read(pixel_id).x == ~0u)
+    {
+        m_ids->write(pixel_id, make_uint2(instance_id, primitive_id));
+    };
+}
+
+UInt2 Film::Instance::active_pixel(Expr<uint> index) const noexcept
+{
+    LUISA_ASSERT(m_active_pixels, "Film moments are not prepared.");
+    return pixel_coordinate(m_active_pixels->read(index));
+}
+
+UInt2 Film::Instance::pixel_coordinate(Expr<uint> index) const noexcept
+{
+    if (!base()->tiled())
+    {
+        auto width = base()->resolution().x;
+        return make_uint2(index % width, index / width);
+    }
+    auto tile = m_tile->read(0u);
+    return tile.xy() + make_uint2(index % tile.z, index / tile.z);
+}
+
+UInt Film::Instance::pixel_index(Expr<uint2> pixel) const noexcept
+{
+    if (!base()->tiled())
+    {
+        return pixel.y * base()->resolution().x + pixel.x;
+    }
+    auto tile = m_tile->read(0u);
+    auto p    = pixel - tile.xy();
+    return p.y * tile.z + p.x;
+}
+
+uint Film::Instance::max_pixel_count() const noexcept
+{
+    auto resolution = base()->resolution();
+    if (!base()->tiled())
+    {
+        return resolution.x * resolution.y;
+    }
+    auto tile = min(make_uint2(base()->tile_size()), resolution);
+    return tile.x * tile.y;
+}
+
+void Film::Instance::allocate(bool moments) noexcept
+{
+    auto&& device = m_renderer.device();
+    auto capacity = max_pixel_count();
 
     if (!m_image)
     {
-        m_image = renderer().device().create_buffer<float4>(pixel_count);
+        m_image     = device.create_buffer<float4>(capacity);
+        m_converted = device.create_buffer<float4>(capacity);
+    }
+    if (base()->features() && !m_features)
+    {
+        m_features        = device.create_buffer<float4>(capacity);
+        m_feature_normals = device.create_buffer<float4>(capacity);
+        m_ids             = device.create_buffer<uint2>(capacity);
+    }
+    if (base()->denoise() && !m_denoise[0])
+    {
+        m_denoise[0] = device.create_buffer<float4>(capacity);
+        m_denoise[1] = device.create_buffer<float4>(capacity);
+    }
+    if (base()->tiled() && !m_tile)
+    {
+        m_tile = device.create_buffer<uint4>(1u);
+        LUISA_INFO("Tiled film: {}x{} tiles, {:.2f} MB of device memory for the film.",
+                   base()->tile_size(),
+                   base()->tile_size(),
+                   static_cast<double>(m_image.size_bytes() + m_converted.size_bytes()) / (1024.0 * 1024.0));
+    }
+    if (moments && !m_moments)
+    {
+        m_moments       = device.create_buffer<float2>(capacity);
+        m_active_pixels = device.create_buffer<uint>(capacity);
+        m_active_count  = device.create_buffer<uint>(1u);
+        m_error_sum     = device.create_buffer<float>(1u);
+    }
+}
+
+void Film::Instance::compile() noexcept
+{
+    LUISA_ASSERT(m_image, "Film is not allocated.");
+
+    auto shader_cache = m_renderer.shader_cache();
 
-        Kernel1D clear_image_kernel = [](BufferFloat4 image) noexcept
+    if (!m_clear_image)
+    {
+        m_clear_image = shader_cache->load_or_compile<1u, Buffer<float4>>("film_clear_image", 0u, [](BufferFloat4 image) noexcept
         {
             image.write(dispatch_x(), make_float4(0.f));
-        };
-        m_clear_image = m_renderer.device().compile(clear_image_kernel);
+        });
     }
-    if (!m_converted)
+    if (!m_convert_image)
     {
-        m_converted = renderer().device().create_buffer<float4>(pixel_count);
-
-        Kernel1D convert_image_kernel = [this](BufferFloat4 accum, BufferFloat4 output) noexcept
+        m_convert_image = shader_cache->load_or_compile<1u, Buffer<float4>, Buffer<float4>>("film_convert_image", 0u, [](BufferFloat4 accum, BufferFloat4 output) noexcept
         {
             auto i     = dispatch_x();
             auto c     = accum.read(i);
             auto n     = max(c.w, 1.f);
             auto scale = (1.f / n);
             output.write(i, make_float4(scale * c.xyz(), 1.f));
+        });
+    }
+    if (m_features && !m_clear_features)
+    {
+        m_clear_features = shader_cache->load_or_compile<1u, Buffer<float4>, Buffer<float4>, Buffer<uint2>>("film_clear_features", 0u, [](BufferFloat4 features, BufferFloat4 normals, BufferUInt2 ids) noexcept
+        {
+            features.write(dispatch_x(), make_float4(0.0f));
+            normals.write(dispatch_x(), make_float4(0.0f));
+            ids.write(dispatch_x(), make_uint2(~0u));
+        });
+
+        Kernel1D extract_aov_kernel = [this](UInt aov) noexcept
+        {
+            auto i = dispatch_x();
+            auto f = features(i);
+            auto c = def(make_float4(0.0f, 0.0f, 0.0f, 1.0f));
+            $if(aov == static_cast<uint>(Aov::albedo))
+            {
+                c = make_float4(f.albedo, 1.0f);
+            }
+            $elif(aov == static_cast<uint>(Aov::normal))
+            {
+                c = make_float4(f.normal, 1.0f);
+            }
+            $elif(aov == static_cast<uint>(Aov::depth))
+            {
+                c = make_float4(make_float3(f.distance), 1.0f);
+            }
+            $elif(aov == static_cast<uint>(Aov::id))
+            {
+                auto id = m_ids->read(i);
+                c       = make_float4(as<float>(id.x), as<float>(id.y), 0.0f, 1.0f);
+            }
+            $else
+            {
+                c = make_float4(make_float3(m_image->read(i).w), 1.0f);
+            };
+            m_converted->write(i, c);
+        };
+        m_extract_aov = shader_cache->compile(extract_aov_kernel, "film_extract_aov", signature());
+    }
+    if (m_denoise[0] && !m_denoise_filter)
+    {
+        m_denoise_demodulate = compile_demodulate(false);
+
+        Kernel1D filter_kernel = [this](BufferFloat4 input, BufferFloat4 output, UInt step, Float sigma_color) noexcept
+        {
+            // 5x5 B3 spline taps with edge-stopping weights (Dammertz et al. 2010), the variance is carried
+            // along and tightens the colour weight as in SVGF (Schied et al. 2017) when the film tracks moments
+            constexpr std::array h{1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+            constexpr auto sigma_luminance = 4.0f;
+            constexpr auto sigma_normal    = 128.0f;
+            constexpr auto sigma_depth     = 0.02f;
+            constexpr auto sigma_albedo    = 0.1f;
+
+            auto resolution = make_int2(base()->resolution());
+            auto i          = dispatch_x();
+            auto p          = make_int2(cast<int>(i % base()->resolution().x), cast<int>(i / base()->resolution().x));
+            auto c_p        = input.read(i);
+            auto f_p        = features(i);
+            auto l_p        = linear_srgb_to_cie_y(c_p.xyz());
+            auto scale      = ite(c_p.w > 0.0f, sigma_luminance * sqrt(c_p.w), sigma_color * max(l_p, 1e-3f)) + 1e-4f;
+
+            auto sum          = def(make_float3(0.0f));
+            auto variance_sum = def(0.0f);
+            auto weight_sum   = def(0.0f);
+            for (auto dy = -2; dy <= 2; dy++)
+            {
+                for (auto dx = -2; dx <= 2; dx++)
+                {
+                    auto q = p + make_int2(dx, dy) * cast<int>(step);
+                    $if(all(q >= 0 && q < resolution))
+                    {
+                        auto j   = cast<uint>(q.y) * base()->resolution().x + cast<uint>(q.x);
+                        auto c_q = input.read(j);
+                        auto f_q = features(j);
+
+                        auto w_color  = exp(-abs(linear_srgb_to_cie_y(c_q.xyz()) - l_p) / scale);
+                        auto w_normal = pow(max(dot(f_p.normal, f_q.normal), 0.0f), sigma_normal);
+                        auto offset   = std::sqrt(static_cast<float>(dx * dx + dy * dy)) * cast<float>(step);
+                        auto w_depth  = exp(-abs(f_p.distance - f_q.distance) / (sigma_depth * f_p.distance * offset + 1e-4f));
+                        auto a        = f_p.albedo - f_q.albedo;
+                        auto w_albedo = exp(-dot(a, a) / (sigma_albedo * sigma_albedo));
+                        // pixels without a surface only mix with each other
+                        auto has_p      = f_p.distance > 0.0f;
+                        auto has_q      = f_q.distance > 0.0f;
+                        auto w_geometry = ite(has_p != has_q, 0.0f, ite(has_p, w_normal * w_depth * w_albedo, 1.0f));
+
+                        auto w = h[dx + 2] * h[dy + 2] * w_color * w_geometry;
+                        sum += w * c_q.xyz();
+                        variance_sum += w * w * c_q.w;
+                        weight_sum += w;
+                    };
+                }
+            }
+            // a hit whose averaged normal cancelled out rejects even its own tap, it is passed through unfiltered
+            $if(weight_sum > 1e-8f)
+            {
+                output.write(i, make_float4(sum / weight_sum, variance_sum / (weight_sum * weight_sum)));
+            }
+            $else
+            {
+                output.write(i, c_p);
+            };
+        };
+        m_denoise_filter = shader_cache->compile(filter_kernel, "film_denoise_filter", signature());
+
+        Kernel1D remodulate_kernel = [this](BufferFloat4 input) noexcept
+        {
+            auto i = dispatch_x();
+            auto c = input.read(i).xyz() * demodulation_albedo(features(i).albedo);
+            m_converted->write(i, make_float4(c, 1.0f));
         };
-        m_convert_image = m_renderer.device().compile(convert_image_kernel);
+        m_denoise_remodulate = shader_cache->compile(remodulate_kernel, "film_denoise_remodulate", signature());
+    }
+    if (m_moments && !m_clear_moments)
+    {
+        Kernel1D clear_moments_kernel = [this]() noexcept
+        {
+            m_moments->write(dispatch_x(), make_float2(0.0f));
+        };
+        m_clear_moments = shader_cache->compile(clear_moments_kernel, "film_clear_moments", signature());
+
+        Kernel1D compact_kernel = [this](Float threshold, Float min_spp) noexcept
+        {
+            auto i = dispatch_x();
+            auto n = m_image->read(i).w;
+            $if(n < min_spp | relative_error(i) > threshold)
+            {
+                auto slot = m_active_count->atomic(0u).fetch_add(1u);
+                m_active_pixels->write(slot, i);
+            };
+        };
+        m_compact_active_pixels = shader_cache->compile(compact_kernel, "film_compact_active_pixels", signature());
+
+        Kernel1D sum_relative_error_kernel = [this]() noexcept
+        {
+            m_error_sum->atomic(0u).fetch_add(relative_error(dispatch_x()));
+        };
+        m_sum_relative_error = shader_cache->compile(sum_relative_error_kernel, "film_sum_relative_error", signature());
+
+        m_extract_sample_count = shader_cache->load_or_compile<1u, Buffer<float4>, Buffer<float4>>("film_extract_sample_count", 0u, [](BufferFloat4 accum, BufferFloat4 output) noexcept
+        {
+            auto i = dispatch_x();
+            auto n = accum.read(i).w;
+            output.write(i, make_float4(make_float3(n), 1.f));
+        });
+
+        if (m_denoise[0])
+        {
+            m_denoise_demodulate_moments = compile_demodulate(true);
+
+            Kernel1D sum_denoised_error_kernel = [this](BufferFloat4 denoised) noexcept
+            {
+                auto c = denoised.read(dispatch_x());
+                m_error_sum->atomic(0u).fetch_add(sqrt(c.w) / max(linear_srgb_to_cie_y(c.xyz()), 1e-3f));
+            };
+            m_sum_denoised_error = shader_cache->compile(sum_denoised_error_kernel, "film_sum_denoised_error", signature());
+        }
+    }
+}
+
+Shader1D<> Film::Instance::compile_demodulate(bool moments) noexcept
+{
+    Kernel1D demodulate_kernel = [this, moments]() noexcept
+    {
+        auto i      = dispatch_x();
+        auto c      = m_image->read(i);
+        auto n      = max(c.w, 1.0f);
+        auto albedo = demodulation_albedo(features(i).albedo);
+        // variance of the pixel mean, the luminance moments are taken before demodulation
+        auto variance = def(0.0f);
+        if (moments)
+        {
+            auto y   = linear_srgb_to_cie_y(albedo);
+            variance = m_moments->read(i).y / max(c.w - 1.0f, 1.0f) / n / (y * y);
+        }
+        m_denoise[0]->write(i, make_float4(c.xyz() / n / albedo, variance));
+    };
+    return m_renderer.shader_cache()->compile(demodulate_kernel, moments ? "film_denoise_demodulate_moments" : "film_denoise_demodulate", signature());
+}
+
+Film::Instance::Features Film::Instance::features(Expr<uint> pixel_id) const noexcept
+{
+    auto f = m_features->read(pixel_id);
+    auto n = m_feature_normals->read(pixel_id);
+    // pixels without a sample, or whose hits cancel out, read back a zero normal
+    auto w = 1.0f / max(n.w, 1.0f);
+    return {
+        .albedo   = f.xyz() * w,
+        .normal   = ite(dot(n.xyz(), n.xyz()) > 0.0f, normalize(n.xyz()), make_float3(0.0f)),
+        .distance = f.w * w};
+}
+
+Float3 Film::Instance::demodulation_albedo(Expr<float3> albedo) noexcept
+{
+    return ite(albedo > 1e-3f, albedo, make_float3(1.0f));
+}
+
+void Film::Instance::prepare(CommandBuffer& command_buffer) noexcept
+{
+    m_rendering_finished = false;
+
+    auto&& device     = m_renderer.device();
+    auto shader_cache = m_renderer.shader_cache();
+
+    uint2 render_resolution = base()->resolution();
+
+    allocate(false);
+    compile();
+    if (base()->tiled())
+    {
+        // starts at the first tile, the integrator walks the rest with set_tile()
+        set_tile(command_buffer, make_uint2(0u), min(make_uint2(base()->tile_size()), render_resolution));
+        return;
+    }
+    m_tile_origin = make_uint2(0u);
+    m_tile_extent = render_resolution;
+    clear(command_buffer);
+
+    if (base()->headless())
+    {
+        return;
     }
-    command_buffer << m_clear_image(m_image).dispatch(pixel_count);
 
     if (!m_window)
     {
@@ -100,7 +489,8 @@ void Film::Instance::prepare(CommandBuffer& command_buffer) noexcept
         {
             auto pixel_coord = dispatch_id().xy();
             auto pixel_id    = pixel_coord.y * base()->resolution().x + pixel_coord.x;
-            auto image_data  = m_image->read(pixel_id);
+            // the denoiser leaves its normalised result in the converted buffer
+            auto image_data  = m_denoise[0] ? m_converted->read(pixel_id) : m_image->read(pixel_id);
             auto inv_n       = (1.0f / max(image_data.w, 1e-6f));
             auto color       = image_data.xyz() * inv_n;
 
@@ -112,32 +502,193 @@ void Film::Instance::prepare(CommandBuffer& command_buffer) noexcept
 
             m_framebuffer->write(pixel_coord, make_float4(color, 1.0f));
         };
-        m_blit = device.compile(blit_kernel);
+        m_blit = shader_cache->compile(blit_kernel, "film_blit", signature());
 
-        Kernel2D clear_kernel = [](ImageFloat image) noexcept
+        m_clear = shader_cache->load_or_compile<2u, Image<float>>("film_clear_framebuffer", 0u, [](ImageFloat image) noexcept
         {
             image->write(dispatch_id().xy(), make_float4(0.0f));
-        };
-        m_clear = device.compile(clear_kernel);
+        });
     }
     m_framerate.clear();
 }
 
-void Film::Instance::download(CommandBuffer& command_buffer, float4* buffer) const noexcept
+uint64_t Film::Instance::signature() const noexcept
+{
+    // kernels capturing the film bake in the resolution, the tiling mode, the denoiser and the features
+    std::array params{
+        base()->resolution().x,
+        base()->resolution().y,
+        base()->tile_size(),
+        static_cast<uint>(base()->denoise()),
+        static_cast<uint>(base()->features()),
+    };
+    return luisa::hash64(params.data(), params.size() * sizeof(uint), luisa::hash64_default_seed);
+}
+
+void Film::Instance::set_tile(CommandBuffer& command_buffer, uint2 origin, uint2 extent) noexcept
+{
+    LUISA_ASSERT(base()->tiled() && m_tile, "Film is not tiled.");
+    LUISA_ASSERT(extent.x * extent.y <= max_pixel_count(), "Tile is larger than the film buffers.");
+
+    m_tile_origin = origin;
+    m_tile_extent = extent;
+    m_tile_host   = make_uint4(origin, extent);
+    command_buffer << m_tile.copy_from(&m_tile_host);
+    clear(command_buffer);
+}
+
+void Film::Instance::clear(CommandBuffer& command_buffer) noexcept
+{
+    command_buffer << m_clear_image(m_image).dispatch(pixel_count());
+    if (m_features)
+    {
+        command_buffer << m_clear_features(m_features, m_feature_normals, m_ids).dispatch(pixel_count());
+    }
+    if (m_moments)
+    {
+        command_buffer << m_clear_moments().dispatch(pixel_count());
+    }
+}
+
+void Film::Instance::prepare_moments(CommandBuffer& command_buffer) noexcept
+{
+    allocate(true);
+    compile();
+    command_buffer << m_clear_moments().dispatch(pixel_count());
+}
+
+uint Film::Instance::compact_active_pixels(CommandBuffer& command_buffer, float threshold, float min_spp) noexcept
+{
+    LUISA_ASSERT(m_moments, "Film moments are not prepared.");
+
+    static constexpr auto zero = 0u;
+    auto active_count          = 0u;
+    command_buffer
+        << m_active_count.copy_from(&zero)
+        << m_compact_active_pixels(threshold, min_spp).dispatch(pixel_count())
+        << m_active_count.copy_to(&active_count)
+        << synchronize();
+    return active_count;
+}
+
+float Film::Instance::mean_relative_error(CommandBuffer& command_buffer) noexcept
+{
+    LUISA_ASSERT(m_moments, "Film moments are not prepared.");
+
+    static constexpr auto zero = 0.0f;
+    auto error_sum             = 0.0f;
+    command_buffer
+        << m_error_sum.copy_from(&zero)
+        << m_sum_relative_error().dispatch(pixel_count())
+        << m_error_sum.copy_to(&error_sum)
+        << synchronize();
+    return error_sum / static_cast<float>(pixel_count());
+}
+
+Float Film::Instance::relative_error(Expr<uint> pixel_id) const noexcept
+{
+    // relative standard error of the pixel mean, black pixels are measured in absolute terms
+    auto n        = m_image->read(pixel_id).w;
+    auto m        = m_moments->read(pixel_id);
+    auto variance = m.y / max(n - 1.0f, 1.0f);
+    return sqrt(variance / max(n, 1.0f)) / max(m.x, 1e-3f);
+}
+
+void Film::Instance::download_sample_count(CommandBuffer& command_buffer, float4* buffer) const noexcept
+{
+    LUISA_ASSERT(m_moments, "Film moments are not prepared.");
+
+    command_buffer
+        << m_extract_sample_count(m_image, m_converted).dispatch(pixel_count())
+        << m_converted.view(0u, pixel_count()).copy_to(buffer);
+}
+
+void Film::Instance::download_aov(CommandBuffer& command_buffer, Aov aov, float4* buffer) const noexcept
+{
+    LUISA_ASSERT(m_features, "Film features are not prepared.");
+
+    command_buffer
+        << m_extract_aov(static_cast<uint>(aov)).dispatch(pixel_count())
+        << m_converted.view(0u, pixel_count()).copy_to(buffer);
+}
+
+void Film::Instance::download_accumulation(CommandBuffer& command_buffer, float4* image, float2* moments) const noexcept
+{
+    LUISA_ASSERT(m_image && m_converted, "Film is not prepared.");
+
+    command_buffer << m_image.view(0u, pixel_count()).copy_to(image);
+    if (moments != nullptr && m_moments)
+    {
+        command_buffer << m_moments.view(0u, pixel_count()).copy_to(moments);
+    }
+}
+
+void Film::Instance::upload_accumulation(CommandBuffer& command_buffer, const float4* image, const float2* moments) noexcept
 {
     LUISA_ASSERT(m_image && m_converted, "Film is not prepared.");
 
-    auto pixel_count = base()->resolution().x * base()->resolution().y;
+    command_buffer << m_image.view(0u, pixel_count()).copy_from(image);
+    if (moments != nullptr && m_moments)
+    {
+        command_buffer << m_moments.view(0u, pixel_count()).copy_from(moments);
+    }
+}
 
+void Film::Instance::denoise(CommandBuffer& command_buffer) const noexcept
+{
+    LUISA_ASSERT(m_denoise[0] && m_denoise_filter, "Film denoiser is not prepared.");
+
+    command_buffer << (m_moments ? m_denoise_demodulate_moments : m_denoise_demodulate)().dispatch(pixel_count());
+    // the colour threshold halves every iteration as the taps spread out
+    auto sigma_color = 1.0f;
+    for (auto i = 0u; i < denoise_iterations; i++)
+    {
+        command_buffer << m_denoise_filter(m_denoise[i % 2u], m_denoise[(i + 1u) % 2u], 1u << i, sigma_color).dispatch(pixel_count());
+        sigma_color *= 0.5f;
+    }
+    command_buffer << m_denoise_remodulate(m_denoise[denoise_iterations % 2u]).dispatch(pixel_count());
+}
+
+float Film::Instance::denoised_relative_error(CommandBuffer& command_buffer) noexcept
+{
+    LUISA_ASSERT(m_moments && m_sum_denoised_error, "Film moments are not prepared.");
+
+    static constexpr auto zero = 0.0f;
+    auto error_sum             = 0.0f;
+    denoise(command_buffer);
     command_buffer
-        << m_convert_image(m_image, m_converted).dispatch(pixel_count)
-        << m_converted.copy_to(buffer);
+        << m_error_sum.copy_from(&zero)
+        << m_sum_denoised_error(m_denoise[denoise_iterations % 2u]).dispatch(pixel_count())
+        << m_error_sum.copy_to(&error_sum)
+        << synchronize();
+    return error_sum / static_cast<float>(pixel_count());
+}
+
+void Film::Instance::download(CommandBuffer& command_buffer, float4* buffer) const noexcept
+{
+    LUISA_ASSERT(m_image && m_converted, "Film is not prepared.");
+
+    if (m_denoise[0])
+    {
+        denoise(command_buffer);
+    }
+    else
+    {
+        command_buffer << m_convert_image(m_image, m_converted).dispatch(pixel_count());
+    }
+    command_buffer << m_converted.view(0u, pixel_count()).copy_to(buffer);
 }
 
 void Film::Instance::release() noexcept
 {
     m_rendering_finished = true;
 
+    // headless and tiled films have no window to wait for
+    if (!m_window)
+    {
+        return;
+    }
+
     CommandBuffer command_buffer{*m_stream};
 
     while (!m_window->should_close())
@@ -157,6 +708,10 @@ bool Film::Instance::should_close() const noexcept
 
 bool Film::Instance::show(CommandBuffer& command_buffer, bool force) const noexcept
 {
+    if (!m_window)
+    {
+        return false;
+    }
     LUISA_ASSERT(command_buffer.stream() == m_stream, "Command buffer stream mismatch.");
 
     static const auto target_fps = 60.0;
@@ -178,6 +733,10 @@ bool Film::Instance::show(CommandBuffer& command_buffer, bool force) const noexc
 
     auto is_ldr = m_window->framebuffer().storage() != PixelStorage::FLOAT4;
 
+    if (m_denoise[0])
+    {
+        denoise(command_buffer);
+    }
     command_buffer
         << m_clear(m_window->framebuffer()).dispatch(m_window->framebuffer().size())
         << m_blit(is_ldr).dispatch(base()->resolution())
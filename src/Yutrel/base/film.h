@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include <imgui.h>
 #include <luisa/core/stl/memory.h>
 #include <luisa/dsl/syntax.h>
@@ -25,10 +27,36 @@ public:
     {
         uint2 resolution{1920u, 1080u};
         bool hdr{false};
+        // no window, swapchain or blit, the result is only written to disk
+        bool headless{false};
+        // renders square tiles of this size one after another and streams them to disk,
+        // 0 keeps the whole image on the device
+        uint tile_size{0u};
+        // edge-avoiding a-trous filter over the accumulated image, guided by the albedo, normal and depth
+        // of the primary hits, applied to the written image and to the window, not available with tiles
+        bool denoise{false};
+        // albedo, shading normal, depth, instance/primitive ids and sample count of the primary hits are
+        // written as layers of the output EXR next to the colour, not available with tiles
+        bool aovs{false};
+        // relative to the working directory
+        luisa::string output{"render.exr"};
     };
 
     [[nodiscard]] static luisa::unique_ptr<Film> create(const CreateInfo& info) noexcept;
 
+    // filter taps are 1, 2, 4, ... pixels apart, 5 iterations cover a 125 pixel footprint
+    static constexpr auto denoise_iterations = 5u;
+
+    enum struct Aov : uint
+    {
+        albedo,
+        normal,
+        depth,
+        // instance and primitive id bit-cast to float in x and y, ~0u where the camera ray found no surface
+        id,
+        sample_count,
+    };
+
 public:
     class Instance
     {
@@ -42,6 +70,38 @@ public:
         Shader1D<Buffer<float4>> m_clear_image;
         Shader1D<Buffer<float4>, Buffer<float4>> m_convert_image;
 
+        // region of the image currently held by the buffers, the whole image unless tiled
+        uint2 m_tile_origin{};
+        uint2 m_tile_extent{};
+        uint4 m_tile_host{};
+        Buffer<uint4> m_tile;
+
+        // per-pixel luminance mean and M2 (Welford) for adaptive sampling
+        mutable Buffer<float2> m_moments;
+        Buffer<uint> m_active_pixels;
+        Buffer<uint> m_active_count;
+        Shader1D<> m_clear_moments;
+        Buffer<float> m_error_sum;
+        Shader1D<float, float> m_compact_active_pixels;
+        Shader1D<> m_sum_relative_error;
+        Shader1D<Buffer<float4>, Buffer<float4>> m_extract_sample_count;
+
+        // primary hit features summed over the samples in float, averaged only when read: albedo and hit
+        // distance, then shading normal and the feature sample count
+        mutable Buffer<float4> m_features;
+        mutable Buffer<float4> m_feature_normals;
+        // instance and primitive id of the first hit, ~0u until the pixel hits a surface
+        mutable Buffer<uint2> m_ids;
+        Shader1D<Buffer<float4>, Buffer<float4>, Buffer<uint2>> m_clear_features;
+        Shader1D<uint> m_extract_aov;
+        // colour divided by albedo with the variance of its luminance in w, ping-ponged between iterations
+        mutable std::array<Buffer<float4>, 2u> m_denoise;
+        Shader1D<> m_denoise_demodulate;
+        Shader1D<> m_denoise_demodulate_moments;
+        Shader1D<Buffer<float4>, Buffer<float4>, uint, float> m_denoise_filter;
+        Shader1D<Buffer<float4>> m_denoise_remodulate;
+        Shader1D<Buffer<float4>> m_sum_denoised_error;
+
         // window display
         Stream* m_stream{};
         luisa::unique_ptr<ImGuiWindow> m_window;
@@ -75,20 +135,83 @@ public:
 
         [[nodiscard]] bool should_close() const noexcept;
 
+        // NaN and Inf samples are dropped, sanitize() returns zero for them and they must not count towards the spp
+        [[nodiscard]] static Bool is_valid(Expr<float3> rgb) noexcept;
+        [[nodiscard]] Float3 sanitize(Expr<float3> rgb, Expr<float> effective_spp) const noexcept;
         void accumulate(Expr<uint2> pixel, Expr<float3> rgb, Expr<float> effective_spp) const noexcept;
-
+        // the colour is added atomically so that other threads may splat into the pixel at the same time, the sample
+        // count and moments must still be owned by the calling thread
+        void accumulate(Expr<uint2> pixel, Expr<float3> rgb_sum, Expr<float> spp, Expr<float2> moments) const noexcept;
+        // the pixel must be owned by the calling thread, the sum is written without atomics
+        void accumulate_exclusive(Expr<uint2> pixel, Expr<float3> rgb_sum, Expr<float> spp) const noexcept;
+        // also merges the luminance mean and M2 of the new samples into the pixel moments
+        void accumulate_exclusive(Expr<uint2> pixel, Expr<float3> rgb_sum, Expr<float> spp, Expr<float2> moments) const noexcept;
+        // the features of the primary hit for the denoiser and the AOVs, one call per sample, distance is 0
+        // and the ids are ~0u on a miss, the pixel must be owned by the calling thread
+        void accumulate_features(Expr<uint2> pixel, Expr<float3> albedo, Expr<float3> normal, Expr<float> distance,
+                                 Expr<uint> instance_id, Expr<uint> primitive_id) const noexcept;
+        [[nodiscard]] UInt2 active_pixel(Expr<uint> index) const noexcept;
+        // maps an index within the current tile to the pixel coordinate in the image
+        [[nodiscard]] UInt2 pixel_coordinate(Expr<uint> index) const noexcept;
+
+        [[nodiscard]] auto tile_origin() const noexcept { return m_tile_origin; }
+        [[nodiscard]] auto tile_extent() const noexcept { return m_tile_extent; }
+        [[nodiscard]] auto pixel_count() const noexcept { return m_tile_extent.x * m_tile_extent.y; }
+        [[nodiscard]] uint max_pixel_count() const noexcept;
+
+        // creates the device buffers, kernels capturing the film must be traced after this
+        void allocate(bool moments) noexcept;
+        // builds the film shaders without recording commands, so it may run on a worker thread
+        void compile() noexcept;
         void prepare(CommandBuffer& command_buffer) noexcept;
+        void prepare_moments(CommandBuffer& command_buffer) noexcept;
+        // drops everything accumulated in the current tile
+        void clear(CommandBuffer& command_buffer) noexcept;
+        // selects and clears the tile that the following samples accumulate into
+        void set_tile(CommandBuffer& command_buffer, uint2 origin, uint2 extent) noexcept;
+        // collects pixels whose relative error is above threshold, returns how many are still active
+        [[nodiscard]] uint compact_active_pixels(CommandBuffer& command_buffer, float threshold, float min_spp) noexcept;
+        // mean over all pixels of the relative standard error of the pixel estimate
+        [[nodiscard]] float mean_relative_error(CommandBuffer& command_buffer) noexcept;
+        // filters the accumulated image into the converted buffer
+        void denoise(CommandBuffer& command_buffer) const noexcept;
+        // mean relative error of the denoised pixels, from the pixel variance carried through the filter
+        [[nodiscard]] float denoised_relative_error(CommandBuffer& command_buffer) noexcept;
         void download(CommandBuffer& command_buffer, float4* buffer) const noexcept;
+        void download_sample_count(CommandBuffer& command_buffer, float4* buffer) const noexcept;
+        void download_aov(CommandBuffer& command_buffer, Aov aov, float4* buffer) const noexcept;
+        // raw accumulation (sum, sample count) and moments, used by checkpoints
+        void download_accumulation(CommandBuffer& command_buffer, float4* image, float2* moments = nullptr) const noexcept;
+        void upload_accumulation(CommandBuffer& command_buffer, const float4* image, const float2* moments = nullptr) noexcept;
         void release() noexcept;
         bool show(CommandBuffer& command_buffer, bool force = false) const noexcept;
 
     private:
         void display() const noexcept;
+        [[nodiscard]] Float relative_error(Expr<uint> pixel_id) const noexcept;
+        struct Features
+        {
+            Float3 albedo;
+            Float3 normal;
+            Float distance;
+        };
+        // averaged over the samples of the pixel
+        [[nodiscard]] Features features(Expr<uint> pixel_id) const noexcept;
+        // albedo the colour is divided by, texels darker than this pass through unchanged
+        [[nodiscard]] static Float3 demodulation_albedo(Expr<float3> albedo) noexcept;
+        [[nodiscard]] Shader1D<> compile_demodulate(bool moments) noexcept;
+        [[nodiscard]] UInt pixel_index(Expr<uint2> pixel) const noexcept;
+        [[nodiscard]] uint64_t signature() const noexcept;
     };
 
 private:
     uint2 m_resolution{1920u, 1080u};
     bool m_hdr{false};
+    bool m_headless{false};
+    uint m_tile_size{0u};
+    bool m_denoise{false};
+    bool m_aovs{false};
+    luisa::string m_output;
 
 public:
     explicit Film(const CreateInfo& info) noexcept;
@@ -108,5 +231,13 @@ public:
 
     [[nodiscard]] auto resolution() const noexcept { return m_resolution; }
     [[nodiscard]] auto hdr() const noexcept { return m_hdr; }
+    [[nodiscard]] auto headless() const noexcept { return m_headless; }
+    [[nodiscard]] auto tile_size() const noexcept { return m_tile_size; }
+    [[nodiscard]] auto tiled() const noexcept { return m_tile_size != 0u; }
+    [[nodiscard]] auto denoise() const noexcept { return m_denoise; }
+    [[nodiscard]] auto aovs() const noexcept { return m_aovs; }
+    // whether the integrators record the primary hit features
+    [[nodiscard]] auto features() const noexcept { return m_denoise || m_aovs; }
+    [[nodiscard]] luisa::string_view output() const noexcept { return m_output; }
 };
 } // namespace Yutrel
\ No newline at end of file
@@ -6,147 +6,234 @@
 
 namespace Yutrel
 {
-void Geometry::build(CommandBuffer& command_buffer, luisa::span<const Shape* const> shapes) noexcept
+void Geometry::prepare(CommandBuffer& command_buffer, luisa::span<const Shape* const> shapes) noexcept
 {
     m_accel = m_renderer.device().create_accel({});
 
     for (auto shape : shapes)
     {
-        process_shape(command_buffer, shape);
+        register_shape(command_buffer, shape);
+    }
+    m_instances.resize(m_pending.size());
+    m_light_bounds.resize(m_instanced_lights.size());
+    m_instance_buffer = m_renderer.device().create_buffer<uint4>(std::max(m_pending.size(), size_t{1u}));
+}
+
+void Geometry::build(CommandBuffer& command_buffer) noexcept
+{
+    for (auto& instance : m_pending)
+    {
+        process_shape(command_buffer, instance);
     }
     LUISA_INFO_WITH_LOCATION("Geometry built with {} unique triangles ({} instanced).",
                              m_triangle_count,
                              m_instanced_triangle_count);
 
-    m_instance_buffer = m_renderer.device().create_buffer<uint4>(m_instances.size());
     command_buffer
-        << m_instance_buffer.copy_from(m_instances.data())
+        << m_instance_buffer.view(0u, m_instances.size()).copy_from(m_instances.data())
         << m_accel.build()
         << commit();
 }
 
-void Geometry::process_shape(CommandBuffer& command_buffer, const Shape* shape) noexcept
+void Geometry::register_shape(CommandBuffer& command_buffer, const Shape* shape) noexcept
 {
     auto surface = shape->surface();
     auto light   = shape->light();
+    auto medium  = shape->medium();
 
     if (shape->is_mesh())
     {
-        auto mesh = [&]
-        {
-            if (auto it = m_meshes.find(shape); it != m_meshes.end())
-            {
-                return it->second;
-            }
-            auto mesh_gemo = [&]
-            {
-                auto [vertices, triangles] = shape->mesh();
-                LUISA_ASSERT(!vertices.empty() && !triangles.empty(), "Empty mesh.");
-                auto hash = luisa::hash64(vertices.data(), vertices.size_bytes(), luisa::hash64_default_seed);
-                hash      = luisa::hash64(triangles.data(), triangles.size_bytes(), hash);
-                if (auto mesh_it = m_mesh_cache.find(hash); mesh_it != m_mesh_cache.end())
-                {
-                    return mesh_it->second;
-                }
-                // create mesh
-                m_triangle_count += triangles.size();
-                auto vertex_buffer   = m_renderer.create<Buffer<Vertex>>(vertices.size());
-                auto triangle_buffer = m_renderer.create<Buffer<Triangle>>(triangles.size());
-                auto mesh            = m_renderer.create<compute::Mesh>(*vertex_buffer, *triangle_buffer, AccelOption{});
-                command_buffer
-                    << vertex_buffer->copy_from(vertices.data())
-                    << triangle_buffer->copy_from(triangles.data())
-                    << commit()
-                    << mesh->build()
-                    << commit();
-                auto vertex_buffer_id   = m_renderer.register_bindless(vertex_buffer->view());
-                auto triangle_buffer_id = m_renderer.register_bindless(triangle_buffer->view());
-                // compute alisa table
-                luisa::vector<float> triangle_areas(triangles.size());
-                for (auto i = 0u; i < triangles.size(); i++)
-                {
-                    auto t            = triangles[i];
-                    auto v0           = vertices[t.i0].position();
-                    auto v1           = vertices[t.i1].position();
-                    auto v2           = vertices[t.i2].position();
-                    triangle_areas[i] = std::abs(length(cross(v1 - v0, v2 - v0)));
-                }
-                auto [alias_table, pdf]                         = create_alias_table(triangle_areas);
-                auto [alisa_table_buffer_view, alias_buffer_id] = m_renderer.bindless_arena_buffer<AliasEntry>(alias_table.size());
-                auto [pdf_buffer_view, pdf_buffer_id]           = m_renderer.bindless_arena_buffer<float>(pdf.size());
-                LUISA_ASSERT(triangle_buffer_id - vertex_buffer_id == Shape::Handle::triangle_buffer_id_offset, "Invalid.");
-                LUISA_ASSERT(alias_buffer_id - vertex_buffer_id == Shape::Handle::alias_table_buffer_id_offset, "Invalid.");
-                LUISA_ASSERT(pdf_buffer_id - vertex_buffer_id == Shape::Handle::pdf_buffer_id_offset, "Invalid.");
-                command_buffer
-                    << alisa_table_buffer_view.copy_from(alias_table.data())
-                    << pdf_buffer_view.copy_from(pdf.data())
-                    << commit();
-
-                auto geom = MeshGeometry{
-                    .resource       = mesh,
-                    .buffer_id_base = vertex_buffer_id};
-                m_mesh_cache.emplace(hash, geom);
-                return geom;
-            }();
-
-            auto encode_fixed_point = [](float x) noexcept
-            {
-                return static_cast<uint16_t>(std::clamp(
-                    std::round(x * 65535.f),
-                    0.f,
-                    65535.f));
-            };
-
-            MeshData data{
-                .resource                = mesh_gemo.resource,
-                .geometry_buffer_id_base = mesh_gemo.buffer_id_base,
-                .vertex_properties       = shape->vertex_properties()};
-            m_meshes.emplace(shape, data);
-            return data;
-        }();
-
-        auto instance_id = static_cast<uint>(m_accel.size());
+        auto instance_id = static_cast<uint>(m_pending.size());
 
         // surfaces
         auto surface_tag = 0u;
-        auto properties  = mesh.vertex_properties;
+        auto properties  = 0u;
         if (surface && !surface->is_null())
         {
             surface_tag = m_renderer.register_surface(command_buffer, surface);
             properties |= Shape::property_flag_has_surface;
         }
 
-        m_accel.emplace_back(*mesh.resource, make_float4x4(1.0f));
-
         // lights
-        auto light_tag = 0u;
+        auto light_tag   = 0u;
+        auto light_index = ~0u;
         if (light && !light->is_null())
         {
             light_tag = m_renderer.register_light(command_buffer, light);
             properties |= Shape::property_flag_has_light;
         }
 
-        m_instances.emplace_back(
-            Shape::Handle::encode(
-                mesh.geometry_buffer_id_base,
-                properties,
-                surface_tag,
-                light_tag,
-                0,
-                mesh.resource->triangle_count(),
-                0,
-                0));
+        // media
+        auto medium_tag = 0u;
+        if (medium && !medium->is_null())
+        {
+            medium_tag = m_renderer.register_medium(command_buffer, medium);
+            properties |= Shape::property_flag_has_medium;
+        }
 
         if (properties & Shape::property_flag_has_light)
         {
+            light_index = static_cast<uint>(m_instanced_lights.size());
             m_instanced_lights.emplace_back(
                 Light::Handle{
                     .instance_id = instance_id,
                     .light_tag   = light_tag});
         }
 
-        m_instanced_triangle_count += mesh.resource->triangle_count();
+        m_pending.emplace_back(
+            PendingInstance{
+                .shape       = shape,
+                .surface_tag = surface_tag,
+                .light_tag   = light_tag,
+                .medium_tag  = medium_tag,
+                .properties  = properties,
+                .light_index = light_index});
+    }
+}
+
+void Geometry::process_shape(CommandBuffer& command_buffer, const PendingInstance& instance) noexcept
+{
+    auto shape = instance.shape;
+
+    auto mesh = [&]
+    {
+        if (auto it = m_meshes.find(shape); it != m_meshes.end())
+        {
+            return it->second;
+        }
+        auto mesh_gemo = [&]
+        {
+            auto [vertices, triangles] = shape->mesh();
+            LUISA_ASSERT(!vertices.empty() && !triangles.empty(), "Empty mesh.");
+            auto hash = luisa::hash64(vertices.data(), vertices.size_bytes(), luisa::hash64_default_seed);
+            hash      = luisa::hash64(triangles.data(), triangles.size_bytes(), hash);
+            if (auto mesh_it = m_mesh_cache.find(hash); mesh_it != m_mesh_cache.end())
+            {
+                return mesh_it->second;
+            }
+            // create mesh
+            m_triangle_count += triangles.size();
+            auto vertex_buffer   = m_renderer.create<Buffer<Vertex>>(vertices.size());
+            auto triangle_buffer = m_renderer.create<Buffer<Triangle>>(triangles.size());
+            auto mesh            = m_renderer.create<compute::Mesh>(*vertex_buffer, *triangle_buffer, AccelOption{});
+            command_buffer
+                << vertex_buffer->copy_from(vertices.data())
+                << triangle_buffer->copy_from(triangles.data())
+                << commit()
+                << mesh->build()
+                << commit();
+            auto vertex_buffer_id   = m_renderer.register_bindless(vertex_buffer->view());
+            auto triangle_buffer_id = m_renderer.register_bindless(triangle_buffer->view());
+            for (auto& v : vertices)
+            {
+                m_bounds_min = min(m_bounds_min, v.position());
+                m_bounds_max = max(m_bounds_max, v.position());
+            }
+            // compute alisa table
+            luisa::vector<float> triangle_areas(triangles.size());
+            for (auto i = 0u; i < triangles.size(); i++)
+            {
+                auto t            = triangles[i];
+                auto v0           = vertices[t.i0].position();
+                auto v1           = vertices[t.i1].position();
+                auto v2           = vertices[t.i2].position();
+                triangle_areas[i] = std::abs(length(cross(v1 - v0, v2 - v0)));
+            }
+            auto [alias_table, pdf]                         = create_alias_table(triangle_areas);
+            auto [alisa_table_buffer_view, alias_buffer_id] = m_renderer.bindless_arena_buffer<AliasEntry>(alias_table.size());
+            auto [pdf_buffer_view, pdf_buffer_id]           = m_renderer.bindless_arena_buffer<float>(pdf.size());
+            LUISA_ASSERT(triangle_buffer_id - vertex_buffer_id == Shape::Handle::triangle_buffer_id_offset, "Invalid.");
+            LUISA_ASSERT(alias_buffer_id - vertex_buffer_id == Shape::Handle::alias_table_buffer_id_offset, "Invalid.");
+            LUISA_ASSERT(pdf_buffer_id - vertex_buffer_id == Shape::Handle::pdf_buffer_id_offset, "Invalid.");
+            command_buffer
+                << alisa_table_buffer_view.copy_from(alias_table.data())
+                << pdf_buffer_view.copy_from(pdf.data())
+                << commit();
+
+            auto geom = MeshGeometry{
+                .resource       = mesh,
+                .buffer_id_base = vertex_buffer_id,
+                .hash           = hash};
+            m_mesh_cache.emplace(hash, geom);
+            return geom;
+        }();
+
+        auto encode_fixed_point = [](float x) noexcept
+        {
+            return static_cast<uint16_t>(std::clamp(
+                std::round(x * 65535.f),
+                0.f,
+                65535.f));
+        };
+
+        MeshData data{
+            .resource                = mesh_gemo.resource,
+            .geometry_buffer_id_base = mesh_gemo.buffer_id_base,
+            .vertex_properties       = shape->vertex_properties(),
+            .hash                    = mesh_gemo.hash};
+        m_meshes.emplace(shape, data);
+        return data;
+    }();
+
+    auto instance_id = static_cast<uint>(m_accel.size());
+    m_accel.emplace_back(*mesh.resource, make_float4x4(1.0f));
+
+    m_instances[instance_id] = Shape::Handle::encode(
+        mesh.geometry_buffer_id_base,
+        instance.properties | mesh.vertex_properties,
+        instance.surface_tag,
+        instance.light_tag,
+        instance.medium_tag,
+        mesh.resource->triangle_count(),
+        0,
+        0);
+    m_fingerprint = luisa::hash64(&mesh.hash, sizeof(mesh.hash), m_fingerprint);
+    m_fingerprint = luisa::hash64(&m_instances[instance_id], sizeof(uint4), m_fingerprint);
+
+    m_instanced_triangle_count += mesh.resource->triangle_count();
+
+    if (instance.light_index != ~0u)
+    {
+        m_light_bounds[instance.light_index] = compute_light_bounds(shape->mesh());
+    }
+}
+
+Geometry::LightBounds Geometry::compute_light_bounds(MeshView mesh) noexcept
+{
+    LightBounds bounds{
+        .bounds_min  = make_float3(std::numeric_limits<float>::max()),
+        .bounds_max  = make_float3(-std::numeric_limits<float>::max()),
+        .axis        = make_float3(0.0f, 0.0f, 1.0f),
+        .cos_theta_o = -1.0f,
+        .area        = 0.0f};
+    // the emitting side of a triangle follows its winding, as front_face does for hits
+    auto normal_sum = make_float3(0.0f);
+    for (auto t : mesh.triangles)
+    {
+        auto v0 = mesh.vertices[t.i0].position();
+        auto v1 = mesh.vertices[t.i1].position();
+        auto v2 = mesh.vertices[t.i2].position();
+        auto c  = cross(v1 - v0, v2 - v0);
+        normal_sum += c;
+        bounds.area += 0.5f * length(c);
+        bounds.bounds_min = min(bounds.bounds_min, min(v0, min(v1, v2)));
+        bounds.bounds_max = max(bounds.bounds_max, max(v0, max(v1, v2)));
+    }
+    if (length(normal_sum) > 0.0f)
+    {
+        bounds.axis        = normalize(normal_sum);
+        bounds.cos_theta_o = 1.0f;
+        for (auto t : mesh.triangles)
+        {
+            auto v0 = mesh.vertices[t.i0].position();
+            auto c  = cross(mesh.vertices[t.i1].position() - v0, mesh.vertices[t.i2].position() - v0);
+            if (auto l = length(c); l > 0.0f)
+            {
+                bounds.cos_theta_o = std::min(bounds.cos_theta_o, dot(bounds.axis, c / l));
+            }
+        }
     }
+    return bounds;
 }
 
 Shape::Handle Geometry::instance(Expr<uint> index) const noexcept
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <limits>
+
 #include <luisa/dsl/syntax.h>
 #include <luisa/runtime/rtx/accel.h>
 
@@ -24,12 +26,35 @@ public:
         Mesh* resource;
         uint geometry_buffer_id_base : 22;
         uint vertex_properties : 10;
+        uint64_t hash;
     };
 
     struct MeshGeometry
     {
         Mesh* resource;
         uint buffer_id_base;
+        uint64_t hash;
+    };
+
+    // what prepare() knows about an instance before its mesh has been imported
+    struct PendingInstance
+    {
+        const Shape* shape;
+        uint surface_tag;
+        uint light_tag;
+        uint medium_tag;
+        uint properties;
+        uint light_index;
+    };
+
+    // extent and orientation of an emissive instance, used to build the light BVH on the host
+    struct LightBounds
+    {
+        float3 bounds_min;
+        float3 bounds_max;
+        float3 axis;
+        float cos_theta_o;
+        float area;
     };
 
 private:
@@ -39,18 +64,34 @@ private:
     uint m_instanced_triangle_count{0u};
     luisa::unordered_map<const Shape*, MeshData> m_meshes;
     luisa::unordered_map<uint64_t, MeshGeometry> m_mesh_cache;
+    luisa::vector<PendingInstance> m_pending;
     luisa::vector<uint4> m_instances;
     Buffer<uint4> m_instance_buffer;
     luisa::vector<Light::Handle> m_instanced_lights;
+    luisa::vector<LightBounds> m_light_bounds;
+    float3 m_bounds_min{std::numeric_limits<float>::max()};
+    float3 m_bounds_max{-std::numeric_limits<float>::max()};
+    // identifies the mesh contents and instance layout, used to validate checkpoints
+    uint64_t m_fingerprint{luisa::hash64_default_seed};
 
 public:
     explicit Geometry(Renderer& renderer) noexcept
         : m_renderer{renderer} {}
 
-    void build(CommandBuffer& command_buffer, luisa::span<const Shape* const> shapes) noexcept;
+    // registers surfaces and lights and creates the accel and instance buffer, so that kernels
+    // can be traced against them while the meshes are still being imported
+    void prepare(CommandBuffer& command_buffer, luisa::span<const Shape* const> shapes) noexcept;
+    // waits for the imports, uploads the meshes and builds the acceleration structure
+    void build(CommandBuffer& command_buffer) noexcept;
 
     [[nodiscard]] auto instances() const noexcept { return luisa::span{m_instances}; }
     [[nodiscard]] auto light_instances() const noexcept { return luisa::span{m_instanced_lights}; }
+    // aligned with light_instances(), valid after build()
+    [[nodiscard]] auto light_bounds() const noexcept { return luisa::span{m_light_bounds}; }
+    [[nodiscard]] auto fingerprint() const noexcept { return m_fingerprint; }
+    // world-space bounds of all instances, valid after build()
+    [[nodiscard]] auto bounds_min() const noexcept { return m_bounds_min; }
+    [[nodiscard]] auto bounds_max() const noexcept { return m_bounds_max; }
     [[nodiscard]] Shape::Handle instance(Expr<uint> index) const noexcept;
     [[nodiscard]] Float4x4 instance_to_world(Expr<uint> index) const noexcept;
     [[nodiscard]] Var<Triangle> triangle(const Shape::Handle& instance, Expr<uint> index) const noexcept;
@@ -61,6 +102,8 @@ public:
     [[nodiscard]] ShadingAttribute shading_point(const Shape::Handle& instance, const Var<Triangle>& triangle, const Var<float2>& bary, const Var<float4x4>& shape_to_world) const noexcept;
 
 private:
-    void process_shape(CommandBuffer& command_buffer, const Shape* shape) noexcept;
+    void register_shape(CommandBuffer& command_buffer, const Shape* shape) noexcept;
+    void process_shape(CommandBuffer& command_buffer, const PendingInstance& instance) noexcept;
+    [[nodiscard]] static LightBounds compute_light_bounds(MeshView mesh) noexcept;
 };
 } // namespace Yutrel
\ No newline at end of file
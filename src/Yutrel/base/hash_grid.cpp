@@ -0,0 +1,196 @@
+#include "hash_grid.h"
+
+#include <luisa/luisa-compute.h>
+
+#include "base/renderer.h"
+#include "utils/shader_cache.h"
+
+namespace Yutrel
+{
+HashGrid::HashGrid(const Renderer& renderer, uint capacity) noexcept
+    : m_renderer(renderer),
+      m_capacity(std::max(capacity, 1u)),
+      m_table_size(std::max(next_pow2(m_capacity) * 2u, scan_block_size))
+{
+    auto&& device  = renderer.device();
+    m_max_radius   = device.create_buffer<uint>(1u);
+    m_cell_counts  = device.create_buffer<uint>(m_table_size);
+    m_cell_offsets = device.create_buffer<uint>(m_table_size);
+    m_entries      = device.create_buffer<uint>(m_capacity * max_cells_per_point);
+    for (auto n = m_table_size;;)
+    {
+        auto blocks = (n + scan_block_size - 1u) / scan_block_size;
+        m_level_sizes.emplace_back(n);
+        m_block_sums.emplace_back(device.create_buffer<uint>(blocks));
+        if (blocks == 1u)
+        {
+            break;
+        }
+        n = blocks;
+    }
+
+    Kernel1D reduce_radius_kernel = [this](BufferFloat4 points) noexcept
+    {
+        auto point = points.read(dispatch_x());
+        $if(point.w > 0.0f)
+        {
+            m_max_radius->atomic(0u).fetch_max(as<uint>(point.w));
+        };
+    };
+
+    // counts the entries of every cell, the count of a cell becomes its offset after the prefix sum
+    Kernel1D count_kernel = [this](BufferFloat4 points) noexcept
+    {
+        auto point = points.read(dispatch_x());
+        $if(point.w > 0.0f)
+        {
+            for_each_overlapped(point.xyz(), point.w, [&](Expr<uint> h) noexcept
+            {
+                m_cell_offsets->atomic(h).fetch_add(1u);
+            });
+        };
+    };
+
+    // the counts are rebuilt as the cursors of the cells, so entries land in any order within their cell
+    Kernel1D scatter_kernel = [this](BufferFloat4 points) noexcept
+    {
+        auto index = dispatch_x();
+        auto point = points.read(index);
+        $if(point.w > 0.0f)
+        {
+            for_each_overlapped(point.xyz(), point.w, [&](Expr<uint> h) noexcept
+            {
+                auto slot = m_cell_counts->atomic(h).fetch_add(1u);
+                m_entries->write(m_cell_offsets->read(h) + slot, index);
+            });
+        };
+    };
+
+    auto shader_cache = renderer.shader_cache();
+    auto signature    = make_uint2(m_capacity, m_table_size);
+    auto hash         = luisa::hash64(&signature, sizeof(signature), luisa::hash64_default_seed);
+    m_reduce_radius   = shader_cache->compile(reduce_radius_kernel, "hash_grid_reduce_radius", hash);
+    m_count           = shader_cache->compile(count_kernel, "hash_grid_count", hash);
+    m_scatter         = shader_cache->compile(scatter_kernel, "hash_grid_scatter", hash);
+
+    m_clear = shader_cache->load_or_compile<1u, Buffer<uint>>("hash_grid_clear", 0u, [](BufferUInt values) noexcept
+    {
+        values.write(dispatch_x(), 0u);
+    });
+    // exclusive prefix sum within each block (Hillis-Steele in shared memory), the block totals go one level up
+    m_scan = shader_cache->load_or_compile<1u, Buffer<uint>, Buffer<uint>, uint>("hash_grid_scan", 0u, [](BufferUInt values, BufferUInt block_sums, UInt n) noexcept
+    {
+        set_block_size(scan_block_size, 1u, 1u);
+        Shared<uint> partial{scan_block_size};
+        auto i = dispatch_x();
+        auto t = thread_x();
+        auto v = def(0u);
+        $if(i < n) { v = values.read(i); };
+        partial[t] = v;
+        sync_block();
+        for (auto offset = 1u; offset < scan_block_size; offset <<= 1u)
+        {
+            auto x = def(0u);
+            $if(t >= offset) { x = partial[t - offset]; };
+            sync_block();
+            partial[t] += x;
+            sync_block();
+        }
+        $if(i < n) { values.write(i, partial[t] - v); };
+        $if(t == scan_block_size - 1u) { block_sums.write(block_x(), partial[t]); };
+    });
+    m_add_block_sums = shader_cache->load_or_compile<1u, Buffer<uint>, Buffer<uint>, uint>("hash_grid_add_block_sums", 0u, [](BufferUInt values, BufferUInt block_sums, UInt n) noexcept
+    {
+        set_block_size(scan_block_size, 1u, 1u);
+        auto i = dispatch_x();
+        $if(i < n) { values.write(i, values.read(i) + block_sums.read(block_x())); };
+    });
+
+    LUISA_INFO("Hash grid: {} cells for up to {} points ({:.2f} MB).",
+               m_table_size,
+               m_capacity,
+               static_cast<double>(size_bytes()) / (1024.0 * 1024.0));
+}
+
+size_t HashGrid::size_bytes() const noexcept
+{
+    auto bytes = m_max_radius.size_bytes() + m_cell_counts.size_bytes() + m_cell_offsets.size_bytes() + m_entries.size_bytes();
+    for (const auto& b : m_block_sums)
+    {
+        bytes += b.size_bytes();
+    }
+    return bytes;
+}
+
+void HashGrid::build(CommandBuffer& command_buffer, const Buffer<float4>& points, uint count) noexcept
+{
+    LUISA_ASSERT(count <= m_capacity, "Hash grid holds at most {} points, got {}.", m_capacity, count);
+    m_max_radius_host = 0u;
+    command_buffer
+        << m_max_radius.copy_from(&m_max_radius_host)
+        << m_clear(m_cell_offsets).dispatch(m_table_size)
+        << m_clear(m_cell_counts).dispatch(m_table_size);
+    if (count == 0u)
+    {
+        return;
+    }
+    command_buffer
+        << m_reduce_radius(points).dispatch(count)
+        << m_count(points).dispatch(count);
+
+    // counts to offsets, up through the levels and back down
+    auto round_up = [](uint n) noexcept { return (n + scan_block_size - 1u) / scan_block_size * scan_block_size; };
+    auto levels   = static_cast<uint>(m_level_sizes.size());
+    for (auto l = 0u; l < levels; l++)
+    {
+        auto& values = l == 0u ? m_cell_offsets : m_block_sums[l - 1u];
+        command_buffer << m_scan(values, m_block_sums[l], m_level_sizes[l]).dispatch(round_up(m_level_sizes[l]));
+    }
+    for (auto l = levels - 1u; l > 0u; l--)
+    {
+        auto& values = l == 1u ? m_cell_offsets : m_block_sums[l - 2u];
+        command_buffer << m_add_block_sums(values, m_block_sums[l - 1u], m_level_sizes[l - 1u]).dispatch(round_up(m_level_sizes[l - 1u]));
+    }
+
+    command_buffer << m_scatter(points).dispatch(count);
+}
+
+Float HashGrid::cell_size() const noexcept
+{
+    return 2.0f * max(as<float>(m_max_radius->read(0u)), 1e-6f);
+}
+
+Int3 HashGrid::cell(Expr<float3> p, Expr<float> cell_size) noexcept
+{
+    return make_int3(floor(p / cell_size));
+}
+
+UInt HashGrid::hash(Expr<int3> cell) const noexcept
+{
+    // Teschner et al. 2003
+    auto c = as<uint3>(cell);
+    return ((c.x * 73856093u) ^ (c.y * 19349663u) ^ (c.z * 83492791u)) & (m_table_size - 1u);
+}
+
+void HashGrid::for_each_overlapped(Expr<float3> p, Expr<float> r, const luisa::function<void(Expr<uint>)>& f) const noexcept
+{
+    auto size = cell_size();
+    auto lo   = cell(p - r, size);
+    auto hi   = cell(p + r, size);
+    // cells outside the range are marked with ~0u, which no bucket uses
+    ArrayVar<uint, max_cells_per_point> hashes;
+    for (auto k = 0u; k < max_cells_per_point; k++)
+    {
+        auto c    = lo + make_int3(static_cast<int>(k & 1u), static_cast<int>((k >> 1u) & 1u), static_cast<int>(k >> 2u));
+        auto h    = hash(c);
+        hashes[k] = ite(all(c <= hi), h, ~0u);
+        // two overlapped cells in the same bucket are entered once, or a lookup would see the point twice
+        auto repeated = def(hashes[k] == ~0u);
+        for (auto j = 0u; j < k; j++)
+        {
+            repeated = repeated | (hashes[j] == h);
+        }
+        $if(!repeated) { f(h); };
+    }
+}
+} // namespace Yutrel
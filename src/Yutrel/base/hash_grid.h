@@ -0,0 +1,87 @@
+#pragma once
+
+#include <luisa/dsl/syntax.h>
+#include <luisa/runtime/buffer.h>
+#include <luisa/runtime/shader.h>
+
+#include "utils/command_buffer.h"
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+class Renderer;
+
+// a hashed uniform grid over points with a search radius each, rebuilt on the device every time the points
+// move: every point is counted into the cells its radius overlaps, the counts are turned into offsets by a
+// parallel prefix sum and the points are scattered into one array sorted by cell, so that a lookup is a
+// single cell whose entries lie next to each other
+class HashGrid
+{
+public:
+    // threads per block of the prefix sum, also the fan-in of each of its levels
+    static constexpr auto scan_block_size = 256u;
+    // the cell is twice the largest radius, so a point overlaps at most two cells along each axis
+    static constexpr auto max_cells_per_point = 8u;
+
+private:
+    const Renderer& m_renderer;
+    uint m_capacity;
+    uint m_table_size;
+
+    // bits of the largest radius of the points, positive floats order like their bits
+    uint m_max_radius_host{0u};
+    Buffer<uint> m_max_radius;
+    // entries per hashed cell, and their offset into the sorted entries
+    Buffer<uint> m_cell_counts;
+    Buffer<uint> m_cell_offsets;
+    // block totals of each level of the prefix sum, the last level is a single block
+    luisa::vector<Buffer<uint>> m_block_sums;
+    luisa::vector<uint> m_level_sizes;
+    // point indices sorted by cell
+    Buffer<uint> m_entries;
+
+    Shader1D<Buffer<uint>> m_clear;
+    Shader1D<Buffer<float4>> m_reduce_radius;
+    Shader1D<Buffer<float4>> m_count;
+    Shader1D<Buffer<float4>> m_scatter;
+    Shader1D<Buffer<uint>, Buffer<uint>, uint> m_scan;
+    Shader1D<Buffer<uint>, Buffer<uint>, uint> m_add_block_sums;
+
+public:
+    HashGrid(const Renderer& renderer, uint capacity) noexcept;
+    ~HashGrid() noexcept = default;
+
+    HashGrid(const HashGrid&)            = delete;
+    HashGrid& operator=(const HashGrid&) = delete;
+
+public:
+    [[nodiscard]] auto capacity() const noexcept { return m_capacity; }
+    [[nodiscard]] auto table_size() const noexcept { return m_table_size; }
+    [[nodiscard]] size_t size_bytes() const noexcept;
+
+    // sorts the first count points, given as (position, radius) with a radius of zero for points to leave out
+    void build(CommandBuffer& command_buffer, const Buffer<float4>& points, uint count) noexcept;
+
+    // calls f with the index of every point whose cell holds p, callers still test the distance to it
+    template <typename F>
+    void for_each(Expr<float3> p, F&& f) const noexcept
+    {
+        auto h     = hash(cell(p, cell_size()));
+        auto begin = m_cell_offsets->read(h);
+        auto end   = begin + m_cell_counts->read(h);
+        $for(i, begin, end)
+        {
+            f(m_entries->read(i));
+        };
+    }
+
+private:
+    [[nodiscard]] Float cell_size() const noexcept;
+    [[nodiscard]] static Int3 cell(Expr<float3> p, Expr<float> cell_size) noexcept;
+    [[nodiscard]] UInt hash(Expr<int3> cell) const noexcept;
+    // calls f once per distinct hashed cell that the sphere of radius r around p overlaps
+    void for_each_overlapped(Expr<float3> p, Expr<float> r, const luisa::function<void(Expr<uint>)>& f) const noexcept;
+};
+} // namespace Yutrel
@@ -1,44 +1,187 @@
 #include "integrator.h"
 
+#include <array>
+#include <typeinfo>
+
+#include <luisa/core/thread_pool.h>
 #include <luisa/luisa-compute.h>
 
 #include "base/camera.h"
-#include "base/camera_controller.h"
 #include "base/film.h"
 #include "base/geometry.h"
 #include "base/interaction.h"
 #include "base/light_sampler.h"
+#include "base/path_guide.h"
 #include "base/renderer.h"
+#include "base/rrs_cache.h"
 #include "base/sampler.h"
+#include "base/spectrum.h"
+#include "integrators/bidirectional_path.h"
+#include "integrators/megakernel_path.h"
+#include "integrators/sppm.h"
+#include "integrators/wavefront_path.h"
+#include "utils/checkpoint.h"
 #include "utils/command_buffer.h"
+#include "utils/exr_writer.h"
 #include "utils/image_io.h"
-#include "utils/progress_bar.h"
-#include "utils/sampling.h"
-#include "utils/spectra.h"
+#include "utils/shader_cache.h"
 
 namespace Yutrel
 {
-luisa::unique_ptr<Integrator> Integrator::create(Renderer& renderer, CommandBuffer& command_buffer) noexcept
+luisa::unique_ptr<Integrator> Integrator::create(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
 {
-    return luisa::make_unique<Integrator>(renderer, command_buffer);
+    if (!renderer.media().empty() && info.type != Type::megakernel_path)
+    {
+        LUISA_WARNING("Only the megakernel path tracer renders participating media, their boundaries block light here.");
+    }
+    switch (info.type)
+    {
+    case Type::megakernel_path:
+        return luisa::make_unique<MegakernelPathTracing>(renderer, command_buffer, info);
+    case Type::wavefront_path:
+        return luisa::make_unique<WavefrontPathTracing>(renderer, command_buffer, info);
+    case Type::bidirectional_path:
+        return luisa::make_unique<BidirectionalPathTracing>(renderer, command_buffer, info);
+    case Type::sppm:
+        return luisa::make_unique<StochasticProgressivePhotonMapping>(renderer, command_buffer, info);
+    default:
+        LUISA_ERROR("Unsupported integrator type {}.", static_cast<uint>(info.type));
+        return nullptr;
+    }
 }
 
-Integrator::Integrator(Renderer& renderer, CommandBuffer& command_buffer) noexcept
+Integrator::Integrator(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
     : m_renderer(renderer),
-      m_sampler(Sampler::create(renderer)),
-      m_light_sampler(LightSampler::create(renderer, command_buffer)) {}
+      m_max_depth(info.max_depth),
+      m_rr_depth(info.rr_depth),
+      m_rr_threshold(info.rr_threshold),
+      m_nee_samples(info.nee_samples),
+      m_adaptive(info.adaptive),
+      m_adaptive_check_interval(std::max(info.adaptive_check_interval, 1u)),
+      m_adaptive_min_spp(info.adaptive_min_spp),
+      m_adaptive_threshold(info.adaptive_threshold),
+      m_output_sample_count(info.adaptive && info.output_sample_count),
+      m_time_budget(std::max(info.time_budget, 0.0f)),
+      m_target_error(std::max(info.target_error, 0.0f)),
+      m_target_error_check_interval(std::max(info.target_error_check_interval, 1u)),
+      m_target_error_min_spp(std::max(info.target_error_min_spp, 2u)),
+      m_checkpoint_interval(std::max(info.checkpoint_interval, 0.0f)),
+      m_resume(info.resume),
+      m_guiding_training_fraction(std::clamp(info.guiding_training_fraction, 0.0f, 1.0f)),
+      m_ears_training_fraction(std::clamp(info.ears_training_fraction, 0.0f, 1.0f)),
+      m_restir(info.restir),
+      m_restir_gi(info.restir_gi),
+      m_report_error(info.report_error),
+      m_reference_path(info.reference_path),
+      m_benchmark_sampler(info.benchmark_sampler),
+      m_sampler(Sampler::create(renderer, command_buffer, info.sampler_info)),
+      m_light_sampler(LightSampler::create(renderer, command_buffer, info.light_sampler_info))
+{
+    if (info.guiding)
+    {
+        m_path_guide = luisa::make_unique<PathGuide>(renderer, info.guiding_grid_resolution, info.guiding_probability);
+    }
+    if (info.ears)
+    {
+        m_rrs_cache = luisa::make_unique<RRSCache>(renderer, info.ears_grid_resolution);
+    }
+    if (m_nee_samples.empty())
+    {
+        m_nee_samples.emplace_back(1u);
+    }
+    luisa::string nee_schedule;
+    for (auto& n : m_nee_samples)
+    {
+        n = std::min(n, max_nee_samples);
+        nee_schedule.append(luisa::format("{}{}", nee_schedule.empty() ? "" : ", ", n));
+    }
+    if (m_nee_samples.size() != 1u || m_nee_samples.front() != 1u)
+    {
+        LUISA_INFO("Next-event estimation takes [{}] light samples per vertex by depth.", nee_schedule);
+    }
+    m_samples_per_dispatch = info.samples_per_dispatch != 0u
+                                 ? info.samples_per_dispatch
+                                 : default_samples_per_dispatch(renderer.device().backend_name());
+    LUISA_INFO("Integrator traces {} samples per thread per dispatch.", m_samples_per_dispatch);
+    if (progressive())
+    {
+        LUISA_INFO("Progressive rendering with time budget {} s and target error {}.", m_time_budget, m_target_error);
+    }
+}
 
 Integrator::~Integrator() noexcept = default;
 
+void Integrator::compile_async(CommandBuffer& command_buffer, const Clock& timeline) noexcept
+{
+    auto camera = m_renderer.camera();
+    auto film   = camera->film();
+
+    // kernels capture the film and sampler buffers, so those are created before any tracing starts
+    film->allocate(track_moments());
+    m_sampler->reset(command_buffer, film->max_pixel_count());
+
+    // the integrator kernels share the sampler's tracing state and stay on one thread
+    m_film_shaders = global_thread_pool().async([film, &timeline]
+    {
+        LUISA_INFO("Startup [{:>9.2f} ms] film shaders started.", timeline.toc());
+        film->compile();
+        LUISA_INFO("Startup [{:>9.2f} ms] film shaders ready.", timeline.toc());
+    });
+    m_integrator_shaders = global_thread_pool().async([this, camera, &timeline]
+    {
+        LUISA_INFO("Startup [{:>9.2f} ms] integrator shaders started.", timeline.toc());
+        compile(camera);
+        LUISA_INFO("Startup [{:>9.2f} ms] integrator shaders ready.", timeline.toc());
+    });
+}
+
+void Integrator::wait_for_shaders() noexcept
+{
+    for (auto& task : {m_film_shaders, m_integrator_shaders})
+    {
+        if (task.valid())
+        {
+            task.wait();
+        }
+    }
+    m_film_shaders       = {};
+    m_integrator_shaders = {};
+}
+
 void Integrator::render(Stream& stream)
 {
+    wait_for_shaders();
+
     CommandBuffer command_buffer{stream};
 
     auto camera      = m_renderer.camera();
     auto resolution  = camera->film()->base()->resolution();
     auto pixel_count = resolution.x * resolution.y;
 
+    if (m_benchmark_sampler)
+    {
+        // the camera dimensions, then a light and a BSDF sample of three dimensions each per vertex
+        m_sampler->benchmark(command_buffer, resolution, Sampler::dimension_path + 6u * m_max_depth);
+    }
     camera->film()->prepare(command_buffer);
+    if (track_moments())
+    {
+        camera->film()->prepare_moments(command_buffer);
+    }
+    if (m_path_guide)
+    {
+        m_path_guide->reset(command_buffer);
+    }
+    if (m_rrs_cache)
+    {
+        m_rrs_cache->reset(command_buffer);
+    }
+    if (camera->film()->base()->tiled())
+    {
+        render_tiles(command_buffer, camera);
+        camera->film()->release();
+        return;
+    }
     {
         render_one_camera(command_buffer, camera);
         if (camera->film()->should_close())
@@ -46,240 +189,488 @@ void Integrator::render(Stream& stream)
             camera->film()->release();
             return;
         }
+        if (m_report_error && camera->film()->base()->denoise())
+        {
+            // the error falls with the square root of the sample count, ignoring the bias the filter adds
+            auto error          = camera->film()->mean_relative_error(command_buffer);
+            auto denoised_error = camera->film()->denoised_relative_error(command_buffer);
+            LUISA_INFO("Denoiser lowers the mean relative error from {} to {}, equal quality without it takes about {:.1f}x the samples.",
+                       error,
+                       denoised_error,
+                       (error * error) / std::max(denoised_error * denoised_error, 1e-12f));
+        }
         luisa::vector<float4> pixels(pixel_count);
         camera->film()->download(command_buffer, pixels.data());
         command_buffer << synchronize();
-        auto output_path = std::filesystem::canonical(std::filesystem::current_path()) / "render.exr";
-        save_image(output_path, reinterpret_cast<const float*>(pixels.data()), resolution);
+        if (!m_reference_path.empty())
+        {
+            report_reference_error(camera, pixels);
+        }
+        auto output_path = output_path_of(camera);
+        if (camera->film()->base()->aovs())
+        {
+            save_aovs(command_buffer, camera, output_path, pixels);
+        }
+        else
+        {
+            save_image(output_path, reinterpret_cast<const float*>(pixels.data()), resolution);
+        }
+        if (m_output_sample_count)
+        {
+            camera->film()->download_sample_count(command_buffer, pixels.data());
+            command_buffer << synchronize();
+            auto sample_count_path = output_path;
+            sample_count_path.replace_filename(output_path.stem().string() + "_sample_count.exr");
+            save_image(sample_count_path, reinterpret_cast<const float*>(pixels.data()), resolution);
+        }
+        // the render finished, a later --resume must not pick up the stale state
+        if (m_checkpoint_interval > 0.0f || m_resume)
+        {
+            std::error_code error;
+            std::filesystem::remove(checkpoint_path_of(camera), error);
+        }
     }
     camera->film()->release();
 }
 
-void Integrator::render_interactive(Stream& stream)
+void Integrator::render_tiles(CommandBuffer& command_buffer, Camera::Instance* camera)
 {
-    CommandBuffer command_buffer{stream};
+    auto film       = camera->film();
+    auto resolution = film->base()->resolution();
+    auto tile_size  = film->base()->tile_size();
+    auto tile_count = (resolution + tile_size - 1u) / tile_size;
 
-    auto camera     = m_renderer.camera();
-    auto resolution = camera->film()->base()->resolution();
+    if (m_checkpoint_interval > 0.0f || m_resume || m_output_sample_count)
+    {
+        LUISA_WARNING("Checkpoints and the sample count output are not available with a tiled film.");
+    }
 
-    camera->film()->prepare(command_buffer);
-    sampler()->reset(command_buffer, resolution.x * resolution.y);
-    command_buffer << synchronize();
+    auto output_path = output_path_of(camera);
+    ExrScanlineWriter writer{output_path, resolution};
 
-    FpsCameraController controller{camera->transform(), camera->base()->up(), FpsCameraController::Config{}};
+    // only one row of tiles is staged on the host before it is streamed to disk
+    luisa::vector<float4> tile_pixels(film->max_pixel_count());
+    luisa::vector<float4> rows(static_cast<size_t>(resolution.x) * tile_size);
+    LUISA_INFO("Rendering {}x{} tiles, {:.2f} MB of host staging.",
+               tile_count.x,
+               tile_count.y,
+               static_cast<double>((tile_pixels.size() + rows.size()) * sizeof(float4)) / (1024.0 * 1024.0));
 
-    Kernel2D render_kernel = [&](UInt frame_index, Float time) noexcept
+    Clock clock;
+    for (auto ty = 0u; ty < tile_count.y; ty++)
     {
-        set_block_size(16u, 16u, 1u);
-        Var pixel_id = dispatch_id().xy();
-        Var L        = Li(camera, frame_index, pixel_id, time);
-        camera->film()->accumulate(pixel_id, L, 1.0f);
+        auto first_row = ty * tile_size;
+        auto row_count = std::min(tile_size, resolution.y - first_row);
+        for (auto tx = 0u; tx < tile_count.x; tx++)
+        {
+            auto origin = make_uint2(tx, ty) * tile_size;
+            auto extent = min(make_uint2(tile_size), resolution - origin);
+            LUISA_INFO("Tile ({}, {}) of {}x{}.", tx, ty, tile_count.x, tile_count.y);
+            film->set_tile(command_buffer, origin, extent);
+            render_one_camera(command_buffer, camera);
+            film->download(command_buffer, tile_pixels.data());
+            command_buffer << synchronize();
+            for (auto y = 0u; y < extent.y; y++)
+            {
+                std::copy_n(tile_pixels.data() + static_cast<size_t>(y) * extent.x,
+                            extent.x,
+                            rows.data() + static_cast<size_t>(y) * resolution.x + origin.x);
+            }
+        }
+        writer.write_rows(first_row, row_count, rows.data());
+    }
+    LUISA_INFO("Tiled rendering finished in {} ms, written to '{}'.", clock.toc(), output_path.string());
+}
+
+void Integrator::save_aovs(CommandBuffer& command_buffer, const Camera::Instance* camera, const std::filesystem::path& path, const luisa::vector<float4>& pixels) noexcept
+{
+    using Aov        = Film::Aov;
+    auto film        = camera->film();
+    auto pixel_count = film->pixel_count();
+
+    // each AOV is unpacked on the device into the film's staging buffer and downloaded in turn
+    constexpr std::array aovs{Aov::albedo, Aov::normal, Aov::depth, Aov::id, Aov::sample_count};
+    std::array<luisa::vector<float4>, aovs.size()> aov_pixels;
+    for (auto i = 0u; i < aovs.size(); i++)
+    {
+        aov_pixels[i].resize(pixel_count);
+        film->download_aov(command_buffer, aovs[i], aov_pixels[i].data());
+    }
+    command_buffer << synchronize();
+
+    std::array<ImageLayer, aovs.size() + 1u> layers{
+        ImageLayer{.name = "", .channels = {"R", "G", "B", "A"}, .pixels = pixels.data()},
+        ImageLayer{.name = "albedo", .channels = {"R", "G", "B"}, .pixels = aov_pixels[0].data(), .fp16 = true},
+        ImageLayer{.name = "N", .channels = {"X", "Y", "Z"}, .pixels = aov_pixels[1].data(), .fp16 = true},
+        ImageLayer{.name = "", .channels = {"Z"}, .pixels = aov_pixels[2].data()},
+        ImageLayer{.name = "id", .channels = {"instance", "primitive"}, .pixels = aov_pixels[3].data(), .is_uint = true},
+        ImageLayer{.name = "", .channels = {"sample_count"}, .pixels = aov_pixels[4].data()},
     };
-    auto render = renderer().device().compile(render_kernel);
+    save_image(path, layers, film->base()->resolution());
+    LUISA_INFO("Wrote the colour with albedo, normal, depth, id and sample count layers to '{}'.", path.string());
+}
 
-    uint global_sample_index = 0u;
+std::filesystem::path Integrator::output_path_of(const Camera::Instance* camera) noexcept
+{
+    // the job's own film, batch jobs share one film instance
+    return std::filesystem::canonical(std::filesystem::current_path()) / camera->base()->film()->output();
+}
 
-    while (true)
+std::filesystem::path Integrator::checkpoint_path_of(const Camera::Instance* camera) noexcept
+{
+    auto path = output_path_of(camera);
+    path.replace_extension(".checkpoint");
+    return path;
+}
+
+uint Integrator::default_samples_per_dispatch(luisa::string_view backend) noexcept
+{
+    // discrete GPUs need enough work per thread to hide the dispatch overhead,
+    // metal and the CPU fallback get fewer to keep the window and progress responsive
+    if (backend == "cuda" || backend == "dx" || backend == "vk")
     {
-        // Process window events & draw current accumulation.
-        camera->film()->show(command_buffer, true);
-        if (camera->film()->should_close())
-        {
-            break;
-        }
+        return 16u;
+    }
+    if (backend == "metal" || backend == "cpu" || backend == "fallback")
+    {
+        return 4u;
+    }
+    return 1u;
+}
 
-        // Update camera from input; reset accumulation if changed.
-        if (controller.update())
+void Integrator::report_reference_error(const Camera::Instance* camera, luisa::span<const float4> pixels) const noexcept
+{
+    auto resolution = camera->film()->base()->resolution();
+    auto reference  = LoadedImage::load(m_reference_path, PixelStorage::FLOAT4);
+    if (!reference || any(reference.size() != resolution))
+    {
+        LUISA_WARNING("Reference '{}' is missing or does not match the {}x{} film, no error reported.",
+                      m_reference_path.string(), resolution.x, resolution.y);
+        return;
+    }
+    // relative MSE, the offset keeps the dark pixels from dominating
+    auto expected = static_cast<const float4*>(reference.pixels());
+    auto sum      = 0.0;
+    for (auto i = 0u; i < pixels.size(); i++)
+    {
+        for (auto c = 0u; c < 3u; c++)
         {
-            auto c2w = controller.camera_to_world();
-            camera->set_transform(command_buffer, c2w);
-            camera->film()->prepare(command_buffer);
-            sampler()->reset(command_buffer, resolution.x * resolution.y);
-            global_sample_index = 0u;
-            command_buffer << synchronize();
+            auto r = static_cast<double>(expected[i][c]);
+            auto d = static_cast<double>(pixels[i][c]) - r;
+            sum += d * d / (r * r + 1e-2);
         }
-
-        command_buffer
-            << render(global_sample_index++, 0.0f).dispatch(resolution)
-            << commit();
     }
-
-    command_buffer << synchronize();
-    camera->film()->release();
+    LUISA_INFO("Relative MSE against '{}': {:.6g} at {} spp.",
+               m_reference_path.filename().string(),
+               sum / (3.0 * static_cast<double>(std::max<size_t>(pixels.size(), 1u))),
+               camera->base()->spp());
 }
 
-void Integrator::render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera)
+void Integrator::report_throughput(luisa::string_view name, double milliseconds, uint2 resolution, uint spp) noexcept
 {
-    auto spp        = camera->base()->spp();
-    auto resolution = camera->film()->base()->resolution();
+    auto samples = static_cast<double>(resolution.x) * static_cast<double>(resolution.y) * static_cast<double>(spp);
+    LUISA_INFO("{} finished in {} ms ({:.2f} M samples/s).",
+               name,
+               milliseconds,
+               samples / std::max(milliseconds, 1e-3) * 1e-3);
+}
 
-    sampler()->reset(command_buffer, resolution.x * resolution.y);
-    command_buffer << synchronize();
+Integrator::RenderProgress Integrator::begin_progress(CommandBuffer& command_buffer, Camera::Instance* camera) noexcept
+{
+    RenderProgress progress{.shutter_samples = camera->base()->shutter_samples()};
+    progress.remaining_spp.reserve(progress.shutter_samples.size());
+    for (const auto& s : progress.shutter_samples)
+    {
+        progress.remaining_spp.emplace_back(s.spp);
+    }
+    if (!m_resume || camera->film()->base()->tiled())
+    {
+        return progress;
+    }
 
-    LUISA_INFO(
-        "Rendering of resolution {}x{} at {}spp.",
-        resolution.x,
-        resolution.y,
-        spp);
+    auto resolution      = camera->film()->base()->resolution();
+    auto checkpoint_path = checkpoint_path_of(camera);
+    auto checkpoint      = load_checkpoint(checkpoint_path);
+    if (!checkpoint)
+    {
+        LUISA_WARNING("Starting from scratch as no checkpoint could be loaded.");
+        return progress;
+    }
+    if (checkpoint->fingerprint != fingerprint(camera) ||
+        any(checkpoint->resolution != resolution) ||
+        checkpoint->image.size() != resolution.x * resolution.y) [[unlikely]]
+    {
+        LUISA_WARNING("Checkpoint '{}' was written for a different scene, starting from scratch.", checkpoint_path.string());
+        return progress;
+    }
 
-    Kernel2D render_kernel = [&](UInt frame_index, Float time, Float shutter_weight) noexcept
+    progress.shutter_samples.clear();
+    progress.remaining_spp.clear();
+    for (const auto& b : checkpoint->shutter_buckets)
     {
-        set_block_size(16u, 16u, 1u);
-        Var pixel_id = dispatch_id().xy();
-        Var L        = Li(camera, frame_index, pixel_id, time);
-        camera->film()->accumulate(pixel_id, L * shutter_weight, 1.0f);
-    };
+        progress.shutter_samples.emplace_back(Camera::ShutterSample{b.time, b.weight, b.spp});
+        progress.remaining_spp.emplace_back(b.remaining_spp);
+    }
+    progress.global_sample_index = checkpoint->global_sample_index;
 
-    LUISA_INFO("Start compiling Integrator shader");
-    Clock clock_compile;
-    auto render = renderer().device().compile(render_kernel);
-    LUISA_INFO("Integrator shader compile in {} ms.", clock_compile.toc());
+    auto has_moments = track_moments() && checkpoint->moments.size() == checkpoint->image.size();
+    camera->film()->upload_accumulation(command_buffer, checkpoint->image.data(), has_moments ? checkpoint->moments.data() : nullptr);
     command_buffer << synchronize();
+    LUISA_INFO("Resumed from checkpoint '{}' at sample {}.", checkpoint_path.string(), progress.global_sample_index);
+    return progress;
+}
 
-    auto shutter_samples = camera->base()->shutter_samples();
-    LUISA_INFO("Rendering started.");
-    Clock clock_render;
-    ProgressBar progress_bar;
-    progress_bar.update(0.0);
-    auto dispatch_count      = 0u;
-    auto global_sample_index = 0u;
-    for (const auto& s : shutter_samples)
+void Integrator::write_checkpoint(CommandBuffer& command_buffer, const Camera::Instance* camera, const RenderProgress& progress) const noexcept
+{
+    if (camera->film()->base()->tiled())
     {
-        for (auto i = 0u; i < s.spp; i++)
-        {
-            dispatch_count++;
-            command_buffer << render(global_sample_index++, s.time, s.weight).dispatch(resolution);
-            const auto dispatches_per_commit = 4u;
-            if (camera->film()->show(command_buffer) || dispatch_count >= dispatches_per_commit) [[unlikely]]
-            {
-                dispatch_count = 0u;
-                auto p         = global_sample_index / static_cast<double>(spp);
-                command_buffer << [&progress_bar, p]
-                {
-                    progress_bar.update(p);
-                };
-            }
-            if (camera->film()->should_close()) [[unlikely]]
-            {
-                command_buffer << synchronize();
-                progress_bar.done();
-                return;
-            }
-        }
+        return;
+    }
+    Clock clock;
+    auto resolution  = camera->film()->base()->resolution();
+    auto pixel_count = camera->film()->pixel_count();
+
+    Checkpoint checkpoint{
+        .fingerprint         = fingerprint(camera),
+        .resolution          = resolution,
+        .global_sample_index = progress.global_sample_index,
+    };
+    for (auto i = 0u; i < progress.shutter_samples.size(); i++)
+    {
+        const auto& s = progress.shutter_samples[i];
+        checkpoint.shutter_buckets.emplace_back(Checkpoint::ShutterBucket{s.time, s.weight, s.spp, progress.remaining_spp[i]});
     }
+    checkpoint.image.resize(pixel_count);
+    if (track_moments())
+    {
+        checkpoint.moments.resize(pixel_count);
+    }
+    camera->film()->download_accumulation(command_buffer, checkpoint.image.data(), checkpoint.moments.empty() ? nullptr : checkpoint.moments.data());
     command_buffer << synchronize();
-    progress_bar.done();
-    LUISA_INFO("Rendering finished in {} ms.", clock_render.toc());
+    if (save_checkpoint(checkpoint_path_of(camera), checkpoint))
+    {
+        LUISA_INFO("Checkpoint at sample {} written in {} ms.", progress.global_sample_index, clock.toc());
+    }
 }
 
-Float3 Integrator::Li(const Camera::Instance* camera, Expr<uint> frame_index, Expr<uint2> pixel_id, Expr<float> time) const noexcept
+uint64_t Integrator::fingerprint(const Camera::Instance* camera) const noexcept
 {
-    sampler()->start(pixel_id, frame_index);
+    // everything that changes the meaning of the accumulated samples
+    auto resolution = camera->film()->base()->resolution();
+    std::array params{
+        resolution.x,
+        resolution.y,
+        camera->base()->spp(),
+        luisa::bit_cast<uint>(camera->base()->shutter_span().x),
+        luisa::bit_cast<uint>(camera->base()->shutter_span().y),
+        m_max_depth,
+        m_rr_depth,
+        luisa::bit_cast<uint>(m_rr_threshold),
+        m_path_guide ? m_path_guide->grid_resolution() : 0u,
+        m_path_guide ? luisa::bit_cast<uint>(m_path_guide->probability()) : 0u,
+        m_path_guide ? luisa::bit_cast<uint>(m_guiding_training_fraction) : 0u,
+        m_rrs_cache ? m_rrs_cache->grid_resolution() : 0u,
+        m_rrs_cache ? luisa::bit_cast<uint>(m_ears_training_fraction) : 0u,
+    };
+    // the integrator and the samplers decide which samples the accumulated ones continue
+    luisa::string samplers;
+    samplers.append(typeid(*this).name()).append(";");
+    samplers.append(typeid(*m_sampler).name()).append(":").append(m_sampler->constants()).append(";");
+    samplers.append(typeid(*m_light_sampler).name()).append(";");
+    for (auto n : m_nee_samples)
+    {
+        samplers.append(luisa::format("{},", n));
+    }
+    auto transform = camera->base()->init_transform();
+    auto hash      = luisa::hash64(&transform, sizeof(transform), ShaderCache::hash(samplers, m_renderer.geometry()->fingerprint()));
+    return luisa::hash64(params.data(), params.size() * sizeof(uint), hash);
+}
 
-    auto u_filter = sampler()->generate_2d();
-    auto u_lens   = camera->base()->requires_lens_sampling() ? sampler()->generate_2d() : make_float2(0.5f);
+Float3 Integrator::preview_radiance(const Camera::Instance* camera, Expr<uint> frame_index, Expr<uint2> pixel_id, Expr<float> time) const noexcept
+{
+    m_sampler->start(pixel_id, frame_index);
 
-    auto [camera_ray, _, camera_weight] = camera->generate_ray(pixel_id, time, u_filter, u_lens);
+    auto u_filter                       = m_sampler->generate_pixel_2d();
+    auto [camera_ray, _, camera_weight] = camera->generate_ray(pixel_id, time, u_filter, make_float2(0.5f));
 
-    auto spectrum = renderer().spectrum();
-    auto swl      = spectrum->sample(spectrum->base()->is_fixed() ? 0.0f : sampler()->generate_1d());
-    SampledSpectrum Li{swl.dimension(), 0.0f};
-    SampledSpectrum beta{swl.dimension(), camera_weight};
+    auto spectrum = m_renderer.spectrum();
+    auto swl      = spectrum->sample(spectrum->base()->is_fixed() ? 0.0f : m_sampler->generate_wavelength());
+    SampledSpectrum L{swl.dimension(), 0.0f};
 
-    auto ray      = camera_ray;
-    auto pdf_bsdf = def(1e16f);
-    $for(depth, max_depth())
+    auto it = m_renderer.geometry()->intersect(camera_ray);
+    $if(it->valid())
     {
-        // trace
-        auto wo = -ray->direction();
-
-        luisa::shared_ptr<Interaction> it = renderer().geometry()->intersect(ray);
-
-        // miss
-        $if(!it->valid())
+        if (!m_renderer.lights().empty())
         {
-            // no environment light for now
-            $break;
-        };
-
-        // hit light
-        $if(!renderer().lights().empty())
-        {
-            $outline
+            $if(it->shape.has_light())
             {
-                $if(it->shape.has_light())
-                {
-                    auto eval = light_sampler()->evaluate_hit(*it, ray->origin(), swl, time);
-                    Li += beta * eval.L * balance_heuristic(pdf_bsdf, eval.pdf);
-                };
+                L += m_light_sampler->evaluate_hit(*it, camera_ray->origin(), swl, time).L;
             };
-        };
-
-        // no surface
-        $if(!it->shape.has_surface()) { $break; };
-
-        // sample light
-        auto u_light_selection = sampler()->generate_1d();
-        auto u_light_surface   = sampler()->generate_2d();
-        auto light_sample      = LightSampler::Sample::zero(swl.dimension());
-        $outline
+        }
+        $if(it->shape.has_surface())
         {
-            light_sample = light_sampler()->sample(*it, u_light_selection, u_light_surface, swl, time);
+            // the light sits at the eye, so N·L is the cosine towards the camera
+            auto n_dot_l = abs(dot(it->shading.n(), camera_ray->direction()));
+            m_renderer.surfaces().dispatch(it->shape.surface_tag(), [&](auto surface) noexcept
+            {
+                L += surface->albedo(*it, swl, time) * n_dot_l;
+            });
         };
+    };
+    return spectrum->srgb(swl, L * camera_weight);
+}
 
-        // cast shadow ray
-        auto occluded = renderer().geometry()->intersect_any(light_sample.shadow_ray);
+Shader2D<uint, float> Integrator::compile_preview(const Camera::Instance* camera) noexcept
+{
+    auto film = camera->film();
 
-        auto u_lobe = sampler()->generate_1d();
-        auto u_bsdf = sampler()->generate_2d();
+    Kernel2D preview_kernel = [&](UInt frame_index, Float time) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        Var pixel_id = dispatch_id().xy();
+        Var L        = preview_radiance(camera, frame_index, pixel_id, time);
+        film->accumulate_exclusive(pixel_id, film->sanitize(L, 1.0f), ite(film->is_valid(L), 1.0f, 0.0f));
+    };
+    Clock clock;
+    auto preview = m_renderer.shader_cache()->compile(preview_kernel, "preview", feature_signature(camera));
+    LUISA_INFO("Preview shader ready in {} ms.", clock.toc());
+    return preview;
+}
 
-        auto u_rr = def(0.0f);
-        $if(depth + 1u >= rr_depth())
+void Integrator::record_features(const Camera::Instance* camera, Expr<uint2> pixel_id, const Interaction& it, Expr<float3> origin,
+                                 const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
+    auto film = camera->film();
+    if (!film->base()->features())
+    {
+        return;
+    }
+    auto albedo       = def(make_float3(0.0f));
+    auto normal       = def(make_float3(0.0f));
+    auto distance     = def(0.0f);
+    auto instance_id  = def(~0u);
+    auto primitive_id = def(~0u);
+    $if(it.valid() & it.shape.has_surface())
+    {
+        auto n       = it.shading.n();
+        normal       = ite(dot(n, origin - it.p_g) < 0.0f, -n, n);
+        distance     = length(it.p_g - origin);
+        instance_id  = it.inst_id;
+        primitive_id = it.prim_id;
+        m_renderer.surfaces().dispatch(it.shape.surface_tag(), [&](auto surface) noexcept
         {
-            u_rr = sampler()->generate_1d();
-        };
+            albedo = m_renderer.spectrum()->srgb(swl, surface->albedo(it, swl, time));
+        });
+    };
+    film->accumulate_features(pixel_id, albedo, normal, distance, instance_id, primitive_id);
+}
 
-        $outline
+Medium::Sample Integrator::sample_medium(const Medium::Stack& media, const Var<Ray>& ray, Expr<float> t_max, Expr<uint> seed,
+                                         const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
+    auto flight = Medium::Sample::zero(swl.dimension());
+    $if(!media.empty())
+    {
+        m_renderer.media().dispatch(media.top(), [&](auto medium) noexcept
         {
-            PolymorphicCall<Surface::Closure> call;
-            renderer().surfaces().dispatch(it->shape.surface_tag(), [&](auto surface) noexcept
-            {
-                surface->closure(call, *it, swl, time);
-            });
-            call.execute([&](const Surface::Closure* closure) noexcept
-            {
-                // direct lighting
-                $if(light_sample.eval.pdf > 0.0f & !occluded)
-                {
-                    auto wi   = light_sample.shadow_ray->direction();
-                    auto eval = closure->evaluate(wo, wi);
-                    auto w    = balance_heuristic(light_sample.eval.pdf, eval.pdf) / light_sample.eval.pdf;
-                    Li += w * beta * eval.f * light_sample.eval.L;
-                };
-
-                // sample surface
-                auto surface_sample = closure->sample(wo, u_lobe, u_bsdf);
-                ray                 = it->spawn_ray(surface_sample.wi);
-                pdf_bsdf            = surface_sample.eval.pdf;
-                auto w              = ite(surface_sample.eval.pdf > 0.0f, 1.0f / surface_sample.eval.pdf, 0.0f);
-                beta *= w * surface_sample.eval.f;
-            });
-        };
+            auto closure = medium->closure(swl, time);
+            flight       = closure->sample(ray->origin(), ray->direction(), t_max, seed);
+        });
+    };
+    return flight;
+}
 
-        auto q = max(beta.max(), 0.05f);
-        $if(depth + 1u >= rr_depth())
+SampledSpectrum Integrator::transmittance(Medium::Stack media, Var<Ray> ray, Expr<float> u, const SampledWavelengths& swl, Expr<float> time,
+                                          UInt& collisions) const noexcept
+{
+    SampledSpectrum Tr{swl.dimension(), 1.0f};
+    $outline
+    {
+        auto segment = def(0u);
+        $loop
         {
-            $if(q < rr_threshold() & u_rr >= q)
+            auto it    = m_renderer.geometry()->intersect(ray);
+            auto t_end = ite(it->valid(), distance(ray->origin(), it->p_g), ray->t_max());
+            $if(!media.empty())
             {
+                m_renderer.media().dispatch(media.top(), [&](auto medium) noexcept
+                {
+                    auto closure = medium->closure(swl, time);
+                    Tr *= closure->transmittance(ray->origin(), ray->direction(), t_end, Medium::tracking_seed(u, segment), collisions);
+                });
+            };
+            $if(!it->valid() | Tr.is_zero()) { $break; };
+            $if(!it->shape.has_medium() | it->shape.has_surface())
+            {
+                Tr = 0.0f;
                 $break;
             };
-            beta *= ite(q < rr_threshold(), 1.0f / q, 1.0f);
+            media.cross(it->front_face, it->shape.medium_tag());
+            ray = it->spawn_ray(ray->direction(), ray->t_max() - t_end);
+            segment += 1u;
         };
     };
+    return Tr;
+}
 
-    Float3 color = spectrum->srgb(swl, Li);
+UInt Integrator::nee_samples(Expr<uint> depth) const noexcept
+{
+    // the table is small and fixed at trace time, so it is unrolled into a select chain
+    auto n = def(m_nee_samples.back());
+    for (auto i = static_cast<uint>(m_nee_samples.size()) - 1u; i-- > 0u;)
+    {
+        n = ite(depth == i, m_nee_samples[i], n);
+    }
+    return n;
+}
+
+uint64_t Integrator::feature_signature(const Camera::Instance* camera) const noexcept
+{
+    luisa::string features;
+    for (auto tag = 0u; tag < m_renderer.surfaces().size(); tag++)
+    {
+        features.append(typeid(*m_renderer.surfaces().impl(tag)).name()).append(";");
+    }
+    for (auto tag = 0u; tag < m_renderer.lights().size(); tag++)
+    {
+        features.append(typeid(*m_renderer.lights().impl(tag)).name()).append(";");
+    }
+    for (auto tag = 0u; tag < m_renderer.media().size(); tag++)
+    {
+        auto medium = m_renderer.media().impl(tag);
+        features.append(typeid(*medium).name()).append(":").append(medium->constants()).append(";");
+    }
+    features.append(typeid(*m_renderer.spectrum()).name()).append(";");
+    features.append(typeid(*m_sampler).name()).append(":").append(m_sampler->constants()).append(";");
+    features.append(typeid(*m_light_sampler).name()).append(";");
+    features.append(typeid(*camera).name()).append(";");
+    features.append(typeid(*camera->filter()).name()).append(";");
+    for (auto n : m_nee_samples)
+    {
+        features.append(luisa::format("{},", n));
+    }
+    features.append(";");
 
-    return color;
-};
+    auto resolution = camera->film()->base()->resolution();
+    std::array params{
+        m_renderer.spectrum()->base()->dimension(),
+        m_max_depth,
+        m_rr_depth,
+        luisa::bit_cast<uint>(m_rr_threshold),
+        luisa::bit_cast<uint>(camera->base()->filter()->radius()),
+        m_path_guide ? m_path_guide->grid_resolution() : 0u,
+        m_path_guide ? luisa::bit_cast<uint>(m_path_guide->probability()) : 0u,
+        m_rrs_cache ? m_rrs_cache->grid_resolution() : 0u,
+        static_cast<uint>(track_moments()),
+        static_cast<uint>(m_restir),
+        static_cast<uint>(m_restir_gi),
+        static_cast<uint>(m_adaptive),
+        resolution.x,
+        resolution.y,
+        camera->film()->base()->tile_size(),
+        static_cast<uint>(camera->film()->base()->features()),
+    };
+    return luisa::hash64(params.data(), params.size() * sizeof(uint), ShaderCache::hash(features));
+}
 
-} // namespace Yutrel
\ No newline at end of file
+} // namespace Yutrel
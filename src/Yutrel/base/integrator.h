@@ -1,10 +1,18 @@
 #pragma once
 
+#include <filesystem>
+#include <future>
+
+#include <luisa/core/clock.h>
 #include <luisa/core/stl/memory.h>
 #include <luisa/dsl/syntax.h>
+#include <luisa/runtime/shader.h>
 #include <luisa/runtime/stream.h>
 
 #include "base/camera.h"
+#include "base/light_sampler.h"
+#include "base/medium.h"
+#include "base/sampler.h"
 #include "utils/command_buffer.h"
 
 namespace Yutrel
@@ -13,13 +21,96 @@ using namespace luisa;
 using namespace luisa::compute;
 
 class Renderer;
-class Sampler;
-class LightSampler;
+class PathGuide;
+class RRSCache;
 
 class Integrator
 {
 public:
-    [[nodiscard]] static luisa::unique_ptr<Integrator> create(Renderer& renderer, CommandBuffer& command_buffer) noexcept;
+    enum class Type
+    {
+        megakernel_path,
+        wavefront_path,
+        bidirectional_path,
+        sppm,
+    };
+
+    struct CreateInfo
+    {
+        Type type{Type::megakernel_path};
+
+        uint max_depth{10u};
+        uint rr_depth{0u};
+        float rr_threshold{0.05f};
+
+        Sampler::CreateInfo sampler_info{};
+        // times sample generation over the film before rendering
+        bool benchmark_sampler{false};
+        LightSampler::CreateInfo light_sampler_info{};
+        // light samples (and shadow rays) taken at the vertex of each depth, combined under one multi-sample MIS
+        // weight with the BSDF sample, the last entry also applies to deeper vertices
+        luisa::vector<uint> nee_samples{1u};
+
+        // samples traced by one thread per dispatch, 0 picks a default for the backend
+        uint samples_per_dispatch{0u};
+
+        // adaptive sampling: pixels whose relative error drops below the threshold stop receiving samples
+        bool adaptive{false};
+        uint adaptive_check_interval{8u};
+        uint adaptive_min_spp{64u};
+        float adaptive_threshold{0.01f};
+        bool output_sample_count{false};
+
+        // progressive mode: keep dispatching passes until the wall-clock budget (seconds)
+        // or the mean relative error is reached, the camera spp stays an upper bound, 0 disables
+        float time_budget{0.0f};
+        float target_error{0.0f};
+        // the mean relative error is estimated every target_error_check_interval passes once every pixel has
+        // target_error_min_spp samples, at least two so that the variance is defined
+        uint target_error_check_interval{8u};
+        uint target_error_min_spp{2u};
+
+        // the render state is written next to each job's output image every checkpoint_interval seconds
+        // (0 disables), resume continues from that file when it matches the scene
+        float checkpoint_interval{0.0f};
+        bool resume{false};
+
+        // path guiding: directional histograms on a grid over the scene are learned in training iterations
+        // of doubling length from guiding_training_fraction of the spp, then mixed with BSDF sampling under MIS
+        bool guiding{false};
+        uint guiding_grid_resolution{16u};
+        float guiding_training_fraction{0.2f};
+        float guiding_probability{0.5f};
+
+        // efficiency-aware Russian roulette and splitting: per-cell continuation factors are learned on a grid
+        // over the scene from a pilot pass of ears_training_fraction of the spp, replacing throughput roulette
+        bool ears{false};
+        uint ears_grid_resolution{16u};
+        float ears_training_fraction{0.05f};
+
+        // interactive mode: direct lighting at the primary hit is resampled from per-pixel reservoirs
+        // reused across frames and neighbouring pixels, the path tracer only adds the indirect part
+        bool restir{false};
+        // interactive mode: indirect lighting at the primary hit is resampled from reservoirs over the
+        // secondary vertices of the paths
+        bool restir_gi{false};
+
+        // stochastic progressive photon mapping: photons traced per iteration (0 matches the pixel count), the
+        // initial gather radius (0 derives it from the scene bounds) and the fraction of new photons kept each iteration
+        uint photons_per_iteration{0u};
+        float photon_radius{0.0f};
+        float photon_alpha{2.0f / 3.0f};
+
+        // logs the mean relative error of the result, for equal-time comparisons between configurations
+        bool report_error{false};
+        // an image of the converged result, the relative MSE of each render against it is logged when given
+        std::filesystem::path reference_path;
+    };
+
+    [[nodiscard]] static luisa::unique_ptr<Integrator> create(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept;
+
+    // light samples kept per vertex, they are all traced before the vertex is shaded
+    static constexpr auto max_nee_samples = 8u;
 
 private:
     const Renderer& m_renderer;
@@ -27,13 +118,43 @@ private:
     uint m_max_depth{10u};
     uint m_rr_depth{0u};
     float m_rr_threshold{0.05f};
+    luisa::vector<uint> m_nee_samples;
+    uint m_samples_per_dispatch{1u};
+
+    bool m_adaptive{false};
+    uint m_adaptive_check_interval{8u};
+    uint m_adaptive_min_spp{64u};
+    float m_adaptive_threshold{0.01f};
+    bool m_output_sample_count{false};
+
+    float m_time_budget{0.0f};
+    float m_target_error{0.0f};
+    uint m_target_error_check_interval{8u};
+    uint m_target_error_min_spp{2u};
+
+    float m_checkpoint_interval{0.0f};
+    bool m_resume{false};
+
+    float m_guiding_training_fraction{0.2f};
+    float m_ears_training_fraction{0.05f};
+    bool m_restir{false};
+    bool m_restir_gi{false};
+    bool m_report_error{false};
+    std::filesystem::path m_reference_path;
+    bool m_benchmark_sampler{false};
 
     luisa::unique_ptr<Sampler> m_sampler;
     luisa::unique_ptr<LightSampler> m_light_sampler;
+    luisa::unique_ptr<PathGuide> m_path_guide;
+    luisa::unique_ptr<RRSCache> m_rrs_cache;
+
+    // shaders being built on worker threads, joined by wait_for_shaders()
+    std::shared_future<void> m_film_shaders;
+    std::shared_future<void> m_integrator_shaders;
 
 public:
-    explicit Integrator(Renderer& renderer, CommandBuffer& command_buffer) noexcept;
-    ~Integrator() noexcept;
+    explicit Integrator(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept;
+    virtual ~Integrator() noexcept;
 
     Integrator() noexcept                    = delete;
     Integrator(const Integrator&)            = delete;
@@ -46,14 +167,95 @@ public:
     [[nodiscard]] auto max_depth() const noexcept { return m_max_depth; }
     [[nodiscard]] auto rr_depth() const noexcept { return m_rr_depth; }
     [[nodiscard]] auto rr_threshold() const noexcept { return m_rr_threshold; }
+    [[nodiscard]] const auto& nee_samples() const noexcept { return m_nee_samples; }
+    // light samples at a vertex of this depth
+    [[nodiscard]] UInt nee_samples(Expr<uint> depth) const noexcept;
+    [[nodiscard]] auto samples_per_dispatch() const noexcept { return m_samples_per_dispatch; }
+    [[nodiscard]] auto adaptive() const noexcept { return m_adaptive; }
+    [[nodiscard]] auto adaptive_check_interval() const noexcept { return m_adaptive_check_interval; }
+    [[nodiscard]] auto adaptive_min_spp() const noexcept { return m_adaptive_min_spp; }
+    [[nodiscard]] auto adaptive_threshold() const noexcept { return m_adaptive_threshold; }
+    [[nodiscard]] auto output_sample_count() const noexcept { return m_output_sample_count; }
+    [[nodiscard]] auto time_budget() const noexcept { return m_time_budget; }
+    [[nodiscard]] auto target_error() const noexcept { return m_target_error; }
+    // whether the pass just finished, with spp samples in every pixel, should estimate the error against the target
+    [[nodiscard]] auto check_target_error(uint pass, uint spp) const noexcept
+    {
+        return m_target_error > 0.0f && pass % m_target_error_check_interval == 0u && spp >= m_target_error_min_spp;
+    }
+    [[nodiscard]] auto progressive() const noexcept { return m_time_budget > 0.0f || m_target_error > 0.0f; }
+    // the film only tracks per-pixel moments when something consumes them
+    [[nodiscard]] auto track_moments() const noexcept { return m_adaptive || m_target_error > 0.0f || m_report_error; }
+    [[nodiscard]] auto checkpoint_interval() const noexcept { return m_checkpoint_interval; }
     [[nodiscard]] auto sampler() const noexcept { return m_sampler.get(); }
     [[nodiscard]] auto light_sampler() const noexcept { return m_light_sampler.get(); }
+    // null unless guiding is enabled
+    [[nodiscard]] auto path_guide() const noexcept { return m_path_guide.get(); }
+    [[nodiscard]] auto guiding_training_fraction() const noexcept { return m_guiding_training_fraction; }
+    // null unless learned roulette and splitting are enabled
+    [[nodiscard]] auto rrs_cache() const noexcept { return m_rrs_cache.get(); }
+    [[nodiscard]] auto ears_training_fraction() const noexcept { return m_ears_training_fraction; }
+    [[nodiscard]] auto restir() const noexcept { return m_restir; }
+    [[nodiscard]] auto restir_gi() const noexcept { return m_restir_gi; }
+    [[nodiscard]] auto report_error() const noexcept { return m_report_error; }
+
+    // creates the film buffers, then builds the film and integrator shaders on worker threads so that
+    // compilation overlaps with geometry upload, timeline is the clock the startup events are logged against
+    void compile_async(CommandBuffer& command_buffer, const Clock& timeline) noexcept;
+    void wait_for_shaders() noexcept;
 
     void render(Stream& stream);
-    void render_interactive(Stream& stream);
+    virtual void render_interactive(Stream& stream) = 0;
+
+protected:
+    // shutter buckets with their remaining samples, shared between the integrators and checkpoints
+    struct RenderProgress
+    {
+        luisa::vector<Camera::ShutterSample> shutter_samples;
+        luisa::vector<uint> remaining_spp;
+        uint global_sample_index{0u};
+    };
+
+    virtual void render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera) = 0;
+    // traces and compiles every shader the render of this camera dispatches, records no commands
+    virtual void compile(const Camera::Instance* camera) noexcept = 0;
+
+    [[nodiscard]] static uint default_samples_per_dispatch(luisa::string_view backend) noexcept;
+    [[nodiscard]] static std::filesystem::path output_path_of(const Camera::Instance* camera) noexcept;
+    // derived from the output image so that batch jobs never resume from each other's state
+    [[nodiscard]] static std::filesystem::path checkpoint_path_of(const Camera::Instance* camera) noexcept;
+    static void report_throughput(luisa::string_view name, double milliseconds, uint2 resolution, uint spp) noexcept;
+    // logs the relative MSE of the final pixels against the reference image
+    void report_reference_error(const Camera::Instance* camera, luisa::span<const float4> pixels) const noexcept;
+
+    // starts from a fresh shutter schedule, or restores film and progress from the checkpoint when resuming
+    [[nodiscard]] RenderProgress begin_progress(CommandBuffer& command_buffer, Camera::Instance* camera) noexcept;
+    void write_checkpoint(CommandBuffer& command_buffer, const Camera::Instance* camera, const RenderProgress& progress) const noexcept;
+    [[nodiscard]] uint64_t fingerprint(const Camera::Instance* camera) const noexcept;
+    // everything the traced integrator kernels are specialized for, used to name cached shaders
+    [[nodiscard]] uint64_t feature_signature(const Camera::Instance* camera) const noexcept;
+
+    // albedo times N·L under a headlight at the camera, shown while the full shaders compile in interactive mode
+    [[nodiscard]] Float3 preview_radiance(const Camera::Instance* camera, Expr<uint> frame_index, Expr<uint2> pixel_id, Expr<float> time) const noexcept;
+    [[nodiscard]] Shader2D<uint, float> compile_preview(const Camera::Instance* camera) noexcept;
+    // albedo, camera-facing shading normal, distance and ids of the primary hit for the film denoiser
+    // and AOVs, does nothing unless the film records features
+    void record_features(const Camera::Instance* camera, Expr<uint2> pixel_id, const Interaction& it, Expr<float3> origin,
+                         const SampledWavelengths& swl, Expr<float> time) const noexcept;
+    // free flight of the ray through the innermost medium of the stack up to t_max, seed as given by
+    // Medium::tracking_seed for the segment
+    [[nodiscard]] Medium::Sample sample_medium(const Medium::Stack& media, const Var<Ray>& ray, Expr<float> t_max, Expr<uint> seed,
+                                               const SampledWavelengths& swl, Expr<float> time) const noexcept;
+    // transmittance of a shadow ray that starts inside the media of the stack, it crosses the boundaries of
+    // media and is blocked by any other shape, collisions counts the density lookups along the way. u is
+    // the one sampler dimension of the shadow ray, callers draw it whether or not the ray is traced
+    [[nodiscard]] SampledSpectrum transmittance(Medium::Stack media, Var<Ray> ray, Expr<float> u, const SampledWavelengths& swl, Expr<float> time,
+                                                UInt& collisions) const noexcept;
 
 private:
-    void render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera);
-    Float3 Li(const Camera::Instance* camera, Expr<uint> frame_index, Expr<uint2> pixel_id, Expr<float> time) const noexcept;
+    // renders the film tile by tile and streams finished rows of tiles to disk
+    void render_tiles(CommandBuffer& command_buffer, Camera::Instance* camera);
+    // writes the colour together with the film AOVs as one multi-layer EXR
+    static void save_aovs(CommandBuffer& command_buffer, const Camera::Instance* camera, const std::filesystem::path& path, const luisa::vector<float4>& pixels) noexcept;
 };
-} // namespace Yutrel
\ No newline at end of file
+} // namespace Yutrel
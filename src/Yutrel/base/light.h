@@ -114,6 +114,11 @@ public:
 
     [[nodiscard]] auto& renderer() const noexcept { return m_renderer; }
     [[nodiscard]] virtual luisa::unique_ptr<Closure> closure(const SampledWavelengths& swl, Expr<float> time) const noexcept = 0;
+
+    // host-side estimates used to weigh lights against each other when building the light BVH:
+    // luminance of the emitted radiance (1 when it is only known on the device) and whether both faces emit
+    [[nodiscard]] virtual float radiance_estimate() const noexcept { return 1.0f; }
+    [[nodiscard]] virtual bool two_sided() const noexcept { return false; }
 };
 
 class Light::Closure
@@ -4,24 +4,47 @@
 #include "base/interaction.h"
 #include "base/light.h"
 #include "base/renderer.h"
+#include "light_samplers/bvh.h"
+#include "light_samplers/uniform.h"
 #include "utils/sampling.h"
 
 namespace Yutrel
 {
-luisa::unique_ptr<LightSampler> LightSampler::create(Renderer& renderer, CommandBuffer& command_buffer) noexcept
+luisa::unique_ptr<LightSampler> LightSampler::create(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
 {
-    return luisa::make_unique<LightSampler>(renderer, command_buffer);
+    switch (info.type)
+    {
+    case Type::uniform:
+        return luisa::make_unique<UniformLightSampler>(renderer, command_buffer);
+    case Type::bvh:
+        return luisa::make_unique<BVHLightSampler>(renderer, command_buffer);
+    default:
+        LUISA_ERROR("Unsupported light sampler type {}.", static_cast<uint>(info.type));
+        return nullptr;
+    }
 }
 
 LightSampler::LightSampler(Renderer& renderer, CommandBuffer& command_buffer) noexcept
     : m_renderer(renderer)
 {
-    if (!renderer.lights().empty())
+    // the instances are known once the geometry is prepared, before any mesh is uploaded
+    auto light_instances = renderer.geometry()->light_instances();
+    m_light_count        = static_cast<uint>(light_instances.size());
+    if (m_light_count != 0u)
     {
-        auto [view, buffer_id] = renderer.bindless_arena_buffer<Light::Handle>(renderer.lights().size());
+        auto [view, buffer_id] = renderer.bindless_arena_buffer<Light::Handle>(m_light_count);
         m_light_buffer_id      = buffer_id;
+
+        m_light_indices.resize(renderer.geometry()->instances().size(), ~0u);
+        for (auto i = 0u; i < m_light_count; i++)
+        {
+            m_light_indices[light_instances[i].instance_id] = i;
+        }
+        auto [index_view, index_buffer_id] = renderer.bindless_arena_buffer<uint>(m_light_indices.size());
+        m_light_index_buffer_id            = index_buffer_id;
         command_buffer
-            << view.copy_from(renderer.geometry()->light_instances().data())
+            << view.copy_from(light_instances.data())
+            << index_view.copy_from(m_light_indices.data())
             << commit();
     }
 }
@@ -35,13 +58,9 @@ LightSampler::Evaluation LightSampler::evaluate_hit(const Interaction& it, Expr<
         LUISA_WARNING_WITH_LOCATION("No lights in scene.");
         return eval;
     };
-    renderer().lights().dispatch(it.shape.light_tag(), [&](auto light) noexcept
-    {
-        auto closure = light->closure(swl, time);
-        eval         = closure->evaluate(it, p_from);
-    });
-    auto n = static_cast<float>(renderer().lights().size());
-    eval.pdf *= 1.0f / n;
+    eval             = evaluate_light(it, p_from, swl, time);
+    auto light_index = renderer().buffer<uint>(m_light_index_buffer_id).read(it.inst_id);
+    eval.pdf *= pmf(p_from, light_index);
     return eval;
 }
 
@@ -56,14 +75,6 @@ LightSampler::Sample LightSampler::sample(const Interaction& it_from, Expr<float
     return sample_selection(it_from, sel, u_light, swl, time);
 }
 
-LightSampler::Selection LightSampler::select(const Interaction& it_from, Expr<float> u, Expr<float> time) const noexcept
-{
-    LUISA_ASSERT(!renderer().lights().empty(), "No lights in scene.");
-    auto n = static_cast<float>(renderer().lights().size());
-
-    return {.tag = cast<uint>(clamp(u * n, 0.0f, n - 1.0f)), .prob = 1.0f / n};
-}
-
 LightSampler::Sample LightSampler::sample_selection(const Interaction& it_from, const Selection& sel, Expr<float2> u, const SampledWavelengths& swl, Expr<float> time) const noexcept
 {
     auto sample = Sample::zero(swl.dimension());
@@ -74,16 +85,24 @@ LightSampler::Sample LightSampler::sample_selection(const Interaction& it_from,
     return sample;
 }
 
-auto LightSampler::sample_area(Expr<float3> p_from, Expr<uint> tag, Expr<float2> u_in) const noexcept
+LightSampler::LightPoint LightSampler::sample_point(Expr<uint> light_index, Expr<float2> u) const noexcept
 {
-    auto handle                = renderer().buffer<Light::Handle>(m_light_buffer_id).read(tag);
+    auto handle                = renderer().buffer<Light::Handle>(m_light_buffer_id).read(light_index);
     auto light_inst            = renderer().geometry()->instance(handle.instance_id);
-    auto light_to_world        = renderer().geometry()->instance_to_world(handle.instance_id);
     auto alias_table_buffer_id = light_inst.alias_table_buffer_id();
-    auto [triangle_id, ux]     = sample_alias_table(renderer().buffer<AliasEntry>(alias_table_buffer_id), light_inst.triangle_count(), u_in.x);
-    auto triangle              = renderer().geometry()->triangle(light_inst, triangle_id);
-    auto uv                    = sample_uniform_triangle(make_float2(ux, u_in.y)).xy();
-    auto attrib                = renderer().geometry()->shading_point(light_inst, triangle, uv, light_to_world);
+    auto [triangle_id, ux]     = sample_alias_table(renderer().buffer<AliasEntry>(alias_table_buffer_id), light_inst.triangle_count(), u.x);
+    auto bary                  = sample_uniform_triangle(make_float2(ux, u.y)).xy();
+
+    return {.light_index = light_index, .triangle_id = triangle_id, .bary = bary};
+}
+
+luisa::shared_ptr<Interaction> LightSampler::light_interaction(Expr<float3> p_from, const LightPoint& point) const noexcept
+{
+    auto handle         = renderer().buffer<Light::Handle>(m_light_buffer_id).read(point.light_index);
+    auto light_inst     = renderer().geometry()->instance(handle.instance_id);
+    auto light_to_world = renderer().geometry()->instance_to_world(handle.instance_id);
+    auto triangle       = renderer().geometry()->triangle(light_inst, point.triangle_id);
+    auto attrib         = renderer().geometry()->shading_point(light_inst, triangle, point.bary, light_to_world);
 
     return luisa::make_shared<Interaction>(Interaction{
         .shape     = std::move(light_inst),
@@ -93,7 +112,7 @@ auto LightSampler::sample_area(Expr<float3> p_from, Expr<uint> tag, Expr<float2>
         .p_s       = attrib.pg,
         .shading   = Frame::make(attrib.ns, attrib.dpdu),
         .inst_id   = handle.instance_id,
-        .prim_id   = triangle_id,
+        .prim_id   = point.triangle_id,
         .prim_area = attrib.area,
         // Match hit-case convention: front_face is true when the outgoing direction
         // (from light point to shading point) lies in the +ng hemisphere.
@@ -101,29 +120,108 @@ auto LightSampler::sample_area(Expr<float3> p_from, Expr<uint> tag, Expr<float2>
     });
 }
 
+LightSampler::Evaluation LightSampler::evaluate_point(const Interaction& it_from, const LightPoint& point, const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
+    LUISA_ASSERT(!renderer().lights().empty(), "No lights in the scene.");
+    auto it   = light_interaction(it_from.p_g, point);
+    auto eval = evaluate_light(*it, it_from.p_s, swl, time);
+    eval.pdf *= pmf(it_from.p_g, point.light_index);
+    return eval;
+}
+
 LightSampler::Sample LightSampler::sample_light(const Interaction& it_from, const Selection& sel, Expr<float2> u, const SampledWavelengths& swl, Expr<float> time) const noexcept
 {
     LUISA_ASSERT(!renderer().lights().empty(), "No lights in the scene.");
-    auto it   = sample_area(it_from.p_g, sel.tag, u);
+    auto point = sample_point(sel.tag, u);
+    auto it    = light_interaction(it_from.p_g, point);
+    auto eval  = evaluate_light(*it, it_from.p_s, swl, time);
+    Light::Sample light_sample = {.eval = std::move(eval), .p = it->p_g};
+    light_sample.eval.pdf *= sel.prob;
+
+    auto sample  = Sample::from_light(light_sample, it_from);
+    sample.point = point;
+    return sample;
+}
+
+LightSampler::AreaSample LightSampler::sample_area(Expr<float> u_select, Expr<float2> u_light, Expr<float2> u_direction, const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
+    LUISA_ASSERT(!renderer().lights().empty(), "No lights in the scene.");
+    auto n           = static_cast<float>(m_light_count);
+    auto light_index = cast<uint>(clamp(u_select * n, 0.0f, n - 1.0f));
+    auto point       = sample_point(light_index, u_light);
+    auto it          = light_interaction(make_float3(0.0f), point);
+
+    // two-sided lights spend the first coordinate on the side they emit from
+    auto two  = two_sided(*it);
+    auto back = two & u_direction.x >= 0.5f;
+    auto u    = make_float2(ite(two, fract(u_direction.x * 2.0f), u_direction.x), u_direction.y);
+    auto n_g  = ite(back, -it->n_g, it->n_g);
+    auto wi   = Frame::make(n_g).local_to_world(sample_cosine_hemisphere(u));
+    it->front_face = !back;
+
+    return AreaSample{
+        .point         = point,
+        .p             = it->p_g,
+        .n_g           = it->n_g,
+        .ray           = it->spawn_ray(wi),
+        .L             = emitted(*it, it->p_g + wi, swl, time),
+        .pdf_area      = pdf_area(*it),
+        .pdf_direction = pdf_direction(*it, it->p_g + wi),
+    };
+}
+
+Float LightSampler::pdf_area(const Interaction& it_light) const noexcept
+{
+    auto pdf_triangle = renderer().buffer<float>(it_light.shape.pdf_buffer_id()).read(it_light.prim_id);
+    return pdf_triangle / (it_light.prim_area * static_cast<float>(std::max(m_light_count, 1u)));
+}
+
+Float LightSampler::pdf_direction(const Interaction& it_light, Expr<float3> p_to) const noexcept
+{
+    auto cos_theta = dot(normalize(p_to - it_light.p_g), it_light.n_g);
+    auto two       = two_sided(it_light);
+    return ite(two, 0.5f * abs(cos_theta), max(cos_theta, 0.0f)) * inv_pi;
+}
+
+SampledSpectrum LightSampler::emitted(const Interaction& it_light, Expr<float3> p_to, const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
+    return evaluate_light(it_light, p_to, swl, time).L;
+}
+
+Bool LightSampler::two_sided(const Interaction& it_light) const noexcept
+{
+    auto two = def(false);
+    renderer().lights().dispatch(it_light.shape.light_tag(), [&](auto light) noexcept
+    {
+        two = light->two_sided();
+    });
+    return two;
+}
+
+LightSampler::Evaluation LightSampler::evaluate_light(const Interaction& it_light, Expr<float3> p_from, const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
     auto eval = Light::Evaluation::zero(swl.dimension());
-    renderer().lights().dispatch(it->shape.light_tag(), [&](auto light) noexcept
+    renderer().lights().dispatch(it_light.shape.light_tag(), [&](auto light) noexcept
     {
         auto closure = light->closure(swl, time);
-        eval         = closure->evaluate(*it, it_from.p_s);
+        eval         = closure->evaluate(it_light, p_from);
     });
-    Light::Sample light_sample = {.eval = std::move(eval), .p = it->p_g};
-    light_sample.eval.pdf *= sel.prob;
-
-    return Sample::from_light(light_sample, it_from);
+    return eval;
 }
 
 LightSampler::Sample LightSampler::Sample::zero(uint dimension) noexcept
 {
-    return Sample{.eval = Evaluation::zero(dimension), .shadow_ray = {}};
+    return Sample{
+        .eval       = Evaluation::zero(dimension),
+        .shadow_ray = {},
+        .point      = {.light_index = 0u, .triangle_id = 0u, .bary = make_float2(0.0f)}};
 }
 
 LightSampler::Sample LightSampler::Sample::from_light(const Light::Sample& s, const Interaction& it_from) noexcept
 {
-    return Sample{.eval = s.eval, .shadow_ray = it_from.spawn_ray_to(s.p)};
+    return Sample{
+        .eval       = s.eval,
+        .shadow_ray = it_from.spawn_ray_to(s.p),
+        .point      = {.light_index = 0u, .triangle_id = 0u, .bary = make_float2(0.0f)}};
 }
 } // namespace Yutrel
\ No newline at end of file
@@ -18,7 +18,18 @@ class Interaction;
 class LightSampler
 {
 public:
-    [[nodiscard]] static luisa::unique_ptr<LightSampler> create(Renderer& renderer, CommandBuffer& command_buffer) noexcept;
+    enum class Type
+    {
+        uniform,
+        bvh,
+    };
+
+    struct CreateInfo
+    {
+        Type type{Type::uniform};
+    };
+
+    [[nodiscard]] static luisa::unique_ptr<LightSampler> create(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept;
 
 public:
     struct Selection
@@ -29,22 +40,50 @@ public:
 
     using Evaluation = Light::Evaluation;
 
+    // a point on a light, enough to evaluate it again from another shading point
+    struct LightPoint
+    {
+        UInt light_index;
+        UInt triangle_id;
+        Float2 bary;
+    };
+
     struct Sample
     {
         Evaluation eval;
         Var<Ray> shadow_ray;
+        LightPoint point;
         [[nodiscard]] static Sample zero(uint dimension) noexcept;
         [[nodiscard]] static Sample from_light(const Light::Sample& s, const Interaction& it_from) noexcept;
     };
 
+    // a point on a light and a direction leaving it, picked without a shading point so that paths can start on the
+    // lights: lights are chosen uniformly, points by area and directions cosine-weighted about the normal
+    struct AreaSample
+    {
+        LightPoint point;
+        Float3 p;
+        Float3 n_g;
+        Var<Ray> ray;
+        // radiance along the ray
+        SampledSpectrum L;
+        // area density of the point including the light selection, solid angle density of the direction
+        Float pdf_area;
+        Float pdf_direction;
+    };
+
 private:
     const Renderer& m_renderer;
 
+    uint m_light_count{0u};
     uint m_light_buffer_id{0u};
+    // index into light_instances() of every instance, ~0u for instances that do not emit
+    luisa::vector<uint> m_light_indices;
+    uint m_light_index_buffer_id{0u};
 
 public:
     explicit LightSampler(Renderer& renderer, CommandBuffer& command_buffer) noexcept;
-    ~LightSampler() noexcept = default;
+    virtual ~LightSampler() noexcept = default;
 
     LightSampler()                               = delete;
     LightSampler(const LightSampler&)            = delete;
@@ -54,13 +93,35 @@ public:
 
 public:
     [[nodiscard]] auto& renderer() const noexcept { return m_renderer; }
+    [[nodiscard]] auto light_count() const noexcept { return m_light_count; }
 
+    // called once the geometry is built, for samplers that depend on the shape of the lights
+    virtual void build(CommandBuffer& command_buffer) noexcept {}
+
+    // p_from is the vertex the ray left from, the same p_g select() saw there, not the offset ray origin
     [[nodiscard]] Evaluation evaluate_hit(const Interaction& it, Expr<float3> p_from, const SampledWavelengths& swl, Expr<float> time) const noexcept;
     [[nodiscard]] Sample sample(const Interaction& it_from, Expr<float> u_select, Expr<float2> u_light, const SampledWavelengths& swl, Expr<float> time) const noexcept;
-    [[nodiscard]] Selection select(const Interaction& it_from, Expr<float> u, Expr<float> time) const noexcept;
+    // picks an index into light_instances() for a shading point
+    [[nodiscard]] virtual Selection select(const Interaction& it_from, Expr<float> u, Expr<float> time) const noexcept = 0;
+    // probability that select() picks light_index from p_from
+    [[nodiscard]] virtual Float pmf(Expr<float3> p_from, Expr<uint> light_index) const noexcept = 0;
     [[nodiscard]] Sample sample_selection(const Interaction& it_from, const Selection& sel, Expr<float2> u, const SampledWavelengths& swl, Expr<float> time) const noexcept;
-    [[nodiscard]] auto sample_area(Expr<float3> p_from, Expr<uint> tag, Expr<float2> u_in) const noexcept;
+    [[nodiscard]] LightPoint sample_point(Expr<uint> light_index, Expr<float2> u) const noexcept;
+    [[nodiscard]] luisa::shared_ptr<Interaction> light_interaction(Expr<float3> p_from, const LightPoint& point) const noexcept;
+    // radiance from the point towards it_from, with the pdf sample() would have picked it with
+    [[nodiscard]] Evaluation evaluate_point(const Interaction& it_from, const LightPoint& point, const SampledWavelengths& swl, Expr<float> time) const noexcept;
     [[nodiscard]] Sample sample_light(const Interaction& it_from, const Selection& sel, Expr<float2> u, const SampledWavelengths& swl, Expr<float> time) const noexcept;
+    [[nodiscard]] AreaSample sample_area(Expr<float> u_select, Expr<float2> u_light, Expr<float2> u_direction, const SampledWavelengths& swl, Expr<float> time) const noexcept;
+    // densities sample_area() picks the point under it_light and the direction from it towards p_to with
+    [[nodiscard]] Float pdf_area(const Interaction& it_light) const noexcept;
+    [[nodiscard]] Float pdf_direction(const Interaction& it_light, Expr<float3> p_to) const noexcept;
+    // radiance the light under it_light emits towards p_to
+    [[nodiscard]] SampledSpectrum emitted(const Interaction& it_light, Expr<float3> p_to, const SampledWavelengths& swl, Expr<float> time) const noexcept;
+
+private:
+    // radiance and area-sampling pdf of the light under it_light, without the selection pmf
+    [[nodiscard]] Evaluation evaluate_light(const Interaction& it_light, Expr<float3> p_from, const SampledWavelengths& swl, Expr<float> time) const noexcept;
+    [[nodiscard]] Bool two_sided(const Interaction& it_light) const noexcept;
 };
 
 } // namespace Yutrel
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include "medium.h"
+
+#include <luisa/dsl/sugar.h>
+
+#include "base/renderer.h"
+#include "media/heterogeneous.h"
+#include "media/homogeneous.h"
+#include "media/null.h"
+#include "utils/frame.h"
+#include "utils/rng.h"
+
+namespace Yutrel
+{
+namespace
+{
+class TrackingRng
+{
+private:
+    UInt m_seed;
+    UInt m_index;
+
+public:
+    explicit TrackingRng(Expr<uint> seed) noexcept
+        : m_seed{seed},
+          m_index{0u} {}
+
+    [[nodiscard]] Float generate() noexcept
+    {
+        auto u = uniform_uint_to_float(xxhash32(make_uint2(m_seed, m_index)));
+        m_index += 1u;
+        return u;
+    }
+};
+} // namespace
+
+luisa::unique_ptr<Medium> Medium::create(Scene& scene, const CreateInfo& info) noexcept
+{
+    switch (info.type)
+    {
+    case Type::homogeneous:
+        return luisa::make_unique<HomogeneousMedium>(scene, info);
+    case Type::heterogeneous:
+        return luisa::make_unique<HeterogeneousMedium>(scene, info);
+    case Type::null:
+    default:
+        return luisa::make_unique<NullMedium>(scene, info);
+    }
+}
+
+UInt Medium::tracking_seed(Expr<float> u, Expr<uint> segment) noexcept
+{
+    return xxhash32(make_uint3(as<uint>(u), segment, 0x6d656469u));
+}
+
+Medium::Medium(Scene& scene, const CreateInfo& info) noexcept
+    : m_sigma_a(max(info.sigma_a, 0.0f) * info.scale),
+      m_sigma_s(max(info.sigma_s, 0.0f) * info.scale),
+      m_g(std::clamp(info.g, -0.99f, 0.99f)) {}
+
+Medium::Instance::Instance(const Renderer& renderer, const Medium* medium) noexcept
+    : m_renderer{renderer},
+      m_medium{medium},
+      m_sigma_a{renderer.spectrum()->base()->encode_static_srgb_unbounded(medium->sigma_a())},
+      m_sigma_s{renderer.spectrum()->base()->encode_static_srgb_unbounded(medium->sigma_s())} {}
+
+luisa::string Medium::Instance::constants() const noexcept
+{
+    return luisa::format("{}", m_medium->g());
+}
+
+Medium::Sample Medium::Closure::sample(Expr<float3> o, Expr<float3> d, Expr<float> t_max, Expr<uint> seed) const noexcept
+{
+    auto s = Sample::zero(swl().dimension());
+    TrackingRng rng{seed};
+    $outline
+    {
+        traverse(o, d, t_max, [&](Expr<float> t0, Expr<float> t1, Expr<float> majorant, Bool& done) noexcept
+        {
+            $if(majorant > 0.0f)
+            {
+                auto t = def(t0);
+                $loop
+                {
+                    t -= log(1.0f - rng.generate()) / majorant;
+                    $if(t >= t1) { $break; };
+                    s.collisions += 1u;
+                    auto [sigma_a, sigma_s] = coefficients(o + d * t);
+                    auto sigma_n            = max(majorant - sigma_a - sigma_s, 0.0f);
+                    // the event is picked by the current throughput averaged over the wavelengths, every
+                    // wavelength is then reweighted by its own coefficient over that probability
+                    auto w_a   = (s.weight * sigma_a).average();
+                    auto w_s   = (s.weight * sigma_s).average();
+                    auto w_n   = (s.weight * sigma_n).average();
+                    auto total = w_a + w_s + w_n;
+                    auto u     = rng.generate() * total;
+                    $if(!(total > 0.0f) | u < w_a)
+                    {
+                        s.absorbed = true;
+                        s.t        = t;
+                        done       = true;
+                        $break;
+                    }
+                    $elif(u < w_a + w_s)
+                    {
+                        s.weight    = s.weight * sigma_s * (total / (w_s * majorant));
+                        s.scattered = true;
+                        s.t         = t;
+                        done        = true;
+                        $break;
+                    };
+                    s.weight = s.weight * sigma_n * (total / (w_n * majorant));
+                };
+            };
+        });
+    };
+    return s;
+}
+
+SampledSpectrum Medium::Closure::transmittance(Expr<float3> o, Expr<float3> d, Expr<float> t_max, Expr<uint> seed, UInt& collisions) const noexcept
+{
+    auto Tr = SampledSpectrum{swl().dimension(), 1.0f};
+    TrackingRng rng{seed};
+    $outline
+    {
+        traverse(o, d, t_max, [&](Expr<float> t0, Expr<float> t1, Expr<float> majorant, Bool& done) noexcept
+        {
+            $if(majorant > 0.0f)
+            {
+                auto t = def(t0);
+                $loop
+                {
+                    t -= log(1.0f - rng.generate()) / majorant;
+                    $if(t >= t1) { $break; };
+                    collisions += 1u;
+                    auto [sigma_a, sigma_s] = coefficients(o + d * t);
+                    Tr                      = Tr * max(1.0f - (sigma_a + sigma_s) * (1.0f / majorant), 0.0f);
+                    // russian roulette once little is left, the survivors make up for the others
+                    auto q = Tr.max();
+                    $if(q < 0.1f)
+                    {
+                        $if(rng.generate() >= q)
+                        {
+                            Tr   = 0.0f;
+                            done = true;
+                            $break;
+                        };
+                        Tr = Tr * (1.0f / q);
+                    };
+                };
+            };
+        });
+    };
+    return Tr;
+}
+
+Float Medium::Closure::phase(Expr<float3> wo, Expr<float3> wi) const noexcept
+{
+    auto g     = instance()->base()->g();
+    auto denom = 1.0f + g * g + 2.0f * g * dot(wo, wi);
+    return 0.25f * inv_pi * (1.0f - g * g) / (denom * sqrt(max(denom, 1e-8f)));
+}
+
+Float3 Medium::Closure::sample_phase(Expr<float3> wo, Expr<float2> u) const noexcept
+{
+    // pbrt-v3 convention, cos_theta is measured from wo
+    auto g         = instance()->base()->g();
+    auto cos_theta = def(1.0f - 2.0f * u.x);
+    if (std::abs(g) >= 1e-3f)
+    {
+        auto sqr_term = (1.0f - g * g) / (1.0f + g - 2.0f * g * u.x);
+        cos_theta     = -(1.0f + g * g - sqr_term * sqr_term) / (2.0f * g);
+    }
+    auto sin_theta = sqrt(max(1.0f - cos_theta * cos_theta, 0.0f));
+    auto phi       = 2.0f * pi * u.y;
+    auto frame     = Frame::make(wo);
+    return frame.local_to_world(make_float3(sin_theta * cos(phi), sin_theta * sin(phi), cos_theta));
+}
+
+} // namespace Yutrel
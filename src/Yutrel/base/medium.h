@@ -0,0 +1,225 @@
+#pragma once
+
+#include <filesystem>
+
+#include <luisa/dsl/syntax.h>
+
+#include "utils/command_buffer.h"
+#include "utils/spectra.h"
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+class Scene;
+class Renderer;
+
+class Medium
+{
+public:
+    // nesting depth of media a path can be inside at once, deeper boundaries are ignored
+    static constexpr auto max_stack_depth = 4u;
+
+    struct Coefficients
+    {
+        SampledSpectrum sigma_a;
+        SampledSpectrum sigma_s;
+    };
+
+    // outcome of a free flight: the ray scattered or was absorbed at t, or passed t_max with neither,
+    // weight is the throughput change of the flight
+    struct Sample
+    {
+        Bool scattered;
+        Bool absorbed;
+        Float t;
+        SampledSpectrum weight;
+        UInt collisions;
+        [[nodiscard]] static auto zero(uint dimension) noexcept
+        {
+            return Sample{
+                .scattered  = false,
+                .absorbed   = false,
+                .t          = 0.0f,
+                .weight     = SampledSpectrum{dimension, 1.0f},
+                .collisions = 0u,
+            };
+        }
+    };
+
+    // the media a path is inside, innermost last, paths start from the camera in vacuum
+    struct Stack
+    {
+        ArrayVar<uint, max_stack_depth> tags;
+        UInt depth{0u};
+
+        [[nodiscard]] auto empty() const noexcept { return depth == 0u; }
+        [[nodiscard]] auto top() const noexcept { return tags[max(depth, 1u) - 1u]; }
+        // entering a boundary pushes its medium, leaving pops the innermost one
+        void cross(Expr<bool> entering, Expr<uint> tag) noexcept
+        {
+            $if(entering)
+            {
+                $if(depth < max_stack_depth)
+                {
+                    tags[depth] = tag;
+                    depth += 1u;
+                };
+            }
+            $elif(depth > 0u)
+            {
+                depth -= 1u;
+            };
+        }
+    };
+
+public:
+    class Instance;
+    class Closure;
+
+public:
+    enum class Type
+    {
+        null,
+        homogeneous,
+        heterogeneous,
+    };
+
+    struct CreateInfo
+    {
+        Type type{Type::null};
+        // absorption and scattering in linear sRGB per unit length, multiplied by scale
+        float3 sigma_a{make_float3(0.0f)};
+        float3 sigma_s{make_float3(1.0f)};
+        float scale{1.0f};
+        // Henyey-Greenstein asymmetry
+        float g{0.0f};
+        // heterogeneous: density on a dense grid over the bounds, x fastest, scaling the coefficients,
+        // or read from a raw volume file when a path is given
+        luisa::vector<float> density;
+        uint3 density_resolution{make_uint3(0u)};
+        std::filesystem::path density_path;
+        // stores the density as a sparse brick map instead of a dense volume on the device
+        bool brick_map{true};
+        float3 bounds_min{make_float3(0.0f)};
+        float3 bounds_max{make_float3(1.0f)};
+        // cells of the majorant grid along each axis
+        uint majorant_resolution{16u};
+    };
+
+    [[nodiscard]] static luisa::unique_ptr<Medium> create(Scene& scene, const CreateInfo& info) noexcept;
+
+    // delta and ratio tracking draw a data-dependent number of numbers, they come from a hashed stream so
+    // that a path vertex takes one sampler dimension u however many segments it tracks through (pbrt-v4),
+    // each segment seeds its stream from u and its index along the vertex
+    [[nodiscard]] static UInt tracking_seed(Expr<float> u, Expr<uint> segment) noexcept;
+
+private:
+    float3 m_sigma_a;
+    float3 m_sigma_s;
+    float m_g;
+
+public:
+    explicit Medium(Scene& scene, const CreateInfo& info) noexcept;
+    virtual ~Medium() noexcept = default;
+
+    Medium()                         = delete;
+    Medium(const Medium&)            = delete;
+    Medium& operator=(const Medium&) = delete;
+    Medium(Medium&&)                 = delete;
+    Medium& operator=(Medium&&)      = delete;
+
+public:
+    [[nodiscard]] auto sigma_a() const noexcept { return m_sigma_a; }
+    [[nodiscard]] auto sigma_s() const noexcept { return m_sigma_s; }
+    [[nodiscard]] auto g() const noexcept { return m_g; }
+    [[nodiscard]] virtual bool is_null() const noexcept { return false; }
+    [[nodiscard]] virtual luisa::unique_ptr<Instance> build(Renderer& renderer, CommandBuffer& command_buffer) const noexcept = 0;
+};
+
+class Medium::Instance
+{
+private:
+    const Renderer& m_renderer;
+    const Medium* m_medium;
+    // spectral encodings of the coefficients at unit density
+    float4 m_sigma_a;
+    float4 m_sigma_s;
+
+public:
+    explicit Instance(const Renderer& renderer, const Medium* medium) noexcept;
+    virtual ~Instance() noexcept = default;
+
+    Instance()                           = delete;
+    Instance(const Instance&)            = delete;
+    Instance& operator=(const Instance&) = delete;
+    Instance(Instance&&)                 = delete;
+    Instance& operator=(Instance&&)      = delete;
+
+public:
+    template <typename T = Medium>
+        requires std::is_base_of_v<Medium, T>
+    [[nodiscard]] auto base() const noexcept
+    {
+        return static_cast<const T*>(m_medium);
+    }
+
+    [[nodiscard]] auto& renderer() const noexcept { return m_renderer; }
+    [[nodiscard]] auto encoded_sigma_a() const noexcept { return m_sigma_a; }
+    [[nodiscard]] auto encoded_sigma_s() const noexcept { return m_sigma_s; }
+    [[nodiscard]] virtual luisa::unique_ptr<Closure> closure(const SampledWavelengths& swl, Expr<float> time) const noexcept = 0;
+    // host constants the closures are traced with, part of the name of cached shaders
+    [[nodiscard]] virtual luisa::string constants() const noexcept;
+};
+
+class Medium::Closure
+{
+public:
+    // visits the segments [t0, t1) of the ray in order with a bound on sigma_t over each, until done is set
+    using SegmentVisitor = luisa::function<void(Expr<float> t0, Expr<float> t1, Expr<float> majorant, Bool& done)>;
+
+private:
+    const Instance* m_instance;
+
+private:
+    const SampledWavelengths& m_swl;
+    Float m_time;
+
+public:
+    explicit Closure(const Instance* instance, const SampledWavelengths& swl, Expr<float> time) noexcept
+        : m_instance{instance}, m_swl{swl}, m_time{time} {}
+    virtual ~Closure() noexcept = default;
+
+    Closure()                          = delete;
+    Closure(const Closure&)            = delete;
+    Closure& operator=(const Closure&) = delete;
+    Closure(Closure&&)                 = delete;
+    Closure& operator=(Closure&&)      = delete;
+
+public:
+    template <typename T = Instance>
+        requires std::is_base_of_v<Instance, T>
+    [[nodiscard]] auto instance() const noexcept
+    {
+        return static_cast<const T*>(m_instance);
+    }
+
+    [[nodiscard]] auto& swl() const noexcept { return m_swl; }
+    [[nodiscard]] auto time() const noexcept { return m_time; }
+
+    [[nodiscard]] virtual Coefficients coefficients(Expr<float3> p) const noexcept                                      = 0;
+    virtual void traverse(Expr<float3> o, Expr<float3> d, Expr<float> t_max, const SegmentVisitor& visitor) const noexcept = 0;
+
+    // free flight by delta tracking over the majorant segments, with the collision probabilities of
+    // spectral tracking (Kutz et al. 2017) so that all wavelengths share one path
+    [[nodiscard]] Sample sample(Expr<float3> o, Expr<float3> d, Expr<float> t_max, Expr<uint> seed) const noexcept;
+    // ratio tracking (Novák et al. 2014) over the same segments, seed as given by tracking_seed
+    [[nodiscard]] SampledSpectrum transmittance(Expr<float3> o, Expr<float3> d, Expr<float> t_max, Expr<uint> seed, UInt& collisions) const noexcept;
+
+    // Henyey-Greenstein, wo and wi both point away from the scattering point
+    [[nodiscard]] Float phase(Expr<float3> wo, Expr<float3> wi) const noexcept;
+    [[nodiscard]] Float3 sample_phase(Expr<float3> wo, Expr<float2> u) const noexcept;
+};
+
+} // namespace Yutrel
@@ -0,0 +1,145 @@
+#include "path_guide.h"
+
+#include <luisa/luisa-compute.h>
+
+#include "base/renderer.h"
+#include "utils/shader_cache.h"
+
+namespace Yutrel
+{
+PathGuide::PathGuide(const Renderer& renderer, uint grid_resolution, float probability) noexcept
+    : SceneGrid(renderer, grid_resolution),
+      m_probability(std::clamp(probability, 0.0f, 1.0f))
+{
+    auto&& device   = renderer.device();
+    auto bins       = cell_count() * bin_count;
+    m_radiance      = device.create_buffer<float>(bins);
+    m_cdf           = device.create_buffer<float>(bins);
+    m_cell_radiance = device.create_buffer<float>(cell_count());
+    LUISA_INFO("Path guide: {}^3 cells with {} directional bins ({:.2f} MB).",
+               this->grid_resolution(),
+               bin_count,
+               static_cast<double>(m_radiance.size_bytes() + m_cdf.size_bytes()) / (1024.0 * 1024.0));
+
+    Kernel1D reset_kernel = [this]() noexcept
+    {
+        auto i = dispatch_x();
+        auto b = i % bin_count;
+        m_radiance->write(i, 0.0f);
+        m_cdf->write(i, cast<float>(b + 1u) / static_cast<float>(bin_count));
+        $if(b == 0u)
+        {
+            m_cell_radiance->write(i / bin_count, 0.0f);
+        };
+    };
+
+    Kernel1D build_kernel = [this]() noexcept
+    {
+        auto c    = dispatch_x();
+        auto base = c * bin_count;
+        auto sum  = def(0.0f);
+        $for(i, bin_count)
+        {
+            sum += m_radiance->read(base + i);
+        };
+        // cells without samples in this iteration keep their previous distribution
+        $if(sum > 0.0f)
+        {
+            auto cdf = def(0.0f);
+            $for(i, bin_count)
+            {
+                cdf += (1.0f - uniform_fraction) * m_radiance->read(base + i) / sum + uniform_fraction / static_cast<float>(bin_count);
+                m_cdf->write(base + i, cdf);
+                m_radiance->write(base + i, 0.0f);
+            };
+            m_cdf->write(base + bin_count - 1u, 1.0f);
+            m_cell_radiance->write(c, sum);
+        };
+    };
+
+    auto shader_cache = renderer.shader_cache();
+    auto signature    = make_uint2(this->grid_resolution(), bin_count);
+    m_reset           = shader_cache->compile(reset_kernel, "path_guide_reset", luisa::hash64(&signature, sizeof(signature), luisa::hash64_default_seed));
+    m_build           = shader_cache->compile(build_kernel, "path_guide_build", luisa::hash64(&signature, sizeof(signature), luisa::hash64_default_seed));
+}
+
+void PathGuide::reset(CommandBuffer& command_buffer) noexcept
+{
+    SceneGrid::reset(command_buffer);
+    command_buffer << m_reset().dispatch(cell_count() * bin_count);
+}
+
+void PathGuide::update(CommandBuffer& command_buffer) noexcept
+{
+    command_buffer << m_build().dispatch(cell_count());
+}
+
+Float PathGuide::selection_probability(Expr<uint> cell) const noexcept
+{
+    return ite(m_cell_radiance->read(cell) > 0.0f, m_probability, 0.0f);
+}
+
+UInt PathGuide::bin(Expr<float3> w) noexcept
+{
+    // equal-area cylindrical map: cos(theta) and phi are both uniform over the sphere
+    auto u   = clamp((w.z + 1.0f) * 0.5f, 0.0f, 0.9999f);
+    auto phi = atan2(w.y, w.x) * inv_pi * 0.5f;
+    auto v   = clamp(ite(phi < 0.0f, phi + 1.0f, phi), 0.0f, 0.9999f);
+    auto bu  = cast<uint>(u * static_cast<float>(direction_resolution));
+    auto bv  = cast<uint>(v * static_cast<float>(direction_resolution));
+    return bu * direction_resolution + bv;
+}
+
+Float PathGuide::bin_probability(Expr<uint> cell, Expr<uint> bin) const noexcept
+{
+    auto base   = cell * bin_count;
+    auto cdf_hi = m_cdf->read(base + bin);
+    auto cdf_lo = ite(bin == 0u, 0.0f, m_cdf->read(base + max(bin, 1u) - 1u));
+    return max(cdf_hi - cdf_lo, 0.0f);
+}
+
+PathGuide::Sample PathGuide::sample(Expr<uint> cell, Expr<float2> u) const noexcept
+{
+    // binary search for the first bin whose cdf exceeds u.x
+    auto base = cell * bin_count;
+    auto lo   = def(0u);
+    auto hi   = def(bin_count - 1u);
+    for (auto i = 0u; i < search_steps; i++)
+    {
+        auto mid = (lo + hi) / 2u;
+        $if(m_cdf->read(base + mid) < u.x)
+        {
+            lo = mid + 1u;
+        }
+        $else
+        {
+            hi = mid;
+        };
+    }
+    auto b      = min(lo, bin_count - 1u);
+    auto cdf_lo = ite(b == 0u, 0.0f, m_cdf->read(base + max(b, 1u) - 1u));
+    auto p_bin  = max(m_cdf->read(base + b) - cdf_lo, 1e-8f);
+    auto offset = clamp((u.x - cdf_lo) / p_bin, 0.0f, 0.9999f);
+
+    auto cu  = (cast<float>(b / direction_resolution) + offset) / static_cast<float>(direction_resolution);
+    auto cv  = (cast<float>(b % direction_resolution) + u.y) / static_cast<float>(direction_resolution);
+    auto z   = 2.0f * cu - 1.0f;
+    auto r   = sqrt(max(1.0f - z * z, 0.0f));
+    auto phi = 2.0f * pi * cv;
+    return {.wi  = make_float3(r * cos(phi), r * sin(phi), z),
+            .pdf = p_bin * static_cast<float>(bin_count) * inv_pi * 0.25f};
+}
+
+Float PathGuide::pdf(Expr<uint> cell, Expr<float3> w) const noexcept
+{
+    return bin_probability(cell, bin(w)) * static_cast<float>(bin_count) * inv_pi * 0.25f;
+}
+
+void PathGuide::record(Expr<uint> cell, Expr<float3> w, Expr<float> radiance) const noexcept
+{
+    $if(radiance > 0.0f & !(compute::isnan(radiance) | compute::isinf(radiance)))
+    {
+        m_radiance->atomic(cell * bin_count + bin(w)).fetch_add(radiance);
+    };
+}
+} // namespace Yutrel
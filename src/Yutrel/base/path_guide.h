@@ -0,0 +1,74 @@
+#pragma once
+
+#include <luisa/dsl/syntax.h>
+#include <luisa/runtime/buffer.h>
+#include <luisa/runtime/shader.h>
+
+#include "base/scene_grid.h"
+#include "utils/command_buffer.h"
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+class Renderer;
+
+// every cell of the scene grid holds a directional histogram over an equal-area cylindrical map of
+// the sphere, learned from the radiance arriving at path vertices
+class PathGuide : public SceneGrid
+{
+public:
+    static constexpr auto direction_resolution = 8u;
+    static constexpr auto bin_count            = direction_resolution * direction_resolution;
+    static constexpr auto search_steps         = 6u;
+    static_assert(1u << search_steps == bin_count);
+    // vertices per path whose incident radiance is recorded while training
+    static constexpr auto max_recorded_vertices = 8u;
+    // mass spread over all bins so that directions the training never saw stay reachable
+    static constexpr auto uniform_fraction = 0.1f;
+
+    struct Sample
+    {
+        Float3 wi;
+        Float pdf;
+    };
+
+private:
+    float m_probability;
+
+    // radiance recorded per bin in the current training iteration
+    Buffer<float> m_radiance;
+    Buffer<float> m_cdf;
+    // radiance the cell's distribution was built from, zero while it has not seen any
+    Buffer<float> m_cell_radiance;
+
+    Shader1D<> m_reset;
+    Shader1D<> m_build;
+
+public:
+    PathGuide(const Renderer& renderer, uint grid_resolution, float probability) noexcept;
+    ~PathGuide() noexcept = default;
+
+    PathGuide(const PathGuide&)            = delete;
+    PathGuide& operator=(const PathGuide&) = delete;
+
+public:
+    [[nodiscard]] auto probability() const noexcept { return m_probability; }
+
+    // uploads the scene bounds and forgets everything learned, the distributions start uniform
+    void reset(CommandBuffer& command_buffer) noexcept;
+    // turns the radiance recorded since the last update into the sampling distributions
+    void update(CommandBuffer& command_buffer) noexcept;
+
+    // probability of following the guide at this cell, zero where nothing was learned
+    [[nodiscard]] Float selection_probability(Expr<uint> cell) const noexcept;
+    [[nodiscard]] Sample sample(Expr<uint> cell, Expr<float2> u) const noexcept;
+    [[nodiscard]] Float pdf(Expr<uint> cell, Expr<float3> w) const noexcept;
+    void record(Expr<uint> cell, Expr<float3> w, Expr<float> radiance) const noexcept;
+
+private:
+    [[nodiscard]] static UInt bin(Expr<float3> w) noexcept;
+    [[nodiscard]] Float bin_probability(Expr<uint> cell, Expr<uint> bin) const noexcept;
+};
+} // namespace Yutrel
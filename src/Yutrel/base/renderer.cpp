@@ -6,12 +6,14 @@
 #include "base/geometry.h"
 #include "base/integrator.h"
 #include "base/scene.h"
+#include "utils/shader_cache.h"
 
 namespace Yutrel
 {
 Renderer::Renderer(Device& device) noexcept
     : m_device(device),
-      m_bindless_array(device.create_bindless_array()) {}
+      m_bindless_array(device.create_bindless_array()),
+      m_shader_cache(luisa::make_unique<ShaderCache>(device)) {}
 
 Renderer::~Renderer() noexcept = default;
 
@@ -39,7 +41,19 @@ uint Renderer::register_light(CommandBuffer& command_buffer, const Light* light)
     return tag;
 }
 
-luisa::unique_ptr<Renderer> Renderer::create(Device& device, Stream& stream, const Scene& scene) noexcept
+uint Renderer::register_medium(CommandBuffer& command_buffer, const Medium* medium) noexcept
+{
+    if (auto iter = m_medium_tags.find(medium);
+        iter != m_medium_tags.end())
+    {
+        return iter->second;
+    }
+    auto tag = m_media.emplace(medium->build(*this, command_buffer));
+    m_medium_tags.emplace(medium, tag);
+    return tag;
+}
+
+luisa::unique_ptr<Renderer> Renderer::create(Device& device, Stream& stream, const Scene& scene, bool interactive) noexcept
 {
     auto renderer = luisa::make_unique<Renderer>(device);
 
@@ -53,31 +67,79 @@ luisa::unique_ptr<Renderer> Renderer::create(Device& device, Stream& stream, con
         }
     };
 
+    // mesh imports were started on the thread pool when the scene was loaded, the shaders are
+    // compiled on worker threads while the geometry is uploaded and joined before returning
+    Clock timeline;
+    auto mark = [&timeline](luisa::string_view event)
+    {
+        LUISA_INFO("Startup [{:>9.2f} ms] {}.", timeline.toc(), event);
+    };
+
     renderer->m_spectrum = scene.spectrum()->build(*renderer, command_buffer);
     update_bindless_if_dirty();
+    mark("spectrum ready");
 
     renderer->m_camera = scene.camera()->build(*renderer, command_buffer);
+    renderer->m_jobs   = {scene.cameras().begin(), scene.cameras().end()};
     update_bindless_if_dirty();
+    mark("camera ready");
 
     renderer->m_geometry = luisa::make_unique<Geometry>(*renderer);
-    renderer->m_geometry->build(command_buffer, scene.shapes());
+    renderer->m_geometry->prepare(command_buffer, scene.shapes());
     update_bindless_if_dirty();
+    mark("surfaces, lights and textures registered");
 
-    renderer->m_integrator = Integrator::create(*renderer, command_buffer);
+    renderer->m_integrator = Integrator::create(*renderer, command_buffer, scene.integrator_info());
     update_bindless_if_dirty();
+    if (!interactive)
+    {
+        renderer->m_integrator->compile_async(command_buffer, timeline);
+        mark("shader compilation launched");
+    }
+
+    renderer->m_geometry->build(command_buffer);
+    update_bindless_if_dirty();
+    mark("meshes imported and uploaded");
+
+    renderer->m_integrator->light_sampler()->build(command_buffer);
+    mark("light sampler built");
 
     command_buffer << synchronize();
+    mark("acceleration structure built");
+
+    renderer->m_integrator->wait_for_shaders();
+    mark("shaders joined, ready to dispatch");
 
     return renderer;
 }
 
 void Renderer::render(Stream& stream)
 {
-    m_integrator->render(stream);
+    if (m_jobs.size() <= 1u)
+    {
+        m_integrator->render(stream);
+        return;
+    }
+
+    // geometry, bindless resources and the compiled integrator shaders are shared by all jobs
+    Clock clock;
+    for (auto i = 0u; i < m_jobs.size(); i++)
+    {
+        LUISA_INFO("Batch job {}/{} -> '{}'.", i + 1u, m_jobs.size(), m_jobs[i]->film()->output());
+        CommandBuffer command_buffer{stream};
+        m_camera->set_camera(command_buffer, m_jobs[i]);
+        command_buffer << synchronize();
+        m_integrator->render(stream);
+    }
+    LUISA_INFO("Batch of {} jobs finished in {} ms.", m_jobs.size(), clock.toc());
 }
 
 void Renderer::render_interactive(Stream& stream)
 {
+    if (m_camera->film()->base()->tiled()) [[unlikely]]
+    {
+        LUISA_ERROR("Interactive rendering needs the whole image on the device, tiled films are not supported.");
+    }
     m_integrator->render_interactive(stream);
 }
 
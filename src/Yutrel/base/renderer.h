@@ -4,6 +4,7 @@
 
 #include "base/camera.h"
 #include "base/light.h"
+#include "base/medium.h"
 #include "base/spectrum.h"
 #include "base/surface.h"
 #include "base/texture.h"
@@ -17,6 +18,7 @@ using TextureSampler = compute::Sampler;
 class Scene;
 class Integrator;
 class Geometry;
+class ShaderCache;
 
 class Renderer final
 {
@@ -29,17 +31,23 @@ private:
     size_t m_bindless_tex3d_count{0u};
     Polymorphic<Surface::Instance> m_surfaces;
     Polymorphic<Light::Instance> m_lights;
+    Polymorphic<Medium::Instance> m_media;
     luisa::unordered_map<const Surface*, uint> m_surface_tags;
     luisa::unordered_map<const Light*, uint> m_light_tags;
+    luisa::unordered_map<const Medium*, uint> m_medium_tags;
     luisa::unordered_map<const Texture*, luisa::unique_ptr<Texture::Instance>> m_textures;
 
     luisa::unique_ptr<Spectrum::Instance> m_spectrum;
     luisa::unique_ptr<Camera::Instance> m_camera;
+    // cameras rendered one after another through m_camera
+    luisa::vector<const Camera*> m_jobs;
     luisa::unique_ptr<Integrator> m_integrator;
     luisa::unique_ptr<Geometry> m_geometry;
 
     luisa::unordered_map<luisa::string, uint> m_named_ids;
 
+    luisa::unique_ptr<ShaderCache> m_shader_cache;
+
 public:
     explicit Renderer(Device& device) noexcept;
     ~Renderer() noexcept;
@@ -107,6 +115,7 @@ public:
 
     [[nodiscard]] uint register_surface(CommandBuffer& command_buffer, const Surface* surface) noexcept;
     [[nodiscard]] uint register_light(CommandBuffer& command_buffer, const Light* light) noexcept;
+    [[nodiscard]] uint register_medium(CommandBuffer& command_buffer, const Medium* medium) noexcept;
 
     template <typename Create>
     uint register_named_id(luisa::string_view identifier, Create&& create_id) noexcept
@@ -121,7 +130,8 @@ public:
     }
 
 public:
-    [[nodiscard]] static luisa::unique_ptr<Renderer> create(Device& device, Stream& stream, const Scene& scene) noexcept;
+    // interactive renders compile their own shaders behind a preview, so the offline ones are skipped
+    [[nodiscard]] static luisa::unique_ptr<Renderer> create(Device& device, Stream& stream, const Scene& scene, bool interactive = false) noexcept;
 
     void render(Stream& stream);
     void render_interactive(Stream& stream);
@@ -133,8 +143,10 @@ public:
     [[nodiscard]] auto camera() const noexcept { return m_camera.get(); }
     [[nodiscard]] auto integrator() const noexcept { return m_integrator.get(); }
     [[nodiscard]] auto geometry() const noexcept { return m_geometry.get(); }
+    [[nodiscard]] auto shader_cache() const noexcept { return m_shader_cache.get(); }
     [[nodiscard]] auto& surfaces() const noexcept { return m_surfaces; }
     [[nodiscard]] auto& lights() const noexcept { return m_lights; }
+    [[nodiscard]] auto& media() const noexcept { return m_media; }
 
     [[nodiscard]] const Texture::Instance* build_texture(CommandBuffer& command_buffer, const Texture* texture) noexcept;
 
@@ -142,6 +154,8 @@ public:
     [[nodiscard]] auto buffer(I&& id) const noexcept { return m_bindless_array->buffer<T>(std::forward<I>(id)); }
     template <typename T>
     [[nodiscard]] auto tex2d(T&& id) const noexcept { return m_bindless_array->tex2d(std::forward<T>(id)); }
+    template <typename T>
+    [[nodiscard]] auto tex3d(T&& id) const noexcept { return m_bindless_array->tex3d(std::forward<T>(id)); }
 };
 
 } // namespace Yutrel
\ No newline at end of file
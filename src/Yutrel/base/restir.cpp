@@ -0,0 +1,14 @@
+#include "restir.h"
+
+#include <luisa/luisa-compute.h>
+
+namespace Yutrel
+{
+Bool ReSTIR::similar(Expr<float4> position, Expr<float4> normal, Expr<float4> other_position, Expr<float4> other_normal) noexcept
+{
+    // same orientation and within a few percent of the hit distance from the tangent plane
+    return other_position.w > 0.0f &
+           dot(normal.xyz(), other_normal.xyz()) > 0.9f &
+           abs(dot(normal.xyz(), other_position.xyz() - position.xyz())) < 0.05f * position.w;
+}
+} // namespace Yutrel
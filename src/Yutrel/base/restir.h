@@ -0,0 +1,66 @@
+#pragma once
+
+#include <luisa/dsl/sugar.h>
+#include <luisa/dsl/syntax.h>
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+// what ReSTIR DI and GI share: the weighted reservoir of resampled importance sampling over a sample of
+// either kind, the test for neighbouring pixels that may share reservoirs and the sample streams of a frame
+class ReSTIR
+{
+public:
+    // sample streams of a frame, or'ed into the frame index, disjoint from each other and from the frame
+    // indices of the path tracer
+    static constexpr auto stream_gi_spatial  = 0x30000000u;
+    static constexpr auto stream_di_primary  = 0x40000000u;
+    static constexpr auto stream_di_initial  = 0x50000000u;
+    static constexpr auto stream_di_spatial  = 0x60000000u;
+    static constexpr auto stream_gi_temporal = 0x70000000u;
+
+    // the history may outweigh the new samples of the current frame by at most this factor
+    static constexpr auto history_cap = 20.0f;
+
+    template <typename T>
+    struct Reservoir
+    {
+        T sample;
+        Float w_sum;
+        Float m;
+        // target of the selected sample at the pixel that owns the reservoir
+        Float p_hat;
+        // unbiased contribution weight, w_sum / (m * p_hat)
+        Float w;
+
+        // the candidate of resampling weight weight replaces the selection with probability weight / w_sum
+        void update(const T& candidate, Expr<float> weight, Expr<float> target, Expr<float> u) noexcept
+        {
+            w_sum += weight;
+            $if(weight > 0.0f & u * w_sum < weight)
+            {
+                sample = candidate;
+                p_hat  = target;
+            };
+        }
+
+        void finalize() noexcept
+        {
+            w = ite(p_hat > 0.0f & m > 0.0f, w_sum / max(m * p_hat, 1e-20f), 0.0f);
+        }
+    };
+
+    // no candidate seen yet, sample only provides the initial values of the selection
+    template <typename T>
+    [[nodiscard]] static Reservoir<T> empty(const T& sample) noexcept
+    {
+        return Reservoir<T>{.sample = sample, .w_sum = 0.0f, .m = 0.0f, .p_hat = 0.0f, .w = 0.0f};
+    }
+
+    // whether the primary hits of two pixels, as (position, hit distance) and geometric normal, are close
+    // enough to share reservoirs
+    [[nodiscard]] static Bool similar(Expr<float4> position, Expr<float4> normal, Expr<float4> other_position, Expr<float4> other_normal) noexcept;
+};
+} // namespace Yutrel
@@ -0,0 +1,254 @@
+#include "restir_di.h"
+
+#include <luisa/luisa-compute.h>
+
+#include "base/film.h"
+#include "base/geometry.h"
+#include "base/integrator.h"
+#include "base/interaction.h"
+#include "base/renderer.h"
+#include "base/sampler.h"
+#include "utils/shader_cache.h"
+
+namespace Yutrel
+{
+ReSTIRDI::ReSTIRDI(const Integrator& integrator, const Camera::Instance* camera, uint64_t signature) noexcept
+    : m_integrator(integrator),
+      m_camera(camera),
+      m_resolution(camera->film()->base()->resolution())
+{
+    auto&& renderer  = integrator.renderer();
+    auto&& device    = renderer.device();
+    auto pixel_count = m_resolution.x * m_resolution.y;
+    m_positions      = device.create_buffer<float4>(pixel_count);
+    m_normals        = device.create_buffer<float4>(pixel_count);
+    for (auto i = 0u; i < 2u; i++)
+    {
+        m_points[i]  = device.create_buffer<uint4>(pixel_count);
+        m_weights[i] = device.create_buffer<float2>(pixel_count);
+    }
+
+    auto geometry      = renderer.geometry();
+    auto sampler       = integrator.sampler();
+    auto light_sampler = integrator.light_sampler();
+    auto film          = camera->film();
+
+    // evaluates body with the closure of the primary hit
+    auto with_closure = [&](const Interaction& it, const SampledWavelengths& swl, Expr<float> time, auto&& body) noexcept
+    {
+        $outline
+        {
+            PolymorphicCall<Surface::Closure> call;
+            renderer.surfaces().dispatch(it.shape.surface_tag(), [&](auto surface) noexcept
+            {
+                surface->closure(call, it, swl, time);
+            });
+            call.execute([&](const Surface::Closure* closure) noexcept
+            {
+                body(closure);
+            });
+        };
+    };
+
+    // candidates from the light sampler, then the reservoir of the previous frame at the same pixel
+    Kernel2D initial_kernel = [&](UInt frame_index, Float time, Bool temporal) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id      = dispatch_id().xy();
+        auto pixel         = pixel_id.y * m_resolution.x + pixel_id.x;
+        auto camera_sample = primary(pixel_id, frame_index, time);
+        auto& swl          = camera_sample.swl;
+        auto it            = geometry->intersect(camera_sample.ray);
+        auto wo            = -camera_sample.ray->direction();
+
+        auto previous_position = m_positions->read(pixel);
+        auto previous_normal   = m_normals->read(pixel);
+        auto position          = def(make_float4(0.0f));
+        auto normal            = def(make_float4(0.0f));
+        auto r                 = empty();
+        $if(it->valid() & it->shape.has_surface())
+        {
+            position = make_float4(it->p_g, distance(camera_sample.ray->origin(), it->p_g));
+            normal   = make_float4(it->n_g, 0.0f);
+            sampler->start(pixel_id, frame_index | ReSTIR::stream_di_initial);
+            with_closure(*it, swl, time, [&](const Surface::Closure* closure) noexcept
+            {
+                $for(i, initial_candidates)
+                {
+                    auto u_select    = sampler->generate_1d();
+                    auto u_light     = sampler->generate_2d();
+                    auto u_reservoir = sampler->generate_1d();
+                    auto s           = light_sampler->sample(*it, u_select, u_light, swl, time);
+                    $if(s.eval.pdf > 0.0f)
+                    {
+                        auto d  = s.eval.p - it->p_g;
+                        auto d2 = max(dot(d, d), 1e-8f);
+                        auto wi = d * rsqrt(d2);
+                        auto f  = (closure->evaluate(wo, wi).f * s.eval.L).average();
+                        // the source pdf and the target share the geometry term, which cancels in the weight
+                        r.update(s.point, f / s.eval.pdf, f * abs(dot(s.eval.ng, wi)) / d2, u_reservoir);
+                    };
+                    r.m += 1.0f;
+                };
+                r.finalize();
+
+                // occluded candidates do not enter the history
+                $if(r.w > 0.0f)
+                {
+                    auto light_it = light_sampler->light_interaction(it->p_g, r.sample);
+                    $if(geometry->intersect_any(it->spawn_ray_to(light_it->p_g)))
+                    {
+                        r.w_sum = 0.0f;
+                        r.w     = 0.0f;
+                    };
+                };
+
+                $if(temporal & ReSTIR::similar(position, normal, previous_position, previous_normal))
+                {
+                    auto point    = load_point(1u, pixel);
+                    auto previous = m_weights[1]->read(pixel);
+                    auto m        = min(previous.y, ReSTIR::history_cap * r.m);
+                    auto p_hat    = unshadowed(closure, *it, wo, point, swl, time).average();
+                    r.update(point, p_hat * previous.x * m, p_hat, sampler->generate_1d());
+                    r.m += m;
+                    r.finalize();
+                };
+            });
+        };
+        m_positions->write(pixel, position);
+        m_normals->write(pixel, normal);
+        store(0u, pixel, r);
+    };
+
+    // reservoirs of random neighbours whose primary hits lie on a similar surface
+    Kernel2D spatial_kernel = [&](UInt frame_index, Float time) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id      = dispatch_id().xy();
+        auto pixel         = pixel_id.y * m_resolution.x + pixel_id.x;
+        auto camera_sample = primary(pixel_id, frame_index, time);
+        auto& swl          = camera_sample.swl;
+        auto it            = geometry->intersect(camera_sample.ray);
+        auto wo            = -camera_sample.ray->direction();
+
+        auto position = m_positions->read(pixel);
+        auto normal   = m_normals->read(pixel);
+        auto r        = empty();
+        $if(position.w > 0.0f)
+        {
+            sampler->start(pixel_id, frame_index | ReSTIR::stream_di_spatial);
+            with_closure(*it, swl, time, [&](const Surface::Closure* closure) noexcept
+            {
+                auto merge = [&](Expr<uint> q) noexcept
+                {
+                    auto point  = load_point(0u, q);
+                    auto weight = m_weights[0]->read(q);
+                    auto p_hat  = unshadowed(closure, *it, wo, point, swl, time).average();
+                    r.update(point, p_hat * weight.x * weight.y, p_hat, sampler->generate_1d());
+                    r.m += weight.y;
+                };
+                merge(pixel);
+                $for(k, spatial_neighbors)
+                {
+                    auto offset = (sampler->generate_2d() * 2.0f - 1.0f) * spatial_radius;
+                    auto q_id   = make_uint2(clamp(make_int2(pixel_id) + make_int2(offset), make_int2(0), make_int2(m_resolution) - 1));
+                    auto q      = q_id.y * m_resolution.x + q_id.x;
+                    $if(q != pixel & ReSTIR::similar(position, normal, m_positions->read(q), m_normals->read(q)))
+                    {
+                        merge(q);
+                    };
+                };
+                r.finalize();
+            });
+        };
+        store(1u, pixel, r);
+    };
+
+    // the selected point with visibility, weighted by the reservoir
+    Kernel2D shade_kernel = [&](UInt frame_index, Float time) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id      = dispatch_id().xy();
+        auto pixel         = pixel_id.y * m_resolution.x + pixel_id.x;
+        auto camera_sample = primary(pixel_id, frame_index, time);
+        auto& swl          = camera_sample.swl;
+        auto it            = geometry->intersect(camera_sample.ray);
+        auto wo            = -camera_sample.ray->direction();
+
+        SampledSpectrum L{swl.dimension(), 0.0f};
+        auto weight = m_weights[1]->read(pixel);
+        $if(it->valid() & it->shape.has_surface() & weight.x > 0.0f)
+        {
+            auto point    = load_point(1u, pixel);
+            auto light_it = light_sampler->light_interaction(it->p_g, point);
+            $if(!geometry->intersect_any(it->spawn_ray_to(light_it->p_g)))
+            {
+                with_closure(*it, swl, time, [&](const Surface::Closure* closure) noexcept
+                {
+                    L += unshadowed(closure, *it, wo, point, swl, time) * weight.x;
+                });
+            };
+        };
+        auto rgb = renderer.spectrum()->srgb(swl, L * camera_sample.weight);
+        film->accumulate_exclusive(pixel_id, film->sanitize(rgb, 1.0f), 0.0f);
+    };
+
+    auto shader_cache = renderer.shader_cache();
+    m_initial         = shader_cache->compile(initial_kernel, "restir_di_initial", signature);
+    m_spatial         = shader_cache->compile(spatial_kernel, "restir_di_spatial", signature);
+    m_shade           = shader_cache->compile(shade_kernel, "restir_di_shade", signature);
+    LUISA_INFO("ReSTIR DI: {} candidates, {} spatial neighbors ({:.2f} MB of reservoirs).",
+               initial_candidates,
+               spatial_neighbors,
+               static_cast<double>(2u * (m_points[0].size_bytes() + m_weights[0].size_bytes())) / (1024.0 * 1024.0));
+}
+
+void ReSTIRDI::render(CommandBuffer& command_buffer, uint frame_index, float time) noexcept
+{
+    command_buffer
+        << m_initial(frame_index, time, m_history_valid).dispatch(m_resolution)
+        << m_spatial(frame_index, time).dispatch(m_resolution)
+        << m_shade(frame_index, time).dispatch(m_resolution);
+    m_history_valid = true;
+}
+
+ReSTIRDI::Primary ReSTIRDI::primary(Expr<uint2> pixel_id, Expr<uint> frame_index, Expr<float> time) const noexcept
+{
+    auto sampler = m_integrator.sampler();
+    sampler->start(pixel_id, frame_index | ReSTIR::stream_di_primary);
+
+    auto u_filter      = sampler->generate_pixel_2d();
+    auto u_lens        = m_camera->base()->requires_lens_sampling() ? sampler->generate_lens_2d() : make_float2(0.5f);
+    auto camera_sample = m_camera->generate_ray(pixel_id, time, u_filter, u_lens);
+
+    auto spectrum = m_integrator.renderer().spectrum();
+    auto swl      = spectrum->sample(spectrum->base()->is_fixed() ? 0.0f : sampler->generate_wavelength());
+    return Primary{.ray = camera_sample.ray, .weight = camera_sample.weight, .swl = std::move(swl)};
+}
+
+SampledSpectrum ReSTIRDI::unshadowed(const Surface::Closure* closure, const Interaction& it, Expr<float3> wo, const LightSampler::LightPoint& point, const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
+    auto eval = m_integrator.light_sampler()->evaluate_point(it, point, swl, time);
+    auto d    = eval.p - it.p_g;
+    auto d2   = max(dot(d, d), 1e-8f);
+    auto wi   = d * rsqrt(d2);
+    return closure->evaluate(wo, wi).f * eval.L * (abs(dot(eval.ng, wi)) / d2);
+}
+
+ReSTIRDI::Reservoir ReSTIRDI::empty() noexcept
+{
+    return ReSTIR::empty(LightSampler::LightPoint{.light_index = 0u, .triangle_id = 0u, .bary = make_float2(0.0f)});
+}
+
+LightSampler::LightPoint ReSTIRDI::load_point(uint index, Expr<uint> pixel) const noexcept
+{
+    auto v = m_points[index]->read(pixel);
+    return {.light_index = v.x, .triangle_id = v.y, .bary = make_float2(as<float>(v.z), as<float>(v.w))};
+}
+
+void ReSTIRDI::store(uint index, Expr<uint> pixel, const Reservoir& r) const noexcept
+{
+    m_points[index]->write(pixel, make_uint4(r.sample.light_index, r.sample.triangle_id, as<uint>(r.sample.bary.x), as<uint>(r.sample.bary.y)));
+    m_weights[index]->write(pixel, make_float2(r.w, r.m));
+}
+} // namespace Yutrel
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+
+#include <luisa/dsl/syntax.h>
+#include <luisa/runtime/buffer.h>
+#include <luisa/runtime/shader.h>
+
+#include "base/camera.h"
+#include "base/light_sampler.h"
+#include "base/restir.h"
+#include "base/surface.h"
+#include "utils/command_buffer.h"
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+class Integrator;
+
+// direct lighting at the primary hit from per-pixel reservoirs over light points, filled by resampled
+// importance sampling from the light sampler and reused across frames and neighbouring pixels
+// (Bitterli et al. 2020, the biased variant without visibility in the reuse weights)
+class ReSTIRDI
+{
+public:
+    static constexpr auto initial_candidates = 8u;
+    static constexpr auto spatial_neighbors  = 4u;
+    static constexpr auto spatial_radius     = 16.0f;
+
+    using Reservoir = ReSTIR::Reservoir<LightSampler::LightPoint>;
+
+private:
+    const Integrator& m_integrator;
+    const Camera::Instance* m_camera;
+    uint2 m_resolution;
+    bool m_history_valid{false};
+
+    // primary hit position and geometric normal per pixel, w is 0 where the camera ray missed
+    Buffer<float4> m_positions;
+    Buffer<float4> m_normals;
+    // light point (light index, triangle, barycentrics) and (W, M) per pixel, the first pair is written by the
+    // initial pass, the second by the spatial pass and kept as the history of the next frame
+    std::array<Buffer<uint4>, 2u> m_points;
+    std::array<Buffer<float2>, 2u> m_weights;
+
+    Shader2D<uint, float, bool> m_initial;
+    Shader2D<uint, float> m_spatial;
+    Shader2D<uint, float> m_shade;
+
+public:
+    // traces and compiles the passes, signature names them in the shader cache
+    ReSTIRDI(const Integrator& integrator, const Camera::Instance* camera, uint64_t signature) noexcept;
+    ~ReSTIRDI() noexcept = default;
+
+    ReSTIRDI(const ReSTIRDI&)            = delete;
+    ReSTIRDI& operator=(const ReSTIRDI&) = delete;
+
+public:
+    // drops the history, the reservoirs of the previous frame belong to another view
+    void invalidate() noexcept { m_history_valid = false; }
+    // adds the direct lighting of the primary hits to the film without counting a sample
+    void render(CommandBuffer& command_buffer, uint frame_index, float time) noexcept;
+
+private:
+    struct Primary
+    {
+        Var<Ray> ray;
+        Float weight;
+        SampledWavelengths swl;
+    };
+
+    // the camera ray and wavelengths of the pixel, identical in every pass of a frame
+    [[nodiscard]] Primary primary(Expr<uint2> pixel_id, Expr<uint> frame_index, Expr<float> time) const noexcept;
+    // f·L·G towards the light point, in the area measure on the light and without visibility
+    [[nodiscard]] SampledSpectrum unshadowed(const Surface::Closure* closure, const Interaction& it, Expr<float3> wo, const LightSampler::LightPoint& point, const SampledWavelengths& swl, Expr<float> time) const noexcept;
+
+    [[nodiscard]] static Reservoir empty() noexcept;
+    [[nodiscard]] LightSampler::LightPoint load_point(uint index, Expr<uint> pixel) const noexcept;
+    void store(uint index, Expr<uint> pixel, const Reservoir& r) const noexcept;
+};
+} // namespace Yutrel
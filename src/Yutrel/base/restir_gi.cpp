@@ -0,0 +1,252 @@
+#include "restir_gi.h"
+
+#include <luisa/luisa-compute.h>
+
+#include "base/film.h"
+#include "base/geometry.h"
+#include "base/integrator.h"
+#include "base/interaction.h"
+#include "base/renderer.h"
+#include "base/sampler.h"
+#include "base/surface.h"
+#include "utils/color_space.h"
+#include "utils/shader_cache.h"
+
+namespace Yutrel
+{
+ReSTIRGI::ReSTIRGI(const Integrator& integrator, const Camera::Instance* camera) noexcept
+    : m_integrator(integrator),
+      m_camera(camera),
+      m_resolution(camera->film()->base()->resolution())
+{
+    auto&& device       = integrator.renderer().device();
+    auto pixel_count    = m_resolution.x * m_resolution.y;
+    m_visible_positions = device.create_buffer<float4>(2u * pixel_count);
+    m_visible_normals   = device.create_buffer<float4>(2u * pixel_count);
+    m_sample_positions  = device.create_buffer<float4>(pixel_count);
+    m_sample_normals    = device.create_buffer<float4>(pixel_count);
+    m_sample_radiance   = device.create_buffer<float4>(pixel_count);
+    for (auto i = 0u; i < 2u; i++)
+    {
+        m_positions[i] = device.create_buffer<float4>(pixel_count);
+        m_normals[i]   = device.create_buffer<float4>(pixel_count);
+        m_radiance[i]  = device.create_buffer<float4>(pixel_count);
+    }
+}
+
+void ReSTIRGI::compile(uint64_t signature) noexcept
+{
+    auto&& renderer = m_integrator.renderer();
+    auto sampler    = m_integrator.sampler();
+    auto film       = m_camera->film();
+
+    // the sample of this frame, then the reservoir of the previous frame at the same pixel
+    Kernel2D temporal_kernel = [&](UInt frame_index, Bool temporal) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id          = dispatch_id().xy();
+        auto pixel             = pixel_id.y * m_resolution.x + pixel_id.x;
+        auto position          = m_visible_positions->read(visible_index(pixel_id, frame_index));
+        auto normal            = m_visible_normals->read(visible_index(pixel_id, frame_index));
+        auto previous_position = m_visible_positions->read(visible_index(pixel_id, frame_index + 1u));
+        auto previous_normal   = m_visible_normals->read(visible_index(pixel_id, frame_index + 1u));
+
+        auto r = empty();
+        $if(position.w > 0.0f)
+        {
+            sampler->start(pixel_id, frame_index | ReSTIR::stream_gi_temporal);
+            auto p        = m_sample_positions->read(pixel);
+            auto n        = m_sample_normals->read(pixel);
+            auto radiance = m_sample_radiance->read(pixel);
+            auto p_hat    = linear_srgb_to_cie_y(radiance.xyz());
+            auto u        = sampler->generate_1d();
+            $if(p.w > 0.0f)
+            {
+                r.update(Sample{.position = p.xyz(), .normal = n.xyz(), .radiance = radiance.xyz()}, p_hat / p.w, p_hat, u);
+            };
+            r.m = 1.0f;
+            r.finalize();
+
+            $if(temporal & ReSTIR::similar(position, normal, previous_position, previous_normal))
+            {
+                auto history_p        = m_positions[1]->read(pixel);
+                auto history_n        = m_normals[1]->read(pixel);
+                auto history_radiance = m_radiance[1]->read(pixel);
+                auto u_history        = sampler->generate_1d();
+                $if(history_p.w > 0.0f & dot(normal.xyz(), history_p.xyz() - position.xyz()) > 0.0f)
+                {
+                    auto j = jacobian(previous_position.xyz(), position.xyz(), history_p.xyz(), history_n.xyz());
+                    $if(j < max_jacobian & j > 1.0f / max_jacobian & visible(position.xyz(), normal.xyz(), history_p.xyz()))
+                    {
+                        auto m             = min(history_n.w, ReSTIR::history_cap * r.m);
+                        auto history_p_hat = linear_srgb_to_cie_y(history_radiance.xyz());
+                        r.update(Sample{.position = history_p.xyz(), .normal = history_n.xyz(), .radiance = history_radiance.xyz()}, history_p_hat * history_p.w * m * j, history_p_hat, u_history);
+                        r.m += m;
+                    };
+                };
+                r.finalize();
+            };
+        };
+        store(0u, pixel, r);
+    };
+
+    // reservoirs of random neighbours on a similar surface whose sample points the pixel can see
+    Kernel2D spatial_kernel = [&](UInt frame_index) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id = dispatch_id().xy();
+        auto pixel    = pixel_id.y * m_resolution.x + pixel_id.x;
+        auto position = m_visible_positions->read(visible_index(pixel_id, frame_index));
+        auto normal   = m_visible_normals->read(visible_index(pixel_id, frame_index));
+
+        auto r = empty();
+        $if(position.w > 0.0f)
+        {
+            sampler->start(pixel_id, frame_index | ReSTIR::stream_gi_spatial);
+            auto merge = [&](Expr<uint> q, Expr<float> j) noexcept
+            {
+                auto p        = m_positions[0]->read(q);
+                auto n        = m_normals[0]->read(q);
+                auto radiance = m_radiance[0]->read(q);
+                auto p_hat    = linear_srgb_to_cie_y(radiance.xyz());
+                r.update(Sample{.position = p.xyz(), .normal = n.xyz(), .radiance = radiance.xyz()}, p_hat * p.w * n.w * j, p_hat, sampler->generate_1d());
+                r.m += n.w;
+            };
+            merge(pixel, 1.0f);
+            $for(k, spatial_neighbors)
+            {
+                auto offset     = (sampler->generate_2d() * 2.0f - 1.0f) * spatial_radius;
+                auto q_id       = make_uint2(clamp(make_int2(pixel_id) + make_int2(offset), make_int2(0), make_int2(m_resolution) - 1));
+                auto q          = q_id.y * m_resolution.x + q_id.x;
+                auto q_position = m_visible_positions->read(visible_index(q_id, frame_index));
+                auto q_normal   = m_visible_normals->read(visible_index(q_id, frame_index));
+                $if(q != pixel & ReSTIR::similar(position, normal, q_position, q_normal))
+                {
+                    auto p = m_positions[0]->read(q);
+                    auto n = m_normals[0]->read(q);
+                    $if(p.w > 0.0f & dot(normal.xyz(), p.xyz() - position.xyz()) > 0.0f)
+                    {
+                        auto j = jacobian(q_position.xyz(), position.xyz(), p.xyz(), n.xyz());
+                        $if(j < max_jacobian & j > 1.0f / max_jacobian & visible(position.xyz(), normal.xyz(), p.xyz()))
+                        {
+                            merge(q, j);
+                        };
+                    };
+                };
+            };
+            r.finalize();
+        };
+        store(1u, pixel, r);
+    };
+
+    // the selected secondary vertex through the bsdf of the primary hit, on the camera ray of the path tracer
+    Kernel2D shade_kernel = [&](UInt frame_index, Float time) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id = dispatch_id().xy();
+        auto pixel    = pixel_id.y * m_resolution.x + pixel_id.x;
+
+        sampler->start(pixel_id, frame_index);
+        auto u_filter                       = sampler->generate_pixel_2d();
+        auto u_lens                         = m_camera->base()->requires_lens_sampling() ? sampler->generate_lens_2d() : make_float2(0.5f);
+        auto [camera_ray, _, camera_weight] = m_camera->generate_ray(pixel_id, time, u_filter, u_lens);
+        auto spectrum                       = renderer.spectrum();
+        auto swl                            = spectrum->sample(spectrum->base()->is_fixed() ? 0.0f : sampler->generate_wavelength());
+
+        SampledSpectrum L{swl.dimension(), 0.0f};
+        auto it = renderer.geometry()->intersect(camera_ray);
+        auto p  = m_positions[1]->read(pixel);
+        $if(it->valid() & it->shape.has_surface() & p.w > 0.0f)
+        {
+            auto wo       = -camera_ray->direction();
+            auto wi       = normalize(p.xyz() - it->p_g);
+            auto radiance = spectrum->decode_illuminant(swl, spectrum->encode_srgb_illuminant(m_radiance[1]->read(pixel).xyz())).value;
+            $outline
+            {
+                PolymorphicCall<Surface::Closure> call;
+                renderer.surfaces().dispatch(it->shape.surface_tag(), [&](auto surface) noexcept
+                {
+                    surface->closure(call, *it, swl, time);
+                });
+                call.execute([&](const Surface::Closure* closure) noexcept
+                {
+                    L += closure->evaluate(wo, wi).f * radiance * p.w;
+                });
+            };
+        };
+        auto rgb = spectrum->srgb(swl, L * camera_weight);
+        film->accumulate_exclusive(pixel_id, film->sanitize(rgb, 1.0f), 0.0f);
+    };
+
+    auto shader_cache = renderer.shader_cache();
+    m_temporal        = shader_cache->compile(temporal_kernel, "restir_gi_temporal", signature);
+    m_spatial         = shader_cache->compile(spatial_kernel, "restir_gi_spatial", signature);
+    m_shade           = shader_cache->compile(shade_kernel, "restir_gi_shade", signature);
+    LUISA_INFO("ReSTIR GI: {} spatial neighbors ({:.2f} MB of reservoirs).",
+               spatial_neighbors,
+               static_cast<double>(6u * m_positions[0].size_bytes()) / (1024.0 * 1024.0));
+}
+
+void ReSTIRGI::render(CommandBuffer& command_buffer, uint frame_index, float time) noexcept
+{
+    command_buffer
+        << m_temporal(frame_index, m_history_valid).dispatch(m_resolution)
+        << m_spatial(frame_index).dispatch(m_resolution)
+        << m_shade(frame_index, time).dispatch(m_resolution);
+    m_history_valid = true;
+}
+
+void ReSTIRGI::record_visible(Expr<uint2> pixel_id, Expr<uint> frame_index, Expr<float3> p, Expr<float3> n, Expr<float> distance) const noexcept
+{
+    auto index = visible_index(pixel_id, frame_index);
+    m_visible_positions->write(index, make_float4(p, distance));
+    m_visible_normals->write(index, make_float4(n, 0.0f));
+}
+
+void ReSTIRGI::record_sample(Expr<uint2> pixel_id, Expr<float3> p, Expr<float3> n, Expr<float3> radiance, Expr<float> pdf) const noexcept
+{
+    auto pixel = pixel_id.y * m_resolution.x + pixel_id.x;
+    m_sample_positions->write(pixel, make_float4(p, pdf));
+    m_sample_normals->write(pixel, make_float4(n, 0.0f));
+    m_sample_radiance->write(pixel, make_float4(radiance, 0.0f));
+}
+
+UInt ReSTIRGI::visible_index(Expr<uint2> pixel_id, Expr<uint> frame_index) const noexcept
+{
+    return (frame_index & 1u) * (m_resolution.x * m_resolution.y) + pixel_id.y * m_resolution.x + pixel_id.x;
+}
+
+Float ReSTIRGI::jacobian(Expr<float3> from, Expr<float3> to, Expr<float3> p, Expr<float3> n) noexcept
+{
+    // ratio of the solid angles the same area around p subtends at both receivers
+    auto d_from   = from - p;
+    auto d_to     = to - p;
+    auto l_from   = max(dot(d_from, d_from), 1e-8f);
+    auto l_to     = max(dot(d_to, d_to), 1e-8f);
+    auto cos_from = abs(dot(n, d_from)) * rsqrt(l_from);
+    auto cos_to   = abs(dot(n, d_to)) * rsqrt(l_to);
+    return cos_to * l_from / max(cos_from * l_to, 1e-8f);
+}
+
+Bool ReSTIRGI::visible(Expr<float3> x, Expr<float3> n_x, Expr<float3> p) const noexcept
+{
+    auto d      = p - x;
+    auto l      = length(d);
+    auto wi     = d * (1.0f / l);
+    auto offset = n_x * 1e-4f;
+    auto origin = x + ite(dot(wi, n_x) > 0.0f, offset, -offset);
+    return !m_integrator.renderer().geometry()->intersect_any(make_ray(origin, wi, 0.0f, l * 0.999f));
+}
+
+ReSTIRGI::Reservoir ReSTIRGI::empty() noexcept
+{
+    return ReSTIR::empty(Sample{.position = make_float3(0.0f), .normal = make_float3(0.0f), .radiance = make_float3(0.0f)});
+}
+
+void ReSTIRGI::store(uint index, Expr<uint> pixel, const Reservoir& r) const noexcept
+{
+    m_positions[index]->write(pixel, make_float4(r.sample.position, r.w));
+    m_normals[index]->write(pixel, make_float4(r.sample.normal, r.m));
+    m_radiance[index]->write(pixel, make_float4(r.sample.radiance, 0.0f));
+}
+} // namespace Yutrel
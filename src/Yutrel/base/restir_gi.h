@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+
+#include <luisa/dsl/syntax.h>
+#include <luisa/runtime/buffer.h>
+#include <luisa/runtime/shader.h>
+
+#include "base/camera.h"
+#include "base/restir.h"
+#include "utils/command_buffer.h"
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+class Integrator;
+
+// indirect lighting at the primary hit from per-pixel reservoirs over secondary vertices: the path tracer
+// records the point its first bounce reached with the radiance leaving it, which is then reused across
+// frames and neighbouring pixels with the solid angle Jacobian between receivers (Ouyang et al. 2021)
+class ReSTIRGI
+{
+public:
+    static constexpr auto spatial_neighbors = 4u;
+    static constexpr auto spatial_radius    = 24.0f;
+    // neighbours whose Jacobian exceeds this ratio in either direction are skipped
+    static constexpr auto max_jacobian = 10.0f;
+
+    // secondary vertex with the radiance leaving it towards the primary hit
+    struct Sample
+    {
+        Float3 position;
+        Float3 normal;
+        Float3 radiance;
+    };
+    using Reservoir = ReSTIR::Reservoir<Sample>;
+
+private:
+    const Integrator& m_integrator;
+    const Camera::Instance* m_camera;
+    uint2 m_resolution;
+    bool m_history_valid{false};
+
+    // primary hit (position, hit distance) and geometric normal of this and the previous frame, indexed
+    // by the parity of the frame index, w is 0 where the camera ray found no surface
+    Buffer<float4> m_visible_positions;
+    Buffer<float4> m_visible_normals;
+    // the sample of the current frame: secondary vertex and bsdf pdf, its normal, radiance towards the primary hit
+    Buffer<float4> m_sample_positions;
+    Buffer<float4> m_sample_normals;
+    Buffer<float4> m_sample_radiance;
+    // reservoirs as (position, W), (normal, M), radiance, the temporal pass writes the first set,
+    // the spatial pass the second which is shaded and kept as the next frame's history
+    std::array<Buffer<float4>, 2u> m_positions;
+    std::array<Buffer<float4>, 2u> m_normals;
+    std::array<Buffer<float4>, 2u> m_radiance;
+
+    Shader2D<uint, bool> m_temporal;
+    Shader2D<uint> m_spatial;
+    Shader2D<uint, float> m_shade;
+
+public:
+    ReSTIRGI(const Integrator& integrator, const Camera::Instance* camera) noexcept;
+    ~ReSTIRGI() noexcept = default;
+
+    ReSTIRGI(const ReSTIRGI&)            = delete;
+    ReSTIRGI& operator=(const ReSTIRGI&) = delete;
+
+public:
+    // traces and compiles the passes, signature names them in the shader cache
+    void compile(uint64_t signature) noexcept;
+    // drops the history, the reservoirs of the previous frame belong to another view
+    void invalidate() noexcept { m_history_valid = false; }
+    // adds the indirect lighting of the primary hits to the film without counting a sample,
+    // after the path tracer recorded the samples of frame_index
+    void render(CommandBuffer& command_buffer, uint frame_index, float time) noexcept;
+
+    // called by the path tracer for every pixel, distance is 0 where the camera ray found no surface
+    void record_visible(Expr<uint2> pixel_id, Expr<uint> frame_index, Expr<float3> p, Expr<float3> n, Expr<float> distance) const noexcept;
+    // pdf is 0 when the path did not bounce off the primary hit
+    void record_sample(Expr<uint2> pixel_id, Expr<float3> p, Expr<float3> n, Expr<float3> radiance, Expr<float> pdf) const noexcept;
+
+private:
+    [[nodiscard]] UInt visible_index(Expr<uint2> pixel_id, Expr<uint> frame_index) const noexcept;
+    // scales the reservoir weight of a sample taken at from for use at to
+    [[nodiscard]] static Float jacobian(Expr<float3> from, Expr<float3> to, Expr<float3> p, Expr<float3> n) noexcept;
+    // whether p is unoccluded from the surface point (x, n_x), with the offsets of Interaction::spawn_ray_to
+    [[nodiscard]] Bool visible(Expr<float3> x, Expr<float3> n_x, Expr<float3> p) const noexcept;
+
+    [[nodiscard]] static Reservoir empty() noexcept;
+    void store(uint index, Expr<uint> pixel, const Reservoir& r) const noexcept;
+};
+} // namespace Yutrel
@@ -0,0 +1,132 @@
+#include "rrs_cache.h"
+
+#include <luisa/luisa-compute.h>
+
+#include "base/camera.h"
+#include "base/film.h"
+#include "base/renderer.h"
+#include "utils/shader_cache.h"
+
+namespace Yutrel
+{
+RRSCache::RRSCache(const Renderer& renderer, uint grid_resolution) noexcept
+    : SceneGrid(renderer, grid_resolution),
+      m_resolution(renderer.camera()->film()->base()->resolution())
+{
+    auto&& device = renderer.device();
+    m_cells       = device.create_buffer<float4>(cell_count());
+    m_pixels      = device.create_buffer<float4>(m_resolution.x * m_resolution.y);
+    m_statistics  = device.create_buffer<float4>(1u);
+    m_image       = device.create_buffer<float4>(1u);
+    LUISA_INFO("RRS cache: {}^3 cells ({:.2f} MB).",
+               this->grid_resolution(),
+               static_cast<double>(m_cells.size_bytes() + m_pixels.size_bytes()) / (1024.0 * 1024.0));
+
+    Kernel1D reset_cells_kernel = [this]() noexcept
+    {
+        m_cells->write(dispatch_x(), make_float4(0.0f));
+    };
+
+    Kernel1D reset_pixels_kernel = [this]() noexcept
+    {
+        m_pixels->write(dispatch_x(), make_float4(0.0f));
+    };
+
+    Kernel1D reduce_kernel = [this]() noexcept
+    {
+        auto p = m_pixels->read(dispatch_x());
+        auto n = max(p.z, 1.0f);
+        auto I = p.x / n;
+        // unbiased variance of one sample
+        auto variance = max(p.y / n - I * I, 0.0f) * n / max(n - 1.0f, 1.0f);
+        $if(I > 0.0f)
+        {
+            m_statistics->atomic(0u).x.fetch_add(variance / (I * I));
+            m_statistics->atomic(0u).y.fetch_add(1.0f);
+        };
+        m_statistics->atomic(0u).z.fetch_add(I);
+        m_statistics->atomic(0u).w.fetch_add(p.w / n);
+    };
+
+    auto shader_cache = renderer.shader_cache();
+    auto signature    = make_uint3(this->grid_resolution(), m_resolution);
+    auto hash         = luisa::hash64(&signature, sizeof(signature), luisa::hash64_default_seed);
+    m_reset_cells     = shader_cache->compile(reset_cells_kernel, "rrs_reset_cells", hash);
+    m_reset_pixels    = shader_cache->compile(reset_pixels_kernel, "rrs_reset_pixels", hash);
+    m_reduce          = shader_cache->compile(reduce_kernel, "rrs_reduce", hash);
+}
+
+void RRSCache::reset(CommandBuffer& command_buffer) noexcept
+{
+    SceneGrid::reset(command_buffer);
+    m_image_host = make_float4(0.0f);
+    command_buffer
+        << m_image.copy_from(&m_image_host)
+        << m_reset_cells().dispatch(cell_count())
+        << m_reset_pixels().dispatch(m_resolution.x * m_resolution.y);
+}
+
+void RRSCache::finish_training(CommandBuffer& command_buffer) noexcept
+{
+    SceneGrid::finish_training(command_buffer);
+
+    auto pixel_count  = m_resolution.x * m_resolution.y;
+    m_statistics_host = make_float4(0.0f);
+    command_buffer
+        << m_statistics.copy_from(&m_statistics_host)
+        << m_reduce().dispatch(pixel_count)
+        << m_statistics.copy_to(&m_statistics_host)
+        << synchronize();
+
+    auto relative_variance = m_statistics_host.x / std::max(m_statistics_host.y, 1.0f);
+    auto mean_estimate     = m_statistics_host.z / static_cast<float>(pixel_count);
+    auto vertices          = std::max(m_statistics_host.w / static_cast<float>(pixel_count), 1.0f);
+    // dark pixels are treated as a hundredth of the mean so that their paths are not split without bound
+    m_image_host = make_float4(relative_variance, vertices, 0.01f * mean_estimate, relative_variance > 0.0f ? 1.0f : 0.0f);
+    command_buffer << m_image.copy_from(&m_image_host) << synchronize();
+    LUISA_INFO("RRS cache trained: relative pixel variance {}, {:.2f} vertices per path.", relative_variance, vertices);
+}
+
+Float RRSCache::factor(Expr<uint2> pixel, Expr<uint> cell, Expr<float> throughput) const noexcept
+{
+    auto image  = m_image->read(0u);
+    auto c      = m_cells->read(cell);
+    auto result = def(0.0f);
+    $if(image.w > 0.0f & c.w > 0.0f)
+    {
+        // q = T · sqrt(E[L_r²] / C_r) / I · sqrt(C / V), with V the relative variance of a pixel sample and C its cost
+        auto p             = m_pixels->read(pixel_index(pixel));
+        auto I             = max(p.x / max(p.z, 1.0f), image.z);
+        auto second_moment = c.y / c.w;
+        auto cost          = 1.0f + c.z / c.w;
+        auto q             = throughput * sqrt(second_moment * image.y / (cost * image.x)) / max(I, 1e-8f);
+        result             = clamp(q, min_factor, max_factor);
+    };
+    return result;
+}
+
+void RRSCache::record_vertex(Expr<uint> cell, Expr<float> radiance, Expr<float> cost) const noexcept
+{
+    $if(!(compute::isnan(radiance) | compute::isinf(radiance)))
+    {
+        auto L = max(radiance, 0.0f);
+        m_cells->atomic(cell).x.fetch_add(L);
+        m_cells->atomic(cell).y.fetch_add(L * L);
+        m_cells->atomic(cell).z.fetch_add(cost);
+        m_cells->atomic(cell).w.fetch_add(1.0f);
+    };
+}
+
+void RRSCache::record_pixel(Expr<uint2> pixel, Expr<float> radiance, Expr<float> cost) const noexcept
+{
+    // one thread owns the pixel during a dispatch
+    auto i = pixel_index(pixel);
+    auto L = ite(compute::isnan(radiance) | compute::isinf(radiance), 0.0f, max(radiance, 0.0f));
+    m_pixels->write(i, m_pixels->read(i) + make_float4(L, L * L, 1.0f, cost));
+}
+
+UInt RRSCache::pixel_index(Expr<uint2> pixel) const noexcept
+{
+    return pixel.y * m_resolution.x + pixel.x;
+}
+} // namespace Yutrel
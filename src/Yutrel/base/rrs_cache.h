@@ -0,0 +1,71 @@
+#pragma once
+
+#include <luisa/dsl/syntax.h>
+#include <luisa/runtime/buffer.h>
+#include <luisa/runtime/shader.h>
+
+#include "base/scene_grid.h"
+#include "utils/command_buffer.h"
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+class Renderer;
+
+// efficiency-aware Russian roulette and splitting (Rath et al. 2022): the scene grid learns the second moment
+// and the cost of the radiance a path gathers after each vertex, which together with the pixel estimates and
+// the image variance of a pilot pass gives the expected number of continuations of a path
+class RRSCache : public SceneGrid
+{
+public:
+    // factors below one roulette the path, above one split it
+    static constexpr auto min_factor = 0.05f;
+    static constexpr auto max_factor = 8.0f;
+    // vertices per path whose continuation is recorded while training
+    static constexpr auto max_recorded_vertices = 8u;
+
+private:
+    uint2 m_resolution;
+
+    float4 m_statistics_host{};
+    float4 m_image_host{};
+    // per cell: sum of the radiance gathered after the vertex divided by the throughput to it, sum of its
+    // square, sum of the vertices traced after it and the number of records
+    Buffer<float4> m_cells;
+    // per pixel: sum of the path radiance, its square, the sample count and the vertices traced
+    Buffer<float4> m_pixels;
+    // sum of the relative pixel variances, pixels with a positive estimate, sum of the pixel estimates,
+    // sum of the mean vertices per path
+    Buffer<float4> m_statistics;
+    // relative variance of one pixel sample, vertices per path, smallest pixel estimate used, 1 once trained
+    Buffer<float4> m_image;
+
+    Shader1D<> m_reset_cells;
+    Shader1D<> m_reset_pixels;
+    Shader1D<> m_reduce;
+
+public:
+    RRSCache(const Renderer& renderer, uint grid_resolution) noexcept;
+    ~RRSCache() noexcept = default;
+
+    RRSCache(const RRSCache&)            = delete;
+    RRSCache& operator=(const RRSCache&) = delete;
+
+public:
+    // uploads the scene bounds and forgets everything learned, paths fall back to throughput roulette
+    void reset(CommandBuffer& command_buffer) noexcept;
+    // derives the image statistics from the pixels of the pilot pass and enables the learned factors
+    void finish_training(CommandBuffer& command_buffer) noexcept;
+
+    // expected number of continuations at a vertex reached with this throughput, 0 where nothing was learned
+    [[nodiscard]] Float factor(Expr<uint2> pixel, Expr<uint> cell, Expr<float> throughput) const noexcept;
+    // radiance gathered after a vertex divided by the throughput to it, and the vertices traced after it
+    void record_vertex(Expr<uint> cell, Expr<float> radiance, Expr<float> cost) const noexcept;
+    void record_pixel(Expr<uint2> pixel, Expr<float> radiance, Expr<float> cost) const noexcept;
+
+private:
+    [[nodiscard]] UInt pixel_index(Expr<uint2> pixel) const noexcept;
+};
+} // namespace Yutrel
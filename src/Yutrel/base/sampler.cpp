@@ -1,49 +1,161 @@
 #include "sampler.h"
 
+#include <typeinfo>
+
+#include <luisa/core/clock.h>
 #include <luisa/luisa-compute.h>
 
 #include "base/renderer.h"
-#include "utils/rng.h"
+#include "samplers/independent.h"
+#include "samplers/pmj02.h"
+#include "samplers/sobol.h"
+#include "samplers/zsobol.h"
+#include "utils/shader_cache.h"
 
 namespace Yutrel
 {
-Sampler::Sampler(const Renderer& renderer) noexcept
-    : m_renderer(renderer) {}
+Sampler::Sampler(const Renderer& renderer, const CreateInfo& info) noexcept
+    : m_renderer(renderer),
+      m_seed(info.seed) {}
+
+luisa::unique_ptr<Sampler> Sampler::create(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
+{
+    switch (info.type)
+    {
+    case Type::independent:
+        return luisa::make_unique<IndependentSampler>(renderer, info);
+    case Type::sobol:
+        return luisa::make_unique<SobolSampler>(renderer, command_buffer, info);
+    case Type::zsobol:
+        return luisa::make_unique<ZSobolSampler>(renderer, command_buffer, info);
+    case Type::pmj02:
+        return luisa::make_unique<PMJ02Sampler>(renderer, command_buffer, info);
+    default:
+        LUISA_ERROR("Unsupported sampler type {}.", static_cast<uint>(info.type));
+        return nullptr;
+    }
+}
 
-luisa::unique_ptr<Sampler> Sampler::create(const Renderer& renderer) noexcept
+luisa::string Sampler::constants() const noexcept
 {
-    return luisa::make_unique<Sampler>(renderer);
+    return luisa::format("{}", m_seed);
 }
 
 void Sampler::reset(CommandBuffer& command_buffer, uint state_count) noexcept
 {
     if (!m_states || state_count > m_states.size())
     {
-        m_states = m_renderer.device().create_buffer<uint>(next_pow2(state_count));
+        m_states = m_renderer.device().create_buffer<uint4>(next_pow2(state_count));
     }
 }
 
 void Sampler::start(UInt2 pixel, UInt index) noexcept
 {
-    m_state.emplace(xxhash32(make_uint4(pixel, seed(), index)));
+    m_state.emplace(initial_state(pixel, index));
+    m_state->dimension = dimension_path;
 }
 
-[[nodiscard]] Float Sampler::generate_1d() noexcept
+void Sampler::load_state(Expr<uint> state_id) noexcept
 {
-    Float u = 0.0f;
-    $outline { u = lcg(*m_state); };
+    LUISA_ASSERT(m_states, "Sampler is not reset.");
+    auto s = m_states->read(state_id);
+    m_state.emplace(State{.key = s.x, .index = s.y, .dimension = s.z, .salt = s.w});
+}
+
+void Sampler::save_state(Expr<uint> state_id) noexcept
+{
+    LUISA_ASSERT(m_states && m_state, "Sampler is not started.");
+    m_states->write(state_id, make_uint4(m_state->key, m_state->index, m_state->dimension, m_state->salt));
+}
+
+Float Sampler::generate_1d() noexcept
+{
+    auto u = generate_1d(m_state->dimension);
+    m_state->dimension += 1u;
+    return u;
+}
+
+Float2 Sampler::generate_2d() noexcept
+{
+    auto u = generate_2d(m_state->dimension);
+    m_state->dimension += 2u;
     return u;
 }
 
-[[nodiscard]] Float2 Sampler::generate_2d() noexcept
+Float2 Sampler::generate_pixel_2d() const noexcept
+{
+    return generate_2d(dimension_filter);
+}
+
+Float2 Sampler::generate_lens_2d() const noexcept
+{
+    return generate_2d(dimension_lens);
+}
+
+Float Sampler::generate_wavelength() const noexcept
+{
+    return generate_1d(dimension_wavelength);
+}
+
+Float Sampler::generate_1d(Expr<uint> dimension) const noexcept
 {
-    Float2 u = make_float2();
-    $outline
+    LUISA_ASSERT(m_state, "Sampler is not started.");
+    return sample_1d(*m_state, dimension);
+}
+
+Float2 Sampler::generate_2d(Expr<uint> dimension) const noexcept
+{
+    LUISA_ASSERT(m_state, "Sampler is not started.");
+    return sample_2d(*m_state, dimension);
+}
+
+UInt Sampler::dimension() const noexcept
+{
+    LUISA_ASSERT(m_state, "Sampler is not started.");
+    return m_state->dimension;
+}
+
+void Sampler::set_dimension(Expr<uint> dimension) noexcept
+{
+    LUISA_ASSERT(m_state, "Sampler is not started.");
+    m_state->dimension = dimension;
+}
+
+void Sampler::benchmark(CommandBuffer& command_buffer, uint2 resolution, uint dimensions) noexcept
+{
+    auto sink = m_renderer.device().create_buffer<float>(1u);
+
+    Kernel2D benchmark_kernel = [&](UInt index) noexcept
     {
-        u.x = generate_1d();
-        u.y = generate_1d();
+        set_block_size(16u, 16u, 1u);
+        start(dispatch_id().xy(), index);
+        auto sum = def(0.0f);
+        $for(d, dimensions / 2u)
+        {
+            auto u = generate_2d();
+            sum += u.x + u.y;
+        };
+        // never taken, keeps the samples from being optimized away
+        $if(sum < 0.0f) { sink->write(0u, sum); };
     };
-    return u;
+    auto signature = ShaderCache::hash(luisa::format("{}:{}:{}", typeid(*this).name(), constants(), dimensions));
+    auto shader    = m_renderer.shader_cache()->compile(benchmark_kernel, "sampler_benchmark", signature);
+
+    constexpr auto passes = 8u;
+    command_buffer << shader(0u).dispatch(resolution) << synchronize();
+    Clock clock;
+    for (auto pass = 1u; pass <= passes; pass++)
+    {
+        command_buffer << shader(pass).dispatch(resolution);
+    }
+    command_buffer << synchronize();
+    auto milliseconds = clock.toc();
+    auto samples      = static_cast<double>(resolution.x) * resolution.y * passes * (dimensions / 2u * 2u);
+    LUISA_INFO("Sampler ({}) generates {:.1f} M samples/s, {:.3f} ns per sample over {} dimensions.",
+               typeid(*this).name(),
+               samples / std::max(milliseconds, 1e-3) * 1e-3,
+               milliseconds * 1e6 / std::max(samples, 1.0),
+               dimensions);
 }
 
-} // namespace Yutrel
\ No newline at end of file
+} // namespace Yutrel
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <luisa/core/stl/memory.h>
+#include <luisa/core/stl.h>
 #include <luisa/dsl/syntax.h>
 
 #include "utils/command_buffer.h"
@@ -15,18 +15,51 @@ class Renderer;
 class Sampler
 {
 public:
-    [[nodiscard]] static luisa::unique_ptr<Sampler> create(const Renderer& renderer) noexcept;
+    enum class Type
+    {
+        independent,
+        sobol,
+        zsobol,
+        pmj02,
+    };
+
+    struct CreateInfo
+    {
+        Type type{Type::independent};
+        uint seed{20120712u};
+    };
+
+    [[nodiscard]] static luisa::unique_ptr<Sampler> create(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept;
+
+    // every camera path draws its pixel filter, lens and wavelength samples from these fixed dimensions, the
+    // light and BSDF samples of the vertices then take the following dimensions in the order they are drawn
+    static constexpr auto dimension_filter     = 0u;
+    static constexpr auto dimension_lens       = 2u;
+    static constexpr auto dimension_wavelength = 4u;
+    static constexpr auto dimension_path       = 5u;
+
+protected:
+    // the sampling state of one path, saved alongside it by the wavefront integrator: key identifies the
+    // pixel to the implementation and salt anything else it scrambles by, dimension is the next one
+    // generate_1d/2d draw from. Every sample is a pure function of the state and its dimension
+    struct State
+    {
+        UInt key;
+        UInt index;
+        UInt dimension;
+        UInt salt;
+    };
 
 private:
     const Renderer& m_renderer;
 
     uint m_seed{20120712u};
-    Buffer<uint> m_states;
-    luisa::optional<Var<uint>> m_state;
+    Buffer<uint4> m_states;
+    luisa::optional<State> m_state;
 
 public:
-    explicit Sampler(const Renderer& renderer) noexcept;
-    ~Sampler() noexcept = default;
+    explicit Sampler(const Renderer& renderer, const CreateInfo& info) noexcept;
+    virtual ~Sampler() noexcept = default;
 
     Sampler() noexcept                          = delete;
     Sampler(const Sampler&) noexcept            = delete;
@@ -35,12 +68,35 @@ public:
     Sampler& operator=(Sampler&&) noexcept      = delete;
 
 public:
+    [[nodiscard]] auto& renderer() const noexcept { return m_renderer; }
     [[nodiscard]] auto seed() const noexcept { return m_seed; }
+    // host constants the samples are generated with, part of the name of cached shaders
+    [[nodiscard]] virtual luisa::string constants() const noexcept;
 
     void reset(CommandBuffer& command_buffer, uint state_count) noexcept;
 
     void start(UInt2 pixel, UInt index) noexcept;
+    void load_state(Expr<uint> state_id) noexcept;
+    void save_state(Expr<uint> state_id) noexcept;
     [[nodiscard]] Float generate_1d() noexcept;
     [[nodiscard]] Float2 generate_2d() noexcept;
+    [[nodiscard]] Float2 generate_pixel_2d() const noexcept;
+    [[nodiscard]] Float2 generate_lens_2d() const noexcept;
+    [[nodiscard]] Float generate_wavelength() const noexcept;
+
+    // any dimension of the started sample can be regenerated, so that separate stages of a path agree on
+    // their numbers without replaying the calls before them
+    [[nodiscard]] Float generate_1d(Expr<uint> dimension) const noexcept;
+    [[nodiscard]] Float2 generate_2d(Expr<uint> dimension) const noexcept;
+    [[nodiscard]] UInt dimension() const noexcept;
+    void set_dimension(Expr<uint> dimension) noexcept;
+
+    // logs the cost of generating samples over the given pixels, dimensions deep
+    void benchmark(CommandBuffer& command_buffer, uint2 resolution, uint dimensions) noexcept;
+
+protected:
+    [[nodiscard]] virtual State initial_state(Expr<uint2> pixel, Expr<uint> index) const noexcept  = 0;
+    [[nodiscard]] virtual Float sample_1d(const State& state, Expr<uint> dimension) const noexcept  = 0;
+    [[nodiscard]] virtual Float2 sample_2d(const State& state, Expr<uint> dimension) const noexcept = 0;
 };
-} // namespace Yutrel
\ No newline at end of file
+} // namespace Yutrel
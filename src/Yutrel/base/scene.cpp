@@ -4,16 +4,20 @@ namespace Yutrel
 {
 struct Scene::Config
 {
-    luisa::unique_ptr<Camera> camera;
-    luisa::unique_ptr<Film> film;
-    luisa::unique_ptr<Filter> filter;
+    luisa::vector<luisa::unique_ptr<Camera>> cameras;
+    luisa::vector<luisa::unique_ptr<Film>> films;
+    luisa::vector<luisa::unique_ptr<Filter>> filters;
     luisa::unique_ptr<Spectrum> spectrum;
     luisa::vector<luisa::unique_ptr<Shape>> shapes;
     luisa::vector<luisa::unique_ptr<Surface>> surfaces;
     luisa::vector<luisa::unique_ptr<Light>> lights;
+    luisa::vector<luisa::unique_ptr<Medium>> media;
     luisa::vector<luisa::unique_ptr<Texture>> textures;
 
     luisa::vector<const Shape*> shapes_view;
+    luisa::vector<const Camera*> cameras_view;
+
+    Integrator::CreateInfo integrator_info;
 };
 
 Scene::Scene(const Context& context) noexcept
@@ -29,6 +33,26 @@ luisa::unique_ptr<Scene> Scene::create(const Context& context, const CreateInfo&
     scene->load_spectrum(info.spectrum_info);
 
     scene->load_camera(info.camera_info);
+    for (auto& camera_info : info.batch_camera_infos)
+    {
+        if (camera_info.type != info.camera_info.type ||
+            any(camera_info.film_info.resolution != info.camera_info.film_info.resolution) ||
+            camera_info.film_info.tile_size != info.camera_info.film_info.tile_size ||
+            camera_info.film_info.denoise != info.camera_info.film_info.denoise ||
+            camera_info.film_info.aovs != info.camera_info.film_info.aovs ||
+            camera_info.filter_info.type != info.camera_info.filter_info.type ||
+            camera_info.filter_info.radius != info.camera_info.filter_info.radius ||
+            camera_info.spp != info.camera_info.spp ||
+            any(camera_info.shutter_span != info.camera_info.shutter_span) ||
+            camera_info.shutter_samples_count != info.camera_info.shutter_samples_count) [[unlikely]]
+        {
+            // the sampler, the shutter buckets and the checkpoint fingerprint are set up from the first camera
+            LUISA_ERROR("Batch cameras must share the camera model, film resolution, filter, spp and shutter of the first camera.");
+        }
+        scene->load_camera(camera_info);
+    }
+
+    scene->m_config->integrator_info = info.integrator_info;
 
     scene->m_config->shapes_view.reserve(info.shape_infos.size());
     for (auto& shape_info : info.shape_infos)
@@ -45,27 +69,17 @@ void Scene::load_spectrum(const Spectrum::CreateInfo& info) noexcept
 
 void Scene::load_camera(const Camera::CreateInfo& info) noexcept
 {
-    if (m_config->camera)
-    {
-        LUISA_ERROR("Multiple cameras are not supported yet.");
-        return;
-    }
-    m_config->camera = Camera::create(*this, info);
+    m_config->cameras_view.emplace_back(m_config->cameras.emplace_back(Camera::create(*this, info)).get());
 }
 
 const Film* Scene::load_film(const Film::CreateInfo& info) noexcept
 {
-    if (m_config->film)
-    {
-        LUISA_ERROR("Multiple films are not supported yet.");
-        return nullptr;
-    }
-    return (m_config->film = Film::create(info)).get();
+    return m_config->films.emplace_back(Film::create(info)).get();
 }
 
 const Filter* Scene::load_filter(const Filter::CreateInfo& info) noexcept
 {
-    return (m_config->filter = Filter::create(*this, info)).get();
+    return m_config->filters.emplace_back(Filter::create(*this, info)).get();
 }
 
 const Shape* Scene::load_shape(const Shape::CreateInfo& info) noexcept
@@ -83,6 +97,11 @@ const Light* Scene::load_light(const Light::CreateInfo& info) noexcept
     return m_config->lights.emplace_back(Light::create(*this, info)).get();
 }
 
+const Medium* Scene::load_medium(const Medium::CreateInfo& info) noexcept
+{
+    return m_config->media.emplace_back(Medium::create(*this, info)).get();
+}
+
 const Texture* Scene::load_texture(const Texture::CreateInfo& info) noexcept
 {
     return m_config->textures.emplace_back(Texture::create(*this, info)).get();
@@ -95,12 +114,22 @@ const Spectrum* Scene::spectrum() const noexcept
 
 const Camera* Scene::camera() const noexcept
 {
-    return m_config->camera.get();
+    return m_config->cameras.empty() ? nullptr : m_config->cameras.front().get();
+}
+
+luisa::span<const Camera* const> Scene::cameras() const noexcept
+{
+    return m_config->cameras_view;
 }
 
 const Film* Scene::film() const noexcept
 {
-    return m_config->film.get();
+    return m_config->films.empty() ? nullptr : m_config->films.front().get();
+}
+
+const Integrator::CreateInfo& Scene::integrator_info() const noexcept
+{
+    return m_config->integrator_info;
 }
 
 luisa::span<const Shape* const> Scene::shapes() const noexcept
@@ -4,6 +4,7 @@
 
 #include "base/camera.h"
 #include "base/film.h"
+#include "base/integrator.h"
 #include "base/shape.h"
 #include "base/spectrum.h"
 #include "base/surface.h"
@@ -21,6 +22,10 @@ public:
     {
         Spectrum::CreateInfo spectrum_info;
         Camera::CreateInfo camera_info;
+        // further camera/film jobs rendered after camera_info in the same process, they must share
+        // its camera model, resolution and filter so that geometry and compiled shaders are reused
+        luisa::vector<Camera::CreateInfo> batch_camera_infos;
+        Integrator::CreateInfo integrator_info;
         luisa::vector<Shape::CreateInfo> shape_infos;
     };
 
@@ -50,11 +55,14 @@ public:
     [[nodiscard]] const Shape* load_shape(const Shape::CreateInfo& info) noexcept;
     [[nodiscard]] const Surface* load_surface(const Surface::CreateInfo& info) noexcept;
     [[nodiscard]] const Light* load_light(const Light::CreateInfo& info) noexcept;
+    [[nodiscard]] const Medium* load_medium(const Medium::CreateInfo& info) noexcept;
     [[nodiscard]] const Texture* load_texture(const Texture::CreateInfo& info) noexcept;
 
     [[nodiscard]] const Spectrum* spectrum() const noexcept;
     [[nodiscard]] const Camera* camera() const noexcept;
+    [[nodiscard]] luisa::span<const Camera* const> cameras() const noexcept;
     [[nodiscard]] const Film* film() const noexcept;
+    [[nodiscard]] const Integrator::CreateInfo& integrator_info() const noexcept;
     [[nodiscard]] luisa::span<const Shape* const> shapes() const noexcept;
 };
 
@@ -0,0 +1,56 @@
+#include "scene_grid.h"
+
+#include <luisa/luisa-compute.h>
+
+#include "base/geometry.h"
+#include "base/renderer.h"
+
+namespace Yutrel
+{
+SceneGrid::SceneGrid(const Renderer& renderer, uint grid_resolution) noexcept
+    : m_renderer(renderer),
+      m_grid_resolution(std::max(grid_resolution, 1u))
+{
+    auto&& device = renderer.device();
+    m_bounds      = device.create_buffer<float4>(2u);
+    m_training    = device.create_buffer<uint>(1u);
+}
+
+void SceneGrid::reset(CommandBuffer& command_buffer) noexcept
+{
+    auto geometry   = m_renderer.geometry();
+    auto extent     = max(geometry->bounds_max() - geometry->bounds_min(), make_float3(1e-4f));
+    m_bounds_host   = {make_float4(geometry->bounds_min(), 0.0f), make_float4(extent, 0.0f)};
+    m_training_host = 0u;
+    m_trained       = false;
+    command_buffer
+        << m_bounds.copy_from(m_bounds_host.data())
+        << m_training.copy_from(&m_training_host);
+}
+
+void SceneGrid::set_training(CommandBuffer& command_buffer, bool training) noexcept
+{
+    m_training_host = training ? 1u : 0u;
+    command_buffer << m_training.copy_from(&m_training_host);
+}
+
+void SceneGrid::finish_training(CommandBuffer& command_buffer) noexcept
+{
+    set_training(command_buffer, false);
+    m_trained = true;
+}
+
+UInt SceneGrid::cell(Expr<float3> p) const noexcept
+{
+    auto bounds_min    = m_bounds->read(0u).xyz();
+    auto bounds_extent = m_bounds->read(1u).xyz();
+    auto x             = clamp((p - bounds_min) / bounds_extent, 0.0f, 0.9999f);
+    auto c             = make_uint3(x * static_cast<float>(m_grid_resolution));
+    return (c.z * m_grid_resolution + c.y) * m_grid_resolution + c.x;
+}
+
+Bool SceneGrid::training() const noexcept
+{
+    return m_training->read(0u) != 0u;
+}
+} // namespace Yutrel
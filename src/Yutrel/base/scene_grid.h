@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+
+#include <luisa/dsl/syntax.h>
+#include <luisa/runtime/buffer.h>
+
+#include "utils/command_buffer.h"
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+class Renderer;
+
+// a regular grid over the scene bounds with a device-side training flag, the caches learned from path
+// vertices keep their data per cell of it
+class SceneGrid
+{
+private:
+    const Renderer& m_renderer;
+    uint m_grid_resolution;
+    bool m_trained{false};
+
+    // scene min and extent, known only after the geometry is built
+    std::array<float4, 2u> m_bounds_host{};
+    uint m_training_host{0u};
+    Buffer<float4> m_bounds;
+    Buffer<uint> m_training;
+
+public:
+    SceneGrid(const Renderer& renderer, uint grid_resolution) noexcept;
+    ~SceneGrid() noexcept = default;
+
+    SceneGrid(const SceneGrid&)            = delete;
+    SceneGrid& operator=(const SceneGrid&) = delete;
+
+public:
+    [[nodiscard]] auto& renderer() const noexcept { return m_renderer; }
+    [[nodiscard]] auto grid_resolution() const noexcept { return m_grid_resolution; }
+    [[nodiscard]] auto trained() const noexcept { return m_trained; }
+    [[nodiscard]] auto cell_count() const noexcept { return m_grid_resolution * m_grid_resolution * m_grid_resolution; }
+
+    // uploads the scene bounds and clears the training state, the cells themselves are reset by the owner
+    void reset(CommandBuffer& command_buffer) noexcept;
+    void set_training(CommandBuffer& command_buffer, bool training) noexcept;
+    void finish_training(CommandBuffer& command_buffer) noexcept;
+
+    [[nodiscard]] UInt cell(Expr<float3> p) const noexcept;
+    [[nodiscard]] Bool training() const noexcept;
+};
+} // namespace Yutrel
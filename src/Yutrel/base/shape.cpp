@@ -19,7 +19,8 @@ luisa::unique_ptr<Shape> Shape::create(Scene& scene, const CreateInfo& info) noe
 
 Shape::Shape(Scene& scene, const CreateInfo& info) noexcept
     : m_surface(scene.load_surface(info.surface_info)),
-      m_light(scene.load_light(info.light_info)) {}
+      m_light(scene.load_light(info.light_info)),
+      m_medium(scene.load_medium(info.medium_info)) {}
 
 uint4 Shape::Handle::encode(
     uint buffer_base, uint flags,
@@ -3,6 +3,7 @@
 #include <luisa/core/stl.h>
 
 #include "base/light.h"
+#include "base/medium.h"
 #include "base/surface.h"
 #include "utils/vertex.h"
 
@@ -35,6 +36,8 @@ public:
 
         Surface::CreateInfo surface_info;
         Light::CreateInfo light_info;
+        // a shape with a medium and no surface bounds the medium, which rays enter through its front faces
+        Medium::CreateInfo medium_info;
     };
 
     [[nodiscard]] static luisa::unique_ptr<Shape> create(Scene& scene, const CreateInfo& info) noexcept;
@@ -53,6 +56,7 @@ public:
 private:
     const Surface* m_surface;
     const Light* m_light;
+    const Medium* m_medium;
 
 public:
     explicit Shape(Scene& scene, const CreateInfo& info) noexcept;
@@ -67,6 +71,7 @@ public:
 public:
     [[nodiscard]] const Surface* surface() const noexcept { return m_surface; }
     [[nodiscard]] const Light* light() const noexcept { return m_light; }
+    [[nodiscard]] const Medium* medium() const noexcept { return m_medium; }
 
     [[nodiscard]] virtual bool is_mesh() const noexcept { return false; }
     [[nodiscard]] virtual MeshView mesh() const noexcept { return {}; }
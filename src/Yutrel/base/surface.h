@@ -119,6 +119,8 @@ public:
     [[nodiscard]] virtual luisa::string closure_identifier() const noexcept                                                   = 0;
     [[nodiscard]] virtual luisa::unique_ptr<Closure> create_closure(SampledWavelengths& swl, Expr<float> time) const noexcept = 0;
     virtual void populate_closure(Closure* closure, const Interaction& it) const noexcept                                     = 0;
+    // reflectance without any lobe sampling, cheap enough for the interactive preview
+    [[nodiscard]] virtual SampledSpectrum albedo(const Interaction& it, const SampledWavelengths& swl, Expr<float> time) const noexcept = 0;
 };
 
 class Surface::Closure : public PolymorphicClosure
@@ -20,10 +20,14 @@ PinholeCamera::Instance::Instance(Renderer& renderer, CommandBuffer& command_buf
     : Camera::Instance(renderer, command_buffer, camera),
       m_device_data(renderer.arena_buffer<PinholeCameraData>(1u))
 {
-    PinholeCameraData host_data{make_float2(film()->base()->resolution()), tan(camera->m_fov * 0.5f)};
-    m_device_data = renderer.arena_buffer<PinholeCameraData>(1u);
+    upload_device_data(command_buffer);
+}
+
+void PinholeCamera::Instance::upload_device_data(CommandBuffer& command_buffer) noexcept
+{
+    m_host_data = PinholeCameraData{make_float2(film()->base()->resolution()), tan(base<PinholeCamera>()->m_fov * 0.5f)};
     command_buffer
-        << m_device_data.copy_from(&host_data)
+        << m_device_data.copy_from(&m_host_data)
         << commit();
 }
 
@@ -36,4 +40,20 @@ Var<Ray> PinholeCamera::Instance::generate_ray_in_camera_space(Expr<float2> pixe
     return make_ray(make_float3(0.0f), direction_cs);
 }
 
+Camera::Projection PinholeCamera::Instance::project_in_camera_space(Expr<float3> p, Expr<float2> u_lens) const noexcept
+{
+    // inverts generate_ray_in_camera_space() on the plane at unit distance
+    auto data  = m_device_data->read(0u);
+    auto q     = p.xy() / max(-p.z, 1e-8f);
+    auto pixel = (make_float2(q.x, -q.y) * (data.resolution.y / data.tan_half_fov) + data.resolution) * 0.5f;
+    return {.p_lens = make_float3(0.0f), .pixel = pixel, .pdf = 0.0f, .valid = p.z < 0.0f};
+}
+
+Float PinholeCamera::Instance::image_area() const noexcept
+{
+    auto data = m_device_data->read(0u);
+    auto h    = 2.0f * data.tan_half_fov;
+    return h * h * data.resolution.x / data.resolution.y;
+}
+
 } // namespace Yutrel
\ No newline at end of file
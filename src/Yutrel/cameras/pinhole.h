@@ -21,6 +21,7 @@ class PinholeCamera final : public Camera
     {
     private:
         BufferView<PinholeCameraData> m_device_data;
+        PinholeCameraData m_host_data;
 
     public:
         explicit Instance(Renderer& renderer, CommandBuffer& command_buffer, const PinholeCamera* camera) noexcept;
@@ -28,6 +29,9 @@ class PinholeCamera final : public Camera
 
     private:
         [[nodiscard]] Var<Ray> generate_ray_in_camera_space(Expr<float2> pixel, Expr<float> time, Expr<float2> u_lens) const noexcept override;
+        [[nodiscard]] Projection project_in_camera_space(Expr<float3> p, Expr<float2> u_lens) const noexcept override;
+        [[nodiscard]] Float image_area() const noexcept override;
+        void upload_device_data(CommandBuffer& command_buffer) noexcept override;
     };
 
 private:
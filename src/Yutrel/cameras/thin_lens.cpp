@@ -24,6 +24,12 @@ ThinLensCamera::Instance::Instance(Renderer& renderer, CommandBuffer& command_bu
     : Camera::Instance(renderer, command_buffer, camera),
       m_device_data(renderer.arena_buffer<ThinLensCameraData>(1u))
 {
+    upload_device_data(command_buffer);
+}
+
+void ThinLensCamera::Instance::upload_device_data(CommandBuffer& command_buffer) noexcept
+{
+    auto camera                 = base<ThinLensCamera>();
     auto v                      = camera->focus_distance();
     auto f                      = camera->focal_length() * 1e-3;
     auto u                      = 1.0 / (1.0 / f - 1.0 / v);
@@ -38,7 +44,7 @@ ThinLensCamera::Instance::Instance(Renderer& renderer, CommandBuffer& command_bu
             : luisa::min(static_cast<float>(object_to_sensor_ratio * .024 / resolution.x),
                          static_cast<float>(object_to_sensor_ratio * .036 / resolution.y));
 
-    ThinLensCameraData host_data{
+    m_host_data = ThinLensCameraData{
         .pixel_offset         = pixel_offset,
         .resolution           = resolution,
         .focus_distance       = v,
@@ -46,7 +52,7 @@ ThinLensCamera::Instance::Instance(Renderer& renderer, CommandBuffer& command_bu
         .projected_pixel_size = projected_pixel_size,
     };
     command_buffer
-        << m_device_data.copy_from(&host_data)
+        << m_device_data.copy_from(&m_host_data)
         << commit();
 }
 
@@ -60,4 +66,23 @@ ThinLensCamera::Instance::Instance(Renderer& renderer, CommandBuffer& command_bu
     return make_ray(p_lens, normalize(p_focal - p_lens));
 }
 
+Camera::Projection ThinLensCamera::Instance::project_in_camera_space(Expr<float3> p, Expr<float2> u_lens) const noexcept
+{
+    // the ray from the lens point through p crosses the focal plane where generate_ray_in_camera_space() aimed it
+    auto data       = m_device_data->read(0u);
+    auto coord_lens = sample_uniform_disk_concentric(u_lens) * data.lens_radius;
+    auto p_lens     = make_float3(coord_lens, 0.0f);
+    auto t          = data.focus_distance / max(-p.z, 1e-8f);
+    auto p_focal    = p_lens + t * (p - p_lens);
+    auto pixel      = make_float2(p_focal.x, -p_focal.y) / data.projected_pixel_size + data.pixel_offset;
+    return {.p_lens = p_lens, .pixel = pixel, .pdf = 0.0f, .valid = p.z < 0.0f};
+}
+
+Float ThinLensCamera::Instance::image_area() const noexcept
+{
+    auto data = m_device_data->read(0u);
+    auto size = data.resolution * (data.projected_pixel_size / data.focus_distance);
+    return size.x * size.y;
+}
+
 } // namespace Yutrel
\ No newline at end of file
@@ -28,6 +28,7 @@ public:
     {
     private:
         BufferView<ThinLensCameraData> m_device_data;
+        ThinLensCameraData m_host_data;
 
     public:
         explicit Instance(Renderer& renderer, CommandBuffer& command_buffer, const ThinLensCamera* camera) noexcept;
@@ -35,6 +36,9 @@ public:
 
     private:
         [[nodiscard]] Var<Ray> generate_ray_in_camera_space(Expr<float2> pixel, Expr<float> time, Expr<float2> u_lens) const noexcept override;
+        [[nodiscard]] Projection project_in_camera_space(Expr<float3> p, Expr<float2> u_lens) const noexcept override;
+        [[nodiscard]] Float image_area() const noexcept override;
+        void upload_device_data(CommandBuffer& command_buffer) noexcept override;
     };
 
 private:
@@ -0,0 +1,687 @@
+#include "bidirectional_path.h"
+
+#include <algorithm>
+
+#include <luisa/core/thread_pool.h>
+#include <luisa/luisa-compute.h>
+
+#include "base/camera.h"
+#include "base/camera_controller.h"
+#include "base/film.h"
+#include "base/geometry.h"
+#include "base/interaction.h"
+#include "base/light_sampler.h"
+#include "base/renderer.h"
+#include "base/sampler.h"
+#include "utils/color_space.h"
+#include "utils/command_buffer.h"
+#include "utils/progress_bar.h"
+#include "utils/shader_cache.h"
+#include "utils/spectra.h"
+
+namespace Yutrel
+{
+namespace
+{
+// the vertices of one subpath, the first lies on the lens or on a light
+struct Subpath
+{
+    static constexpr auto capacity = BidirectionalPathTracing::max_subpath_vertices;
+
+    ArrayVar<TriangleHit, capacity> hit;
+    ArrayVar<float3, capacity> p;
+    ArrayVar<float3, capacity> n;
+    // area densities of the vertex when sampled from its predecessor and from its successor
+    ArrayVar<float, capacity> pdf_fwd;
+    ArrayVar<float, capacity> pdf_rev;
+    // throughput up to the vertex
+    Local<float> beta;
+    UInt count{0u};
+
+    explicit Subpath(uint dimension) noexcept : beta{capacity * dimension} {}
+
+    void store_beta(Expr<uint> index, const SampledSpectrum& b) noexcept
+    {
+        for (auto i = 0u; i < b.dimension(); i++)
+        {
+            beta[index * b.dimension() + i] = b[i];
+        }
+    }
+
+    [[nodiscard]] SampledSpectrum load_beta(Expr<uint> index, uint dimension) noexcept
+    {
+        SampledSpectrum b{dimension};
+        for (auto i = 0u; i < dimension; i++)
+        {
+            b[i] = beta[index * dimension + i];
+        }
+        return b;
+    }
+};
+
+// a solid angle density at p_from turned into an area density at p_to
+[[nodiscard]] Float convert_density(Expr<float> pdf, Expr<float3> p_from, Expr<float3> p_to, Expr<float3> n_to) noexcept
+{
+    auto d        = p_to - p_from;
+    auto distance = max(length(d), 1e-6f);
+    return pdf * abs(dot(n_to, d)) / (distance * distance * distance);
+}
+} // namespace
+
+void BidirectionalPathTracing::render_interactive(Stream& stream)
+{
+    CommandBuffer command_buffer{stream};
+
+    auto camera     = renderer().camera();
+    auto resolution = camera->film()->base()->resolution();
+
+    if (restir() || restir_gi())
+    {
+        LUISA_WARNING("ReSTIR is not supported by the bidirectional integrator, tracing all lighting.");
+    }
+
+    camera->film()->prepare(command_buffer);
+    sampler()->reset(command_buffer, resolution.x * resolution.y);
+    command_buffer << synchronize();
+
+    FpsCameraController controller{camera->transform(), camera->base()->up(), FpsCameraController::Config{}};
+
+    // the preview drives the window until the full shader, compiled on a worker thread, is ready
+    auto preview = compile_preview(camera);
+    Shader2D<uint2, uint, uint, float, float> render;
+    auto compiled = global_thread_pool().async([&]
+    {
+        render = compile_render(camera, false, "bidirectional_interactive");
+    });
+    auto full_shader = false;
+
+    uint global_sample_index = 0u;
+
+    while (true)
+    {
+        camera->film()->show(command_buffer, true);
+        if (camera->film()->should_close())
+        {
+            break;
+        }
+
+        auto swap = !full_shader && compiled.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+        if (swap)
+        {
+            full_shader = true;
+            LUISA_INFO("Full shader ready, leaving the preview.");
+        }
+
+        if (controller.update() || swap)
+        {
+            auto c2w = controller.camera_to_world();
+            camera->set_transform(command_buffer, c2w);
+            camera->film()->prepare(command_buffer);
+            sampler()->reset(command_buffer, resolution.x * resolution.y);
+            global_sample_index = 0u;
+            command_buffer << synchronize();
+        }
+
+        if (full_shader)
+        {
+            command_buffer << render(make_uint2(0u), global_sample_index, 1u, 0.0f, 1.0f).dispatch(resolution);
+        }
+        else
+        {
+            command_buffer << preview(global_sample_index, 0.0f).dispatch(resolution);
+        }
+        global_sample_index++;
+        command_buffer << commit();
+    }
+
+    command_buffer << synchronize();
+    compiled.wait();
+    camera->film()->release();
+}
+
+void BidirectionalPathTracing::compile(const Camera::Instance* camera) noexcept
+{
+    LUISA_INFO("Start compiling Integrator shader");
+    Clock clock_compile;
+    m_render = compile_render(camera, track_moments(), "bidirectional_render");
+    LUISA_INFO("Integrator shader compile in {} ms.", clock_compile.toc());
+}
+
+Shader2D<uint2, uint, uint, float, float> BidirectionalPathTracing::compile_render(const Camera::Instance* camera, bool moments, luisa::string_view name) noexcept
+{
+    auto film = camera->film();
+    // splats land anywhere in the image, a tile cannot normalize them
+    auto splat = !film->base()->tiled();
+    if (!splat)
+    {
+        LUISA_WARNING("Light tracing needs the whole image, a tiled film only combines the strategies that end in the camera subpath.");
+    }
+    if (max_depth() + 2u > max_subpath_vertices)
+    {
+        LUISA_WARNING("Bidirectional path tracing keeps {} vertices per subpath, paths are cut at depth {}.", max_subpath_vertices, max_subpath_vertices - 2u);
+    }
+
+    // the colour goes through the atomic path of the film since splats of other pixels may land at the same time
+    Kernel2D render_kernel = [&](UInt2 tile_origin, UInt frame_index, UInt sample_count, Float time, Float shutter_weight) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id = tile_origin + dispatch_id().xy();
+        auto L_sum    = def(make_float3(0.0f));
+        auto mean     = def(0.0f);
+        auto m2       = def(0.0f);
+        // invalid samples are dropped and not counted
+        auto valid_count = def(0u);
+        $for(i, sample_count)
+        {
+            Var L = Li(camera, frame_index + i, pixel_id, time, shutter_weight, splat);
+            $if(film->is_valid(L * shutter_weight))
+            {
+                auto c = film->sanitize(L * shutter_weight, 1.0f);
+                L_sum += c;
+                valid_count += 1u;
+                if (moments)
+                {
+                    auto y     = linear_srgb_to_cie_y(c);
+                    auto delta = y - mean;
+                    mean += delta / cast<float>(valid_count);
+                    m2 += delta * (y - mean);
+                }
+            };
+        };
+        if (moments)
+        {
+            film->accumulate(pixel_id, L_sum, cast<float>(valid_count), make_float2(mean, m2));
+        }
+        else
+        {
+            film->accumulate(pixel_id, L_sum, cast<float>(valid_count));
+        }
+    };
+    return renderer().shader_cache()->compile(render_kernel, name, feature_signature(camera));
+}
+
+void BidirectionalPathTracing::render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera)
+{
+    auto spp        = camera->base()->spp();
+    auto film       = camera->film();
+    auto resolution = film->tile_extent();
+
+    sampler()->reset(command_buffer, film->pixel_count());
+    command_buffer << synchronize();
+
+    LUISA_INFO(
+        "Rendering of resolution {}x{} at {}spp (bidirectional).",
+        resolution.x,
+        resolution.y,
+        spp);
+    if (adaptive())
+    {
+        LUISA_WARNING("Adaptive sampling is not supported by the bidirectional integrator, splats need every pixel at the same spp.");
+    }
+    if (path_guide() != nullptr || rrs_cache() != nullptr)
+    {
+        LUISA_WARNING("Path guiding and learned roulette are not supported by the bidirectional integrator.");
+    }
+
+    if (!m_render)
+    {
+        compile(camera);
+    }
+    command_buffer << synchronize();
+
+    auto progress         = begin_progress(command_buffer, camera);
+    auto& shutter_samples = progress.shutter_samples;
+    auto& remaining_spp   = progress.remaining_spp;
+
+    LUISA_INFO("Rendering started.");
+    Clock clock_render;
+    Clock clock_checkpoint;
+    ProgressBar progress_bar;
+    progress_bar.update(0.0);
+    auto dispatch_count       = 0u;
+    auto& global_sample_index = progress.global_sample_index;
+    auto pass_count           = 0u;
+    auto bucket               = 0u;
+    auto error                = -1.0f;
+    while (true)
+    {
+        // as in the megakernel, progressive mode cycles through the shutter buckets
+        auto skipped = 0u;
+        while (skipped < remaining_spp.size() && remaining_spp[bucket] == 0u)
+        {
+            bucket = (bucket + 1u) % remaining_spp.size();
+            skipped++;
+        }
+        if (skipped == remaining_spp.size())
+        {
+            break;
+        }
+        const auto& s     = shutter_samples[bucket];
+        auto sample_count = std::min(samples_per_dispatch(), remaining_spp[bucket]);
+        remaining_spp[bucket] -= sample_count;
+        if (progressive())
+        {
+            bucket = (bucket + 1u) % remaining_spp.size();
+        }
+
+        dispatch_count++;
+        pass_count++;
+        command_buffer << m_render(film->tile_origin(), global_sample_index, sample_count, s.time, s.weight).dispatch(resolution);
+        global_sample_index += sample_count;
+        const auto dispatches_per_commit = 4u;
+        if (film->show(command_buffer) || dispatch_count >= dispatches_per_commit) [[unlikely]]
+        {
+            dispatch_count = 0u;
+            auto p         = global_sample_index / static_cast<double>(spp);
+            if (time_budget() > 0.0f)
+            {
+                p = std::max(p, clock_render.toc() * 1e-3 / time_budget());
+            }
+            command_buffer << [&progress_bar, p]
+            {
+                progress_bar.update(std::min(p, 1.0));
+            };
+            if (time_budget() > 0.0f)
+            {
+                command_buffer << synchronize();
+                if (clock_render.toc() * 1e-3 >= time_budget())
+                {
+                    break;
+                }
+            }
+        }
+        if (film->should_close()) [[unlikely]]
+        {
+            command_buffer << synchronize();
+            progress_bar.done();
+            return;
+        }
+        if (checkpoint_interval() > 0.0f && clock_checkpoint.toc() * 1e-3 >= checkpoint_interval())
+        {
+            write_checkpoint(command_buffer, camera, progress);
+            clock_checkpoint.tic();
+        }
+        if (check_target_error(pass_count, global_sample_index))
+        {
+            error = film->mean_relative_error(command_buffer);
+            if (error <= target_error())
+            {
+                break;
+            }
+        }
+    }
+    command_buffer << synchronize();
+    progress_bar.done();
+    auto render_time = clock_render.toc();
+    if (progressive() || report_error())
+    {
+        if (error < 0.0f && track_moments())
+        {
+            error = film->mean_relative_error(command_buffer);
+        }
+        // the pixel moments only see the strategies that end in the pixel, not the splats it receives
+        LUISA_INFO("Rendering (bidirectional) reached {} spp and mean relative error {} (splats excluded) in {:.2f} s, efficiency {:.4g}.",
+                   global_sample_index,
+                   error,
+                   render_time * 1e-3,
+                   1.0 / std::max(static_cast<double>(error) * error * render_time * 1e-3, 1e-12));
+    }
+    report_throughput("Bidirectional rendering", render_time, resolution, global_sample_index);
+}
+
+Float3 BidirectionalPathTracing::Li(const Camera::Instance* camera, Expr<uint> frame_index, Expr<uint2> pixel_id, Expr<float> time,
+                                    Expr<float> shutter_weight, bool splat) const noexcept
+{
+    sampler()->start(pixel_id, frame_index);
+
+    auto u_filter = sampler()->generate_pixel_2d();
+    auto u_lens   = camera->base()->requires_lens_sampling() ? sampler()->generate_lens_2d() : make_float2(0.5f);
+
+    auto [camera_ray, _, camera_weight] = camera->generate_ray(pixel_id, time, u_filter, u_lens);
+
+    auto spectrum  = renderer().spectrum();
+    auto swl       = spectrum->sample(spectrum->base()->is_fixed() ? 0.0f : sampler()->generate_wavelength());
+    auto dimension = swl.dimension();
+    SampledSpectrum L{dimension, 0.0f};
+
+    auto film        = camera->film();
+    auto geometry    = renderer().geometry();
+    auto has_lights  = !renderer().lights().empty();
+    auto max_bounces = std::min(max_depth(), max_subpath_vertices - 2u);
+
+    Subpath camera_path{dimension};
+    Subpath light_path{dimension};
+    auto light_point = LightSampler::LightPoint{.light_index = def(0u), .triangle_id = def(0u), .bary = def(make_float2(0.0f))};
+
+    auto with_closure = [&](const Interaction& it, auto&& f) noexcept
+    {
+        PolymorphicCall<Surface::Closure> call;
+        renderer().surfaces().dispatch(it.shape.surface_tag(), [&](auto surface) noexcept
+        {
+            surface->closure(call, it, swl, time);
+        });
+        call.execute([&](const Surface::Closure* closure) noexcept
+        {
+            f(closure);
+        });
+    };
+
+    // rebuilds the surface under a stored vertex as seen from its predecessor
+    auto vertex_interaction = [&](Subpath& path, Expr<uint> index) noexcept
+    {
+        auto p_from = path.p[index - 1u];
+        return geometry->interaction(make_ray(p_from, normalize(path.p[index] - p_from)), def(path.hit[index]));
+    };
+
+    // balance heuristic over every strategy that samples the same path of s light and t camera vertices, the
+    // reverse densities next to the connection are those of the connected path
+    auto mis_weight = [&](Expr<uint> s, Expr<uint> t, Expr<float> pt_rev, Expr<float> pt_minus_rev,
+                          Expr<float> qs_rev, Expr<float> qs_minus_rev) noexcept
+    {
+        auto remap = [](Expr<float> x) noexcept { return ite(x != 0.0f, x, 1.0f); };
+        auto sum   = def(0.0f);
+        auto ri    = def(1.0f);
+        $for(k, 1u, t)
+        {
+            auto i   = t - k;
+            auto rev = ite(i + 1u == t, pt_rev, ite(i + 2u == t, pt_minus_rev, camera_path.pdf_rev[i]));
+            ri *= remap(rev) / remap(camera_path.pdf_fwd[i]);
+            // ending the camera subpath on the lens is a splat, and the lens is never connected to a light directly
+            auto available = def(i != 1u);
+            if (splat)
+            {
+                available = available | (s + t != 2u);
+            }
+            $if(available) { sum += ri; };
+        };
+        ri = 1.0f;
+        $for(k, 0u, s)
+        {
+            auto i   = s - 1u - k;
+            auto rev = ite(i + 1u == s, qs_rev, ite(i + 2u == s, qs_minus_rev, light_path.pdf_rev[i]));
+            ri *= remap(rev) / remap(light_path.pdf_fwd[i]);
+            sum += ri;
+        };
+        return 1.0f / (1.0f + sum);
+    };
+
+    // camera subpath, the strategies without light vertices are counted where it finds a light
+    {
+        SampledSpectrum beta{dimension, camera_weight};
+        auto ray       = camera_ray;
+        auto pdf_solid = def(camera->pdf_direction(camera_ray->direction()));
+
+        camera_path.p[0]       = camera_ray->origin();
+        camera_path.n[0]       = camera_ray->direction();
+        camera_path.pdf_fwd[0] = 1.0f;
+        camera_path.pdf_rev[0] = 0.0f;
+        camera_path.store_beta(0u, beta);
+        camera_path.count = 1u;
+
+        $while(camera_path.count < max_bounces + 2u)
+        {
+            auto hit = geometry->trace_closest(ray);
+            auto it  = geometry->interaction(ray, hit);
+            auto i   = def(camera_path.count);
+            auto pre = i - 1u;
+
+            $if(i == 1u)
+            {
+                record_features(camera, pixel_id, *it, ray->origin(), swl, time);
+            };
+            $if(!it->valid()) { $break; };
+
+            camera_path.hit[i]     = hit;
+            camera_path.p[i]       = it->p_g;
+            camera_path.n[i]       = it->n_g;
+            camera_path.pdf_fwd[i] = convert_density(pdf_solid, camera_path.p[pre], it->p_g, it->n_g);
+            camera_path.store_beta(i, beta);
+            camera_path.count = i + 1u;
+
+            if (has_lights)
+            {
+                $if(it->shape.has_light())
+                {
+                    $outline
+                    {
+                        auto p_prev       = camera_path.p[pre];
+                        auto Le           = light_sampler()->emitted(*it, p_prev, swl, time);
+                        auto pt_rev       = light_sampler()->pdf_area(*it);
+                        auto pt_minus_rev = convert_density(light_sampler()->pdf_direction(*it, p_prev), it->p_g, p_prev, camera_path.n[pre]);
+                        L += mis_weight(0u, i + 1u, pt_rev, pt_minus_rev, 0.0f, 0.0f) * beta * Le;
+                    };
+                };
+            }
+
+            // lights without a surface end the path and take no part in connections
+            $if(!it->shape.has_surface())
+            {
+                camera_path.count = i;
+                $break;
+            };
+
+            auto u_lobe        = sampler()->generate_1d();
+            auto u_bsdf        = sampler()->generate_2d();
+            auto wo            = -ray->direction();
+            auto pdf_rev_solid = def(0.0f);
+            $outline
+            {
+                with_closure(*it, [&](const Surface::Closure* closure) noexcept
+                {
+                    auto surface_sample = closure->sample(wo, u_lobe, u_bsdf);
+                    auto pdf            = surface_sample.eval.pdf;
+                    pdf_rev_solid       = closure->evaluate(surface_sample.wi, wo).pdf;
+                    ray                 = it->spawn_ray(surface_sample.wi);
+                    pdf_solid           = pdf;
+                    beta *= ite(pdf > 0.0f, 1.0f / pdf, 0.0f) * surface_sample.eval.f;
+                });
+            };
+            camera_path.pdf_rev[pre] = convert_density(pdf_rev_solid, it->p_g, camera_path.p[pre], camera_path.n[pre]);
+            $if(pdf_solid <= 0.0f) { $break; };
+        };
+    }
+
+    // light subpath, starting on a point sampled by area on a uniformly chosen light
+    if (has_lights)
+    {
+        auto u_select    = sampler()->generate_1d();
+        auto u_light     = sampler()->generate_2d();
+        auto u_direction = sampler()->generate_2d();
+        auto emission    = light_sampler()->sample_area(u_select, u_light, u_direction, swl, time);
+        light_point.light_index = emission.point.light_index;
+        light_point.triangle_id = emission.point.triangle_id;
+        light_point.bary        = emission.point.bary;
+
+        $if(emission.pdf_area > 0.0f & emission.pdf_direction > 0.0f)
+        {
+            light_path.p[0]       = emission.p;
+            light_path.n[0]       = emission.n_g;
+            light_path.pdf_fwd[0] = emission.pdf_area;
+            light_path.pdf_rev[0] = 0.0f;
+            // the radiance of the first vertex is evaluated towards each vertex it connects to
+            light_path.store_beta(0u, SampledSpectrum{dimension, 1.0f / emission.pdf_area});
+            light_path.count = 1u;
+
+            auto ray       = emission.ray;
+            auto pdf_solid = def(emission.pdf_direction);
+            auto cos_light = abs(dot(emission.n_g, ray->direction()));
+            SampledSpectrum beta{dimension};
+            beta = emission.L * (cos_light / (emission.pdf_area * emission.pdf_direction));
+
+            $while(light_path.count < max_bounces + 1u)
+            {
+                auto hit = geometry->trace_closest(ray);
+                auto it  = geometry->interaction(ray, hit);
+                auto i   = def(light_path.count);
+                auto pre = i - 1u;
+                $if(!it->valid() | !it->shape.has_surface()) { $break; };
+
+                light_path.hit[i]     = hit;
+                light_path.p[i]       = it->p_g;
+                light_path.n[i]       = it->n_g;
+                light_path.pdf_fwd[i] = convert_density(pdf_solid, light_path.p[pre], it->p_g, it->n_g);
+                light_path.store_beta(i, beta);
+                light_path.count = i + 1u;
+
+                auto u_lobe        = sampler()->generate_1d();
+                auto u_bsdf        = sampler()->generate_2d();
+                auto wo            = -ray->direction();
+                auto pdf_rev_solid = def(0.0f);
+                $outline
+                {
+                    with_closure(*it, [&](const Surface::Closure* closure) noexcept
+                    {
+                        auto surface_sample = closure->sample(wo, u_lobe, u_bsdf);
+                        auto pdf            = surface_sample.eval.pdf;
+                        pdf_rev_solid       = closure->evaluate(surface_sample.wi, wo).pdf;
+                        ray                 = it->spawn_ray(surface_sample.wi);
+                        pdf_solid           = pdf;
+                        beta *= ite(pdf > 0.0f, 1.0f / pdf, 0.0f) * surface_sample.eval.f;
+                    });
+                };
+                light_path.pdf_rev[pre] = convert_density(pdf_rev_solid, it->p_g, light_path.p[pre], light_path.n[pre]);
+                $if(pdf_solid <= 0.0f) { $break; };
+            };
+        };
+    }
+
+    // strategies with vertices on both subpaths, s light and t camera vertices
+    $for(t, 1u, camera_path.count + 1u)
+    {
+        $for(s, 1u, light_path.count + 1u)
+        {
+            $if(s + t > max_bounces + 2u) { $continue; };
+
+            $if(t == 1u)
+            {
+                // light tracing: the light subpath is connected to the lens and splatted where it lands
+                if (splat)
+                {
+                    $if(s >= 2u)
+                    {
+                        $outline
+                        {
+                            auto qs         = s - 1u;
+                            auto p_s        = light_path.p[qs];
+                            auto it_s       = vertex_interaction(light_path, qs);
+                            auto u_splat    = camera->base()->requires_lens_sampling() ? sampler()->generate_2d() : make_float2(0.5f);
+                            auto projection = camera->project(p_s, u_splat);
+                            $if(projection.valid)
+                            {
+                                auto d        = projection.p_lens - p_s;
+                                auto distance = length(d);
+                                auto wi       = d / distance;
+                                auto wo       = normalize(light_path.p[qs - 1u] - p_s);
+                                SampledSpectrum f{dimension};
+                                auto pdf_rev = def(0.0f);
+                                with_closure(*it_s, [&](const Surface::Closure* closure) noexcept
+                                {
+                                    f       = closure->evaluate(wo, wi).f;
+                                    pdf_rev = closure->evaluate(wi, wo).pdf;
+                                });
+                                // the camera pdf of the direction is also its importance per unit lens area
+                                auto contribution = light_path.load_beta(qs, dimension) * f * (projection.pdf / (distance * distance));
+                                $if(contribution.max() > 0.0f & !geometry->intersect_any(it_s->spawn_ray_to(projection.p_lens)))
+                                {
+                                    auto qs_rev       = convert_density(projection.pdf, projection.p_lens, p_s, light_path.n[qs]);
+                                    auto qs_minus_rev = convert_density(pdf_rev, p_s, light_path.p[qs - 1u], light_path.n[qs - 1u]);
+                                    auto w            = mis_weight(s, 1u, 0.0f, 0.0f, qs_rev, qs_minus_rev);
+                                    auto color        = spectrum->srgb(swl, contribution * w) * shutter_weight;
+                                    film->accumulate(make_uint2(projection.pixel), color, 0.0f);
+                                };
+                            };
+                        };
+                    };
+                }
+            }
+            $elif(s == 1u)
+            {
+                // next-event estimation towards the first vertex of the light subpath
+                $outline
+                {
+                    auto pt   = t - 1u;
+                    auto p_t  = camera_path.p[pt];
+                    auto it_t = vertex_interaction(camera_path, pt);
+                    auto it_l = light_sampler()->light_interaction(p_t, light_point);
+
+                    auto d        = it_l->p_g - p_t;
+                    auto distance = length(d);
+                    auto wi       = d / distance;
+                    auto wo       = normalize(camera_path.p[pt - 1u] - p_t);
+                    auto Le       = light_sampler()->emitted(*it_l, p_t, swl, time);
+                    SampledSpectrum f{dimension};
+                    auto pdf_fwd = def(0.0f);
+                    auto pdf_rev = def(0.0f);
+                    with_closure(*it_t, [&](const Surface::Closure* closure) noexcept
+                    {
+                        auto eval = closure->evaluate(wo, wi);
+                        f         = eval.f;
+                        pdf_fwd   = eval.pdf;
+                        pdf_rev   = closure->evaluate(wi, wo).pdf;
+                    });
+                    auto cos_light    = abs(dot(it_l->n_g, wi));
+                    auto contribution = camera_path.load_beta(pt, dimension) * f * Le * light_path.load_beta(0u, dimension) * (cos_light / (distance * distance));
+                    $if(contribution.max() > 0.0f & !geometry->intersect_any(it_t->spawn_ray_to(it_l->p_g)))
+                    {
+                        auto pt_rev       = convert_density(light_sampler()->pdf_direction(*it_l, p_t), it_l->p_g, p_t, camera_path.n[pt]);
+                        auto pt_minus_rev = convert_density(pdf_rev, p_t, camera_path.p[pt - 1u], camera_path.n[pt - 1u]);
+                        auto qs_rev       = convert_density(pdf_fwd, p_t, it_l->p_g, it_l->n_g);
+                        L += mis_weight(1u, t, pt_rev, pt_minus_rev, qs_rev, 0.0f) * contribution;
+                    };
+                };
+            }
+            $else
+            {
+                // connects two surface vertices through both of their closures
+                $outline
+                {
+                    auto pt   = t - 1u;
+                    auto qs   = s - 1u;
+                    auto p_t  = camera_path.p[pt];
+                    auto p_s  = light_path.p[qs];
+                    auto it_t = vertex_interaction(camera_path, pt);
+                    auto it_s = vertex_interaction(light_path, qs);
+
+                    auto d        = p_s - p_t;
+                    auto distance = length(d);
+                    auto wi       = d / distance;
+                    auto wo_t     = normalize(camera_path.p[pt - 1u] - p_t);
+                    auto wo_s     = normalize(light_path.p[qs - 1u] - p_s);
+                    SampledSpectrum f_t{dimension};
+                    SampledSpectrum f_s{dimension};
+                    auto pdf_t_fwd = def(0.0f);
+                    auto pdf_t_rev = def(0.0f);
+                    auto pdf_s_fwd = def(0.0f);
+                    auto pdf_s_rev = def(0.0f);
+                    with_closure(*it_t, [&](const Surface::Closure* closure) noexcept
+                    {
+                        auto eval = closure->evaluate(wo_t, wi);
+                        f_t       = eval.f;
+                        pdf_t_fwd = eval.pdf;
+                        pdf_t_rev = closure->evaluate(wi, wo_t).pdf;
+                    });
+                    with_closure(*it_s, [&](const Surface::Closure* closure) noexcept
+                    {
+                        auto eval = closure->evaluate(wo_s, -wi);
+                        f_s       = eval.f;
+                        pdf_s_fwd = eval.pdf;
+                        pdf_s_rev = closure->evaluate(-wi, wo_s).pdf;
+                    });
+                    auto contribution = camera_path.load_beta(pt, dimension) * f_t * f_s * light_path.load_beta(qs, dimension) * (1.0f / (distance * distance));
+                    $if(contribution.max() > 0.0f & !geometry->intersect_any(it_t->spawn_ray_to(p_s)))
+                    {
+                        auto pt_rev       = convert_density(pdf_s_fwd, p_s, p_t, camera_path.n[pt]);
+                        auto pt_minus_rev = convert_density(pdf_t_rev, p_t, camera_path.p[pt - 1u], camera_path.n[pt - 1u]);
+                        auto qs_rev       = convert_density(pdf_t_fwd, p_t, p_s, light_path.n[qs]);
+                        auto qs_minus_rev = convert_density(pdf_s_rev, p_s, light_path.p[qs - 1u], light_path.n[qs - 1u]);
+                        L += mis_weight(s, t, pt_rev, pt_minus_rev, qs_rev, qs_minus_rev) * contribution;
+                    };
+                };
+            };
+        };
+    };
+
+    return spectrum->srgb(swl, L);
+}
+
+} // namespace Yutrel
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <luisa/runtime/shader.h>
+
+#include "base/integrator.h"
+
+namespace Yutrel
+{
+// bidirectional path tracing (Veach 1997): every sample traces a camera and a light subpath and connects each pair
+// of their vertices, the strategies are combined with the balance heuristic and those that reach the camera
+// through a light subpath are splatted into the film
+class BidirectionalPathTracing final : public Integrator
+{
+public:
+    // vertices kept per subpath, the camera subpath needs max_depth + 2 of them
+    static constexpr auto max_subpath_vertices = 16u;
+
+private:
+    Shader2D<uint2, uint, uint, float, float> m_render;
+
+public:
+    explicit BidirectionalPathTracing(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
+        : Integrator(renderer, command_buffer, info) {}
+    ~BidirectionalPathTracing() noexcept override = default;
+
+public:
+    void render_interactive(Stream& stream) override;
+
+private:
+    void render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera) override;
+    void compile(const Camera::Instance* camera) noexcept override;
+    [[nodiscard]] Shader2D<uint2, uint, uint, float, float> compile_render(const Camera::Instance* camera, bool moments, luisa::string_view name) noexcept;
+    // radiance of the strategies that end in this pixel, those that end on the lens are splatted where they land
+    // unless splat is off, which also leaves them out of the MIS weights
+    [[nodiscard]] Float3 Li(const Camera::Instance* camera, Expr<uint> frame_index, Expr<uint2> pixel_id, Expr<float> time,
+                            Expr<float> shutter_weight, bool splat) const noexcept;
+};
+} // namespace Yutrel
@@ -0,0 +1,1023 @@
+#include "megakernel_path.h"
+
+#include <array>
+
+#include <luisa/core/thread_pool.h>
+#include <luisa/luisa-compute.h>
+
+#include "base/camera.h"
+#include "base/camera_controller.h"
+#include "base/film.h"
+#include "base/geometry.h"
+#include "base/interaction.h"
+#include "base/light_sampler.h"
+#include "base/path_guide.h"
+#include "base/renderer.h"
+#include "base/restir_di.h"
+#include "base/restir_gi.h"
+#include "base/rrs_cache.h"
+#include "base/sampler.h"
+#include "utils/color_space.h"
+#include "utils/command_buffer.h"
+#include "utils/progress_bar.h"
+#include "utils/shader_cache.h"
+#include "utils/sampling.h"
+#include "utils/spectra.h"
+
+namespace Yutrel
+{
+MegakernelPathTracing::MegakernelPathTracing(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
+    : Integrator(renderer, command_buffer, info)
+{
+    if (!renderer.media().empty())
+    {
+        m_medium_interactions = renderer.device().create_buffer<uint>(2u);
+        if (restir() || restir_gi())
+        {
+            LUISA_WARNING("ReSTIR takes the primary vertex to be on a surface, scattering in media before it is not resampled.");
+        }
+    }
+}
+
+void MegakernelPathTracing::render_interactive(Stream& stream)
+{
+    CommandBuffer command_buffer{stream};
+
+    auto camera     = renderer().camera();
+    auto resolution = camera->film()->base()->resolution();
+
+    camera->film()->prepare(command_buffer);
+    sampler()->reset(command_buffer, resolution.x * resolution.y);
+    // the learned structures stay untrained in the interactive view
+    if (path_guide() != nullptr)
+    {
+        path_guide()->reset(command_buffer);
+    }
+    if (rrs_cache() != nullptr)
+    {
+        rrs_cache()->reset(command_buffer);
+    }
+    command_buffer << synchronize();
+
+    FpsCameraController controller{camera->transform(), camera->base()->up(), FpsCameraController::Config{}};
+
+    // the preview drives the window until the full shader, compiled on a worker thread, is ready
+    auto preview = compile_preview(camera);
+
+    // with ReSTIR the path tracer leaves the direct lighting of the primary hit to the reservoir passes
+    auto use_restir = restir() && light_sampler()->light_count() != 0u;
+    if (restir() && !use_restir)
+    {
+        LUISA_WARNING("ReSTIR needs at least one light, falling back to path tracing.");
+    }
+    // with ReSTIR GI it also hands everything beyond the first bounce to the GI reservoirs
+    auto gi_passes = restir_gi() ? luisa::make_unique<ReSTIRGI>(*this, camera) : nullptr;
+    Kernel2D render_kernel = [&](UInt frame_index, Float time) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        Var pixel_id = dispatch_id().xy();
+        Var L        = Li(camera, frame_index, pixel_id, time, !use_restir, gi_passes.get());
+        camera->film()->accumulate_exclusive(pixel_id, camera->film()->sanitize(L, 1.0f), ite(camera->film()->is_valid(L), 1.0f, 0.0f));
+    };
+    Shader2D<uint, float> render;
+    luisa::unique_ptr<ReSTIRDI> di_passes;
+    auto compiled = global_thread_pool().async([&]
+    {
+        auto signature = feature_signature(camera);
+        render         = renderer().shader_cache()->compile(render_kernel, "megakernel_interactive", signature);
+        if (use_restir)
+        {
+            di_passes = luisa::make_unique<ReSTIRDI>(*this, camera, signature);
+        }
+        if (gi_passes != nullptr)
+        {
+            gi_passes->compile(signature);
+        }
+    });
+    auto full_shader = false;
+
+    uint global_sample_index = 0u;
+
+    while (true)
+    {
+        // Process window events & draw current accumulation.
+        camera->film()->show(command_buffer, true);
+        if (camera->film()->should_close())
+        {
+            break;
+        }
+
+        // Swap to the full shader once it is ready, the preview samples are discarded.
+        auto swap = !full_shader && compiled.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+        if (swap)
+        {
+            full_shader = true;
+            LUISA_INFO("Full shader ready, leaving the preview.");
+        }
+
+        // Update camera from input; reset accumulation if changed.
+        if (controller.update() || swap)
+        {
+            auto c2w = controller.camera_to_world();
+            camera->set_transform(command_buffer, c2w);
+            camera->film()->prepare(command_buffer);
+            sampler()->reset(command_buffer, resolution.x * resolution.y);
+            global_sample_index = 0u;
+            // the reservoirs are not reprojected, they describe the previous view
+            if (di_passes != nullptr)
+            {
+                di_passes->invalidate();
+            }
+            if (gi_passes != nullptr)
+            {
+                gi_passes->invalidate();
+            }
+            command_buffer << synchronize();
+        }
+
+        auto& shader = full_shader ? render : preview;
+        command_buffer << shader(global_sample_index, 0.0f).dispatch(resolution);
+        if (full_shader && di_passes != nullptr)
+        {
+            di_passes->render(command_buffer, global_sample_index, 0.0f);
+        }
+        if (full_shader && gi_passes != nullptr)
+        {
+            gi_passes->render(command_buffer, global_sample_index, 0.0f);
+        }
+        global_sample_index++;
+        command_buffer << commit();
+    }
+
+    command_buffer << synchronize();
+    // the window may close before the worker is done, it still references this frame
+    compiled.wait();
+    camera->film()->release();
+}
+
+void MegakernelPathTracing::compile(const Camera::Instance* camera) noexcept
+{
+    // each thread owns one pixel: samples are summed in registers and written once per dispatch
+    auto film         = camera->film();
+    auto render_pixel = [&](Expr<uint2> pixel_id, Expr<uint> frame_index, Expr<uint> sample_count, Expr<float> time, Expr<float> shutter_weight) noexcept
+    {
+        auto L_sum = def(make_float3(0.0f));
+        // luminance mean and M2 of this dispatch's samples for the adaptive convergence test
+        auto mean = def(0.0f);
+        auto m2   = def(0.0f);
+        // invalid samples are dropped and not counted
+        auto valid_count = def(0u);
+        $for(i, sample_count)
+        {
+            Var L = Li(camera, frame_index + i, pixel_id, time);
+            $if(film->is_valid(L * shutter_weight))
+            {
+                auto c = film->sanitize(L * shutter_weight, 1.0f);
+                L_sum += c;
+                valid_count += 1u;
+                if (track_moments())
+                {
+                    auto y     = linear_srgb_to_cie_y(c);
+                    auto delta = y - mean;
+                    mean += delta / cast<float>(valid_count);
+                    m2 += delta * (y - mean);
+                }
+            };
+        };
+        if (track_moments())
+        {
+            film->accumulate_exclusive(pixel_id, L_sum, cast<float>(valid_count), make_float2(mean, m2));
+        }
+        else
+        {
+            film->accumulate_exclusive(pixel_id, L_sum, cast<float>(valid_count));
+        }
+    };
+
+    // tiled films dispatch over one tile at a time
+    Kernel2D render_kernel = [&](UInt2 tile_origin, UInt frame_index, UInt sample_count, Float time, Float shutter_weight) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        render_pixel(tile_origin + dispatch_id().xy(), frame_index, sample_count, time, shutter_weight);
+    };
+
+    // dispatched over the compacted list of pixels that have not converged yet
+    Kernel1D render_active_kernel = [&](UInt frame_index, UInt sample_count, Float time, Float shutter_weight) noexcept
+    {
+        set_block_size(256u, 1u, 1u);
+        render_pixel(film->active_pixel(dispatch_x()), frame_index, sample_count, time, shutter_weight);
+    };
+
+    LUISA_INFO("Start compiling Integrator shader");
+    Clock clock_compile;
+    auto signature = feature_signature(camera);
+    m_render       = renderer().shader_cache()->compile(render_kernel, "megakernel_render", signature);
+    if (adaptive())
+    {
+        m_render_active = renderer().shader_cache()->compile(render_active_kernel, "megakernel_render_active", signature);
+    }
+    LUISA_INFO("Integrator shader compile in {} ms.", clock_compile.toc());
+}
+
+void MegakernelPathTracing::render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera)
+{
+    auto spp        = camera->base()->spp();
+    auto film       = camera->film();
+    auto resolution = film->tile_extent();
+
+    sampler()->reset(command_buffer, film->pixel_count());
+    command_buffer << synchronize();
+
+    LUISA_INFO(
+        "Rendering of resolution {}x{} at {}spp.",
+        resolution.x,
+        resolution.y,
+        spp);
+
+    if (!m_render)
+    {
+        compile(camera);
+    }
+    command_buffer << synchronize();
+
+    std::array<uint, 2u> medium_interactions{};
+    if (m_medium_interactions)
+    {
+        command_buffer << m_medium_interactions.copy_from(medium_interactions.data()) << synchronize();
+    }
+
+    // training counts towards the time budget so that guided and unguided runs compare at equal time
+    Clock clock_render;
+    if (path_guide() != nullptr && !path_guide()->trained())
+    {
+        train_guide(command_buffer, camera);
+    }
+    if (rrs_cache() != nullptr && !rrs_cache()->trained())
+    {
+        train_rrs(command_buffer, camera);
+    }
+
+    auto progress         = begin_progress(command_buffer, camera);
+    auto& shutter_samples = progress.shutter_samples;
+    auto& remaining_spp   = progress.remaining_spp;
+
+    LUISA_INFO("Rendering started.");
+    ProgressBar progress_bar;
+    progress_bar.update(0.0);
+    Clock clock_checkpoint;
+    auto dispatch_count       = 0u;
+    auto& global_sample_index = progress.global_sample_index;
+    auto pixel_count         = film->pixel_count();
+    auto active_count        = pixel_count;
+    auto pass_count          = 0u;
+    auto traced_samples      = 0.0;
+    auto bucket              = 0u;
+    auto error               = -1.0f;
+    while (active_count != 0u)
+    {
+        // sequential mode drains one shutter bucket after another, progressive mode cycles
+        // through the buckets so that stopping at any pass still covers the shutter evenly
+        auto skipped = 0u;
+        while (skipped < remaining_spp.size() && remaining_spp[bucket] == 0u)
+        {
+            bucket = (bucket + 1u) % remaining_spp.size();
+            skipped++;
+        }
+        if (skipped == remaining_spp.size())
+        {
+            break;
+        }
+        const auto& s     = shutter_samples[bucket];
+        auto sample_count = std::min(samples_per_dispatch(), remaining_spp[bucket]);
+        remaining_spp[bucket] -= sample_count;
+        if (progressive())
+        {
+            bucket = (bucket + 1u) % remaining_spp.size();
+        }
+
+        dispatch_count++;
+        pass_count++;
+        if (active_count == pixel_count)
+        {
+            command_buffer << m_render(film->tile_origin(), global_sample_index, sample_count, s.time, s.weight).dispatch(resolution);
+        }
+        else
+        {
+            command_buffer << m_render_active(global_sample_index, sample_count, s.time, s.weight).dispatch(active_count);
+        }
+        traced_samples += static_cast<double>(active_count) * sample_count;
+        global_sample_index += sample_count;
+        const auto dispatches_per_commit = 4u;
+        if (camera->film()->show(command_buffer) || dispatch_count >= dispatches_per_commit) [[unlikely]]
+        {
+            dispatch_count = 0u;
+            auto p         = global_sample_index / static_cast<double>(spp);
+            if (time_budget() > 0.0f)
+            {
+                p = std::max(p, clock_render.toc() * 1e-3 / time_budget());
+            }
+            command_buffer << [&progress_bar, p]
+            {
+                progress_bar.update(std::min(p, 1.0));
+            };
+            // keep the host clock in step with the device so the budget is not overshot by queued work
+            if (time_budget() > 0.0f)
+            {
+                command_buffer << synchronize();
+                if (clock_render.toc() * 1e-3 >= time_budget())
+                {
+                    break;
+                }
+            }
+        }
+        if (camera->film()->should_close()) [[unlikely]]
+        {
+            command_buffer << synchronize();
+            progress_bar.done();
+            return;
+        }
+        if (checkpoint_interval() > 0.0f && clock_checkpoint.toc() * 1e-3 >= checkpoint_interval())
+        {
+            write_checkpoint(command_buffer, camera, progress);
+            clock_checkpoint.tic();
+        }
+        if (adaptive() && pass_count % adaptive_check_interval() == 0u && global_sample_index >= adaptive_min_spp())
+        {
+            active_count = film->compact_active_pixels(command_buffer, adaptive_threshold(), static_cast<float>(adaptive_min_spp()));
+        }
+        if (check_target_error(pass_count, global_sample_index))
+        {
+            error = film->mean_relative_error(command_buffer);
+            if (error <= target_error())
+            {
+                break;
+            }
+        }
+    }
+    command_buffer << synchronize();
+    progress_bar.done();
+    auto render_time = clock_render.toc();
+    auto average_spp = traced_samples / pixel_count;
+    if (adaptive())
+    {
+        LUISA_INFO("Adaptive sampling traced {:.1f} spp on average, {} pixels still active.", average_spp, active_count);
+    }
+    if (progressive())
+    {
+        if (error < 0.0f && track_moments())
+        {
+            error = film->mean_relative_error(command_buffer);
+        }
+        LUISA_INFO("Progressive rendering reached {:.1f} spp on average ({} spp per pixel at most) in {:.2f} s, mean relative error {}.",
+                   average_spp,
+                   global_sample_index,
+                   render_time * 1e-3,
+                   error);
+    }
+    else if (report_error())
+    {
+        if (error < 0.0f)
+        {
+            error = film->mean_relative_error(command_buffer);
+        }
+        // efficiency as the inverse of squared error times time, comparable across roulette policies
+        LUISA_INFO("Rendering ({}) reached mean relative error {} in {:.2f} s, efficiency {:.4g}.",
+                   luisa::format("{}{}", path_guide() != nullptr ? "guided" : "unguided", rrs_cache() != nullptr ? ", EARS" : ""),
+                   error,
+                   render_time * 1e-3,
+                   1.0 / std::max(static_cast<double>(error) * error * render_time * 1e-3, 1e-12));
+    }
+    report_throughput("Megakernel rendering", render_time, resolution, static_cast<uint>(average_spp));
+    if (m_medium_interactions)
+    {
+        command_buffer << m_medium_interactions.copy_to(medium_interactions.data()) << synchronize();
+        auto count = (static_cast<uint64_t>(medium_interactions[1]) << 32u) | medium_interactions[0];
+        // the whole render time is spread over the interactions, surfaces and shading included, so this is
+        // an upper bound on the media cost and only comparable between renders of the same scene
+        LUISA_INFO("Participating media: {} interactions ({:.2f} per sample), {:.2f} ns of render time per interaction.",
+                   count,
+                   static_cast<double>(count) / std::max(traced_samples, 1.0),
+                   render_time * 1e6 / static_cast<double>(std::max<uint64_t>(count, 1u)));
+    }
+}
+
+void MegakernelPathTracing::train_guide(CommandBuffer& command_buffer, Camera::Instance* camera) noexcept
+{
+    auto guide        = path_guide();
+    auto film         = camera->film();
+    auto training_spp = std::max(static_cast<uint>(camera->base()->spp() * guiding_training_fraction()), 1u);
+    // training samples use their own sequence so they stay uncorrelated with the kept ones
+    auto frame_index = 0x80000000u;
+    auto time        = camera->base()->shutter_span().x;
+
+    Clock clock;
+    auto iteration_spp = 1u;
+    auto trained_spp   = 0u;
+    auto iterations    = 0u;
+    guide->set_training(command_buffer, true);
+    while (trained_spp < training_spp)
+    {
+        auto iteration_end = std::min(trained_spp + iteration_spp, training_spp);
+        while (trained_spp < iteration_end)
+        {
+            auto sample_count = std::min(samples_per_dispatch(), iteration_end - trained_spp);
+            dispatch_training(command_buffer, camera, frame_index + trained_spp, sample_count, time);
+            trained_spp += sample_count;
+        }
+        guide->update(command_buffer);
+        command_buffer << commit();
+        iteration_spp *= 2u;
+        iterations++;
+    }
+    guide->finish_training(command_buffer);
+    // the training samples were drawn from immature distributions and are not kept
+    film->clear(command_buffer);
+    command_buffer << synchronize();
+    LUISA_INFO("Path guide trained with {} spp in {} iterations ({} ms).", trained_spp, iterations, clock.toc());
+}
+
+void MegakernelPathTracing::train_rrs(CommandBuffer& command_buffer, Camera::Instance* camera) noexcept
+{
+    auto rrs          = rrs_cache();
+    auto film         = camera->film();
+    auto training_spp = std::max(static_cast<uint>(camera->base()->spp() * ears_training_fraction()), 4u);
+    // the pilot samples use their own sequence so they stay uncorrelated with the kept ones
+    auto frame_index = 0x90000000u;
+    auto time        = camera->base()->shutter_span().x;
+
+    Clock clock;
+    rrs->set_training(command_buffer, true);
+    for (auto trained_spp = 0u; trained_spp < training_spp;)
+    {
+        auto sample_count = std::min(samples_per_dispatch(), training_spp - trained_spp);
+        dispatch_training(command_buffer, camera, frame_index + trained_spp, sample_count, time);
+        trained_spp += sample_count;
+    }
+    rrs->finish_training(command_buffer);
+    // the pilot paths used throughput roulette and are not kept
+    film->clear(command_buffer);
+    command_buffer << synchronize();
+    LUISA_INFO("RRS cache trained with {} spp ({} ms).", training_spp, clock.toc());
+}
+
+void MegakernelPathTracing::dispatch_training(CommandBuffer& command_buffer, Camera::Instance* camera, uint frame_index, uint sample_count, float time) noexcept
+{
+    auto film = camera->film();
+    if (!film->base()->tiled())
+    {
+        command_buffer << m_render(film->tile_origin(), frame_index, sample_count, time, 1.0f).dispatch(film->tile_extent());
+        return;
+    }
+    // the learned distributions cover the whole scene, so every tile trains them, the tile being
+    // rendered is restored afterwards and its accumulation cleared by the caller
+    auto resolution = film->base()->resolution();
+    auto tile_size  = film->base()->tile_size();
+    auto origin     = film->tile_origin();
+    auto extent     = film->tile_extent();
+    for (auto y = 0u; y < resolution.y; y += tile_size)
+    {
+        for (auto x = 0u; x < resolution.x; x += tile_size)
+        {
+            auto tile_origin = make_uint2(x, y);
+            film->set_tile(command_buffer, tile_origin, min(make_uint2(tile_size), resolution - tile_origin));
+            // the tile is uploaded from host memory that the next set_tile() overwrites
+            command_buffer << m_render(tile_origin, frame_index, sample_count, time, 1.0f).dispatch(film->tile_extent())
+                           << synchronize();
+        }
+    }
+    film->set_tile(command_buffer, origin, extent);
+    command_buffer << synchronize();
+}
+
+Float3 MegakernelPathTracing::Li(const Camera::Instance* camera, Expr<uint> frame_index, Expr<uint2> pixel_id, Expr<float> time,
+                                 bool primary_direct, const ReSTIRGI* gi) const noexcept
+{
+    sampler()->start(pixel_id, frame_index);
+
+    auto u_filter = sampler()->generate_pixel_2d();
+    auto u_lens   = camera->base()->requires_lens_sampling() ? sampler()->generate_lens_2d() : make_float2(0.5f);
+
+    auto [camera_ray, _, camera_weight] = camera->generate_ray(pixel_id, time, u_filter, u_lens);
+
+    auto spectrum = renderer().spectrum();
+    auto swl      = spectrum->sample(spectrum->base()->is_fixed() ? 0.0f : sampler()->generate_wavelength());
+    SampledSpectrum Li{swl.dimension(), 0.0f};
+    SampledSpectrum beta{swl.dimension(), camera_weight};
+
+    auto ray      = camera_ray;
+    auto pdf_bsdf = def(1e16f);
+    // the vertex the ray left from, the light sampler selected its light samples there and not at the offset origin
+    auto ray_vertex = def(camera_ray->origin());
+    // light samples taken at the vertex the BSDF sample left from, for the MIS weight of emission it hits
+    auto nee_count_bsdf = def(1u);
+
+    // path vertices whose incident radiance is fed back to the guide while training
+    auto guide = path_guide();
+    ArrayVar<uint, PathGuide::max_recorded_vertices> record_cells;
+    ArrayVar<float3, PathGuide::max_recorded_vertices> record_directions;
+    ArrayVar<float, PathGuide::max_recorded_vertices> record_radiance;
+    ArrayVar<float, PathGuide::max_recorded_vertices> record_throughput;
+    auto record_count = def(0u);
+
+    // ReSTIR GI: what the path gathers beyond the first bounce is traced with unit throughput from the secondary vertex
+    SampledSpectrum Li_primary{swl.dimension(), 0.0f};
+    auto gi_bounced  = def(false);
+    auto gi_pdf      = def(0.0f);
+    auto gi_position = def(make_float3(0.0f));
+    auto gi_normal   = def(make_float3(0.0f));
+
+    // learned roulette and splitting, ReSTIR GI restarts the path at the first bounce and keeps throughput roulette
+    auto rrs = gi == nullptr ? rrs_cache() : nullptr;
+    // one vertex at a time may split, its extra continuations are traced after the current one ends
+    auto split_count = def(0u);
+    auto split_depth = def(0u);
+    auto split_ray   = def(camera_ray);
+    SampledSpectrum split_beta{swl.dimension(), 0.0f};
+    auto resumed = def(false);
+    // vertices whose continuation is fed back to the cache while training
+    ArrayVar<uint, RRSCache::max_recorded_vertices> rrs_cells;
+    ArrayVar<float, RRSCache::max_recorded_vertices> rrs_radiance;
+    ArrayVar<float, RRSCache::max_recorded_vertices> rrs_throughput;
+    ArrayVar<uint, RRSCache::max_recorded_vertices> rrs_vertex;
+    auto rrs_count    = def(0u);
+    auto vertex_count = def(0u);
+
+    // participating media, the stack holds the media the path is in and the split vertex keeps its own
+    auto has_media = !renderer().media().empty();
+    Medium::Stack media;
+    Medium::Stack split_media;
+    auto medium_interactions = def(0u);
+
+    auto depth = def(0u);
+    // ends the current continuation, or goes back to the split vertex while continuations are left
+    auto next_continuation = [&]() noexcept
+    {
+        $if(split_count == 0u) { $break; };
+        split_count -= 1u;
+        ray     = split_ray;
+        beta    = split_beta;
+        depth   = split_depth;
+        resumed = true;
+        if (has_media)
+        {
+            media = split_media;
+        }
+        $continue;
+    };
+
+    $loop
+    {
+        $if(depth >= max_depth()) { next_continuation(); };
+
+        // trace, the origin stays the previous vertex while the ray crosses boundaries of media
+        auto wo     = -ray->direction();
+        auto ray_in = def(ray);
+        auto origin = def(ray->origin());
+
+        luisa::shared_ptr<Interaction> it = renderer().geometry()->intersect(ray);
+        vertex_count += 1u;
+
+        // free flights through the media on the way to the hit, shapes that only bound a medium are crossed.
+        // A resumed continuation retraces the ray to its split vertex, where the flight already ended
+        auto medium_scattered = def(false);
+        auto medium_absorbed  = def(false);
+        auto medium_t         = def(0.0f);
+        if (has_media)
+        {
+            // one dimension per vertex whatever the media along the ray, so later dimensions stay aligned
+            auto u_medium = sampler()->generate_1d();
+            $if(!resumed)
+            {
+                auto segment = def(0u);
+                $loop
+                {
+                    auto t_max  = ite(it->valid(), distance(ray->origin(), it->p_g), Interaction::default_t_max);
+                    auto flight = sample_medium(media, ray, t_max, Medium::tracking_seed(u_medium, segment), swl, time);
+                    medium_interactions += flight.collisions;
+                    beta *= flight.weight;
+                    $if(flight.scattered | flight.absorbed)
+                    {
+                        medium_scattered = flight.scattered;
+                        medium_absorbed  = flight.absorbed;
+                        medium_t         = flight.t;
+                        $break;
+                    };
+                    $if(!it->valid() | !it->shape.has_medium() | it->shape.has_surface()) { $break; };
+                    media.cross(it->front_face, it->shape.medium_tag());
+                    ray = it->spawn_ray(ray->direction());
+                    *it = *renderer().geometry()->intersect(ray);
+                    segment += 1u;
+                };
+                ray_in = ray;
+            };
+        }
+
+        $if(depth == 0u & !resumed)
+        {
+            record_features(camera, pixel_id, *it, origin, swl, time);
+        };
+
+        if (gi != nullptr)
+        {
+            $if(depth == 0u)
+            {
+                // the normal faces the camera so that samples behind the surface can be told apart
+                auto visible = it->valid() & it->shape.has_surface();
+                auto n       = ite(dot(it->n_g, wo) < 0.0f, -it->n_g, it->n_g);
+                gi->record_visible(pixel_id, frame_index, it->p_g, n, ite(visible, distance(origin, it->p_g), 0.0f));
+            }
+            $elif(depth == 1u)
+            {
+                gi_position = it->p_g;
+                gi_normal   = it->n_g;
+            };
+        }
+
+        if (has_media)
+        {
+            $if(medium_absorbed) { next_continuation(); };
+            $if(medium_scattered)
+            {
+                // one light sample and one phase function sample, weighted by the balance heuristic
+                auto p = ray->origin() + ray->direction() * medium_t;
+                Interaction it_medium;
+                it_medium.p_g = p;
+                it_medium.p_s = p;
+                it_medium.n_g = make_float3(0.0f);
+
+                auto u_light_selection = sampler()->generate_1d();
+                auto u_light_surface   = sampler()->generate_2d();
+                auto u_phase           = sampler()->generate_2d();
+                auto u_shadow          = sampler()->generate_1d();
+                auto light_sample      = LightSampler::Sample::zero(swl.dimension());
+                $outline
+                {
+                    light_sample = light_sampler()->sample(it_medium, u_light_selection, u_light_surface, swl, time);
+                };
+                SampledSpectrum Tr{swl.dimension(), 0.0f};
+                $if(light_sample.eval.pdf > 0.0f)
+                {
+                    Tr = transmittance(media, light_sample.shadow_ray, u_shadow, swl, time, medium_interactions);
+                };
+                $outline
+                {
+                    renderer().media().dispatch(media.top(), [&](auto medium) noexcept
+                    {
+                        auto closure = medium->closure(swl, time);
+                        $if(light_sample.eval.pdf > 0.0f)
+                        {
+                            auto phase = closure->phase(wo, light_sample.shadow_ray->direction());
+                            Li += beta * Tr * light_sample.eval.L * (phase / (light_sample.eval.pdf + phase));
+                        };
+                        // the phase function is sampled exactly, so the throughput is unchanged
+                        auto wi  = closure->sample_phase(wo, u_phase);
+                        ray        = make_ray(p, wi);
+                        ray_vertex = p;
+                        pdf_bsdf   = closure->phase(wo, wi);
+                    });
+                };
+                nee_count_bsdf = 1u;
+                depth += 1u;
+                $continue;
+            };
+        }
+
+        // miss
+        $if(!it->valid())
+        {
+            // no environment light for now
+            next_continuation();
+        };
+
+        auto skip_emission = def(false);
+        auto skip_light    = def(false);
+        // light samples at the primary hit carry all of its direct lighting when emission is skipped for GI
+        auto light_only = def(false);
+        if (!primary_direct || gi != nullptr)
+        {
+            skip_emission = depth == 1u;
+        }
+        if (!primary_direct)
+        {
+            skip_light = depth == 0u;
+        }
+        else if (gi != nullptr)
+        {
+            light_only = depth == 0u;
+        }
+        // a resumed continuation already counted the emission and direct light of its vertex
+        skip_emission = skip_emission | resumed;
+        skip_light    = skip_light | resumed;
+
+        // hit light
+        $if(!renderer().lights().empty())
+        {
+            $outline
+            {
+                $if(it->shape.has_light() & !skip_emission)
+                {
+                    auto eval = light_sampler()->evaluate_hit(*it, ray_vertex, swl, time);
+                    Li += beta * eval.L * balance_heuristic(1u, pdf_bsdf, nee_count_bsdf, eval.pdf);
+                };
+            };
+        };
+
+        // no surface
+        $if(!it->shape.has_surface()) { next_continuation(); };
+
+        // sample lights, all shadow rays of the vertex are traced back to back before it is shaded
+        auto dimension = swl.dimension();
+        auto nee_count = nee_samples(depth);
+        ArrayVar<Ray, max_nee_samples> nee_rays;
+        ArrayVar<float, max_nee_samples> nee_pdf;
+        ArrayVar<float, max_nee_samples> nee_u_shadow;
+        Local<float> nee_L{max_nee_samples * dimension};
+        $for(s, nee_count)
+        {
+            auto u_light_selection = sampler()->generate_1d();
+            auto u_light_surface   = sampler()->generate_2d();
+            if (has_media)
+            {
+                nee_u_shadow[s] = sampler()->generate_1d();
+            }
+            auto light_sample      = LightSampler::Sample::zero(dimension);
+            $if(!skip_light)
+            {
+                $outline
+                {
+                    light_sample = light_sampler()->sample(*it, u_light_selection, u_light_surface, swl, time);
+                };
+            };
+            nee_rays[s] = light_sample.shadow_ray;
+            nee_pdf[s]  = light_sample.eval.pdf;
+            for (auto i = 0u; i < dimension; i++)
+            {
+                nee_L[s * dimension + i] = light_sample.eval.L[i];
+            }
+        };
+
+        // cast shadow rays
+        $for(s, nee_count)
+        {
+            $if(nee_pdf[s] > 0.0f)
+            {
+                if (has_media)
+                {
+                    auto Tr = transmittance(media, nee_rays[s], nee_u_shadow[s], swl, time, medium_interactions);
+                    for (auto i = 0u; i < dimension; i++)
+                    {
+                        nee_L[s * dimension + i] *= Tr[i];
+                    }
+                    $if(Tr.is_zero()) { nee_pdf[s] = 0.0f; };
+                }
+                else
+                {
+                    $if(renderer().geometry()->intersect_any(nee_rays[s])) { nee_pdf[s] = 0.0f; };
+                }
+            };
+        };
+
+        auto u_lobe = sampler()->generate_1d();
+        auto u_bsdf = sampler()->generate_2d();
+
+        auto u_rr = def(0.0f);
+        if (rrs != nullptr)
+        {
+            // also rounds the splitting factor
+            u_rr = sampler()->generate_1d();
+        }
+        else
+        {
+            $if(depth + 1u >= rr_depth())
+            {
+                u_rr = sampler()->generate_1d();
+            };
+        }
+        auto rrs_cell = def(0u);
+        if (rrs != nullptr)
+        {
+            rrs_cell = rrs->cell(it->p_g);
+        }
+
+        auto guide_cell        = def(0u);
+        auto guide_probability = def(0.0f);
+        auto u_guide           = def(0.0f);
+        auto u_guide_direction = def(make_float2(0.0f));
+        if (guide != nullptr)
+        {
+            guide_cell        = guide->cell(it->p_g);
+            guide_probability = guide->selection_probability(guide_cell);
+            u_guide           = sampler()->generate_1d();
+            u_guide_direction = sampler()->generate_2d();
+        }
+
+        SampledSpectrum beta_vertex{swl.dimension()};
+        beta_vertex = beta;
+
+        $outline
+        {
+            PolymorphicCall<Surface::Closure> call;
+            renderer().surfaces().dispatch(it->shape.surface_tag(), [&](auto surface) noexcept
+            {
+                surface->closure(call, *it, swl, time);
+            });
+            call.execute([&](const Surface::Closure* closure) noexcept
+            {
+                // direct lighting, each of the n light samples is weighted by the balance heuristic over n light
+                // samples and one BSDF sample, which together with the 1/n of the estimate gives 1/(n p_l + p_bsdf)
+                auto n = cast<float>(nee_count);
+                $for(s, nee_count)
+                {
+                    auto pdf_light = nee_pdf[s];
+                    $if(pdf_light > 0.0f)
+                    {
+                        auto wi   = nee_rays[s]->direction();
+                        auto eval = closure->evaluate(wo, wi);
+                        // the BSDF sample competes with the density it is actually drawn from
+                        auto pdf_bsdf_mis = def(eval.pdf);
+                        if (guide != nullptr)
+                        {
+                            pdf_bsdf_mis = lerp(eval.pdf, guide->pdf(guide_cell, wi), guide_probability);
+                        }
+                        auto w = 1.0f / (n * pdf_light + ite(light_only, 0.0f, pdf_bsdf_mis));
+                        SampledSpectrum L{dimension};
+                        for (auto i = 0u; i < dimension; i++)
+                        {
+                            L[i] = nee_L[s * dimension + i];
+                        }
+                        Li += w * beta * eval.f * L;
+                    };
+                };
+
+                // sample surface
+                auto surface_sample = closure->sample(wo, u_lobe, u_bsdf);
+                auto wi             = surface_sample.wi;
+                auto f              = surface_sample.eval.f;
+                auto pdf            = surface_sample.eval.pdf;
+                if (guide != nullptr)
+                {
+                    // one-sample MIS between the BSDF and the learned distribution
+                    $if(guide_probability > 0.0f)
+                    {
+                        auto guided = guide->sample(guide_cell, u_guide_direction);
+                        wi          = ite(u_guide < guide_probability, guided.wi, wi);
+                        auto eval   = closure->evaluate(wo, wi);
+                        f           = eval.f;
+                        pdf         = lerp(eval.pdf, guide->pdf(guide_cell, wi), guide_probability);
+                    };
+                }
+                ray            = it->spawn_ray(wi);
+                ray_vertex     = it->p_g;
+                pdf_bsdf       = pdf;
+                nee_count_bsdf = nee_count;
+                auto w   = ite(pdf > 0.0f, 1.0f / pdf, 0.0f);
+                beta *= w * f;
+            });
+        };
+
+        if (guide != nullptr)
+        {
+            $if(record_count < PathGuide::max_recorded_vertices)
+            {
+                record_cells[record_count]      = guide_cell;
+                record_directions[record_count] = ray->direction();
+                record_radiance[record_count]   = Li.average();
+                record_throughput[record_count] = beta.average();
+                record_count += 1u;
+            };
+        }
+
+        if (gi != nullptr)
+        {
+            $if(depth == 0u)
+            {
+                Li_primary = Li;
+                Li         = 0.0f;
+                beta       = ite(pdf_bsdf > 0.0f, 1.0f, 0.0f);
+                gi_pdf     = pdf_bsdf;
+                gi_bounced = true;
+            };
+        }
+
+        if (rrs == nullptr)
+        {
+            auto q = max(beta.max(), 0.05f);
+            $if(depth + 1u >= rr_depth())
+            {
+                $if(q < rr_threshold() & u_rr >= q)
+                {
+                    next_continuation();
+                };
+                beta *= ite(q < rr_threshold(), 1.0f / q, 1.0f);
+            };
+        }
+        else
+        {
+            $if(rrs->training() & rrs_count < RRSCache::max_recorded_vertices)
+            {
+                rrs_cells[rrs_count]      = rrs_cell;
+                rrs_radiance[rrs_count]   = Li.average();
+                rrs_throughput[rrs_count] = beta_vertex.average();
+                rrs_vertex[rrs_count]     = vertex_count;
+                rrs_count += 1u;
+            };
+            // expected number of continuations, throughput roulette where the cache has learned nothing
+            auto q            = max(beta.max(), 0.05f);
+            auto continuation = def(1.0f);
+            $if(depth + 1u >= rr_depth())
+            {
+                continuation = ite(q < rr_threshold(), q, 1.0f);
+            };
+            $if(!rrs->training())
+            {
+                auto factor  = rrs->factor(pixel_id, rrs_cell, beta_vertex.average());
+                continuation = ite(factor > 0.0f, factor, continuation);
+            };
+            // only one split vertex is pending at a time
+            $if(split_count != 0u | depth + 1u >= max_depth())
+            {
+                continuation = min(continuation, 1.0f);
+            };
+            // a resumed continuation was weighted when its vertex split
+            $if(!resumed)
+            {
+                auto n = cast<uint>(continuation) + ite(u_rr < fract(continuation), 1u, 0u);
+                $if(n == 0u)
+                {
+                    next_continuation();
+                };
+                beta *= 1.0f / continuation;
+                $if(n > 1u)
+                {
+                    split_count = n - 1u;
+                    split_depth = depth;
+                    split_ray   = ray_in;
+                    split_beta  = beta_vertex * (1.0f / continuation);
+                    if (has_media)
+                    {
+                        split_media = media;
+                    }
+                };
+            };
+        }
+        resumed = false;
+        depth += 1u;
+    };
+
+    // everything gathered after a vertex, divided by the throughput to it, came from its continuation
+    if (rrs != nullptr)
+    {
+        $if(rrs->training())
+        {
+            auto L_path = Li.average();
+            $for(k, rrs_count)
+            {
+                auto throughput = rrs_throughput[k];
+                $if(throughput > 0.0f)
+                {
+                    rrs->record_vertex(rrs_cells[k], (L_path - rrs_radiance[k]) / throughput, cast<float>(vertex_count - rrs_vertex[k]));
+                };
+            };
+            rrs->record_pixel(pixel_id, L_path, cast<float>(vertex_count));
+        };
+    }
+
+    // everything gathered after a vertex, divided by the throughput up to it, arrived along its direction
+    if (guide != nullptr)
+    {
+        $if(guide->training())
+        {
+            auto L_path = Li.average();
+            $for(k, record_count)
+            {
+                auto throughput = record_throughput[k];
+                $if(throughput > 0.0f)
+                {
+                    guide->record(record_cells[k], record_directions[k], (L_path - record_radiance[k]) / throughput);
+                };
+            };
+        };
+    }
+
+    if (has_media)
+    {
+        // one atomic per path, carrying into the high word when the low one wraps
+        $if(medium_interactions > 0u)
+        {
+            auto before = m_medium_interactions->atomic(0u).fetch_add(medium_interactions);
+            $if(before + medium_interactions < before) { m_medium_interactions->atomic(1u).fetch_add(1u); };
+        };
+    }
+
+    Float3 color = spectrum->srgb(swl, Li);
+
+    if (gi != nullptr)
+    {
+        // without a bounce everything the path found belongs to the film
+        gi->record_sample(pixel_id, gi_position, gi_normal, ite(gi_bounced, color, make_float3(0.0f)), ite(gi_bounced, gi_pdf, 0.0f));
+        return ite(gi_bounced, spectrum->srgb(swl, Li_primary), color);
+    }
+    return color;
+};
+
+} // namespace Yutrel
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <luisa/runtime/buffer.h>
+#include <luisa/runtime/shader.h>
+
+#include "base/integrator.h"
+
+namespace Yutrel
+{
+class ReSTIRGI;
+
+// traces whole paths inside a single kernel
+class MegakernelPathTracing final : public Integrator
+{
+private:
+    // compiled on the first render and reused for every tile
+    Shader2D<uint2, uint, uint, float, float> m_render;
+    Shader1D<uint, uint, float, float> m_render_active;
+    // collisions of the paths with participating media as the low and high word of a 64-bit count,
+    // only allocated when the scene has media
+    Buffer<uint> m_medium_interactions;
+
+public:
+    explicit MegakernelPathTracing(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept;
+    ~MegakernelPathTracing() noexcept override = default;
+
+public:
+    void render_interactive(Stream& stream) override;
+
+private:
+    void render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera) override;
+    void compile(const Camera::Instance* camera) noexcept override;
+    // learns the path guide in iterations of doubling spp, then discards the training samples
+    void train_guide(CommandBuffer& command_buffer, Camera::Instance* camera) noexcept;
+    // learns the continuation factors from a pilot pass with throughput roulette, then discards it
+    void train_rrs(CommandBuffer& command_buffer, Camera::Instance* camera) noexcept;
+    // one training dispatch over the whole frame, tiled films are walked tile by tile
+    void dispatch_training(CommandBuffer& command_buffer, Camera::Instance* camera, uint frame_index, uint sample_count, float time) noexcept;
+    // the interactive ReSTIR passes take over parts of the first bounce: without primary_direct light sampling at the
+    // primary hit is skipped, with gi everything gathered beyond it is recorded there instead of returned, and in both
+    // cases emission found by the first BSDF sample is left out
+    [[nodiscard]] Float3 Li(const Camera::Instance* camera, Expr<uint> frame_index, Expr<uint2> pixel_id, Expr<float> time,
+                            bool primary_direct = true, const ReSTIRGI* gi = nullptr) const noexcept;
+};
+} // namespace Yutrel
@@ -0,0 +1,519 @@
+#include "sppm.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <luisa/core/thread_pool.h>
+#include <luisa/luisa-compute.h>
+
+#include "base/camera.h"
+#include "base/camera_controller.h"
+#include "base/film.h"
+#include "base/geometry.h"
+#include "base/hash_grid.h"
+#include "base/interaction.h"
+#include "base/light_sampler.h"
+#include "base/renderer.h"
+#include "base/sampler.h"
+#include "utils/color_space.h"
+#include "utils/command_buffer.h"
+#include "utils/progress_bar.h"
+#include "utils/shader_cache.h"
+#include "utils/spectra.h"
+
+namespace Yutrel
+{
+StochasticProgressivePhotonMapping::StochasticProgressivePhotonMapping(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
+    : Integrator(renderer, command_buffer, info),
+      m_photons_per_iteration(info.photons_per_iteration),
+      m_initial_radius(std::max(info.photon_radius, 0.0f)),
+      m_alpha(std::clamp(info.photon_alpha, 0.0f, 1.0f)) {}
+
+StochasticProgressivePhotonMapping::~StochasticProgressivePhotonMapping() noexcept = default;
+
+void StochasticProgressivePhotonMapping::render_interactive(Stream& stream)
+{
+    CommandBuffer command_buffer{stream};
+
+    auto camera     = renderer().camera();
+    auto resolution = camera->film()->base()->resolution();
+
+    if (restir() || restir_gi())
+    {
+        LUISA_WARNING("ReSTIR is not supported by photon mapping, gathering all indirect lighting from photons.");
+    }
+
+    camera->film()->prepare(command_buffer);
+    command_buffer << synchronize();
+
+    FpsCameraController controller{camera->transform(), camera->base()->up(), FpsCameraController::Config{}};
+
+    // the preview drives the window until the passes, compiled on a worker thread, are ready
+    auto preview  = compile_preview(camera);
+    auto compiled = global_thread_pool().async([this, camera]
+    {
+        compile(camera);
+    });
+    auto full_shader = false;
+
+    uint global_sample_index = 0u;
+
+    while (true)
+    {
+        camera->film()->show(command_buffer, true);
+        if (camera->film()->should_close())
+        {
+            break;
+        }
+
+        auto swap = !full_shader && compiled.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+        if (swap)
+        {
+            full_shader = true;
+            LUISA_INFO("Photon mapping shaders ready, leaving the preview.");
+        }
+
+        // the radii belong to the visible points of the previous view, so they start over as well
+        if (controller.update() || swap)
+        {
+            auto c2w = controller.camera_to_world();
+            camera->set_transform(command_buffer, c2w);
+            camera->film()->prepare(command_buffer);
+            if (full_shader)
+            {
+                reset(command_buffer, camera);
+            }
+            global_sample_index = 0u;
+            command_buffer << synchronize();
+        }
+
+        if (full_shader)
+        {
+            iterate(command_buffer, camera, global_sample_index++, 0.0f, 1.0f);
+        }
+        else
+        {
+            command_buffer << preview(global_sample_index++, 0.0f).dispatch(resolution);
+        }
+        command_buffer << commit();
+    }
+
+    command_buffer << synchronize();
+    compiled.wait();
+    camera->film()->release();
+}
+
+void StochasticProgressivePhotonMapping::compile(const Camera::Instance* camera) noexcept
+{
+    LUISA_INFO("Start compiling Integrator shader");
+    Clock clock_compile;
+
+    auto film        = camera->film();
+    auto pixel_count = film->max_pixel_count();
+    if (m_photons_per_iteration == 0u)
+    {
+        auto resolution         = film->base()->resolution();
+        m_photons_per_iteration = resolution.x * resolution.y;
+    }
+
+    auto&& device     = renderer().device();
+    m_visible_points  = device.create_buffer<float4>(pixel_count);
+    m_visible_origins = device.create_buffer<float4>(pixel_count);
+    m_visible_hits    = device.create_buffer<TriangleHit>(pixel_count);
+    m_visible_beta    = device.create_buffer<float4>(pixel_count);
+    m_direct          = device.create_buffer<float4>(pixel_count);
+    m_flux            = device.create_buffer<float4>(pixel_count);
+    m_statistics      = device.create_buffer<float4>(pixel_count);
+    m_grid            = luisa::make_unique<HashGrid>(renderer(), pixel_count);
+
+    auto spectrum   = renderer().spectrum();
+    auto geometry   = renderer().geometry();
+    auto dimension  = spectrum->base()->dimension();
+    auto has_lights = !renderer().lights().empty();
+    LUISA_ASSERT(dimension <= 4u, "Photon mapping stores spectra of at most 4 samples, got {}.", dimension);
+
+    auto with_closure = [&](const Interaction& it, SampledWavelengths& swl, Expr<float> time, auto&& f) noexcept
+    {
+        PolymorphicCall<Surface::Closure> call;
+        renderer().surfaces().dispatch(it.shape.surface_tag(), [&](auto surface) noexcept
+        {
+            surface->closure(call, it, swl, time);
+        });
+        call.execute([&](const Surface::Closure* closure) noexcept
+        {
+            f(closure);
+        });
+    };
+
+    Kernel1D reset_kernel = [&](Float radius) noexcept
+    {
+        m_statistics->write(dispatch_x(), make_float4(radius, 0.0f, 0.0f, 0.0f));
+    };
+
+    // one visible point per pixel at the first surface the camera ray finds, with its direct lighting
+    Kernel2D camera_kernel = [&](UInt2 tile_origin, UInt iteration, Float time, Float shutter_weight, Float u_wavelength) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id = tile_origin + dispatch_id().xy();
+        auto index    = dispatch_id().y * dispatch_size().x + dispatch_id().x;
+        sampler()->start(pixel_id, iteration);
+
+        auto u_filter = sampler()->generate_pixel_2d();
+        auto u_lens   = camera->base()->requires_lens_sampling() ? sampler()->generate_lens_2d() : make_float2(0.5f);
+
+        auto [camera_ray, _, camera_weight] = camera->generate_ray(pixel_id, time, u_filter, u_lens);
+
+        // all pixels and photons of an iteration share the wavelengths, so that the photons can be gathered anywhere
+        auto swl = spectrum->sample(u_wavelength);
+        SampledSpectrum beta{dimension, camera_weight * shutter_weight};
+        SampledSpectrum Ld{dimension, 0.0f};
+
+        auto hit = geometry->trace_closest(camera_ray);
+        auto it  = geometry->interaction(camera_ray, hit);
+        record_features(camera, pixel_id, *it, camera_ray->origin(), swl, time);
+
+        auto point = def(make_float4(0.0f));
+        $if(it->valid())
+        {
+            if (has_lights)
+            {
+                $if(it->shape.has_light())
+                {
+                    Ld += beta * light_sampler()->evaluate_hit(*it, camera_ray->origin(), swl, time).L;
+                };
+            }
+            $if(it->shape.has_surface())
+            {
+                // photons are only gathered after their first bounce, the light they carry before it is sampled here
+                auto u_light_selection = sampler()->generate_1d();
+                auto u_light_surface   = sampler()->generate_2d();
+                if (has_lights)
+                {
+                    $outline
+                    {
+                        auto light_sample = light_sampler()->sample(*it, u_light_selection, u_light_surface, swl, time);
+                        $if(light_sample.eval.pdf > 0.0f & !geometry->intersect_any(light_sample.shadow_ray))
+                        {
+                            with_closure(*it, swl, time, [&](const Surface::Closure* closure) noexcept
+                            {
+                                auto eval = closure->evaluate(-camera_ray->direction(), light_sample.shadow_ray->direction());
+                                Ld += beta * eval.f * light_sample.eval.L / light_sample.eval.pdf;
+                            });
+                        };
+                    };
+                }
+                point = make_float4(it->p_g, m_statistics->read(index).x);
+            };
+        };
+
+        auto beta_packed = def(make_float4(0.0f));
+        for (auto i = 0u; i < dimension; i++)
+        {
+            beta_packed[i] = beta[i];
+        }
+        m_visible_points->write(index, point);
+        m_visible_origins->write(index, make_float4(camera_ray->origin(), 0.0f));
+        m_visible_hits->write(index, hit);
+        m_visible_beta->write(index, beta_packed);
+        m_direct->write(index, make_float4(spectrum->srgb(swl, Ld), 0.0f));
+        m_flux->write(index, make_float4(0.0f));
+    };
+
+    // photons leave the lights through the same closures, and add their flux to every visible point they land near
+    Kernel1D photon_kernel = [&](UInt iteration, Float time, Float u_wavelength) noexcept
+    {
+        auto photon_id = dispatch_x();
+        sampler()->start(make_uint2(photon_id, 0u), iteration | stream_photon);
+        auto swl = spectrum->sample(u_wavelength);
+
+        auto deposit = [&](Expr<float3> p, Expr<float3> wi, const SampledSpectrum& beta_photon) noexcept
+        {
+            m_grid->for_each(p, [&](Expr<uint> index) noexcept
+            {
+                auto point = m_visible_points->read(index);
+                auto d     = p - point.xyz();
+                $if(dot(d, d) < point.w * point.w)
+                {
+                    auto origin = m_visible_origins->read(index).xyz();
+                    auto it     = geometry->interaction(make_ray(origin, normalize(point.xyz() - origin)), m_visible_hits->read(index));
+                    auto packed = m_visible_beta->read(index);
+                    SampledSpectrum beta{dimension};
+                    for (auto i = 0u; i < dimension; i++)
+                    {
+                        beta[i] = packed[i];
+                    }
+                    SampledSpectrum f{dimension};
+                    with_closure(*it, swl, time, [&](const Surface::Closure* closure) noexcept
+                    {
+                        f = closure->evaluate(normalize(origin - point.xyz()), wi).f;
+                    });
+                    // the closure includes the cosine at the visible point, the density estimate does not
+                    auto cos_wi = max(abs(dot(it->shading.n(), wi)), 1e-4f);
+                    auto phi    = spectrum->srgb(swl, beta * f * beta_photon) / cos_wi;
+                    $if(all(phi >= 0.0f) & !any(compute::isnan(phi) | compute::isinf(phi)))
+                    {
+                        m_flux->atomic(index).x.fetch_add(phi.x);
+                        m_flux->atomic(index).y.fetch_add(phi.y);
+                        m_flux->atomic(index).z.fetch_add(phi.z);
+                        m_flux->atomic(index).w.fetch_add(1.0f);
+                    };
+                };
+            });
+        };
+
+        auto u_select    = sampler()->generate_1d();
+        auto u_light     = sampler()->generate_2d();
+        auto u_direction = sampler()->generate_2d();
+        auto emission    = light_sampler()->sample_area(u_select, u_light, u_direction, swl, time);
+        $if(emission.pdf_area > 0.0f & emission.pdf_direction > 0.0f)
+        {
+            auto ray       = emission.ray;
+            auto cos_light = abs(dot(emission.n_g, ray->direction()));
+            SampledSpectrum beta{dimension};
+            beta = emission.L * (cos_light / (emission.pdf_area * emission.pdf_direction));
+            // roulette is relative to the emitted power, photon throughput is not bounded by one
+            auto beta_emitted = max(beta.max(), 1e-8f);
+
+            $for(depth, max_depth())
+            {
+                auto it = geometry->intersect(ray);
+                $if(!it->valid() | !it->shape.has_surface()) { $break; };
+
+                auto wi = -ray->direction();
+                $if(depth > 0u)
+                {
+                    $outline { deposit(it->p_g, wi, beta); };
+                };
+
+                auto u_lobe = sampler()->generate_1d();
+                auto u_bsdf = sampler()->generate_2d();
+                auto u_rr   = sampler()->generate_1d();
+                auto pdf    = def(0.0f);
+                $outline
+                {
+                    with_closure(*it, swl, time, [&](const Surface::Closure* closure) noexcept
+                    {
+                        auto surface_sample = closure->sample(wi, u_lobe, u_bsdf);
+                        pdf                 = surface_sample.eval.pdf;
+                        ray                 = it->spawn_ray(surface_sample.wi);
+                        beta *= ite(pdf > 0.0f, 1.0f / pdf, 0.0f) * surface_sample.eval.f;
+                    });
+                };
+                $if(pdf <= 0.0f) { $break; };
+
+                $if(depth + 1u >= rr_depth())
+                {
+                    auto q = max(beta.max() / beta_emitted, 0.05f);
+                    $if(q < rr_threshold() & u_rr >= q) { $break; };
+                    beta *= ite(q < rr_threshold(), 1.0f / q, 1.0f);
+                };
+            };
+        };
+    };
+
+    // the film receives the estimate of this iteration alone, gathered with the radius the points were sorted with,
+    // so that its running mean is the progressive estimate, then the radius shrinks with the photons found
+    Kernel2D update_kernel = [&](UInt2 tile_origin, UInt photon_count, Float alpha) noexcept
+    {
+        set_block_size(16u, 16u, 1u);
+        auto pixel_id   = tile_origin + dispatch_id().xy();
+        auto index      = dispatch_id().y * dispatch_size().x + dispatch_id().x;
+        auto statistics = m_statistics->read(index);
+        auto flux       = m_flux->read(index);
+        auto r          = statistics.x;
+        auto n          = statistics.y;
+        auto m          = flux.w;
+
+        auto L = m_direct->read(index).xyz() + flux.xyz() / (cast<float>(photon_count) * pi * r * r);
+        auto c     = film->sanitize(L, 1.0f);
+        auto count = ite(film->is_valid(L), 1.0f, 0.0f);
+        if (track_moments())
+        {
+            film->accumulate_exclusive(pixel_id, c, count, make_float2(linear_srgb_to_cie_y(c), 0.0f));
+        }
+        else
+        {
+            film->accumulate_exclusive(pixel_id, c, count);
+        }
+
+        $if(m > 0.0f)
+        {
+            auto n_next = n + alpha * m;
+            auto r_next = r * sqrt(n_next / (n + m));
+            m_statistics->write(index, make_float4(r_next, n_next, 0.0f, 0.0f));
+        };
+    };
+
+    auto shader_cache = renderer().shader_cache();
+    auto signature    = feature_signature(camera);
+    m_reset           = shader_cache->compile(reset_kernel, "sppm_reset", signature);
+    m_camera_pass     = shader_cache->compile(camera_kernel, "sppm_camera_pass", signature);
+    m_photon_pass     = shader_cache->compile(photon_kernel, "sppm_photon_pass", signature);
+    m_update          = shader_cache->compile(update_kernel, "sppm_update", signature);
+
+    LUISA_INFO("Integrator shader compile in {} ms.", clock_compile.toc());
+    LUISA_INFO("Photon mapping traces {} photons per iteration, visible points and hash grid take {:.2f} MB.",
+               m_photons_per_iteration,
+               static_cast<double>(size_bytes()) / (1024.0 * 1024.0));
+}
+
+void StochasticProgressivePhotonMapping::reset(CommandBuffer& command_buffer, const Camera::Instance* camera) noexcept
+{
+    auto radius = m_initial_radius;
+    if (radius <= 0.0f)
+    {
+        // a small fraction of the scene, known only once the geometry is built
+        auto geometry = renderer().geometry();
+        radius        = 0.005f * length(geometry->bounds_max() - geometry->bounds_min());
+    }
+    command_buffer << m_reset(radius).dispatch(camera->film()->pixel_count());
+}
+
+void StochasticProgressivePhotonMapping::iterate(CommandBuffer& command_buffer, const Camera::Instance* camera, uint iteration, float time, float shutter_weight) noexcept
+{
+    auto film = camera->film();
+    // golden ratio sequence over the wavelengths shared by an iteration
+    auto u_wavelength = renderer().spectrum()->base()->is_fixed() ? 0.0f : std::fmod(0.5f + 0.6180339887f * static_cast<float>(iteration), 1.0f);
+    command_buffer << m_camera_pass(film->tile_origin(), iteration, time, shutter_weight, u_wavelength).dispatch(film->tile_extent());
+    m_grid->build(command_buffer, m_visible_points, film->pixel_count());
+    command_buffer
+        << m_photon_pass(iteration, time, u_wavelength).dispatch(m_photons_per_iteration)
+        << m_update(film->tile_origin(), m_photons_per_iteration, m_alpha).dispatch(film->tile_extent());
+}
+
+size_t StochasticProgressivePhotonMapping::size_bytes() const noexcept
+{
+    return m_visible_points.size_bytes() + m_visible_origins.size_bytes() + m_visible_hits.size_bytes() +
+           m_visible_beta.size_bytes() + m_direct.size_bytes() + m_flux.size_bytes() + m_statistics.size_bytes() +
+           m_grid->size_bytes();
+}
+
+void StochasticProgressivePhotonMapping::render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera)
+{
+    auto spp        = camera->base()->spp();
+    auto film       = camera->film();
+    auto resolution = film->tile_extent();
+
+    LUISA_INFO(
+        "Rendering of resolution {}x{} with {} photon mapping iterations.",
+        resolution.x,
+        resolution.y,
+        spp);
+    if (adaptive())
+    {
+        LUISA_WARNING("Adaptive sampling is not supported by photon mapping, every pixel takes part in each iteration.");
+    }
+    if (path_guide() != nullptr || rrs_cache() != nullptr)
+    {
+        LUISA_WARNING("Path guiding and learned roulette are not supported by photon mapping.");
+    }
+    if (checkpoint_interval() > 0.0f)
+    {
+        LUISA_WARNING("Photon mapping keeps its radii on the device, checkpoints are not written.");
+    }
+
+    if (!m_camera_pass)
+    {
+        compile(camera);
+    }
+    reset(command_buffer, camera);
+    command_buffer << synchronize();
+
+    // iterations cycle through the shutter buckets, the radii shrink over all of them together
+    auto shutter_samples = camera->base()->shutter_samples();
+    luisa::vector<uint> remaining_spp;
+    for (const auto& s : shutter_samples)
+    {
+        remaining_spp.emplace_back(s.spp);
+    }
+
+    LUISA_INFO("Rendering started.");
+    Clock clock_render;
+    ProgressBar progress_bar;
+    progress_bar.update(0.0);
+    auto dispatch_count = 0u;
+    auto iteration      = 0u;
+    auto bucket         = 0u;
+    auto error          = -1.0f;
+    while (true)
+    {
+        auto skipped = 0u;
+        while (skipped < remaining_spp.size() && remaining_spp[bucket] == 0u)
+        {
+            bucket = (bucket + 1u) % remaining_spp.size();
+            skipped++;
+        }
+        if (skipped == remaining_spp.size())
+        {
+            break;
+        }
+        const auto& s = shutter_samples[bucket];
+        remaining_spp[bucket]--;
+        bucket = (bucket + 1u) % remaining_spp.size();
+
+        iterate(command_buffer, camera, iteration, s.time, s.weight);
+        iteration++;
+        dispatch_count++;
+        const auto dispatches_per_commit = 4u;
+        if (film->show(command_buffer) || dispatch_count >= dispatches_per_commit) [[unlikely]]
+        {
+            dispatch_count = 0u;
+            auto p         = iteration / static_cast<double>(spp);
+            if (time_budget() > 0.0f)
+            {
+                p = std::max(p, clock_render.toc() * 1e-3 / time_budget());
+            }
+            command_buffer << [&progress_bar, p]
+            {
+                progress_bar.update(std::min(p, 1.0));
+            };
+            if (time_budget() > 0.0f)
+            {
+                command_buffer << synchronize();
+                if (clock_render.toc() * 1e-3 >= time_budget())
+                {
+                    break;
+                }
+            }
+        }
+        if (film->should_close()) [[unlikely]]
+        {
+            command_buffer << synchronize();
+            progress_bar.done();
+            return;
+        }
+        if (check_target_error(iteration, iteration))
+        {
+            error = film->mean_relative_error(command_buffer);
+            if (error <= target_error())
+            {
+                break;
+            }
+        }
+    }
+    command_buffer << synchronize();
+    progress_bar.done();
+    auto render_time = clock_render.toc();
+    auto photons     = static_cast<double>(iteration) * static_cast<double>(m_photons_per_iteration);
+    LUISA_INFO("Photon mapping traced {} iterations of {} photons ({:.2f} M photons/s), visible points and hash grid take {:.2f} MB.",
+               iteration,
+               m_photons_per_iteration,
+               photons / std::max(render_time, 1e-3) * 1e-3,
+               static_cast<double>(size_bytes()) / (1024.0 * 1024.0));
+    if (progressive() || report_error())
+    {
+        if (error < 0.0f && track_moments())
+        {
+            error = film->mean_relative_error(command_buffer);
+        }
+        // consecutive iterations share the shrinking radii, so the error treats correlated estimates as independent
+        LUISA_INFO("Rendering (photon mapping) reached {} iterations and mean relative error {} in {:.2f} s, efficiency {:.4g}.",
+                   iteration,
+                   error,
+                   render_time * 1e-3,
+                   1.0 / std::max(static_cast<double>(error) * error * render_time * 1e-3, 1e-12));
+    }
+    report_throughput("Photon mapping rendering", render_time, resolution, iteration);
+}
+
+} // namespace Yutrel
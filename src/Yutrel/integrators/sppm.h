@@ -0,0 +1,61 @@
+#pragma once
+
+#include <luisa/runtime/buffer.h>
+#include <luisa/runtime/rtx/hit.h>
+#include <luisa/runtime/shader.h>
+
+#include "base/integrator.h"
+
+namespace Yutrel
+{
+class HashGrid;
+
+// stochastic progressive photon mapping (Hachisuka and Jensen 2009): every iteration finds one visible point
+// per pixel, sorts them into a hash grid and traces photons from the lights that are gathered at the visible
+// points within a per-pixel radius, which shrinks with the photons the pixel has seen
+class StochasticProgressivePhotonMapping final : public Integrator
+{
+public:
+    // sample stream of the photon paths of an iteration, disjoint from the camera pass
+    static constexpr auto stream_photon = 0xa0000000u;
+
+private:
+    uint m_photons_per_iteration{0u};
+    float m_initial_radius{0.0f};
+    float m_alpha{2.0f / 3.0f};
+
+    // the visible point of each pixel of the current tile as (position, radius), a radius of zero where the
+    // camera ray found no surface, with the ray origin, hit and throughput it was reached with
+    Buffer<float4> m_visible_points;
+    Buffer<float4> m_visible_origins;
+    Buffer<TriangleHit> m_visible_hits;
+    Buffer<float4> m_visible_beta;
+    // direct lighting of the iteration, and the photon flux gathered with the number of photons
+    Buffer<float4> m_direct;
+    Buffer<float4> m_flux;
+    // radius and accumulated photon count of each pixel, kept across iterations
+    Buffer<float4> m_statistics;
+    luisa::unique_ptr<HashGrid> m_grid;
+
+    Shader1D<float> m_reset;
+    Shader2D<uint2, uint, float, float, float> m_camera_pass;
+    Shader1D<uint, float, float> m_photon_pass;
+    Shader2D<uint2, uint, float> m_update;
+
+public:
+    explicit StochasticProgressivePhotonMapping(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept;
+    ~StochasticProgressivePhotonMapping() noexcept override;
+
+public:
+    void render_interactive(Stream& stream) override;
+
+private:
+    void render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera) override;
+    void compile(const Camera::Instance* camera) noexcept override;
+    // starts every pixel of the tile over from the initial radius
+    void reset(CommandBuffer& command_buffer, const Camera::Instance* camera) noexcept;
+    // camera pass, grid build, photon pass and radius update, the pixels receive the estimate of the iteration
+    void iterate(CommandBuffer& command_buffer, const Camera::Instance* camera, uint iteration, float time, float shutter_weight) noexcept;
+    [[nodiscard]] size_t size_bytes() const noexcept;
+};
+} // namespace Yutrel
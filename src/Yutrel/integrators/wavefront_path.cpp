@@ -0,0 +1,512 @@
+#include "wavefront_path.h"
+
+#include <algorithm>
+
+#include <luisa/core/thread_pool.h>
+#include <luisa/luisa-compute.h>
+
+#include "base/camera.h"
+#include "base/camera_controller.h"
+#include "base/film.h"
+#include "base/geometry.h"
+#include "base/interaction.h"
+#include "base/light_sampler.h"
+#include "base/renderer.h"
+#include "base/sampler.h"
+#include "base/spectrum.h"
+#include "utils/command_buffer.h"
+#include "utils/progress_bar.h"
+#include "utils/shader_cache.h"
+#include "utils/sampling.h"
+
+namespace Yutrel
+{
+SampledWavelengths WavefrontPathTracing::load_wavelengths(Expr<uint> state_id) const noexcept
+{
+    SampledWavelengths swl{renderer().spectrum()->base()->dimension()};
+    auto lambdas = m_wavelengths->read(state_id);
+    auto pdfs    = m_wavelength_pdfs->read(state_id);
+    for (auto i = 0u; i < swl.dimension(); i++)
+    {
+        swl.set_lambda(i, lambdas[i]);
+        swl.set_pdf(i, pdfs[i]);
+    }
+    return swl;
+}
+
+SampledSpectrum WavefrontPathTracing::load_spectrum(const Buffer<float4>& buffer, Expr<uint> state_id) const noexcept
+{
+    SampledSpectrum s{renderer().spectrum()->base()->dimension()};
+    auto v = buffer->read(state_id);
+    for (auto i = 0u; i < s.dimension(); i++)
+    {
+        s[i] = v[i];
+    }
+    return s;
+}
+
+void WavefrontPathTracing::store_spectrum(const Buffer<float4>& buffer, Expr<uint> state_id, const SampledSpectrum& s) const noexcept
+{
+    auto v = def(make_float4(0.0f));
+    for (auto i = 0u; i < s.dimension(); i++)
+    {
+        v[i] = s[i];
+    }
+    buffer->write(state_id, v);
+}
+
+void WavefrontPathTracing::push_queue(const Buffer<uint>& queue, Expr<uint> counter, Expr<uint> offset, Expr<uint> state_id) const noexcept
+{
+    auto slot = m_queue_counters->atomic(counter).fetch_add(1u);
+    queue->write(offset + slot, state_id);
+}
+
+void WavefrontPathTracing::prepare(CommandBuffer& command_buffer, const Camera::Instance* camera) noexcept
+{
+    // one path state per pixel of the largest tile the film holds
+    auto state_count = camera->film()->max_pixel_count();
+
+    sampler()->reset(command_buffer, state_count);
+    if (m_camera == camera && m_state_count == state_count)
+    {
+        return;
+    }
+    compile(camera);
+}
+
+void WavefrontPathTracing::compile(const Camera::Instance* camera) noexcept
+{
+    // the state buffers are sized for the camera, so they are created together with the kernels capturing them
+    auto state_count = camera->film()->max_pixel_count();
+
+    LUISA_ASSERT(renderer().spectrum()->base()->dimension() <= 4u,
+                 "Wavefront path tracing supports at most 4 wavelength samples.");
+
+    m_camera      = camera;
+    m_state_count = state_count;
+
+    auto&& device      = renderer().device();
+    auto surface_count = static_cast<uint>(renderer().surfaces().size());
+
+    m_rays            = device.create_buffer<Ray>(state_count);
+    m_hits            = device.create_buffer<TriangleHit>(state_count);
+    m_wavelengths     = device.create_buffer<float4>(state_count);
+    m_wavelength_pdfs = device.create_buffer<float4>(state_count);
+    m_beta            = device.create_buffer<float4>(state_count);
+    m_radiance        = device.create_buffer<float4>(state_count);
+    m_pdf_bsdf        = device.create_buffer<float4>(state_count);
+    m_shadow_rays     = device.create_buffer<Ray>(state_count);
+    m_light_radiance  = device.create_buffer<float4>(state_count);
+    m_light_pdf       = device.create_buffer<float>(state_count);
+    for (auto& queue : m_ray_queues)
+    {
+        queue = device.create_buffer<uint>(state_count);
+    }
+    m_hit_queue      = device.create_buffer<uint>(state_count);
+    m_shadow_queue   = device.create_buffer<uint>(state_count);
+    m_surface_queues = device.create_buffer<uint>(std::max(surface_count, 1u) * state_count);
+    m_queue_counters = device.create_buffer<uint>(counter_surface_queue_base + surface_count);
+
+    LUISA_INFO("Wavefront path states: {} ({:.2f} MB).",
+               state_count,
+               static_cast<double>(m_rays.size_bytes() * 2u + m_hits.size_bytes() +
+                                   m_wavelengths.size_bytes() * 6u + m_light_pdf.size_bytes() +
+                                   m_hit_queue.size_bytes() * 4u + m_surface_queues.size_bytes()) /
+                   (1024.0 * 1024.0));
+
+    Kernel1D reset_queues_kernel = [&](UInt keep) noexcept
+    {
+        auto counter = dispatch_x();
+        $if(counter != keep)
+        {
+            m_queue_counters->write(counter, 0u);
+        };
+    };
+
+    Kernel1D generate_rays_kernel = [&](UInt frame_index, Float time) noexcept
+    {
+        set_block_size(256u, 1u, 1u);
+        auto state_id = dispatch_x();
+        auto pixel_id = camera->film()->pixel_coordinate(state_id);
+
+        sampler()->start(pixel_id, frame_index);
+        auto u_filter = sampler()->generate_pixel_2d();
+        auto u_lens   = camera->base()->requires_lens_sampling() ? sampler()->generate_lens_2d() : make_float2(0.5f);
+
+        auto [camera_ray, _, camera_weight] = camera->generate_ray(pixel_id, time, u_filter, u_lens);
+
+        auto spectrum = renderer().spectrum();
+        auto swl      = spectrum->sample(spectrum->base()->is_fixed() ? 0.0f : sampler()->generate_wavelength());
+        sampler()->save_state(state_id);
+
+        auto lambdas = def(make_float4(0.0f));
+        auto pdfs    = def(make_float4(0.0f));
+        for (auto i = 0u; i < swl.dimension(); i++)
+        {
+            lambdas[i] = swl.lambda(i);
+            pdfs[i]    = swl.pdf(i);
+        }
+        m_wavelengths->write(state_id, lambdas);
+        m_wavelength_pdfs->write(state_id, pdfs);
+        m_rays->write(state_id, camera_ray);
+        m_beta->write(state_id, make_float4(camera_weight));
+        m_radiance->write(state_id, make_float4(0.0f));
+        m_pdf_bsdf->write(state_id, make_float4(camera_ray->origin(), 1e16f));
+
+        // every path starts alive, keep the queue in pixel order for coherence
+        m_ray_queues[0u]->write(state_id, state_id);
+        $if(state_id == 0u)
+        {
+            m_queue_counters->write(counter_ray_queue_base, dispatch_size_x());
+        };
+    };
+
+    Kernel1D intersect_kernel = [&](BufferUInt ray_queue, UInt ray_counter, Float time) noexcept
+    {
+        set_block_size(256u, 1u, 1u);
+        auto queue_id = dispatch_x();
+        $if(queue_id < m_queue_counters->read(ray_counter))
+        {
+            auto state_id = ray_queue.read(queue_id);
+            auto ray      = m_rays->read(state_id);
+            auto hit      = renderer().geometry()->trace_closest(ray);
+            m_hits->write(state_id, hit);
+
+            $if(!hit->miss())
+            {
+                auto it = renderer().geometry()->interaction(ray, hit);
+
+                // hit light
+                if (!renderer().lights().empty())
+                {
+                    $if(it->shape.has_light())
+                    {
+                        auto swl      = load_wavelengths(state_id);
+                        auto beta     = load_spectrum(m_beta, state_id);
+                        auto Li       = load_spectrum(m_radiance, state_id);
+                        auto pdf_bsdf = m_pdf_bsdf->read(state_id);
+                        auto eval     = light_sampler()->evaluate_hit(*it, pdf_bsdf.xyz(), swl, time);
+                        Li += beta * eval.L * balance_heuristic(pdf_bsdf.w, eval.pdf);
+                        store_spectrum(m_radiance, state_id, Li);
+                    };
+                }
+
+                $if(it->shape.has_surface())
+                {
+                    push_queue(m_hit_queue, counter_hit_queue, 0u, state_id);
+                    auto tag = it->shape.surface_tag();
+                    push_queue(m_surface_queues, counter_surface_queue_base + tag, tag * state_count, state_id);
+                };
+            };
+        };
+    };
+
+    Kernel1D sample_light_kernel = [&](Float time) noexcept
+    {
+        set_block_size(256u, 1u, 1u);
+        auto queue_id = dispatch_x();
+        $if(queue_id < m_queue_counters->read(counter_hit_queue))
+        {
+            auto state_id = m_hit_queue->read(queue_id);
+            auto it       = renderer().geometry()->interaction(m_rays->read(state_id), m_hits->read(state_id));
+            auto swl      = load_wavelengths(state_id);
+
+            sampler()->load_state(state_id);
+            auto u_light_selection = sampler()->generate_1d();
+            auto u_light_surface   = sampler()->generate_2d();
+            sampler()->save_state(state_id);
+
+            auto light_sample = light_sampler()->sample(*it, u_light_selection, u_light_surface, swl, time);
+            store_spectrum(m_light_radiance, state_id, light_sample.eval.L);
+            m_light_pdf->write(state_id, light_sample.eval.pdf);
+            m_shadow_rays->write(state_id, light_sample.shadow_ray);
+            $if(light_sample.eval.pdf > 0.0f)
+            {
+                push_queue(m_shadow_queue, counter_shadow_queue, 0u, state_id);
+            };
+        };
+    };
+
+    Kernel1D trace_shadow_kernel = [&]() noexcept
+    {
+        set_block_size(256u, 1u, 1u);
+        auto queue_id = dispatch_x();
+        $if(queue_id < m_queue_counters->read(counter_shadow_queue))
+        {
+            auto state_id = m_shadow_queue->read(queue_id);
+            $if(renderer().geometry()->intersect_any(m_shadow_rays->read(state_id)))
+            {
+                m_light_pdf->write(state_id, 0.0f);
+            };
+        };
+    };
+
+    Kernel1D accumulate_kernel = [&](Float shutter_weight) noexcept
+    {
+        set_block_size(256u, 1u, 1u);
+        auto state_id = dispatch_x();
+        auto pixel_id = camera->film()->pixel_coordinate(state_id);
+        auto swl      = load_wavelengths(state_id);
+        auto Li       = load_spectrum(m_radiance, state_id);
+        auto L        = renderer().spectrum()->srgb(swl, Li) * shutter_weight;
+        camera->film()->accumulate_exclusive(pixel_id, camera->film()->sanitize(L, 1.0f), ite(camera->film()->is_valid(L), 1.0f, 0.0f));
+    };
+
+    LUISA_INFO("Start compiling wavefront shaders");
+    Clock clock_compile;
+    auto shader_cache = renderer().shader_cache();
+    auto signature    = feature_signature(camera);
+    m_reset_queues    = shader_cache->compile(reset_queues_kernel, "wavefront_reset_queues", signature);
+    m_generate_rays   = shader_cache->compile(generate_rays_kernel, "wavefront_generate_rays", signature);
+    m_intersect       = shader_cache->compile(intersect_kernel, "wavefront_intersect", signature);
+    m_sample_light    = shader_cache->compile(sample_light_kernel, "wavefront_sample_light", signature);
+    m_trace_shadow    = shader_cache->compile(trace_shadow_kernel, "wavefront_trace_shadow", signature);
+    m_accumulate      = shader_cache->compile(accumulate_kernel, "wavefront_accumulate", signature);
+
+    // one shading kernel per surface tag so that each dispatch evaluates a single closure type
+    m_shade.clear();
+    m_shade.reserve(surface_count);
+    for (auto tag = 0u; tag < surface_count; tag++)
+    {
+        Kernel1D shade_kernel = [&, tag](BufferUInt next_queue, UInt next_counter, UInt depth, Float time) noexcept
+        {
+            set_block_size(256u, 1u, 1u);
+            auto queue_id = dispatch_x();
+            $if(queue_id < m_queue_counters->read(counter_surface_queue_base + tag))
+            {
+                auto state_id = m_surface_queues->read(tag * state_count + queue_id);
+                auto ray      = m_rays->read(state_id);
+                auto it       = renderer().geometry()->interaction(ray, m_hits->read(state_id));
+                auto wo       = -ray->direction();
+                auto swl      = load_wavelengths(state_id);
+                auto beta     = load_spectrum(m_beta, state_id);
+                auto Li       = load_spectrum(m_radiance, state_id);
+                auto pdf_bsdf = def(0.0f);
+
+                sampler()->load_state(state_id);
+                auto u_lobe = sampler()->generate_1d();
+                auto u_bsdf = sampler()->generate_2d();
+                auto u_rr   = def(0.0f);
+                $if(depth + 1u >= rr_depth())
+                {
+                    u_rr = sampler()->generate_1d();
+                };
+                sampler()->save_state(state_id);
+
+                // paths that missed or hit a light only leave the features of their pixel empty
+                $if(depth == 0u)
+                {
+                    record_features(camera, camera->film()->pixel_coordinate(state_id), *it, ray->origin(), swl, time);
+                };
+
+                auto light_pdf = m_light_pdf->read(state_id);
+                auto light_L   = load_spectrum(m_light_radiance, state_id);
+                auto wi_light  = m_shadow_rays->read(state_id)->direction();
+
+                PolymorphicCall<Surface::Closure> call;
+                renderer().surfaces().impl(tag)->closure(call, *it, swl, time);
+                call.execute([&](const Surface::Closure* closure) noexcept
+                {
+                    // direct lighting
+                    $if(light_pdf > 0.0f)
+                    {
+                        auto eval = closure->evaluate(wo, wi_light);
+                        auto w    = balance_heuristic(light_pdf, eval.pdf) / light_pdf;
+                        Li += w * beta * eval.f * light_L;
+                    };
+
+                    // sample surface
+                    auto surface_sample = closure->sample(wo, u_lobe, u_bsdf);
+                    m_rays->write(state_id, it->spawn_ray(surface_sample.wi));
+                    pdf_bsdf = surface_sample.eval.pdf;
+                    auto w   = ite(surface_sample.eval.pdf > 0.0f, 1.0f / surface_sample.eval.pdf, 0.0f);
+                    beta *= w * surface_sample.eval.f;
+                });
+
+                auto alive = def(!beta.is_zero());
+                auto q     = max(beta.max(), 0.05f);
+                $if(depth + 1u >= rr_depth())
+                {
+                    alive = alive & !(q < rr_threshold() & u_rr >= q);
+                    beta *= ite(q < rr_threshold(), 1.0f / q, 1.0f);
+                };
+
+                store_spectrum(m_beta, state_id, beta);
+                store_spectrum(m_radiance, state_id, Li);
+                m_pdf_bsdf->write(state_id, make_float4(it->p_g, pdf_bsdf));
+                $if(alive)
+                {
+                    auto slot = m_queue_counters->atomic(next_counter).fetch_add(1u);
+                    next_queue.write(slot, state_id);
+                };
+            };
+        };
+        m_shade.emplace_back(shader_cache->compile(shade_kernel, luisa::format("wavefront_shade_{}", tag), signature));
+    }
+    LUISA_INFO("Wavefront shaders ({} stages) compile in {} ms.", 6u + surface_count, clock_compile.toc());
+}
+
+void WavefrontPathTracing::sample_pass(CommandBuffer& command_buffer, uint frame_index, float time, float weight) noexcept
+{
+    auto counter_count = counter_surface_queue_base + static_cast<uint>(m_shade.size());
+
+    // generation and accumulation cover the current tile, the other stages are bounded by the queue counters
+    auto pixel_count = m_camera->film()->pixel_count();
+    command_buffer << m_generate_rays(frame_index, time).dispatch(pixel_count);
+    for (auto depth = 0u; depth < max_depth(); depth++)
+    {
+        auto current = depth % 2u;
+        auto next    = 1u - current;
+        command_buffer
+            << m_reset_queues(counter_ray_queue_base + current).dispatch(counter_count)
+            << m_intersect(m_ray_queues[current], counter_ray_queue_base + current, time).dispatch(m_state_count)
+            << m_sample_light(time).dispatch(m_state_count)
+            << m_trace_shadow().dispatch(m_state_count);
+        for (auto& shade : m_shade)
+        {
+            command_buffer << shade(m_ray_queues[next], counter_ray_queue_base + next, depth, time).dispatch(m_state_count);
+        }
+    }
+    command_buffer << m_accumulate(weight).dispatch(pixel_count);
+}
+
+void WavefrontPathTracing::render_interactive(Stream& stream)
+{
+    CommandBuffer command_buffer{stream};
+
+    auto camera     = renderer().camera();
+    auto resolution = camera->film()->base()->resolution();
+
+    if (restir() || restir_gi())
+    {
+        LUISA_WARNING("ReSTIR is not supported by the wavefront integrator, path tracing all lighting.");
+    }
+
+    camera->film()->prepare(command_buffer);
+    sampler()->reset(command_buffer, camera->film()->max_pixel_count());
+    command_buffer << synchronize();
+
+    FpsCameraController controller{camera->transform(), camera->base()->up(), FpsCameraController::Config{}};
+
+    // the preview drives the window until the stage shaders, compiled on a worker thread, are ready
+    auto preview  = compile_preview(camera);
+    auto compiled = global_thread_pool().async([this, camera]
+    {
+        compile(camera);
+    });
+    auto full_shader = false;
+
+    uint global_sample_index = 0u;
+
+    while (true)
+    {
+        camera->film()->show(command_buffer, true);
+        if (camera->film()->should_close())
+        {
+            break;
+        }
+
+        auto swap = !full_shader && compiled.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+        if (swap)
+        {
+            full_shader = true;
+            LUISA_INFO("Wavefront shaders ready, leaving the preview.");
+        }
+
+        if (controller.update() || swap)
+        {
+            auto c2w = controller.camera_to_world();
+            camera->set_transform(command_buffer, c2w);
+            camera->film()->prepare(command_buffer);
+            global_sample_index = 0u;
+            command_buffer << synchronize();
+        }
+
+        if (full_shader)
+        {
+            sample_pass(command_buffer, global_sample_index++, 0.0f, 1.0f);
+        }
+        else
+        {
+            command_buffer << preview(global_sample_index++, 0.0f).dispatch(resolution);
+        }
+        command_buffer << commit();
+    }
+
+    command_buffer << synchronize();
+    compiled.wait();
+    camera->film()->release();
+}
+
+void WavefrontPathTracing::render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera)
+{
+    auto spp        = camera->base()->spp();
+    auto resolution = camera->film()->tile_extent();
+
+    LUISA_INFO(
+        "Rendering of resolution {}x{} at {}spp (wavefront).",
+        resolution.x,
+        resolution.y,
+        spp);
+    if (adaptive())
+    {
+        LUISA_WARNING("Adaptive sampling is not supported by the wavefront integrator, all pixels get {}spp.", spp);
+    }
+    if (progressive())
+    {
+        LUISA_WARNING("Progressive rendering is not supported by the wavefront integrator, rendering {}spp.", spp);
+    }
+    if (path_guide() != nullptr)
+    {
+        LUISA_WARNING("Path guiding is not supported by the wavefront integrator, sampling the BSDF only.");
+    }
+    if (rrs_cache() != nullptr)
+    {
+        LUISA_WARNING("Learned Russian roulette and splitting are not supported by the wavefront integrator, using throughput roulette.");
+    }
+    if (std::any_of(nee_samples().begin(), nee_samples().end(), [](auto n) { return n != 1u; }))
+    {
+        LUISA_WARNING("Multi-sample next-event estimation is not supported by the wavefront integrator, taking one light sample per vertex.");
+    }
+
+    prepare(command_buffer, camera);
+    command_buffer << synchronize();
+
+    auto progress = begin_progress(command_buffer, camera);
+    LUISA_INFO("Rendering started.");
+    Clock clock_render;
+    Clock clock_checkpoint;
+    ProgressBar progress_bar;
+    progress_bar.update(0.0);
+    for (auto bucket = 0u; bucket < progress.shutter_samples.size(); bucket++)
+    {
+        const auto& s = progress.shutter_samples[bucket];
+        while (progress.remaining_spp[bucket] != 0u)
+        {
+            progress.remaining_spp[bucket]--;
+            sample_pass(command_buffer, progress.global_sample_index++, s.time, s.weight);
+            auto p = progress.global_sample_index / static_cast<double>(spp);
+            command_buffer << [&progress_bar, p]
+            {
+                progress_bar.update(p);
+            };
+            camera->film()->show(command_buffer);
+            if (camera->film()->should_close()) [[unlikely]]
+            {
+                command_buffer << synchronize();
+                progress_bar.done();
+                return;
+            }
+            if (checkpoint_interval() > 0.0f && clock_checkpoint.toc() * 1e-3 >= checkpoint_interval())
+            {
+                write_checkpoint(command_buffer, camera, progress);
+                clock_checkpoint.tic();
+            }
+        }
+    }
+    command_buffer << synchronize();
+    progress_bar.done();
+    report_throughput("Wavefront rendering", clock_render.toc(), resolution, spp);
+}
+
+} // namespace Yutrel
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <luisa/runtime/buffer.h>
+#include <luisa/runtime/rtx/hit.h>
+#include <luisa/runtime/rtx/ray.h>
+#include <luisa/runtime/shader.h>
+
+#include "base/integrator.h"
+#include "utils/spectra.h"
+
+namespace Yutrel
+{
+// splits the path tracing loop into stage kernels that communicate through SoA path states and queues
+class WavefrontPathTracing final : public Integrator
+{
+private:
+    static constexpr auto counter_ray_queue_base     = 0u;
+    static constexpr auto counter_hit_queue          = 2u;
+    static constexpr auto counter_shadow_queue       = 3u;
+    static constexpr auto counter_surface_queue_base = 4u;
+
+    uint m_state_count{0u};
+    const Camera::Instance* m_camera{nullptr};
+
+    // path states
+    Buffer<Ray> m_rays;
+    Buffer<TriangleHit> m_hits;
+    Buffer<float4> m_wavelengths;
+    Buffer<float4> m_wavelength_pdfs;
+    Buffer<float4> m_beta;
+    Buffer<float4> m_radiance;
+    // the vertex the ray left from, where the light sampler selected its light sample, and the bsdf pdf
+    Buffer<float4> m_pdf_bsdf;
+    Buffer<Ray> m_shadow_rays;
+    Buffer<float4> m_light_radiance;
+    Buffer<float> m_light_pdf;
+
+    // queues
+    std::array<Buffer<uint>, 2u> m_ray_queues;
+    Buffer<uint> m_hit_queue;
+    Buffer<uint> m_shadow_queue;
+    Buffer<uint> m_surface_queues;
+    Buffer<uint> m_queue_counters;
+
+    // stages
+    Shader1D<uint> m_reset_queues;
+    Shader1D<uint, float> m_generate_rays;
+    Shader1D<Buffer<uint>, uint, float> m_intersect;
+    Shader1D<float> m_sample_light;
+    Shader1D<> m_trace_shadow;
+    luisa::vector<Shader1D<Buffer<uint>, uint, uint, float>> m_shade;
+    Shader1D<float> m_accumulate;
+
+public:
+    explicit WavefrontPathTracing(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
+        : Integrator(renderer, command_buffer, info) {}
+    ~WavefrontPathTracing() noexcept override = default;
+
+public:
+    void render_interactive(Stream& stream) override;
+
+private:
+    void render_one_camera(CommandBuffer& command_buffer, Camera::Instance* camera) override;
+
+    void compile(const Camera::Instance* camera) noexcept override;
+
+    void prepare(CommandBuffer& command_buffer, const Camera::Instance* camera) noexcept;
+    void sample_pass(CommandBuffer& command_buffer, uint frame_index, float time, float weight) noexcept;
+
+    [[nodiscard]] SampledWavelengths load_wavelengths(Expr<uint> state_id) const noexcept;
+    [[nodiscard]] SampledSpectrum load_spectrum(const Buffer<float4>& buffer, Expr<uint> state_id) const noexcept;
+    void store_spectrum(const Buffer<float4>& buffer, Expr<uint> state_id, const SampledSpectrum& s) const noexcept;
+    void push_queue(const Buffer<uint>& queue, Expr<uint> counter, Expr<uint> offset, Expr<uint> state_id) const noexcept;
+};
+} // namespace Yutrel
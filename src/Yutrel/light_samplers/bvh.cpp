@@ -0,0 +1,243 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <numbers>
+#include <numeric>
+
+#include "base/interaction.h"
+#include "base/renderer.h"
+
+namespace Yutrel
+{
+namespace
+{
+constexpr auto one_minus_epsilon = 0x1.fffffep-1f;
+
+struct DirectionCone
+{
+    float3 axis;
+    float cos_theta;
+};
+
+// smallest cone found by rotating a towards b that contains both, after pbrt's DirectionCone::Union
+[[nodiscard]] DirectionCone merge_cones(const DirectionCone& a, const DirectionCone& b) noexcept
+{
+    auto theta_a = std::acos(std::clamp(a.cos_theta, -1.0f, 1.0f));
+    auto theta_b = std::acos(std::clamp(b.cos_theta, -1.0f, 1.0f));
+    auto theta_d = std::acos(std::clamp(dot(a.axis, b.axis), -1.0f, 1.0f));
+    if (std::min(theta_d + theta_b, std::numbers::pi_v<float>) <= theta_a) { return a; }
+    if (std::min(theta_d + theta_a, std::numbers::pi_v<float>) <= theta_b) { return b; }
+
+    auto theta_o = 0.5f * (theta_a + theta_d + theta_b);
+    auto w       = cross(a.axis, b.axis);
+    if (theta_o >= std::numbers::pi_v<float> || dot(w, w) == 0.0f)
+    {
+        return {.axis = a.axis, .cos_theta = -1.0f};
+    }
+
+    // rodrigues rotation of a.axis by theta_r around w
+    auto k       = normalize(w);
+    auto theta_r = theta_o - theta_a;
+    auto axis    = a.axis * std::cos(theta_r) +
+                   cross(k, a.axis) * std::sin(theta_r) +
+                   k * dot(k, a.axis) * (1.0f - std::cos(theta_r));
+    return {.axis = normalize(axis), .cos_theta = std::cos(theta_o)};
+}
+} // namespace
+
+BVHLightSampler::BVHLightSampler(Renderer& renderer, CommandBuffer& command_buffer) noexcept
+    : LightSampler(renderer, command_buffer)
+{
+    if (light_count() != 0u)
+    {
+        auto [node_view, node_buffer_id]   = renderer.bindless_arena_buffer<LightBVHNode>(2u * light_count() - 1u);
+        auto [trail_view, trail_buffer_id] = renderer.bindless_arena_buffer<uint2>(light_count());
+        m_node_view                        = node_view;
+        m_trail_view                       = trail_view;
+        m_node_buffer_id                   = node_buffer_id;
+        m_trail_buffer_id                  = trail_buffer_id;
+    }
+}
+
+void BVHLightSampler::build(CommandBuffer& command_buffer) noexcept
+{
+    if (light_count() == 0u) { return; }
+
+    auto& geometry = *renderer().geometry();
+    luisa::vector<LightBVHNode> leaves;
+    leaves.reserve(light_count());
+    for (auto i = 0u; i < light_count(); i++)
+    {
+        auto handle    = geometry.light_instances()[i];
+        auto& bounds   = geometry.light_bounds()[i];
+        auto light     = renderer().lights().impl(handle.light_tag);
+        auto two_sided = light->two_sided();
+        leaves.emplace_back(LightBVHNode{
+            .bounds_min  = bounds.bounds_min,
+            .bounds_max  = bounds.bounds_max,
+            .axis        = bounds.axis,
+            .cos_theta_o = two_sided ? -1.0f : bounds.cos_theta_o,
+            .phi         = light->radiance_estimate() * bounds.area * std::numbers::pi_v<float> * (two_sided ? 2.0f : 1.0f),
+            .index       = i,
+            .is_leaf     = 1u});
+    }
+
+    luisa::vector<uint> lights(light_count());
+    std::iota(lights.begin(), lights.end(), 0u);
+    m_nodes.clear();
+    m_nodes.reserve(2u * light_count() - 1u);
+    m_trails.resize(light_count());
+    build_node(lights, leaves, 0u, 0u);
+
+    auto max_depth = std::max_element(m_trails.cbegin(), m_trails.cend(), [](auto a, auto b)
+                                      { return a.y < b.y; })
+                         ->y;
+    LUISA_INFO("Light BVH over {} lights: {} nodes, depth {}.", light_count(), m_nodes.size(), max_depth);
+
+    command_buffer
+        << m_node_view.copy_from(m_nodes.data())
+        << m_trail_view.copy_from(m_trails.data())
+        << commit();
+}
+
+uint BVHLightSampler::build_node(luisa::span<uint> lights, luisa::span<const LightBVHNode> leaves, uint depth, uint trail) noexcept
+{
+    auto node_index = static_cast<uint>(m_nodes.size());
+    if (lights.size() == 1u)
+    {
+        m_nodes.emplace_back(leaves[lights.front()]);
+        m_trails[lights.front()] = make_uint2(trail, depth);
+        return node_index;
+    }
+    LUISA_ASSERT(depth < 32u, "Light BVH is too deep.");
+
+    // median split along the longest axis of the centroid bounds
+    auto centroid = [&](uint light)
+    {
+        return 0.5f * (leaves[light].bounds_min + leaves[light].bounds_max);
+    };
+    auto centroid_min = make_float3(std::numeric_limits<float>::max());
+    auto centroid_max = make_float3(-std::numeric_limits<float>::max());
+    for (auto light : lights)
+    {
+        centroid_min = min(centroid_min, centroid(light));
+        centroid_max = max(centroid_max, centroid(light));
+    }
+    auto extent = centroid_max - centroid_min;
+    auto axis   = extent.x > extent.y ? (extent.x > extent.z ? 0u : 2u) : (extent.y > extent.z ? 1u : 2u);
+    auto middle = lights.begin() + lights.size() / 2u;
+    std::nth_element(lights.begin(), middle, lights.end(), [&](uint a, uint b)
+                     { return centroid(a)[axis] < centroid(b)[axis]; });
+
+    m_nodes.emplace_back();
+    auto first  = build_node(lights.subspan(0u, lights.size() / 2u), leaves, depth + 1u, trail);
+    auto second = build_node(lights.subspan(lights.size() / 2u), leaves, depth + 1u, trail | (1u << depth));
+
+    auto a    = m_nodes[first];
+    auto b    = m_nodes[second];
+    auto cone = merge_cones({a.axis, a.cos_theta_o}, {b.axis, b.cos_theta_o});
+
+    m_nodes[node_index] = LightBVHNode{
+        .bounds_min  = min(a.bounds_min, b.bounds_min),
+        .bounds_max  = max(a.bounds_max, b.bounds_max),
+        .axis        = cone.axis,
+        .cos_theta_o = cone.cos_theta,
+        .phi         = a.phi + b.phi,
+        .index       = second,
+        .is_leaf     = 0u};
+    return node_index;
+}
+
+Var<LightBVHNode> BVHLightSampler::node(Expr<uint> index) const noexcept
+{
+    return renderer().buffer<LightBVHNode>(m_node_buffer_id).read(index);
+}
+
+Float BVHLightSampler::importance(Expr<float3> p, const Var<LightBVHNode>& node) noexcept
+{
+    // after pbrt's LightBounds::Importance, without the receiver normal so that pmf() can be evaluated
+    // from the position of the previous vertex alone
+    auto pc     = 0.5f * (node.bounds_min + node.bounds_max);
+    auto radius = 0.5f * length(node.bounds_max - node.bounds_min);
+    auto d2     = dot(p - pc, p - pc);
+    auto wi     = normalize(p - pc);
+
+    auto cos_theta_w = dot(node.axis, wi);
+    auto sin_theta_w = sqrt(max(1.0f - cos_theta_w * cos_theta_w, 0.0f));
+    auto cos_theta_o = node.cos_theta_o;
+    auto sin_theta_o = sqrt(max(1.0f - cos_theta_o * cos_theta_o, 0.0f));
+
+    // angle subtended by the bounding sphere, everything when p is inside it
+    auto cos_theta_b = ite(d2 < radius * radius, -1.0f, sqrt(max(1.0f - radius * radius / d2, 0.0f)));
+    auto sin_theta_b = sqrt(max(1.0f - cos_theta_b * cos_theta_b, 0.0f));
+
+    // cos(max(0, theta_w - theta_o - theta_b))
+    auto cos_theta_x = ite(cos_theta_w > cos_theta_o, 1.0f, cos_theta_w * cos_theta_o + sin_theta_w * sin_theta_o);
+    auto sin_theta_x = ite(cos_theta_w > cos_theta_o, 0.0f, sin_theta_w * cos_theta_o - cos_theta_w * sin_theta_o);
+    auto cos_theta_p = ite(cos_theta_x > cos_theta_b, 1.0f, cos_theta_x * cos_theta_b + sin_theta_x * sin_theta_b);
+
+    // area lights emit over the hemisphere around their normal
+    return ite(cos_theta_p > 0.0f, node.phi * cos_theta_p / max(d2, radius), 0.0f);
+}
+
+LightSampler::Selection BVHLightSampler::select(const Interaction& it_from, Expr<float> u_in, Expr<float> time) const noexcept
+{
+    LUISA_ASSERT(light_count() != 0u, "No lights in scene.");
+
+    auto u     = def(u_in);
+    auto index = def(0u);
+    auto prob  = def(1.0f);
+    auto tag   = def(0u);
+    $for(level, 32u)
+    {
+        auto n = node(index);
+        $if(n.is_leaf != 0u)
+        {
+            tag = n.index;
+            $break;
+        };
+        auto importance_first  = importance(it_from.p_g, node(index + 1u));
+        auto importance_second = importance(it_from.p_g, node(n.index));
+        auto sum               = importance_first + importance_second;
+        $if(sum <= 0.0f)
+        {
+            prob = 0.0f;
+            $break;
+        };
+        // reuse the remainder of u for the levels below
+        auto p_first = importance_first / sum;
+        $if(u < p_first)
+        {
+            index = index + 1u;
+            prob *= p_first;
+            u = min(u / p_first, one_minus_epsilon);
+        }
+        $else
+        {
+            index = n.index;
+            prob *= 1.0f - p_first;
+            u = min((u - p_first) / (1.0f - p_first), one_minus_epsilon);
+        };
+    };
+    return {.tag = tag, .prob = prob};
+}
+
+Float BVHLightSampler::pmf(Expr<float3> p_from, Expr<uint> light_index) const noexcept
+{
+    auto trail = renderer().buffer<uint2>(m_trail_buffer_id).read(light_index);
+    auto index = def(0u);
+    auto prob  = def(1.0f);
+    $for(level, trail.y)
+    {
+        auto n                 = node(index);
+        auto importance_first  = importance(p_from, node(index + 1u));
+        auto importance_second = importance(p_from, node(n.index));
+        auto sum               = importance_first + importance_second;
+        auto second            = ((trail.x >> level) & 1u) != 0u;
+        prob *= ite(sum > 0.0f, ite(second, importance_second, importance_first) / sum, 0.0f);
+        index = ite(second, n.index, index + 1u);
+    };
+    return prob;
+}
+} // namespace Yutrel
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "base/geometry.h"
+#include "base/light_sampler.h"
+
+namespace Yutrel
+{
+struct LightBVHNode
+{
+    float3 bounds_min;
+    float3 bounds_max;
+    // normal cone, cos_theta_o is -1 when the node emits in every direction
+    float3 axis;
+    float cos_theta_o;
+    // total emitted power below the node
+    float phi;
+    // leaves: index into light_instances(), interior nodes: the second child, the first one directly follows
+    uint index;
+    uint is_leaf;
+};
+
+} // namespace Yutrel
+
+LUISA_STRUCT(Yutrel::LightBVHNode,
+             bounds_min, bounds_max, axis,
+             cos_theta_o, phi, index, is_leaf){};
+
+namespace Yutrel
+{
+// many-light sampler: a BVH over the emissive instances with power and normal cone bounds per node,
+// descended stochastically by the importance of each child to the shading point
+class BVHLightSampler final : public LightSampler
+{
+private:
+    luisa::vector<LightBVHNode> m_nodes;
+    // per light, the branches taken from the root (bit i set when the second child is taken at depth i) and the leaf depth
+    luisa::vector<uint2> m_trails;
+
+    // allocated up front so that the kernels can be traced before the geometry is built
+    BufferView<LightBVHNode> m_node_view;
+    BufferView<uint2> m_trail_view;
+    uint m_node_buffer_id{0u};
+    uint m_trail_buffer_id{0u};
+
+public:
+    explicit BVHLightSampler(Renderer& renderer, CommandBuffer& command_buffer) noexcept;
+
+public:
+    void build(CommandBuffer& command_buffer) noexcept override;
+
+    [[nodiscard]] Selection select(const Interaction& it_from, Expr<float> u, Expr<float> time) const noexcept override;
+    [[nodiscard]] Float pmf(Expr<float3> p_from, Expr<uint> light_index) const noexcept override;
+
+private:
+    // appends the subtree over lights to m_nodes and returns its root
+    uint build_node(luisa::span<uint> lights, luisa::span<const LightBVHNode> leaves, uint depth, uint trail) noexcept;
+    [[nodiscard]] Var<LightBVHNode> node(Expr<uint> index) const noexcept;
+    // conservative estimate of the power that reaches p from below the node
+    [[nodiscard]] static Float importance(Expr<float3> p, const Var<LightBVHNode>& node) noexcept;
+};
+} // namespace Yutrel
@@ -0,0 +1,17 @@
+#include "uniform.h"
+
+namespace Yutrel
+{
+LightSampler::Selection UniformLightSampler::select(const Interaction& it_from, Expr<float> u, Expr<float> time) const noexcept
+{
+    LUISA_ASSERT(light_count() != 0u, "No lights in scene.");
+    auto n = static_cast<float>(light_count());
+
+    return {.tag = cast<uint>(clamp(u * n, 0.0f, n - 1.0f)), .prob = 1.0f / n};
+}
+
+Float UniformLightSampler::pmf(Expr<float3> p_from, Expr<uint> light_index) const noexcept
+{
+    return 1.0f / static_cast<float>(std::max(light_count(), 1u));
+}
+} // namespace Yutrel
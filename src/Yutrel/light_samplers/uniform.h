@@ -0,0 +1,18 @@
+#pragma once
+
+#include "base/light_sampler.h"
+
+namespace Yutrel
+{
+// every light is picked with the same probability
+class UniformLightSampler final : public LightSampler
+{
+public:
+    explicit UniformLightSampler(Renderer& renderer, CommandBuffer& command_buffer) noexcept
+        : LightSampler(renderer, command_buffer) {}
+
+public:
+    [[nodiscard]] Selection select(const Interaction& it_from, Expr<float> u, Expr<float> time) const noexcept override;
+    [[nodiscard]] Float pmf(Expr<float3> p_from, Expr<uint> light_index) const noexcept override;
+};
+} // namespace Yutrel
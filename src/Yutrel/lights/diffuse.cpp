@@ -25,6 +25,16 @@ luisa::unique_ptr<Light::Closure> DiffuseLight::Instance::closure(const SampledW
     return luisa::make_unique<Closure>(this, swl, time);
 }
 
+float DiffuseLight::Instance::radiance_estimate() const noexcept
+{
+    auto scale = base<DiffuseLight>()->scale();
+    if (auto v = m_emission->base()->evaluate_static())
+    {
+        return scale * std::max(dot(make_float3(0.2126f, 0.7152f, 0.0722f), v->xyz()), 0.0f);
+    }
+    return scale;
+}
+
 Light::Evaluation DiffuseLight::Closure::evaluate(const Interaction& it_light, Expr<float3> p_from) const noexcept
 {
     auto eval = Light::Evaluation::zero(swl().dimension());
@@ -36,6 +36,8 @@ public:
 
     [[nodiscard]] auto texture() const noexcept { return m_emission; }
     [[nodiscard]] luisa::unique_ptr<Light::Closure> closure(const SampledWavelengths& swl, Expr<float> time) const noexcept override;
+    [[nodiscard]] float radiance_estimate() const noexcept override;
+    [[nodiscard]] bool two_sided() const noexcept override { return base<DiffuseLight>()->two_sided(); }
 };
 
 class DiffuseLight::Closure : public Light::Closure
@@ -1,18 +1,162 @@
 #include "base/application.h"
+#include "utils/volume_io.h"
+
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
 
 #include <luisa/core/logging.h>
 
 using namespace Yutrel;
 
+// writes count small downward-facing quads in a grid under the cornell box ceiling and returns their paths,
+// a many-light benchmark for the light samplers
+static luisa::vector<std::filesystem::path> write_ceiling_lights(uint count)
+{
+    auto directory = std::filesystem::path{".cache"} / "many_lights";
+    std::filesystem::create_directories(directory);
+
+    auto columns = static_cast<uint>(std::ceil(std::sqrt(static_cast<float>(count))));
+    auto spacing = 1.9f / static_cast<float>(columns);
+    auto half    = 0.2f * spacing;
+    luisa::vector<std::filesystem::path> paths;
+    for (auto i = 0u; i < count; i++)
+    {
+        auto x    = -0.95f + (static_cast<float>(i % columns) + 0.5f) * spacing;
+        auto y    = -0.95f + (static_cast<float>(i / columns) + 0.5f) * spacing;
+        auto path = directory / luisa::format("light_{:04}.obj", i).c_str();
+        std::ofstream file{path};
+        // counter-clockwise seen from below, so the quad emits downwards
+        file << "v " << x - half << " " << y + half << " 1.98\n"
+             << "v " << x + half << " " << y + half << " 1.98\n"
+             << "v " << x + half << " " << y - half << " 1.98\n"
+             << "v " << x - half << " " << y - half << " 1.98\n"
+             << "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+             << "f 1/1 2/2 3/3\nf 1/1 3/3 4/4\n";
+        paths.emplace_back(path);
+    }
+    return paths;
+}
+
+// writes an axis-aligned box with outward-facing triangles, used as the boundary of a medium
+static std::filesystem::path write_box(luisa::string_view name, float3 lo, float3 hi)
+{
+    auto directory = std::filesystem::path{".cache"} / "media";
+    std::filesystem::create_directories(directory);
+    auto path = directory / luisa::format("{}.obj", name).c_str();
+    std::ofstream file{path};
+    for (auto i = 0u; i < 8u; i++)
+    {
+        file << "v " << ((i & 1u) ? hi.x : lo.x) << " " << ((i & 2u) ? hi.y : lo.y) << " " << ((i & 4u) ? hi.z : lo.z) << "\n";
+    }
+    file << "f 1 3 4\nf 1 4 2\nf 5 6 8\nf 5 8 7\n"
+         << "f 1 2 6\nf 1 6 5\nf 3 7 8\nf 3 8 4\n"
+         << "f 1 5 7\nf 1 7 3\nf 2 4 8\nf 2 8 6\n";
+    return path;
+}
+
+// a few soft blobs of smoke in a mostly empty grid, so the majorant grid has cells to skip
+static luisa::vector<float> smoke_density(uint resolution)
+{
+    constexpr std::array blobs{
+        make_float4(0.50f, 0.50f, 0.30f, 0.16f),
+        make_float4(0.35f, 0.55f, 0.55f, 0.12f),
+        make_float4(0.65f, 0.45f, 0.70f, 0.10f),
+    };
+    luisa::vector<float> density(static_cast<size_t>(resolution) * resolution * resolution);
+    for (auto z = 0u; z < resolution; z++)
+    {
+        for (auto y = 0u; y < resolution; y++)
+        {
+            for (auto x = 0u; x < resolution; x++)
+            {
+                auto p = (make_float3(make_uint3(x, y, z)) + 0.5f) / static_cast<float>(resolution);
+                auto d = 0.0f;
+                for (auto b : blobs)
+                {
+                    auto r2 = length_squared(p - b.xyz()) / (b.w * b.w);
+                    d += r2 < 1.0f ? std::exp(-3.0f * r2) : 0.0f;
+                }
+                density[(static_cast<size_t>(z) * resolution + y) * resolution + x] = d;
+            }
+        }
+    }
+    return density;
+}
+
+[[noreturn]] static void usage(const char* program)
+{
+    LUISA_ERROR("Usage: {} <backend> [--interactive|-i] [--headless] [--wavefront] [--bdpt] [--sppm] [--adaptive] [--time-budget <seconds>] [--target-error <relative error>] [--checkpoint <seconds>] [--resume] [--tile <size>] [--turntable <views>] [--guided] [--report-error] [--light-bvh] [--many-lights <count>] [--restir] [--restir-gi] [--denoise] [--aovs] [--ears] [--nee <samples>] [--fog] [--smoke] [--dense-volume] [--sampler <independent|sobol|zsobol|pmj02>] [--benchmark-sampler] [--reference <image>]. <backend>: cuda, dx, metal", program);
+    exit(1);
+}
+
+// the whole argument has to be a finite number, anything else prints the usage
+static float parse_float(const char* program, const char* value)
+{
+    char* end = nullptr;
+    errno     = 0;
+    auto v    = std::strtof(value, &end);
+    if (end == value || *end != '\0' || errno == ERANGE || !std::isfinite(v))
+    {
+        usage(program);
+    }
+    return v;
+}
+
+static uint parse_uint(const char* program, const char* value)
+{
+    char* end = nullptr;
+    errno     = 0;
+    auto v    = std::strtoul(value, &end, 10);
+    // strtoul would accept leading whitespace and wrap negative values around
+    if (!std::isdigit(static_cast<unsigned char>(value[0])) || *end != '\0' || errno == ERANGE || v > std::numeric_limits<uint>::max())
+    {
+        usage(program);
+    }
+    return static_cast<uint>(v);
+}
+
 int main(int argc, char* argv[])
 {
     if (argc <= 1)
     {
-        LUISA_ERROR("Usage: {} <backend> [--interactive|-i]. <backend>: cuda, dx, metal", argv[0]);
-        exit(1);
+        usage(argv[0]);
     }
 
-    bool interactive = false;
+    bool interactive   = false;
+    bool headless      = false;
+    bool wavefront     = false;
+    bool bdpt          = false;
+    bool sppm          = false;
+    bool adaptive      = false;
+    float time_budget  = 0.0f;
+    float target_error = 0.0f;
+    float checkpoint   = 0.0f;
+    bool resume        = false;
+    uint tile_size     = 0u;
+    uint turntable     = 1u;
+    bool guided        = false;
+    bool report_error  = false;
+    bool light_bvh     = false;
+    uint many_lights   = 0u;
+    bool restir        = false;
+    bool restir_gi     = false;
+    bool denoise       = false;
+    bool aovs          = false;
+    bool ears          = false;
+    uint nee_samples   = 1u;
+    bool fog           = false;
+    bool smoke         = false;
+    bool dense_volume  = false;
+    auto sampler_type  = Sampler::Type::independent;
+    bool bench_sampler = false;
+    std::filesystem::path reference;
     for (int i = 2; i < argc; i++)
     {
         auto arg = luisa::string_view{argv[i]};
@@ -20,12 +164,137 @@ int main(int argc, char* argv[])
         {
             interactive = true;
         }
+        else if (arg == "--headless")
+        {
+            headless = true;
+        }
+        else if (arg == "--wavefront")
+        {
+            wavefront = true;
+        }
+        else if (arg == "--bdpt")
+        {
+            bdpt = true;
+        }
+        else if (arg == "--sppm")
+        {
+            sppm = true;
+        }
+        else if (arg == "--adaptive")
+        {
+            adaptive = true;
+        }
+        else if (arg == "--time-budget" && i + 1 < argc)
+        {
+            time_budget = parse_float(argv[0], argv[++i]);
+        }
+        else if (arg == "--target-error" && i + 1 < argc)
+        {
+            target_error = parse_float(argv[0], argv[++i]);
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc)
+        {
+            checkpoint = parse_float(argv[0], argv[++i]);
+        }
+        else if (arg == "--resume")
+        {
+            resume = true;
+        }
+        else if (arg == "--tile" && i + 1 < argc)
+        {
+            tile_size = parse_uint(argv[0], argv[++i]);
+        }
+        else if (arg == "--turntable" && i + 1 < argc)
+        {
+            turntable = std::max(parse_uint(argv[0], argv[++i]), 1u);
+        }
+        else if (arg == "--guided")
+        {
+            guided = true;
+        }
+        else if (arg == "--report-error")
+        {
+            report_error = true;
+        }
+        else if (arg == "--light-bvh")
+        {
+            light_bvh = true;
+        }
+        else if (arg == "--many-lights" && i + 1 < argc)
+        {
+            many_lights = parse_uint(argv[0], argv[++i]);
+        }
+        else if (arg == "--restir")
+        {
+            restir = true;
+        }
+        else if (arg == "--restir-gi")
+        {
+            restir_gi = true;
+        }
+        else if (arg == "--denoise")
+        {
+            denoise = true;
+        }
+        else if (arg == "--aovs")
+        {
+            aovs = true;
+        }
+        else if (arg == "--ears")
+        {
+            ears = true;
+        }
+        else if (arg == "--nee" && i + 1 < argc)
+        {
+            nee_samples = parse_uint(argv[0], argv[++i]);
+        }
+        else if (arg == "--fog")
+        {
+            fog = true;
+        }
+        else if (arg == "--smoke")
+        {
+            smoke = true;
+        }
+        else if (arg == "--dense-volume")
+        {
+            dense_volume = true;
+        }
+        else if (arg == "--sampler" && i + 1 < argc)
+        {
+            auto name = luisa::string_view{argv[++i]};
+            if (name == "sobol")
+            {
+                sampler_type = Sampler::Type::sobol;
+            }
+            else if (name == "zsobol")
+            {
+                sampler_type = Sampler::Type::zsobol;
+            }
+            else if (name == "pmj02")
+            {
+                sampler_type = Sampler::Type::pmj02;
+            }
+            else if (name != "independent")
+            {
+                LUISA_WARNING("Unknown sampler '{}', using independent samples.", name);
+            }
+        }
+        else if (arg == "--benchmark-sampler")
+        {
+            bench_sampler = true;
+        }
+        else if (arg == "--reference" && i + 1 < argc)
+        {
+            reference = argv[++i];
+        }
     }
 
     Application::CreateInfo app_info{
         .bin         = argv[0],
         .backend     = argv[1],
         .interactive = interactive,
+        .headless    = headless,
     };
 
     auto& scene_info = app_info.scene_info;
@@ -33,11 +302,43 @@ int main(int argc, char* argv[])
     scene_info.spectrum_info = {
         .type = Spectrum::Type::HeroWavelength,
     };
+    auto integrator_type = wavefront ? Integrator::Type::wavefront_path : Integrator::Type::megakernel_path;
+    if (bdpt)
+    {
+        integrator_type = Integrator::Type::bidirectional_path;
+    }
+    if (sppm)
+    {
+        integrator_type = Integrator::Type::sppm;
+    }
+    scene_info.integrator_info = {
+        .type                = integrator_type,
+        .sampler_info        = {.type = sampler_type},
+        .benchmark_sampler   = bench_sampler,
+        .light_sampler_info  = {.type = light_bvh ? LightSampler::Type::bvh : LightSampler::Type::uniform},
+        // extra light samples only at the primary hit, where direct lighting dominates the variance
+        .nee_samples         = {nee_samples, 1u},
+        .adaptive            = adaptive,
+        .output_sample_count = adaptive,
+        .time_budget         = time_budget,
+        .target_error        = target_error,
+        .checkpoint_interval = checkpoint,
+        .resume              = resume,
+        .guiding             = guided,
+        .ears                = ears,
+        .restir              = restir,
+        .restir_gi           = restir_gi,
+        .report_error        = report_error,
+        .reference_path      = reference,
+    };
     scene_info.camera_info = {
         .type      = Camera::Type::pinhole,
         .film_info = {
             .resolution = make_uint2(1024u),
-            .hdr        = false},
+            .hdr        = false,
+            .tile_size  = tile_size,
+            .denoise    = denoise,
+            .aovs       = aovs},
         .filter_info = {.type = Filter::Type::Gaussian, .radius = 1.0f},
         .spp         = 65536u,
         .position    = make_float3(0.0f, -6.8f, 1.0f),
@@ -47,6 +348,28 @@ int main(int argc, char* argv[])
         .fov = 19.5f,
     };
 
+    // turntable views around the up axis, rendered as one batch
+    if (turntable > 1u)
+    {
+        auto view_info = scene_info.camera_info;
+        auto offset    = view_info.position - view_info.lookat;
+        for (auto view = 0u; view < turntable; view++)
+        {
+            auto angle                 = 2.0f * pi * static_cast<float>(view) / static_cast<float>(turntable);
+            auto r                     = make_float3x3(rotation(view_info.up, angle));
+            view_info.position         = view_info.lookat + r * offset;
+            view_info.film_info.output = luisa::format("render_{:03}.exr", view);
+            if (view == 0u)
+            {
+                scene_info.camera_info = view_info;
+            }
+            else
+            {
+                scene_info.batch_camera_infos.emplace_back(view_info);
+            }
+        }
+    }
+
     scene_info.shape_infos.resize(8);
 
     scene_info.shape_infos[0] =
@@ -98,6 +421,61 @@ int main(int argc, char* argv[])
                 .type        = Surface::Type::diffuse,
                 .reflectance = {.v = make_float4(0.725f, 0.71f, 0.68f, 1.0f)}}};
 
+    // replaces the area light with a grid of small lights with varying colors, about the same total power
+    if (many_lights != 0u)
+    {
+        scene_info.shape_infos.erase(scene_info.shape_infos.begin() + 4);
+        auto paths = write_ceiling_lights(many_lights);
+        auto scale = 0.47f * 0.38f / (0.16f * 1.9f * 1.9f);
+        for (auto i = 0u; i < many_lights; i++)
+        {
+            auto hue = static_cast<float>(i) / static_cast<float>(many_lights);
+            auto rgb = make_float3(0.5f) + 0.5f * cos(2.0f * pi * (hue + make_float3(0.0f, 0.33f, 0.67f)));
+            scene_info.shape_infos.emplace_back(
+                Shape::CreateInfo{
+                    .path       = paths[i],
+                    .light_info = {
+                        .type     = Light::Type::diffuse,
+                        .emission = {.v = make_float4(25.0f * scale * rgb, 1.0f)}}});
+        }
+    }
+
+    // thin fog filling the room, its boundary is a box just inside the walls and below the light
+    if (fog)
+    {
+        scene_info.shape_infos.emplace_back(
+            Shape::CreateInfo{
+                .path        = write_box("fog", make_float3(-0.99f, -0.99f, 0.01f), make_float3(0.99f, 0.99f, 1.97f)),
+                .medium_info = {
+                    .type    = Medium::Type::homogeneous,
+                    .sigma_a = make_float3(0.02f),
+                    .sigma_s = make_float3(0.15f, 0.18f, 0.2f)}});
+    }
+    // heterogeneous smoke in the middle of the room, written as a raw volume and loaded back like a file
+    // from disk, stored as bricks unless the dense volume is asked for
+    if (smoke)
+    {
+        auto lo       = make_float3(-0.6f, -0.6f, 0.2f);
+        auto hi       = make_float3(0.6f, 0.6f, 1.6f);
+        auto boundary = write_box("smoke", lo, hi);
+        auto path     = std::filesystem::path{boundary}.replace_extension(".vol");
+        save_raw_volume(path, DenseVolume{.values = smoke_density(64u), .resolution = make_uint3(64u)});
+        scene_info.shape_infos.emplace_back(
+            Shape::CreateInfo{
+                .path        = boundary,
+                .medium_info = {
+                    .type                = Medium::Type::heterogeneous,
+                    .sigma_a             = make_float3(0.05f),
+                    .sigma_s             = make_float3(0.9f),
+                    .scale               = 12.0f,
+                    .g                   = 0.3f,
+                    .density_path        = path,
+                    .brick_map           = !dense_volume,
+                    .bounds_min          = lo,
+                    .bounds_max          = hi,
+                    .majorant_resolution = 16u}});
+    }
+
     Application app{app_info};
     app.run();
 
@@ -0,0 +1,201 @@
+#include "heterogeneous.h"
+
+#include <luisa/dsl/sugar.h>
+
+#include "base/renderer.h"
+#include "utils/volume_io.h"
+
+namespace Yutrel
+{
+HeterogeneousMedium::HeterogeneousMedium(Scene& scene, const CreateInfo& info) noexcept
+    : Medium(scene, info),
+      m_density(info.density),
+      m_density_resolution(info.density_resolution),
+      m_bounds_min(min(info.bounds_min, info.bounds_max)),
+      m_bounds_max(max(info.bounds_min, info.bounds_max))
+{
+    if (!info.density_path.empty())
+    {
+        auto volume          = load_raw_volume(info.density_path);
+        m_density            = std::move(volume.values);
+        m_density_resolution = volume.resolution;
+    }
+    auto res = m_density_resolution;
+    if (m_density.empty())
+    {
+        LUISA_WARNING("Heterogeneous medium without a density, ignored.");
+        return;
+    }
+    LUISA_ASSERT(m_density.size() == static_cast<size_t>(res.x) * res.y * res.z,
+                 "Density of {} voxels does not match the resolution {}x{}x{}.",
+                 m_density.size(), res.x, res.y, res.z);
+    m_majorant_resolution = min(make_uint3(std::max(info.majorant_resolution, 1u)), res);
+
+    // the largest density a point of each cell can interpolate, the trilinear filter reaches half a voxel
+    // past the cell on every side so the voxels straddling its faces count too
+    auto m = m_majorant_resolution;
+    m_majorants.resize(static_cast<size_t>(m.x) * m.y * m.z);
+    auto voxel_range = [](uint c, uint cells, uint voxels) noexcept
+    {
+        auto lo = std::floor(static_cast<float>(c) / static_cast<float>(cells) * static_cast<float>(voxels) - 0.5f);
+        auto hi = std::floor(static_cast<float>(c + 1u) / static_cast<float>(cells) * static_cast<float>(voxels) - 0.5f) + 1.0f;
+        return std::make_pair(static_cast<uint>(std::clamp(lo, 0.0f, static_cast<float>(voxels - 1u))),
+                              static_cast<uint>(std::clamp(hi, 0.0f, static_cast<float>(voxels - 1u))));
+    };
+    for (auto z = 0u; z < m.z; z++)
+    {
+        auto [z0, z1] = voxel_range(z, m.z, res.z);
+        for (auto y = 0u; y < m.y; y++)
+        {
+            auto [y0, y1] = voxel_range(y, m.y, res.y);
+            for (auto x = 0u; x < m.x; x++)
+            {
+                auto [x0, x1] = voxel_range(x, m.x, res.x);
+                auto majorant = 0.0f;
+                for (auto k = z0; k <= z1; k++)
+                {
+                    for (auto j = y0; j <= y1; j++)
+                    {
+                        for (auto i = x0; i <= x1; i++)
+                        {
+                            majorant = std::max(majorant, m_density[(static_cast<size_t>(k) * res.y + j) * res.x + i]);
+                        }
+                    }
+                }
+                m_majorants[(static_cast<size_t>(z) * m.y + y) * m.x + x] = majorant;
+            }
+        }
+    }
+    auto empty = std::count(m_majorants.cbegin(), m_majorants.cend(), 0.0f);
+    LUISA_INFO("Heterogeneous medium: {}x{}x{} voxels, {}x{}x{} majorant cells ({} empty).",
+               res.x, res.y, res.z, m.x, m.y, m.z, empty);
+
+    if (info.brick_map)
+    {
+        // the device only sees the bricks from here on
+        m_brick_map = luisa::make_unique<BrickMap>(m_density, res);
+        m_density.clear();
+        m_density.shrink_to_fit();
+    }
+}
+
+luisa::unique_ptr<Medium::Instance> HeterogeneousMedium::build(Renderer& renderer, CommandBuffer& command_buffer) const noexcept
+{
+    auto density_id = ~0u;
+    luisa::unique_ptr<BrickMap::Instance> bricks;
+    if (m_brick_map)
+    {
+        bricks = m_brick_map->build(renderer, command_buffer);
+    }
+    else
+    {
+        auto density = renderer.create<Volume<float>>(PixelStorage::FLOAT1, m_density_resolution);
+        command_buffer << density->copy_from(m_density.data());
+        density_id = renderer.register_bindless(*density, TextureSampler::linear_point_zero());
+    }
+
+    auto [majorants, majorant_buffer_id] = renderer.bindless_arena_buffer<float>(m_majorants.size());
+    command_buffer << majorants.copy_from(m_majorants.data());
+
+    return luisa::make_unique<Instance>(renderer, this, density_id, std::move(bricks), majorant_buffer_id);
+}
+
+luisa::unique_ptr<Medium::Closure> HeterogeneousMedium::Instance::closure(const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
+    return luisa::make_unique<Closure>(this, swl, time);
+}
+
+luisa::string HeterogeneousMedium::Instance::constants() const noexcept
+{
+    auto medium = base<HeterogeneousMedium>();
+    auto lo     = medium->bounds_min();
+    auto hi     = medium->bounds_max();
+    auto res    = medium->majorant_resolution();
+    auto c      = luisa::format("{},{},{},{},{},{},{},{},{},{}",
+                                Medium::Instance::constants(), lo.x, lo.y, lo.z, hi.x, hi.y, hi.z, res.x, res.y, res.z);
+    if (auto bricks = medium->brick_map())
+    {
+        auto voxels = bricks->resolution();
+        c.append(luisa::format(",bricks:{},{},{},{}", voxels.x, voxels.y, voxels.z, bricks->atlas_bricks().x));
+    }
+    return c;
+}
+
+HeterogeneousMedium::Closure::Closure(const Medium::Instance* instance, const SampledWavelengths& swl, Expr<float> time) noexcept
+    : Medium::Closure(instance, swl, time),
+      m_sigma_a{instance->renderer().spectrum()->decode_unbounded(swl, instance->encoded_sigma_a()).value},
+      m_sigma_s{instance->renderer().spectrum()->decode_unbounded(swl, instance->encoded_sigma_s()).value},
+      m_sigma_t_max{(m_sigma_a + m_sigma_s).max()} {}
+
+Medium::Coefficients HeterogeneousMedium::Closure::coefficients(Expr<float3> p) const noexcept
+{
+    auto medium  = instance<HeterogeneousMedium::Instance>();
+    auto base    = medium->base<HeterogeneousMedium>();
+    auto uvw     = (p - base->bounds_min()) / (base->bounds_max() - base->bounds_min());
+    auto density = def(0.0f);
+    if (auto bricks = medium->bricks())
+    {
+        density = bricks->sample(uvw);
+    }
+    else
+    {
+        density = medium->renderer().tex3d(medium->density_id()).sample(uvw).x;
+    }
+    return {.sigma_a = m_sigma_a * density, .sigma_s = m_sigma_s * density};
+}
+
+void HeterogeneousMedium::Closure::traverse(Expr<float3> o, Expr<float3> d, Expr<float> t_max, const SegmentVisitor& visitor) const noexcept
+{
+    auto medium    = instance<HeterogeneousMedium::Instance>();
+    auto base      = medium->base<HeterogeneousMedium>();
+    auto res       = base->majorant_resolution();
+    auto majorants = medium->renderer().buffer<float>(medium->majorant_buffer_id());
+
+    // the ray in cell units, t is unchanged by the mapping
+    auto scale = make_float3(res) / (base->bounds_max() - base->bounds_min());
+    auto og    = (o - base->bounds_min()) * scale;
+    auto dg    = d * scale;
+    auto inv_d = 1.0f / dg;
+    auto t_lo  = (0.0f - og) * inv_d;
+    auto t_hi  = (make_float3(res) - og) * inv_d;
+    auto t0    = max(reduce_max(min(t_lo, t_hi)), 0.0f);
+    auto t1    = min(reduce_min(max(t_lo, t_hi)), t_max);
+    $if(t0 < t1)
+    {
+        auto p      = og + dg * t0;
+        auto cell   = def(clamp(make_int3(floor(p)), 0, make_int3(res) - 1));
+        auto step   = ite(dg >= 0.0f, make_int3(1), make_int3(-1));
+        auto delta  = abs(inv_d);
+        auto ahead  = make_float3(cell + ite(dg >= 0.0f, make_int3(1), make_int3(0)));
+        auto t_next = def(ite(dg == 0.0f, make_float3(std::numeric_limits<float>::max()), t0 + (ahead - p) * inv_d));
+        auto t      = def(t0);
+        auto done   = def(false);
+        $loop
+        {
+            auto t_exit   = min(reduce_min(t_next), t1);
+            auto index    = (cast<uint>(cell.z) * res.y + cast<uint>(cell.y)) * res.x + cast<uint>(cell.x);
+            auto majorant = majorants.read(index) * m_sigma_t_max;
+            visitor(t, t_exit, majorant, done);
+            $if(done | t_exit >= t1) { $break; };
+            t = t_exit;
+            $if(t_next.x <= t_next.y & t_next.x <= t_next.z)
+            {
+                cell.x += step.x;
+                t_next.x += delta.x;
+            }
+            $elif(t_next.y <= t_next.z)
+            {
+                cell.y += step.y;
+                t_next.y += delta.y;
+            }
+            $else
+            {
+                cell.z += step.z;
+                t_next.z += delta.z;
+            };
+            $if(any(cell < 0 | cell >= make_int3(res))) { $break; };
+        };
+    };
+}
+
+} // namespace Yutrel
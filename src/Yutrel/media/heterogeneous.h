@@ -0,0 +1,73 @@
+#pragma once
+
+#include "base/brick_map.h"
+#include "base/medium.h"
+
+namespace Yutrel
+{
+// coefficients scaled by a density on a grid over a box, sampled trilinearly from a dense volume or a
+// sparse brick map. Free flights step through a coarse grid holding the largest density each cell can
+// interpolate, so that sparse dense regions only force short steps where they are
+class HeterogeneousMedium : public Medium
+{
+public:
+    class Instance;
+    class Closure;
+
+private:
+    // the dense grid, released once it has been converted to bricks
+    luisa::vector<float> m_density;
+    uint3 m_density_resolution;
+    luisa::unique_ptr<BrickMap> m_brick_map;
+    float3 m_bounds_min;
+    float3 m_bounds_max;
+    luisa::vector<float> m_majorants;
+    uint3 m_majorant_resolution{make_uint3(1u)};
+
+public:
+    explicit HeterogeneousMedium(Scene& scene, const CreateInfo& info) noexcept;
+
+    [[nodiscard]] auto bounds_min() const noexcept { return m_bounds_min; }
+    [[nodiscard]] auto bounds_max() const noexcept { return m_bounds_max; }
+    [[nodiscard]] auto majorant_resolution() const noexcept { return m_majorant_resolution; }
+    [[nodiscard]] auto brick_map() const noexcept { return m_brick_map.get(); }
+    [[nodiscard]] bool is_null() const noexcept override { return m_majorants.empty(); }
+    [[nodiscard]] luisa::unique_ptr<Medium::Instance> build(Renderer& renderer, CommandBuffer& command_buffer) const noexcept override;
+};
+
+class HeterogeneousMedium::Instance : public Medium::Instance
+{
+private:
+    // the dense volume, or the brick map when the density is sparse
+    uint m_density_id;
+    luisa::unique_ptr<BrickMap::Instance> m_bricks;
+    uint m_majorant_buffer_id;
+
+public:
+    explicit Instance(const Renderer& renderer, const HeterogeneousMedium* medium, uint density_id,
+                      luisa::unique_ptr<BrickMap::Instance> bricks, uint majorant_buffer_id) noexcept
+        : Medium::Instance(renderer, medium), m_density_id(density_id), m_bricks(std::move(bricks)), m_majorant_buffer_id(majorant_buffer_id) {}
+
+    [[nodiscard]] auto density_id() const noexcept { return m_density_id; }
+    [[nodiscard]] auto bricks() const noexcept { return m_bricks.get(); }
+    [[nodiscard]] auto majorant_buffer_id() const noexcept { return m_majorant_buffer_id; }
+    [[nodiscard]] luisa::unique_ptr<Medium::Closure> closure(const SampledWavelengths& swl, Expr<float> time) const noexcept override;
+    [[nodiscard]] luisa::string constants() const noexcept override;
+};
+
+class HeterogeneousMedium::Closure : public Medium::Closure
+{
+private:
+    SampledSpectrum m_sigma_a;
+    SampledSpectrum m_sigma_s;
+    Float m_sigma_t_max;
+
+public:
+    Closure(const Medium::Instance* instance, const SampledWavelengths& swl, Expr<float> time) noexcept;
+
+    [[nodiscard]] Coefficients coefficients(Expr<float3> p) const noexcept override;
+    // Amanatides-Woo traversal of the majorant cells along the part of the ray inside the bounds
+    void traverse(Expr<float3> o, Expr<float3> d, Expr<float> t_max, const SegmentVisitor& visitor) const noexcept override;
+};
+
+} // namespace Yutrel
@@ -0,0 +1,33 @@
+#include "homogeneous.h"
+
+#include "base/renderer.h"
+
+namespace Yutrel
+{
+HomogeneousMedium::HomogeneousMedium(Scene& scene, const CreateInfo& info) noexcept
+    : Medium(scene, info) {}
+
+luisa::unique_ptr<Medium::Instance> HomogeneousMedium::build(Renderer& renderer, CommandBuffer& command_buffer) const noexcept
+{
+    return luisa::make_unique<Instance>(renderer, this);
+}
+
+luisa::unique_ptr<Medium::Closure> HomogeneousMedium::Instance::closure(const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
+    return luisa::make_unique<Closure>(this, swl, time);
+}
+
+HomogeneousMedium::Closure::Closure(const Medium::Instance* instance, const SampledWavelengths& swl, Expr<float> time) noexcept
+    : Medium::Closure(instance, swl, time),
+      m_coefficients{
+          .sigma_a = instance->renderer().spectrum()->decode_unbounded(swl, instance->encoded_sigma_a()).value,
+          .sigma_s = instance->renderer().spectrum()->decode_unbounded(swl, instance->encoded_sigma_s()).value,
+      } {}
+
+void HomogeneousMedium::Closure::traverse(Expr<float3> o, Expr<float3> d, Expr<float> t_max, const SegmentVisitor& visitor) const noexcept
+{
+    auto done = def(false);
+    visitor(0.0f, t_max, (m_coefficients.sigma_a + m_coefficients.sigma_s).max(), done);
+}
+
+} // namespace Yutrel
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "base/medium.h"
+
+namespace Yutrel
+{
+// constant coefficients, the majorant is exact so every collision is a real one
+class HomogeneousMedium : public Medium
+{
+public:
+    class Instance;
+    class Closure;
+
+public:
+    explicit HomogeneousMedium(Scene& scene, const CreateInfo& info) noexcept;
+
+    [[nodiscard]] bool is_null() const noexcept override { return all(sigma_a() + sigma_s() == 0.0f); }
+    [[nodiscard]] luisa::unique_ptr<Medium::Instance> build(Renderer& renderer, CommandBuffer& command_buffer) const noexcept override;
+};
+
+class HomogeneousMedium::Instance : public Medium::Instance
+{
+public:
+    explicit Instance(const Renderer& renderer, const HomogeneousMedium* medium) noexcept
+        : Medium::Instance(renderer, medium) {}
+
+    [[nodiscard]] luisa::unique_ptr<Medium::Closure> closure(const SampledWavelengths& swl, Expr<float> time) const noexcept override;
+};
+
+class HomogeneousMedium::Closure : public Medium::Closure
+{
+private:
+    Coefficients m_coefficients;
+
+public:
+    Closure(const Medium::Instance* instance, const SampledWavelengths& swl, Expr<float> time) noexcept;
+
+    [[nodiscard]] Coefficients coefficients(Expr<float3> p) const noexcept override { return m_coefficients; }
+    void traverse(Expr<float3> o, Expr<float3> d, Expr<float> t_max, const SegmentVisitor& visitor) const noexcept override;
+};
+
+} // namespace Yutrel
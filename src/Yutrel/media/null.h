@@ -0,0 +1,19 @@
+#pragma once
+
+#include "base/medium.h"
+
+namespace Yutrel
+{
+class NullMedium : public Medium
+{
+public:
+    explicit NullMedium(Scene& scene, const CreateInfo& info) noexcept : Medium(scene, info) {}
+
+    [[nodiscard]] bool is_null() const noexcept override { return true; }
+    [[nodiscard]] luisa::unique_ptr<Instance> build(Renderer& renderer, CommandBuffer& command_buffer) const noexcept override
+    {
+        return nullptr;
+    }
+};
+
+} // namespace Yutrel
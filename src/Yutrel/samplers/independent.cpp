@@ -0,0 +1,22 @@
+#include "independent.h"
+
+#include "utils/rng.h"
+
+namespace Yutrel
+{
+Sampler::State IndependentSampler::initial_state(Expr<uint2> pixel, Expr<uint> index) const noexcept
+{
+    return {.key = xxhash32(make_uint3(pixel, seed())), .index = index, .dimension = 0u, .salt = 0u};
+}
+
+Float IndependentSampler::sample_1d(const State& state, Expr<uint> dimension) const noexcept
+{
+    return uniform_uint_to_float(pcg3d(make_uint3(state.key, state.index, dimension)).x);
+}
+
+Float2 IndependentSampler::sample_2d(const State& state, Expr<uint> dimension) const noexcept
+{
+    auto v = pcg3d(make_uint3(state.key, state.index, dimension));
+    return make_float2(uniform_uint_to_float(v.x), uniform_uint_to_float(v.y));
+}
+} // namespace Yutrel
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "base/sampler.h"
+
+namespace Yutrel
+{
+// uniform random numbers hashed from the pixel, sample index and dimension
+class IndependentSampler final : public Sampler
+{
+public:
+    explicit IndependentSampler(const Renderer& renderer, const CreateInfo& info) noexcept
+        : Sampler(renderer, info) {}
+
+protected:
+    [[nodiscard]] State initial_state(Expr<uint2> pixel, Expr<uint> index) const noexcept override;
+    [[nodiscard]] Float sample_1d(const State& state, Expr<uint> dimension) const noexcept override;
+    [[nodiscard]] Float2 sample_2d(const State& state, Expr<uint> dimension) const noexcept override;
+};
+} // namespace Yutrel
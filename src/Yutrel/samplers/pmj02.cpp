@@ -0,0 +1,56 @@
+#include "pmj02.h"
+
+#include <random>
+
+#include <luisa/dsl/sugar.h>
+
+#include "base/renderer.h"
+#include "utils/low_discrepancy.h"
+#include "utils/rng.h"
+
+namespace Yutrel
+{
+PMJ02Sampler::PMJ02Sampler(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
+    : Sampler(renderer, info)
+{
+    // randomly generated pmj02 sequences are distributed as Owen-scrambled 2D Sobol points (Helmer et al. 2021),
+    // so every set is the first two Sobol dimensions under its own scramble
+    auto matrices = sobol_generator_matrices(2u);
+    std::mt19937 random{info.seed};
+    m_points.resize(static_cast<size_t>(set_count) * point_count);
+    for (auto s = 0u; s < set_count; s++)
+    {
+        auto seed_x = static_cast<uint>(random());
+        auto seed_y = static_cast<uint>(random());
+        for (auto i = 0u; i < point_count; i++)
+        {
+            m_points[s * point_count + i] = make_uint2(owen_scramble(sobol_sample(matrices, i, 0u), seed_x),
+                                                       owen_scramble(sobol_sample(matrices, i, 1u), seed_y));
+        }
+    }
+    auto [points, points_id] = renderer.bindless_arena_buffer<uint2>(m_points.size());
+    command_buffer << points.copy_from(m_points.data());
+    m_points_id = points_id;
+}
+
+Sampler::State PMJ02Sampler::initial_state(Expr<uint2> pixel, Expr<uint> index) const noexcept
+{
+    return {.key = xxhash32(make_uint3(pixel, seed())), .index = index, .dimension = 0u, .salt = 0u};
+}
+
+Float PMJ02Sampler::sample_1d(const State& state, Expr<uint> dimension) const noexcept
+{
+    // either coordinate of a (0,2) sequence is stratified on its own
+    return sample_2d(state, dimension).x;
+}
+
+Float2 PMJ02Sampler::sample_2d(const State& state, Expr<uint> dimension) const noexcept
+{
+    // samples past the end of a set continue in another one
+    auto hash  = xxhash32(make_uint3(state.key, dimension, state.index / point_count));
+    auto set   = hash % set_count;
+    auto shift = make_uint2(xxhash32(make_uint2(hash, 0u)), xxhash32(make_uint2(hash, 1u)));
+    auto p     = renderer().buffer<uint2>(m_points_id).read(set * point_count + state.index % point_count) ^ shift;
+    return make_float2(uniform_uint_to_float(p.x), uniform_uint_to_float(p.y));
+}
+} // namespace Yutrel
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "base/sampler.h"
+
+namespace Yutrel
+{
+// progressive multi-jittered (0,2) sequences (Christensen et al. 2018) from precomputed tables, each pixel
+// and dimension pair picks one of the sets and xors a random digital shift onto it, which keeps the
+// stratification of every prefix of a power of two samples
+class PMJ02Sampler final : public Sampler
+{
+public:
+    static constexpr auto set_count   = 32u;
+    static constexpr auto point_count = 4096u;
+
+private:
+    // 32-bit fixed point coordinates, set after set
+    luisa::vector<uint2> m_points;
+    uint m_points_id{0u};
+
+public:
+    explicit PMJ02Sampler(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept;
+
+protected:
+    [[nodiscard]] State initial_state(Expr<uint2> pixel, Expr<uint> index) const noexcept override;
+    [[nodiscard]] Float sample_1d(const State& state, Expr<uint> dimension) const noexcept override;
+    [[nodiscard]] Float2 sample_2d(const State& state, Expr<uint> dimension) const noexcept override;
+};
+} // namespace Yutrel
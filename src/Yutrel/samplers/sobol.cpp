@@ -0,0 +1,45 @@
+#include "sobol.h"
+
+#include "base/renderer.h"
+#include "utils/low_discrepancy.h"
+#include "utils/rng.h"
+
+namespace Yutrel
+{
+SobolSampler::SobolSampler(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
+    : Sampler(renderer, info),
+      m_matrices(sobol_generator_matrices(2u))
+{
+    auto [matrices, matrices_id] = renderer.bindless_arena_buffer<uint>(m_matrices.size());
+    command_buffer << matrices.copy_from(m_matrices.data());
+    m_matrices_id = matrices_id;
+}
+
+Sampler::State SobolSampler::initial_state(Expr<uint2> pixel, Expr<uint> index) const noexcept
+{
+    return {.key = xxhash32(make_uint3(pixel, seed())), .index = index, .dimension = 0u, .salt = 0u};
+}
+
+std::pair<UInt, UInt> SobolSampler::padded_index(const State& state, Expr<uint> dimension) const noexcept
+{
+    // the nested scramble of the index permutes it within every aligned power of two block, so the first
+    // 2^k samples of each dimension still form a (0,k,2)-net while the dimensions decorrelate
+    auto hash  = xxhash32(make_uint2(state.key, dimension));
+    auto index = owen_scramble(state.index, hash);
+    return {index, xxhash32(hash)};
+}
+
+Float SobolSampler::sample_1d(const State& state, Expr<uint> dimension) const noexcept
+{
+    auto [index, hash] = padded_index(state, dimension);
+    return uniform_uint_to_float(owen_scramble(sobol_sample(renderer(), m_matrices_id, index, 0u), hash));
+}
+
+Float2 SobolSampler::sample_2d(const State& state, Expr<uint> dimension) const noexcept
+{
+    auto [index, hash] = padded_index(state, dimension);
+    auto x             = owen_scramble(sobol_sample(renderer(), m_matrices_id, index, 0u), hash);
+    auto y             = owen_scramble(sobol_sample(renderer(), m_matrices_id, index, 1u), xxhash32(hash));
+    return make_float2(uniform_uint_to_float(x), uniform_uint_to_float(y));
+}
+} // namespace Yutrel
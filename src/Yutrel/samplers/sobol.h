@@ -0,0 +1,28 @@
+#pragma once
+
+#include "base/sampler.h"
+
+namespace Yutrel
+{
+// padded Sobol: every 1D and 2D sample takes the first two Sobol dimensions, which form a (0,2)-sequence,
+// with the sample index shuffled and the values Owen-scrambled by a hash of the pixel and the dimension
+// (Burley 2020). Higher Sobol dimensions would need optimised direction numbers for good 2D projections
+class SobolSampler final : public Sampler
+{
+private:
+    luisa::vector<uint> m_matrices;
+    uint m_matrices_id{0u};
+
+public:
+    explicit SobolSampler(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept;
+
+protected:
+    [[nodiscard]] State initial_state(Expr<uint2> pixel, Expr<uint> index) const noexcept override;
+    [[nodiscard]] Float sample_1d(const State& state, Expr<uint> dimension) const noexcept override;
+    [[nodiscard]] Float2 sample_2d(const State& state, Expr<uint> dimension) const noexcept override;
+
+private:
+    // the shuffled sample index and the scrambling seed of the dimension
+    [[nodiscard]] std::pair<UInt, UInt> padded_index(const State& state, Expr<uint> dimension) const noexcept;
+};
+} // namespace Yutrel
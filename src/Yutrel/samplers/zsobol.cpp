@@ -0,0 +1,110 @@
+#include "zsobol.h"
+
+#include <algorithm>
+#include <bit>
+
+#include <luisa/dsl/sugar.h>
+
+#include "base/camera.h"
+#include "base/film.h"
+#include "base/renderer.h"
+#include "utils/low_discrepancy.h"
+#include "utils/rng.h"
+
+namespace Yutrel
+{
+ZSobolSampler::ZSobolSampler(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept
+    : Sampler(renderer, info),
+      m_matrices(sobol_generator_matrices(2u))
+{
+    auto [matrices, matrices_id] = renderer.bindless_arena_buffer<uint>(m_matrices.size());
+    command_buffer << matrices.copy_from(m_matrices.data());
+    m_matrices_id = matrices_id;
+
+    std::array<uint, 4u> digits{0u, 1u, 2u, 3u};
+    for (auto& p : m_permutations)
+    {
+        p = digits[0] | (digits[1] << 2u) | (digits[2] << 4u) | (digits[3] << 6u);
+        std::next_permutation(digits.begin(), digits.end());
+    }
+
+    // the Morton index of the pixel followed by the sample index has to fit into 32 bits, at high
+    // resolutions and spp the Morton bits that do not fit seed the scramble of their block of pixels, so
+    // blocks stay decorrelated from each other instead of sharing samples
+    auto camera     = renderer.camera();
+    auto resolution = camera->film()->base()->resolution();
+    auto log2_res   = static_cast<uint>(std::bit_width(next_pow2(std::max(resolution.x, resolution.y)) - 1u));
+    m_log2_spp      = std::min(static_cast<uint>(std::bit_width(next_pow2(camera->base()->spp()) - 1u)), 31u);
+    m_digits        = log2_res + (m_log2_spp + 1u) / 2u;
+    auto index_bits = 2u * m_digits - (m_log2_spp & 1u);
+    m_pixel_bits    = 2u * log2_res;
+    if (index_bits > 32u)
+    {
+        m_digits     = (32u + (m_log2_spp & 1u)) / 2u;
+        m_pixel_bits = 32u - m_log2_spp;
+        LUISA_INFO("ZSobol index of {} bits, blocks of {} pixels are scrambled separately.", index_bits, 1ull << m_pixel_bits);
+    }
+}
+
+luisa::string ZSobolSampler::constants() const noexcept
+{
+    return luisa::format("{},{},{},{}", Sampler::constants(), m_log2_spp, m_digits, m_pixel_bits);
+}
+
+Sampler::State ZSobolSampler::initial_state(Expr<uint2> pixel, Expr<uint> index) const noexcept
+{
+    // samples past the power of two above the spp continue with another scramble of the sequence
+    auto spp_mask = (1u << m_log2_spp) - 1u;
+    auto morton   = morton2(pixel);
+    auto block    = def(0u);
+    if (m_pixel_bits < 32u)
+    {
+        block = morton >> m_pixel_bits;
+    }
+    return {
+        .key       = (morton << m_log2_spp) | (index & spp_mask),
+        .index     = index,
+        .dimension = 0u,
+        .salt      = xxhash32(make_uint3(index >> m_log2_spp, block, seed())),
+    };
+}
+
+UInt ZSobolSampler::sample_index(const State& state, Expr<uint> dimension) const noexcept
+{
+    Constant permutations = luisa::span{m_permutations};
+
+    auto odd          = m_log2_spp & 1u;
+    auto sample_index = def(0u);
+    $for(i, odd, m_digits)
+    {
+        // each base-4 digit is permuted by the digits above it
+        auto shift  = 2u * i - odd;
+        auto digit  = (state.key >> shift) & 3u;
+        auto higher = ite(shift + 2u < 32u, state.key >> min(shift + 2u, 31u), 0u);
+        auto p      = (xxhash32(make_uint2(higher ^ (0x55555555u * dimension), state.salt)) >> 24u) % 24u;
+        sample_index |= ((permutations[p] >> (2u * digit)) & 3u) << shift;
+    };
+    if (odd != 0u)
+    {
+        auto digit = state.key & 1u;
+        sample_index |= digit ^ (xxhash32(make_uint2((state.key >> 1u) ^ (0x55555555u * dimension), state.salt)) & 1u);
+    }
+    return sample_index;
+}
+
+Float ZSobolSampler::sample_1d(const State& state, Expr<uint> dimension) const noexcept
+{
+    auto index = sample_index(state, dimension);
+    auto hash  = xxhash32(make_uint3(dimension, seed(), state.salt));
+    return uniform_uint_to_float(owen_scramble(sobol_sample(renderer(), m_matrices_id, index, 0u), hash));
+}
+
+Float2 ZSobolSampler::sample_2d(const State& state, Expr<uint> dimension) const noexcept
+{
+    auto index = sample_index(state, dimension);
+    auto hash  = xxhash32(make_uint3(dimension, seed(), state.salt));
+    auto x     = owen_scramble(sobol_sample(renderer(), m_matrices_id, index, 0u), hash);
+    auto y     = owen_scramble(sobol_sample(renderer(), m_matrices_id, index, 1u), xxhash32(hash));
+    return make_float2(uniform_uint_to_float(x), uniform_uint_to_float(y));
+}
+} // namespace Yutrel
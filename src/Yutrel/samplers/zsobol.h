@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+
+#include "base/sampler.h"
+
+namespace Yutrel
+{
+// ZSobol (Ahmed and Wonka 2020) after pbrt-v4: the samples of all pixels are one Sobol sequence indexed
+// along the Morton curve over the image, the base-4 digits of the index are permuted per dimension so that
+// neighbouring pixels receive well distributed, decorrelated samples
+class ZSobolSampler final : public Sampler
+{
+private:
+    luisa::vector<uint> m_matrices;
+    uint m_matrices_id{0u};
+    uint m_log2_spp{0u};
+    uint m_digits{0u};
+    // low bits of the Morton index that fit into the index next to the sample bits, the bits above them
+    // scramble their block of pixels instead
+    uint m_pixel_bits{0u};
+    // the 24 permutations of the four base-4 digits, two bits per entry
+    std::array<uint, 24u> m_permutations{};
+
+public:
+    explicit ZSobolSampler(Renderer& renderer, CommandBuffer& command_buffer, const CreateInfo& info) noexcept;
+
+    [[nodiscard]] luisa::string constants() const noexcept override;
+
+protected:
+    [[nodiscard]] State initial_state(Expr<uint2> pixel, Expr<uint> index) const noexcept override;
+    [[nodiscard]] Float sample_1d(const State& state, Expr<uint> dimension) const noexcept override;
+    [[nodiscard]] Float2 sample_2d(const State& state, Expr<uint> dimension) const noexcept override;
+
+private:
+    [[nodiscard]] UInt sample_index(const State& state, Expr<uint> dimension) const noexcept;
+};
+} // namespace Yutrel
@@ -1,6 +1,9 @@
 #include "mesh.h"
 
+#include <mutex>
+
 #include <luisa/core/clock.h>
+#include <luisa/core/thread_pool.h>
 
 #include <assimp/Importer.hpp>
 #include <assimp/Subdivision.h>
@@ -14,22 +17,38 @@ Mesh::Mesh(Scene& scene, const CreateInfo& info) noexcept
     : Shape(scene, info),
       m_loader(MeshLoader::load(info.path)) {}
 
-luisa::shared_ptr<MeshLoader> MeshLoader::load(std::filesystem::path path,
-                                               uint subdiv_level,
-                                               bool flip_uv,
-                                               bool drop_normal,
-                                               bool drop_uv) noexcept
+std::shared_future<luisa::shared_ptr<MeshLoader>> MeshLoader::load(std::filesystem::path path,
+                                                                   uint subdiv_level,
+                                                                   bool flip_uv,
+                                                                   bool drop_normal,
+                                                                   bool drop_uv) noexcept
 {
-    static luisa::lru_cache<uint64_t, luisa::shared_ptr<MeshLoader>> loaded_meshes{256u};
+    static luisa::lru_cache<uint64_t, std::shared_future<luisa::shared_ptr<MeshLoader>>> loaded_meshes{256u};
+    static std::mutex mutex;
 
     auto abs_path = std::filesystem::canonical(path).string();
     auto key      = luisa::hash_value(abs_path, luisa::hash_value(subdiv_level));
 
+    std::scoped_lock lock{mutex};
     if (auto m = loaded_meshes.at(key))
     {
         return *m;
     }
 
+    auto future = global_thread_pool().async([path = std::move(path), subdiv_level, flip_uv, drop_normal, drop_uv]
+    {
+        return import(path, subdiv_level, flip_uv, drop_normal, drop_uv);
+    });
+    loaded_meshes.emplace(key, future);
+    return future;
+}
+
+luisa::shared_ptr<MeshLoader> MeshLoader::import(const std::filesystem::path& path,
+                                                 uint subdiv_level,
+                                                 bool flip_uv,
+                                                 bool drop_normal,
+                                                 bool drop_uv) noexcept
+{
     Clock clock;
     auto path_string = path.string();
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <future>
+
 #include "base/shape.h"
 
 namespace Yutrel
@@ -18,17 +20,25 @@ public:
     [[nodiscard]] auto mesh() const noexcept { return MeshView{m_vertices, m_triangles}; }
     [[nodiscard]] auto properties() const noexcept { return m_properties; }
 
-    [[nodiscard]] static luisa::shared_ptr<MeshLoader> load(std::filesystem::path path,
-                                                            uint subdiv_level = 0u,
-                                                            bool flip_uv      = false,
-                                                            bool drop_normal  = false,
-                                                            bool drop_uv      = false) noexcept;
+    // imports on the global thread pool, the future is shared by every shape using the same file
+    [[nodiscard]] static std::shared_future<luisa::shared_ptr<MeshLoader>> load(std::filesystem::path path,
+                                                                                uint subdiv_level = 0u,
+                                                                                bool flip_uv      = false,
+                                                                                bool drop_normal  = false,
+                                                                                bool drop_uv      = false) noexcept;
+
+private:
+    [[nodiscard]] static luisa::shared_ptr<MeshLoader> import(const std::filesystem::path& path,
+                                                              uint subdiv_level,
+                                                              bool flip_uv,
+                                                              bool drop_normal,
+                                                              bool drop_uv) noexcept;
 };
 
 class Mesh : public Shape
 {
 private:
-    luisa::shared_ptr<MeshLoader> m_loader;
+    std::shared_future<luisa::shared_ptr<MeshLoader>> m_loader;
 
 public:
     explicit Mesh(Scene& scene, const CreateInfo& info) noexcept;
@@ -36,7 +46,8 @@ public:
 
 public:
     [[nodiscard]] bool is_mesh() const noexcept override { return true; }
-    [[nodiscard]] MeshView mesh() const noexcept override { return m_loader->mesh(); }
-    [[nodiscard]] virtual uint vertex_properties() const noexcept override { return m_loader->properties(); }
+    // both block until the import has finished
+    [[nodiscard]] MeshView mesh() const noexcept override { return m_loader.get()->mesh(); }
+    [[nodiscard]] virtual uint vertex_properties() const noexcept override { return m_loader.get()->properties(); }
 };
 } // namespace Yutrel
\ No newline at end of file
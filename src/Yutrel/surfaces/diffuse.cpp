@@ -34,6 +34,11 @@ void Diffuse::Instance::populate_closure(Surface::Closure* closure, const Intera
     closure->bind(std::move(ctx));
 }
 
+SampledSpectrum Diffuse::Instance::albedo(const Interaction& it, const SampledWavelengths& swl, Expr<float> time) const noexcept
+{
+    return m_reflectance->evaluate_albedo_spectrum(it, swl, time).value;
+}
+
 Surface::Sample Diffuse::Closure::sample_impl(Expr<float3> wo, Expr<float> u_lobe, Expr<float2> u) const noexcept
 {
     auto&& ctx = context<Context>();
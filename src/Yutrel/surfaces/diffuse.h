@@ -36,6 +36,7 @@ public:
     [[nodiscard]] luisa::string closure_identifier() const noexcept override { return "Diffuse"; }
     [[nodiscard]] luisa::unique_ptr<Surface::Closure> create_closure(SampledWavelengths& swl, Expr<float> time) const noexcept override;
     void populate_closure(Surface::Closure* closure, const Interaction& it) const noexcept override;
+    [[nodiscard]] SampledSpectrum albedo(const Interaction& it, const SampledWavelengths& swl, Expr<float> time) const noexcept override;
 };
 
 class Diffuse::Closure : public Surface::Closure
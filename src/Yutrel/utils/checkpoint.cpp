@@ -0,0 +1,114 @@
+#include "checkpoint.h"
+
+#include <fstream>
+
+#include <luisa/core/logging.h>
+
+namespace Yutrel
+{
+namespace
+{
+constexpr auto checkpoint_magic   = 0x50435459u; // "YTCP"
+constexpr auto checkpoint_version = 1u;
+
+struct CheckpointHeader
+{
+    uint magic;
+    uint version;
+    uint64_t fingerprint;
+    uint resolution_x;
+    uint resolution_y;
+    uint global_sample_index;
+    uint shutter_bucket_count;
+    uint64_t image_size;
+    uint64_t moments_size;
+};
+
+template <typename T>
+void write_array(std::ofstream& file, const luisa::vector<T>& array) noexcept
+{
+    file.write(reinterpret_cast<const char*>(array.data()), static_cast<std::streamsize>(array.size() * sizeof(T)));
+}
+
+template <typename T>
+bool read_array(std::ifstream& file, luisa::vector<T>& array, size_t size) noexcept
+{
+    array.resize(size);
+    file.read(reinterpret_cast<char*>(array.data()), static_cast<std::streamsize>(size * sizeof(T)));
+    return file.good();
+}
+} // namespace
+
+bool save_checkpoint(const std::filesystem::path& path, const Checkpoint& checkpoint) noexcept
+{
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+        if (!file)
+        {
+            LUISA_WARNING_WITH_LOCATION("Failed to open checkpoint '{}' for writing.", temp_path.string());
+            return false;
+        }
+        CheckpointHeader header{
+            .magic                = checkpoint_magic,
+            .version              = checkpoint_version,
+            .fingerprint          = checkpoint.fingerprint,
+            .resolution_x         = checkpoint.resolution.x,
+            .resolution_y         = checkpoint.resolution.y,
+            .global_sample_index  = checkpoint.global_sample_index,
+            .shutter_bucket_count = static_cast<uint>(checkpoint.shutter_buckets.size()),
+            .image_size           = checkpoint.image.size(),
+            .moments_size         = checkpoint.moments.size(),
+        };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_array(file, checkpoint.shutter_buckets);
+        write_array(file, checkpoint.image);
+        write_array(file, checkpoint.moments);
+        if (!file)
+        {
+            LUISA_WARNING_WITH_LOCATION("Failed to write checkpoint '{}'.", temp_path.string());
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error)
+    {
+        LUISA_WARNING_WITH_LOCATION("Failed to move checkpoint to '{}': {}.", path.string(), error.message());
+        return false;
+    }
+    return true;
+}
+
+luisa::optional<Checkpoint> load_checkpoint(const std::filesystem::path& path) noexcept
+{
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+    {
+        LUISA_WARNING_WITH_LOCATION("Checkpoint '{}' does not exist.", path.string());
+        return luisa::nullopt;
+    }
+    CheckpointHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != checkpoint_magic || header.version != checkpoint_version)
+    {
+        LUISA_WARNING_WITH_LOCATION("Invalid checkpoint '{}'.", path.string());
+        return luisa::nullopt;
+    }
+    Checkpoint checkpoint{
+        .fingerprint         = header.fingerprint,
+        .resolution          = make_uint2(header.resolution_x, header.resolution_y),
+        .global_sample_index = header.global_sample_index,
+    };
+    if (!read_array(file, checkpoint.shutter_buckets, header.shutter_bucket_count) ||
+        !read_array(file, checkpoint.image, header.image_size) ||
+        !read_array(file, checkpoint.moments, header.moments_size))
+    {
+        LUISA_WARNING_WITH_LOCATION("Truncated checkpoint '{}'.", path.string());
+        return luisa::nullopt;
+    }
+    return checkpoint;
+}
+
+} // namespace Yutrel
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+
+#include <luisa/core/basic_types.h>
+#include <luisa/core/stl.h>
+
+namespace Yutrel
+{
+using namespace luisa;
+
+// everything needed to continue a render after the process is killed
+struct Checkpoint
+{
+    struct ShutterBucket
+    {
+        float time;
+        float weight;
+        uint spp;
+        uint remaining_spp;
+    };
+
+    uint64_t fingerprint{0u};
+    uint2 resolution{};
+    uint global_sample_index{0u};
+    luisa::vector<ShutterBucket> shutter_buckets;
+    // film accumulation, w holds the sample count
+    luisa::vector<float4> image;
+    // optional per-pixel luminance moments
+    luisa::vector<float2> moments;
+};
+
+// writes to a temporary file first so an interrupted save never corrupts the previous checkpoint
+bool save_checkpoint(const std::filesystem::path& path, const Checkpoint& checkpoint) noexcept;
+[[nodiscard]] luisa::optional<Checkpoint> load_checkpoint(const std::filesystem::path& path) noexcept;
+
+} // namespace Yutrel
@@ -0,0 +1,133 @@
+#include "exr_writer.h"
+
+#include <array>
+#include <cstring>
+
+#include <luisa/core/logging.h>
+
+namespace Yutrel
+{
+namespace
+{
+constexpr auto exr_magic        = 20000630;
+constexpr auto exr_version      = 2;
+constexpr auto exr_pixel_float  = 2;
+constexpr auto exr_channel_size = sizeof(float);
+// channels are stored in alphabetical order
+constexpr std::array exr_channels{"B", "G", "R"};
+
+template <typename T>
+void write_value(std::ofstream& file, const T& value) noexcept
+{
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void write_string(std::ofstream& file, const char* s) noexcept
+{
+    file.write(s, static_cast<std::streamsize>(std::strlen(s) + 1u));
+}
+
+void write_attribute_header(std::ofstream& file, const char* name, const char* type, int size) noexcept
+{
+    write_string(file, name);
+    write_string(file, type);
+    write_value(file, size);
+}
+} // namespace
+
+ExrScanlineWriter::ExrScanlineWriter(std::filesystem::path path, uint2 resolution) noexcept
+    : m_path(std::move(path)),
+      m_file(m_path, std::ios::binary | std::ios::trunc),
+      m_resolution(resolution),
+      m_scanline(resolution.x * exr_channels.size())
+{
+    if (!m_file)
+    {
+        LUISA_WARNING_WITH_LOCATION("Failed to open '{}' for writing.", m_path.string());
+        return;
+    }
+
+    auto width  = static_cast<int>(resolution.x);
+    auto height = static_cast<int>(resolution.y);
+
+    write_value(m_file, exr_magic);
+    write_value(m_file, exr_version);
+
+    // channel list: name, pixel type, pLinear + reserved, x/y sampling
+    auto channel_list_size = 1;
+    for (auto c : exr_channels)
+    {
+        channel_list_size += static_cast<int>(std::strlen(c) + 1u + 16u);
+    }
+    write_attribute_header(m_file, "channels", "chlist", channel_list_size);
+    for (auto c : exr_channels)
+    {
+        write_string(m_file, c);
+        write_value(m_file, exr_pixel_float);
+        write_value(m_file, 0u);
+        write_value(m_file, 1);
+        write_value(m_file, 1);
+    }
+    write_value(m_file, '\0');
+
+    write_attribute_header(m_file, "compression", "compression", 1);
+    write_value(m_file, static_cast<uint8_t>(0u));
+    for (auto window : {"dataWindow", "displayWindow"})
+    {
+        write_attribute_header(m_file, window, "box2i", 16);
+        write_value(m_file, std::array{0, 0, width - 1, height - 1});
+    }
+    write_attribute_header(m_file, "lineOrder", "lineOrder", 1);
+    write_value(m_file, static_cast<uint8_t>(0u));
+    write_attribute_header(m_file, "pixelAspectRatio", "float", 4);
+    write_value(m_file, 1.0f);
+    write_attribute_header(m_file, "screenWindowCenter", "v2f", 8);
+    write_value(m_file, std::array{0.0f, 0.0f});
+    write_attribute_header(m_file, "screenWindowWidth", "float", 4);
+    write_value(m_file, 1.0f);
+    write_value(m_file, '\0');
+
+    // uncompressed blocks have a fixed size, so the offset table is known before any pixel
+    auto block_size = sizeof(int) * 2u + m_scanline.size() * exr_channel_size;
+    auto offset     = static_cast<uint64_t>(m_file.tellp()) + sizeof(uint64_t) * resolution.y;
+    for (auto y = 0u; y < resolution.y; y++)
+    {
+        write_value(m_file, offset + y * block_size);
+    }
+}
+
+ExrScanlineWriter::~ExrScanlineWriter() noexcept
+{
+    if (m_file.is_open() && !complete())
+    {
+        LUISA_WARNING_WITH_LOCATION("'{}' closed after {} of {} rows.", m_path.string(), m_next_row, m_resolution.y);
+    }
+}
+
+void ExrScanlineWriter::write_rows(uint first_row, uint row_count, const float4* pixels) noexcept
+{
+    LUISA_ASSERT(first_row == m_next_row, "Rows must be written in order.");
+    LUISA_ASSERT(first_row + row_count <= m_resolution.y, "Rows out of range.");
+
+    auto width = m_resolution.x;
+    for (auto r = 0u; r < row_count; r++)
+    {
+        auto row = pixels + static_cast<size_t>(r) * width;
+        for (auto x = 0u; x < width; x++)
+        {
+            m_scanline[x]              = row[x].z;
+            m_scanline[width + x]      = row[x].y;
+            m_scanline[2u * width + x] = row[x].x;
+        }
+        write_value(m_file, static_cast<int>(first_row + r));
+        write_value(m_file, static_cast<int>(m_scanline.size() * exr_channel_size));
+        m_file.write(reinterpret_cast<const char*>(m_scanline.data()), static_cast<std::streamsize>(m_scanline.size() * exr_channel_size));
+    }
+    m_next_row += row_count;
+    if (!m_file) [[unlikely]]
+    {
+        LUISA_WARNING_WITH_LOCATION("Failed to write rows to '{}'.", m_path.string());
+    }
+}
+
+} // namespace Yutrel
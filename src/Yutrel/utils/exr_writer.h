@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+
+#include <luisa/core/basic_types.h>
+#include <luisa/core/stl.h>
+
+namespace Yutrel
+{
+using namespace luisa;
+
+// writes an uncompressed scanline RGB float EXR row by row, so the whole image never has to be in memory
+class ExrScanlineWriter
+{
+private:
+    std::filesystem::path m_path;
+    std::ofstream m_file;
+    uint2 m_resolution;
+    uint m_next_row{0u};
+    luisa::vector<float> m_scanline;
+
+public:
+    ExrScanlineWriter(std::filesystem::path path, uint2 resolution) noexcept;
+    ~ExrScanlineWriter() noexcept;
+
+    ExrScanlineWriter(const ExrScanlineWriter&)            = delete;
+    ExrScanlineWriter& operator=(const ExrScanlineWriter&) = delete;
+
+public:
+    // rows must be written top to bottom, pixels holds row_count full-width rows of rgba
+    void write_rows(uint first_row, uint row_count, const float4* pixels) noexcept;
+    [[nodiscard]] auto complete() const noexcept { return m_next_row == m_resolution.y; }
+    [[nodiscard]] explicit operator bool() const noexcept { return m_file.good(); }
+};
+
+} // namespace Yutrel
@@ -1,5 +1,6 @@
 #include "image_io.h"
 
+#include <algorithm>
 #include <array>
 
 #include <stb/stb_image.h>
@@ -1069,6 +1070,96 @@ void save_image(std::filesystem::path path, const float* pixels, uint2 resolutio
     }
 }
 
+void save_image(std::filesystem::path path, luisa::span<const ImageLayer> layers, uint2 resolution) noexcept
+{
+    auto ext = path.extension().string();
+    for (auto& c : ext)
+    {
+        c = static_cast<char>(std::tolower(c));
+    }
+    if (ext != ".exr") [[unlikely]]
+    {
+        LUISA_WARNING_WITH_LOCATION(
+            "Layered images are only written as EXR, '{}' is saved with the '.exr' extension.",
+            path.string());
+        path.replace_extension(".exr");
+    }
+
+    struct Channel
+    {
+        luisa::string name;
+        const ImageLayer* layer;
+        uint index;
+    };
+    luisa::vector<Channel> channels;
+    for (auto& layer : layers)
+    {
+        for (auto c = 0u; c < layer.channels.size(); c++)
+        {
+            auto name = layer.name.empty() ? layer.channels[c] : luisa::format("{}.{}", layer.name, layer.channels[c]);
+            LUISA_ASSERT(name.size() < 256u, "EXR channel name '{}' is too long.", name);
+            channels.emplace_back(Channel{.name = std::move(name), .layer = &layer, .index = c});
+        }
+    }
+    // EXR readers expect the channels sorted by name
+    std::sort(channels.begin(), channels.end(), [](const Channel& a, const Channel& b) noexcept
+    {
+        return a.name < b.name;
+    });
+
+    // split the interleaved layers into one plane per channel, uint planes keep their bits
+    auto pixel_count = static_cast<size_t>(resolution.x) * resolution.y;
+    luisa::vector<luisa::vector<uint>> planes(channels.size());
+    luisa::vector<unsigned char*> plane_pointers(channels.size());
+    for (auto i = 0u; i < channels.size(); i++)
+    {
+        auto& channel = channels[i];
+        auto source   = static_cast<const uint*>(channel.layer->pixels);
+        planes[i].resize(pixel_count);
+        for (size_t p = 0u; p < pixel_count; p++)
+        {
+            planes[i][p] = source[p * channel.layer->stride + channel.index];
+        }
+        plane_pointers[i] = reinterpret_cast<unsigned char*>(planes[i].data());
+    }
+
+    EXRHeader header;
+    InitEXRHeader(&header);
+    header.compression_type      = TINYEXR_COMPRESSIONTYPE_ZIP;
+    header.num_channels          = static_cast<int>(channels.size());
+    header.channels              = luisa::allocate_with_allocator<EXRChannelInfo>(header.num_channels);
+    header.pixel_types           = luisa::allocate_with_allocator<int>(header.num_channels);
+    header.requested_pixel_types = luisa::allocate_with_allocator<int>(header.num_channels);
+    for (auto i = 0u; i < channels.size(); i++)
+    {
+        auto layer = channels[i].layer;
+        strcpy(header.channels[i].name, channels[i].name.c_str());
+        header.pixel_types[i]           = layer->is_uint ? TINYEXR_PIXELTYPE_UINT : TINYEXR_PIXELTYPE_FLOAT;
+        header.requested_pixel_types[i] = layer->is_uint ? TINYEXR_PIXELTYPE_UINT : (layer->fp16 ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT);
+    }
+
+    EXRImage image;
+    InitEXRImage(&image);
+    image.num_channels = header.num_channels;
+    image.images       = plane_pointers.data();
+    image.width        = static_cast<int>(resolution.x);
+    image.height       = static_cast<int>(resolution.y);
+
+    const char* err = nullptr;
+    if (auto ret = SaveEXRImageToFile(&image, &header, path.string().c_str(), &err);
+        ret != TINYEXR_SUCCESS) [[unlikely]]
+    {
+        LUISA_WARNING_WITH_LOCATION(
+            "Failed to save layered image to '{}': {}.",
+            path.string(),
+            err ? err : "unknown error");
+        FreeEXRErrorMessage(err);
+    }
+    luisa::deallocate_with_allocator(header.channels);
+    luisa::deallocate_with_allocator(header.pixel_types);
+    luisa::deallocate_with_allocator(header.requested_pixel_types);
+}
+
 void save_image(std::filesystem::path path, const uint8_t* pixels, uint2 resolution, uint components) noexcept
 {
     LUISA_INFO("Saving image ({}x{}x{}) to '{}'.",
@@ -52,6 +52,23 @@ public:
 void save_image(std::filesystem::path path, const float* pixels,
                 uint2 resolution, uint components = 4) noexcept;
 
+// one layer of a multi-layer EXR, channel c of pixel i is pixels[i * stride + c]
+struct ImageLayer
+{
+    // channels are written as "<name>.<channel>", an empty name leaves them unprefixed
+    luisa::string name;
+    luisa::vector<luisa::string> channels;
+    const void* pixels{nullptr};
+    uint stride{4u};
+    // the pixels are uint instead of float, written as UINT channels
+    bool is_uint{false};
+    // float channels are stored as half in the file
+    bool fp16{false};
+};
+
+// writes all layers into one EXR file
+void save_image(std::filesystem::path path, luisa::span<const ImageLayer> layers, uint2 resolution) noexcept;
+
 void save_image(std::filesystem::path path, const uint8_t* pixels,
                 uint2 resolution, uint components = 4) noexcept;
 
@@ -0,0 +1,216 @@
+#include "low_discrepancy.h"
+
+#include <array>
+
+#include <luisa/luisa-compute.h>
+
+#include "base/renderer.h"
+
+namespace Yutrel
+{
+namespace
+{
+// x * y modulo the polynomial p of the given degree, all over GF(2)
+uint polynomial_mul_mod(uint x, uint y, uint p, uint degree) noexcept
+{
+    auto r = 0u;
+    for (; y != 0u; y >>= 1u)
+    {
+        if (y & 1u)
+        {
+            r ^= x;
+        }
+        x <<= 1u;
+        if (x & (1u << degree))
+        {
+            x ^= p;
+        }
+    }
+    return r;
+}
+
+uint polynomial_pow_mod(uint x, uint e, uint p, uint degree) noexcept
+{
+    auto r = 1u;
+    for (; e != 0u; e >>= 1u)
+    {
+        if (e & 1u)
+        {
+            r = polynomial_mul_mod(r, x, p, degree);
+        }
+        x = polynomial_mul_mod(x, x, p, degree);
+    }
+    return r;
+}
+
+// p is primitive when x has order 2^degree - 1 modulo p
+bool is_primitive(uint p, uint degree) noexcept
+{
+    auto order = (1u << degree) - 1u;
+    if (polynomial_pow_mod(2u, order, p, degree) != 1u)
+    {
+        return false;
+    }
+    auto n = order;
+    for (auto q = 2u; q * q <= n; q++)
+    {
+        if (n % q == 0u)
+        {
+            if (polynomial_pow_mod(2u, order / q, p, degree) == 1u)
+            {
+                return false;
+            }
+            while (n % q == 0u)
+            {
+                n /= q;
+            }
+        }
+    }
+    return n == 1u || polynomial_pow_mod(2u, order / n, p, degree) != 1u;
+}
+
+uint reverse_bits(uint v) noexcept
+{
+    v = ((v >> 1u) & 0x55555555u) | ((v & 0x55555555u) << 1u);
+    v = ((v >> 2u) & 0x33333333u) | ((v & 0x33333333u) << 2u);
+    v = ((v >> 4u) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4u);
+    v = ((v >> 8u) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8u);
+    return (v >> 16u) | (v << 16u);
+}
+} // namespace
+
+luisa::vector<uint> sobol_generator_matrices(uint dimensions) noexcept
+{
+    // primitive polynomials in increasing order, bit i holds the coefficient of x^i
+    luisa::vector<std::pair<uint, uint>> polynomials;
+    for (auto degree = 1u; polynomials.size() + 1u < dimensions; degree++)
+    {
+        LUISA_ASSERT(degree < 31u, "Too many Sobol dimensions ({}).", dimensions);
+        for (auto p = (1u << degree) | 1u; p < (2u << degree) && polynomials.size() + 1u < dimensions; p += 2u)
+        {
+            if (is_primitive(p, degree))
+            {
+                polynomials.emplace_back(p, degree);
+            }
+        }
+    }
+
+    // any odd initial direction numbers m_k < 2^k give a valid Sobol sequence, they are drawn from a fixed
+    // xorshift stream, the samplers only use dimensions 0 and 1 where the choice does not matter
+    auto state  = 0x9e3779b9u;
+    auto random = [&state]() noexcept
+    {
+        state ^= state << 13u;
+        state ^= state >> 17u;
+        state ^= state << 5u;
+        return state;
+    };
+
+    luisa::vector<uint> matrices(static_cast<size_t>(dimensions) * 32u);
+    for (auto k = 0u; k < 32u; k++)
+    {
+        matrices[k] = 1u << (31u - k);
+    }
+    for (auto d = 1u; d < dimensions; d++)
+    {
+        auto [p, s] = polynomials[d - 1u];
+        std::array<uint64_t, 32u> m{};
+        for (auto k = 0u; k < std::min(s, 32u); k++)
+        {
+            m[k] = ((random() & ((1u << k) - 1u)) << 1u) | 1u;
+        }
+        // m_k = 2 a_1 m_{k-1} ^ 4 a_2 m_{k-2} ^ ... ^ 2^s m_{k-s} ^ m_{k-s}
+        for (auto k = s; k < 32u; k++)
+        {
+            auto v = m[k - s] ^ (m[k - s] << s);
+            for (auto j = 1u; j < s; j++)
+            {
+                if ((p >> (s - j)) & 1u)
+                {
+                    v ^= m[k - j] << j;
+                }
+            }
+            m[k] = v;
+        }
+        for (auto k = 0u; k < 32u; k++)
+        {
+            matrices[d * 32u + k] = static_cast<uint>(m[k] << (31u - k));
+        }
+    }
+    return matrices;
+}
+
+uint sobol_sample(luisa::span<const uint> matrices, uint index, uint dimension) noexcept
+{
+    auto v = 0u;
+    for (auto column = dimension * 32u; index != 0u; index >>= 1u, column++)
+    {
+        if (index & 1u)
+        {
+            v ^= matrices[column];
+        }
+    }
+    return v;
+}
+
+UInt sobol_sample(const Renderer& renderer, uint matrices_id, Expr<uint> index, Expr<uint> dimension) noexcept
+{
+    auto matrices = renderer.buffer<uint>(matrices_id);
+    auto v        = def(0u);
+    auto i        = def(index);
+    auto column   = def(dimension * 32u);
+    $loop
+    {
+        $if(i == 0u) { $break; };
+        $if((i & 1u) != 0u) { v ^= matrices.read(column); };
+        i >>= 1u;
+        column += 1u;
+    };
+    return v;
+}
+
+uint owen_scramble(uint v, uint seed) noexcept
+{
+    v = reverse_bits(v);
+    v ^= v * 0x3d20adeau;
+    v += seed;
+    v *= (seed >> 16u) | 1u;
+    v ^= v * 0x05526c56u;
+    v ^= v * 0x53a22864u;
+    return reverse_bits(v);
+}
+
+UInt owen_scramble(Expr<uint> v, Expr<uint> seed) noexcept
+{
+    static Callable impl = [](UInt v, UInt seed) noexcept
+    {
+        v = reverse(v);
+        v ^= v * 0x3d20adeau;
+        v += seed;
+        v *= (seed >> 16u) | 1u;
+        v ^= v * 0x05526c56u;
+        v ^= v * 0x53a22864u;
+        return reverse(v);
+    };
+    return impl(v, seed);
+}
+
+UInt morton2(Expr<uint2> p) noexcept
+{
+    static Callable impl = [](UInt2 p) noexcept
+    {
+        auto spread = [](UInt x) noexcept
+        {
+            x = x & 0xffffu;
+            x = (x | (x << 8u)) & 0x00ff00ffu;
+            x = (x | (x << 4u)) & 0x0f0f0f0fu;
+            x = (x | (x << 2u)) & 0x33333333u;
+            x = (x | (x << 1u)) & 0x55555555u;
+            return x;
+        };
+        return spread(p.x) | (spread(p.y) << 1u);
+    };
+    return impl(p);
+}
+
+} // namespace Yutrel
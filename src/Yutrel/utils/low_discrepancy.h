@@ -0,0 +1,28 @@
+#pragma once
+
+#include <luisa/core/stl.h>
+#include <luisa/dsl/syntax.h>
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+class Renderer;
+
+// the 32 generator matrix columns of each of the first dimensions of the Sobol sequence, column j is
+// xored into a sample when bit j of its index is set. Dimension 0 is the van der Corput sequence, the
+// others follow primitive polynomials of increasing degree. Dimensions 0 and 1 do not depend on the
+// initial direction numbers, the later ones use arbitrary ones and lack good 2D projections
+[[nodiscard]] luisa::vector<uint> sobol_generator_matrices(uint dimensions) noexcept;
+[[nodiscard]] uint sobol_sample(luisa::span<const uint> matrices, uint index, uint dimension) noexcept;
+[[nodiscard]] UInt sobol_sample(const Renderer& renderer, uint matrices_id, Expr<uint> index, Expr<uint> dimension) noexcept;
+
+// nested uniform scrambling of the bits of v, after the hash of Burley (2020) as in pbrt-v4
+[[nodiscard]] uint owen_scramble(uint v, uint seed) noexcept;
+[[nodiscard]] UInt owen_scramble(Expr<uint> v, Expr<uint> seed) noexcept;
+
+// interleaves the lower 16 bits of x and y, x in the even bits
+[[nodiscard]] UInt morton2(Expr<uint2> p) noexcept;
+
+} // namespace Yutrel
@@ -75,15 +75,16 @@ Float uniform_uint_to_float(Expr<uint> u) noexcept
     return min(one_minus_epsilon, u * 0x1p-32f);
 }
 
-Float lcg(UInt& state) noexcept
+UInt3 pcg3d(Expr<uint3> v) noexcept
 {
-    static Callable impl = [](UInt& state) noexcept
-    {
-        constexpr auto lcg_a = 1664525u;
-        constexpr auto lcg_c = 1013904223u;
-        state                = lcg_a * state + lcg_c;
-        return uniform_uint_to_float(state);
-    };
-    return impl(state);
+    UInt3 p = v * 1664525u + 1013904223u;
+    p.x += p.y * p.z;
+    p.y += p.z * p.x;
+    p.z += p.x * p.y;
+    p ^= p >> 16u;
+    p.x += p.y * p.z;
+    p.y += p.z * p.x;
+    p.z += p.x * p.y;
+    return p;
 }
 } // namespace Yutrel
\ No newline at end of file
@@ -14,6 +14,7 @@ using namespace luisa::compute;
 
 [[nodiscard]] Float uniform_uint_to_float(Expr<uint> u) noexcept;
 
-[[nodiscard]] Float lcg(UInt& state) noexcept;
+// pcg3d of Jarzynski and Olano (2020): three well mixed words from three, expanded inline at every call
+[[nodiscard]] UInt3 pcg3d(Expr<uint3> v) noexcept;
 
 } // namespace Yutrel
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "shader_cache.h"
+
+#include <fstream>
+
+namespace Yutrel
+{
+ShaderCache::ShaderCache(Device& device) noexcept
+    : m_device(device),
+      m_backend_hash(hash(device.backend_name())),
+      m_index_path(std::filesystem::current_path() / ".cache" / "yutrel_shaders.txt")
+{
+    // the index only tracks which entries were produced before, the backend still validates the binaries
+    std::ifstream file{m_index_path};
+    for (std::string line; std::getline(file, line);)
+    {
+        if (!line.empty())
+        {
+            m_entries.emplace(line);
+        }
+    }
+    LUISA_INFO("Shader cache: {} known entries in '{}'.", m_entries.size(), m_index_path.string());
+}
+
+ShaderCache::~ShaderCache() noexcept
+{
+    LUISA_INFO("Shader cache: {} traced kernels in {:.1f} ms, {} capture-free kernels loaded or compiled in {:.1f} ms.",
+               m_traced_count, m_traced_milliseconds, m_loaded_count, m_loaded_milliseconds);
+}
+
+luisa::string ShaderCache::entry_name(luisa::string_view label, uint64_t signature) const noexcept
+{
+    return luisa::format("yutrel_{}_{:016x}", label, luisa::hash64(&signature, sizeof(signature), m_backend_hash));
+}
+
+bool ShaderCache::known(const luisa::string& name) const noexcept
+{
+    std::scoped_lock lock{m_mutex};
+    return m_entries.find(name) != m_entries.end();
+}
+
+void ShaderCache::forget(const luisa::string& name) noexcept
+{
+    std::scoped_lock lock{m_mutex};
+    m_entries.erase(name);
+    std::ofstream file{m_index_path, std::ios::trunc};
+    for (const auto& entry : m_entries)
+    {
+        file << entry << '\n';
+    }
+}
+
+void ShaderCache::report(const luisa::string& name, bool known, bool traced, double milliseconds) noexcept
+{
+    if (traced)
+    {
+        LUISA_INFO("Shader '{}' lowered and passed to the backend in {:.1f} ms ({}).",
+                   name, milliseconds, known ? "known signature, backend cache expected" : "new signature");
+    }
+    else
+    {
+        LUISA_INFO("Shader '{}' {} in {:.1f} ms.", name, known ? "loaded by name" : "compiled and saved", milliseconds);
+    }
+    std::scoped_lock lock{m_mutex};
+    if (traced)
+    {
+        m_traced_milliseconds += milliseconds;
+        m_traced_count++;
+    }
+    else
+    {
+        m_loaded_milliseconds += milliseconds;
+        m_loaded_count++;
+    }
+    if (known)
+    {
+        return;
+    }
+    m_entries.emplace(name);
+    std::error_code error;
+    std::filesystem::create_directories(m_index_path.parent_path(), error);
+    std::ofstream file{m_index_path, std::ios::app};
+    file << name << '\n';
+}
+
+} // namespace Yutrel
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+
+#include <luisa/core/clock.h>
+#include <luisa/core/logging.h>
+#include <luisa/core/stl.h>
+#include <luisa/dsl/func.h>
+#include <luisa/runtime/device.h>
+#include <luisa/runtime/shader.h>
+
+namespace Yutrel
+{
+using namespace luisa;
+using namespace luisa::compute;
+
+// names compiled shaders after a hash of the features they were specialized for and the backend, so that
+// warm starts reuse the backend's cached binaries. Only capture-free kernels skip tracing and code generation
+// entirely, kernels that capture resources are traced on every run and only the backend compile may be saved.
+// The index only records which names were produced before, whether the backend really reused a binary for a
+// traced kernel is not visible from here, so the two routes are logged and timed separately
+class ShaderCache
+{
+private:
+    Device& m_device;
+    uint64_t m_backend_hash;
+    std::filesystem::path m_index_path;
+    luisa::unordered_set<luisa::string> m_entries;
+    // shaders are built from several worker threads during startup
+    mutable std::mutex m_mutex;
+    // milliseconds spent on each route, logged when the cache is destroyed
+    double m_traced_milliseconds{0.0};
+    double m_loaded_milliseconds{0.0};
+    uint m_traced_count{0u};
+    uint m_loaded_count{0u};
+
+public:
+    explicit ShaderCache(Device& device) noexcept;
+    ~ShaderCache() noexcept;
+
+    ShaderCache(const ShaderCache&)            = delete;
+    ShaderCache& operator=(const ShaderCache&) = delete;
+
+public:
+    // the kernel is always traced and lowered to backend source, as the captured resources are bound into it,
+    // for a known signature the backend is expected to find the binary for that source in its own cache
+    template <size_t N, typename... Args>
+    [[nodiscard]] Shader<N, Args...> compile(const Kernel<N, Args...>& kernel, luisa::string_view label, uint64_t signature) noexcept
+    {
+        auto name = entry_name(label, signature);
+        auto hit  = known(name);
+        Clock clock;
+        auto shader = m_device.compile(kernel, ShaderOption{.enable_cache = true, .name = name});
+        report(name, hit, true, clock.toc());
+        return shader;
+    }
+
+    // capture-free kernels are loaded straight from disk on a hit and not even traced, an index entry whose
+    // binary is gone or rejected by the backend is dropped and the kernel compiled again
+    template <size_t N, typename... Args, typename Def>
+    [[nodiscard]] Shader<N, Args...> load_or_compile(luisa::string_view label, uint64_t signature, Def&& def) noexcept
+    {
+        auto name = entry_name(label, signature);
+        auto hit  = known(name);
+        Clock clock;
+        Shader<N, Args...> shader;
+        if (hit)
+        {
+            shader = m_device.load_shader<N, Args...>(name);
+            if (!shader) [[unlikely]]
+            {
+                LUISA_WARNING("Shader cache entry '{}' could not be loaded, compiling it again.", name);
+                forget(name);
+                hit = false;
+            }
+        }
+        if (!hit)
+        {
+            Kernel<N, Args...> kernel = std::forward<Def>(def);
+            static_cast<void>(m_device.compile(kernel, ShaderOption{.compile_only = true, .name = name}));
+            shader = m_device.load_shader<N, Args...>(name);
+        }
+        report(name, hit, false, clock.toc());
+        return shader;
+    }
+
+    [[nodiscard]] static uint64_t hash(luisa::string_view s, uint64_t seed = luisa::hash64_default_seed) noexcept
+    {
+        return luisa::hash64(s.data(), s.size(), seed);
+    }
+
+private:
+    [[nodiscard]] luisa::string entry_name(luisa::string_view label, uint64_t signature) const noexcept;
+    [[nodiscard]] bool known(const luisa::string& name) const noexcept;
+    // removes a stale entry and rewrites the index without it
+    void forget(const luisa::string& name) noexcept;
+    // known is whether the name was in the index, traced whether the kernel went through device.compile
+    void report(const luisa::string& name, bool known, bool traced, double milliseconds) noexcept;
+};
+
+} // namespace Yutrel
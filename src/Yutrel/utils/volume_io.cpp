@@ -0,0 +1,40 @@
+#include "volume_io.h"
+
+#include <fstream>
+
+#include <luisa/core/logging.h>
+
+namespace Yutrel
+{
+DenseVolume load_raw_volume(const std::filesystem::path& path) noexcept
+{
+    std::ifstream file{path, std::ios::binary};
+    if (!file) [[unlikely]]
+    {
+        LUISA_ERROR_WITH_LOCATION("Failed to open volume '{}'.", path.string());
+    }
+    DenseVolume volume;
+    file.read(reinterpret_cast<char*>(&volume.resolution), sizeof(uint) * 3u);
+    auto count = static_cast<size_t>(volume.resolution.x) * volume.resolution.y * volume.resolution.z;
+    volume.values.resize(count);
+    file.read(reinterpret_cast<char*>(volume.values.data()), static_cast<std::streamsize>(count * sizeof(float)));
+    if (!file || count == 0u) [[unlikely]]
+    {
+        LUISA_ERROR_WITH_LOCATION("Invalid volume '{}' of resolution {}x{}x{}.",
+                                  path.string(), volume.resolution.x, volume.resolution.y, volume.resolution.z);
+    }
+    return volume;
+}
+
+void save_raw_volume(const std::filesystem::path& path, const DenseVolume& volume) noexcept
+{
+    std::ofstream file{path, std::ios::binary};
+    file.write(reinterpret_cast<const char*>(&volume.resolution), sizeof(uint) * 3u);
+    file.write(reinterpret_cast<const char*>(volume.values.data()), static_cast<std::streamsize>(volume.values.size() * sizeof(float)));
+    if (!file) [[unlikely]]
+    {
+        LUISA_WARNING_WITH_LOCATION("Failed to write volume '{}'.", path.string());
+    }
+}
+
+} // namespace Yutrel
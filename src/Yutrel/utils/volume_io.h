@@ -0,0 +1,23 @@
+#pragma once
+
+#include <filesystem>
+
+#include <luisa/core/basic_types.h>
+#include <luisa/core/stl.h>
+
+namespace Yutrel
+{
+using namespace luisa;
+
+// a dense grid of scalars, x varies fastest
+struct DenseVolume
+{
+    luisa::vector<float> values;
+    uint3 resolution{make_uint3(0u)};
+};
+
+// the raw volume format: the resolution as three little-endian uint32 followed by the float32 voxels, x fastest
+[[nodiscard]] DenseVolume load_raw_volume(const std::filesystem::path& path) noexcept;
+void save_raw_volume(const std::filesystem::path& path, const DenseVolume& volume) noexcept;
+
+} // namespace Yutrel